@@ -2,6 +2,9 @@
 #include <DirectXMath.h>
 using namespace DirectX;
 
+#include "BoxCollision.h"
+#include "Broadphase.h"
+
 //if the normalWorld == XMVectorZero(), no collision
 struct CollisionInfo{ // the return structure, with these values, you should be able to calculate the impulse
 	bool isValid;                          // whether there is a collision point, true for yes
@@ -82,6 +85,34 @@ inline CollisionInfo checkCollision(const XMMATRIX obj2World_A, const XMMATRIX o
 	return CollisionInfo(); // if the info.normal == XMVectorZero(), no collision
 }
 
+/* Separating axis test over all 15 axes (see Simulation/BoxCollision.h), same params as checkCollision().
+Finds edge-edge contacts too and returns up to 4 points with penetration depths, so it
+only has to be called once per pair. manifold.normalWorld is the direction of the impulse
+to A, like CollisionInfo::normalWorld. Returns false if the boxes don't overlap.
+The matrices have to be rigid (rotation and translation only).
+*/
+inline bool checkCollisionSAT(const XMMATRIX obj2World_A, const XMMATRIX obj2World_B,
+	float xlen_A, float ylen_A, float zlen_A, float xlen_B, float ylen_B, float zlen_B, ContactManifold& manifold) {
+
+	XMFLOAT4X4 matA, matB;
+	XMStoreFloat4x4(&matA, obj2World_A);
+	XMStoreFloat4x4(&matB, obj2World_B);
+	return collideBoxes(Box::fromTransform(matA.m, xlen_A, ylen_A, zlen_A),
+	                    Box::fromTransform(matB.m, xlen_B, ylen_B, zlen_B), manifold);
+}
+
+/* World space bounds of a box, same params as checkCollision(). With many boxes, fill a
+std::vector<Aabb> with these once per frame, pass it to the update() of a SweepAndPrune or
+DynamicAabbTree (see Simulation/Broadphase.h) that lives across frames, and only call
+checkCollisionSAT() (or collideBoxPairsSimd()) for its pairs() instead of for all pairs.
+*/
+inline Aabb boundsOfBox(const XMMATRIX obj2World, float xlen, float ylen, float zlen) {
+
+	XMFLOAT4X4 mat;
+	XMStoreFloat4x4(&mat, obj2World);
+	return boxBounds(Box::fromTransform(mat.m, xlen, ylen, zlen));
+}
+
 /*
 // simple examples, suppose that boxes A and B are at the original point and have no rotation
 // case 1, collide at a corner of Box B:
@@ -0,0 +1,171 @@
+#include "layoutBenchmark.h"
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <DirectXMath.h>
+
+#include "MassSpringSystem.h"
+
+using namespace DirectX;
+
+
+namespace
+{
+	const float kStiffness = 40.f;
+	const float kDamping   = 4.f;
+	const float kMass      = 10.f;
+	const float kTimeStep  = 0.005f;
+	const float kRestLength = 0.1f;
+
+	// Point/spring layout as it was used by main.cpp before MassSpringSystem:
+	// one heap allocation per element, springs referencing points by pointer
+	struct LegacyPoint
+	{
+		bool fixed;
+		XMVECTOR coords;
+		XMVECTOR int_F = XMVectorSet(0.f, 0.f, 0.f, 0.f);
+		XMVECTOR ext_F = XMVectorSet(0.f, 0.f, 0.f, 0.f);
+		XMVECTOR curr_v = XMVectorSet(0.f, 0.f, 0.f, 0.f);
+		XMVECTOR xtmp;
+		XMVECTOR vtmp = XMVectorSet(0.f, 0.f, 0.f, 0.f);
+
+		LegacyPoint(bool fixed, FXMVECTOR coords) : fixed(fixed), coords(coords), xtmp(coords) {}
+	};
+
+	struct LegacySpring
+	{
+		LegacyPoint* point1;
+		LegacyPoint* point2;
+		float org_length;
+		float stiffness;
+		XMVECTOR forces = XMVectorSet(0.f, 0.f, 0.f, 0.f);
+
+		LegacySpring(LegacyPoint* point1, LegacyPoint* point2, float o_length, float stiffness) : point1(point1), point2(point2), org_length(o_length), stiffness(stiffness)
+		{
+		}
+
+		void computeSpringForces()
+		{
+			float curr_length = XMVectorGetX(XMVector3Length(point1->coords - point2->coords));
+			float springForce = (-1 * stiffness) * (curr_length - org_length);
+			forces = XMVectorSubtract(point1->coords, point2->coords);
+			forces = XMVectorScale(forces, 1.f / curr_length);
+			forces = XMVectorScale(forces, springForce);
+
+			point1->int_F += forces;
+			point2->int_F += XMVectorScale(forces, -1.f);
+		}
+
+		void addDamping()
+		{
+			point1->int_F += XMVectorScale(point1->curr_v, -kDamping);
+			point2->int_F += XMVectorScale(point2->curr_v, -kDamping);
+		}
+	};
+
+	// Calls buildPoint(x, y) and buildSpring(a, b) for a cloth-like grid
+	// with structural springs, sized to hold about numSprings springs.
+	// The grid is stretched by 10% so that the springs start out under tension.
+	template <typename PointFn, typename SpringFn>
+	void buildGrid(size_t numSprings, PointFn buildPoint, SpringFn buildSpring)
+	{
+		// a n x n grid has 2 * n * (n - 1) structural springs
+		size_t n = (size_t)std::ceil(0.5 + std::sqrt(0.25 + numSprings / 2.0));
+		for (size_t y = 0; y < n; y++)
+			for (size_t x = 0; x < n; x++)
+				buildPoint(x * 1.1f * kRestLength, y * 1.1f * kRestLength, y == n - 1);
+
+		size_t added = 0;
+		for (size_t y = 0; y < n && added < numSprings; y++)
+		{
+			for (size_t x = 0; x < n && added < numSprings; x++)
+			{
+				size_t i = y * n + x;
+				if (x + 1 < n && added < numSprings) { buildSpring(i, i + 1); added++; }
+				if (y + 1 < n && added < numSprings) { buildSpring(i, i + n); added++; }
+			}
+		}
+	}
+
+	// One explicit Euler step with damping over the pointer based layout
+	void legacyStep(std::vector<LegacyPoint*>& points, std::vector<LegacySpring*>& springs, float h)
+	{
+		for (size_t i = 0; i < points.size(); i++)
+		{
+			points[i]->int_F = XMVectorZero();
+			points[i]->ext_F = XMVectorZero();
+		}
+		for (size_t i = 0; i < springs.size(); i++)
+		{
+			springs[i]->computeSpringForces();
+			springs[i]->addDamping();
+		}
+		for (size_t i = 0; i < points.size(); i++)
+		{
+			LegacyPoint* p = points[i];
+			if (p->fixed) { continue; }
+			XMVECTOR totalForce = XMVectorAdd(p->ext_F, p->int_F);
+			p->coords += XMVectorScale(p->curr_v, h);
+			p->curr_v += XMVectorScale(totalForce, h / kMass);
+		}
+	}
+
+	// Runs step() until at least ~20M springs were processed and returns ms per step
+	template <typename StepFn>
+	double timeSteps(size_t numSprings, StepFn step)
+	{
+		size_t numSteps = 20000000 / numSprings;
+		if (numSteps < 5) { numSteps = 5; }
+
+		step(); // warm up
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for (size_t i = 0; i < numSteps; i++)
+		{
+			step();
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		return std::chrono::duration<double, std::milli>(end - start).count() / numSteps;
+	}
+}
+
+
+void runLayoutBenchmark()
+{
+	const size_t sizes[] = { 1000, 100000, 1000000 };
+
+	std::cout << "Mass-spring layout benchmark (explicit Euler with damping, ms per step)\n";
+	std::cout << std::setw(10) << "springs" << std::setw(16) << "point*/spring*" << std::setw(12) << "SoA" << std::setw(10) << "speedup" << "\n";
+
+	for (size_t size : sizes)
+	{
+		// pointer based layout
+		std::vector<LegacyPoint*> points;
+		std::vector<LegacySpring*> springs;
+		buildGrid(size,
+			[&](float x, float y, bool fixed) { points.push_back(new LegacyPoint(fixed, XMVectorSet(x, y, 0.f, 0.f))); },
+			[&](size_t a, size_t b) { springs.push_back(new LegacySpring(points[a], points[b], kRestLength, kStiffness)); });
+		double legacyMs = timeSteps(springs.size(), [&]() { legacyStep(points, springs, kTimeStep); });
+		for (size_t i = 0; i < points.size(); i++) { delete points[i]; }
+		for (size_t i = 0; i < springs.size(); i++) { delete springs[i]; }
+
+		// structure of arrays layout (MassSpringSystem of the simulation library)
+		MassSpringSystem ms;
+		ms.m_params.integrator = INTEGRATOR_EULER;
+		ms.m_params.damping = kDamping;
+		buildGrid(size,
+			[&](float x, float y, bool fixed) { ms.addPoint(x, y, 0.f, fixed, kMass); },
+			[&](size_t a, size_t b) { ms.addSpring((uint32_t)a, (uint32_t)b, kRestLength, kStiffness); });
+		double soaMs = timeSteps(ms.numSprings(), [&]() { ms.nextStep(kTimeStep); });
+
+		std::cout << std::setw(10) << ms.numSprings()
+		          << std::setw(16) << std::fixed << std::setprecision(4) << legacyMs
+		          << std::setw(12) << soaMs
+		          << std::setw(9) << std::setprecision(2) << legacyMs / soaMs << "x\n";
+	}
+	std::cout << std::endl;
+}
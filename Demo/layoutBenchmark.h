@@ -0,0 +1,11 @@
+#ifndef __layoutBenchmark_h__
+#define __layoutBenchmark_h__
+
+
+// Compare the time per simulation step of the old pointer based point/spring
+// layout against MassSpringSystem for 1k, 100k and 1M springs.
+// Results are printed to the console.
+void runLayoutBenchmark();
+
+
+#endif
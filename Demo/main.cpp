@@ -37,6 +37,15 @@ using std::cout;
 // Internal includes
 #include "util/util.h"
 #include "util/FFmpeg.h"
+#include "layoutBenchmark.h"
+
+// Simulation library includes
+#include "AdaptiveStepper.h"
+#include "MassSpringSystem.h"
+#include "Profiler.h"
+#include "Scenes.h"
+#include "Snapshot.h"
+#include "StepAccumulator.h"
 
 #define TEMPLATE_DEMO
 //#define MASS_SPRING_SYSTEM
@@ -92,275 +101,153 @@ bool  g_bDrawTeapot    = true;
 bool  g_bDrawTriangle  = true;
 bool  g_bDrawSpheres = true;
 // added
-bool	g_bMidpoint = true; // if false: then Euler
+int		g_iIntegrator = INTEGRATOR_MIDPOINT; // see Integrators.h
+int		g_iForceEvaluations = 0; // of the last step, shown in the tweak bar
+int		g_iXpbdIterations = 10;
+bool	g_bXpbdJacobi = false; // parallel Jacobi instead of Gauss-Seidel iterations
+bool	g_bCgMultigrid = false; // implicit Euler: multigrid V-cycle as CG preconditioner (see Multigrid.h)
+float	g_fXpbdResidual = 0.f; // RMS constraint residual of the last iteration, shown in the tweak bar
 bool	g_bDrawSprings = true;
 bool	g_bDrawPoints = true;
 float	g_fDamping = 4.0f;
 bool	g_bGravityOn = false;
+bool	g_bFloorCollision = true; // keep the points above the floor drawn at y = -1
+bool	g_bBoxCollision = false; // collide with the axis box drawn around the origin
+bool	g_bSelfCollision = false; // point-point collision through a spatial hash
+bool	g_bContinuousCollision = false; // sweep the point paths against the box, no tunnelling at large time steps
+float	g_fCollisionRadius = 0.04f;
+int		g_iCollisionContacts = 0; // of the last step, shown in the tweak bar
 
 float	h_timeStep = 0.1f;
+int		g_iMaxSubsteps = 8; // simulation steps per frame at most, the rest of the frame time is dropped
+bool	g_bInterpolate = true; // draw positions interpolated between the last two steps
+bool	g_bAdaptiveStep = false; // midpoint steps sized by their error estimate, up to h_timeStep (see AdaptiveStepper.h)
+float	g_fStepTolerance = 0.001f; // adaptive: position error per step, ten times that for the velocities
+float	g_fStepBudgetMs = 10.f; // adaptive: simulation time per frame, the rest of the frame time is dropped
+int		g_iStepsPerFrame = 0; // adaptive: steps of the last frame, shown in the tweak bar
+float	g_fNextTimeStep = 0.f; // adaptive: size of the next step, shown in the tweak bar
+bool	g_bSleeping = false; // skip clusters of points that came to rest (see SleepClusters.h)
+int		g_iAwakePoints = 0; // of the last step, shown in the tweak bar
+int		g_iSleepingPoints = 0;
 float	point_mass = 10.0f;
+int		g_iSceneSize = 16; // size of the generated scenes (Cloth, Ropes, Softbody), see Scenes.h
+int		g_iBuiltSceneSize = 0; // g_iSceneSize of the scene in g_massSpring
 float	GravityConst = -9.81;
 float		gravMulti = 0.2;
 
 
 // added functions (Peter)
-float getDistance(XMVECTOR* p, XMVECTOR* q);
 void nextStep(float timeStep);
+void nextStepsAdaptive(float frameTime);
 void massSpringInitialization();
 void SpringHouseInitialization();
+void GeneratedSceneInitialization();
+void resetSimulation();
 
 #endif
 //#ifdef MASS_SPRING_SYSTEM
 //#endif
 
-// Using structs instead of separate classes for mass point and springs (Peter)
-struct point
-{
-	bool fixed; 
-	XMVECTOR coords;
-	XMVECTOR int_F = XMVectorSet(0.f, 0.f, 0.f, 0.f);
-	XMVECTOR ext_F = XMVectorSet(0.f, 0.f, 0.f, 0.f);
-	XMVECTOR curr_v = XMVectorSet(0.f, 0.f, 0.f, 0.f);	// current velocity
-	// for midpoint xtmp and vtmp
-	XMVECTOR xtmp;
-	XMVECTOR vtmp = XMVectorSet(0.f, 0.f, 0.f, 0.f);
-
-	// constructor
-	point(bool fixed, XMVECTOR &coords) : coords(coords), fixed(fixed)
-	{
-		xtmp = coords;
-	}
-
-	// adding vec onto internal Force
-	void addIntF(XMVECTOR vec)
-	{
-		int_F += vec;
-	}
-
-	void addExtF(XMVECTOR vec) 
-	{
-		ext_F += vec;
-	}
-
-	void addGravity()
-	{
-		if (g_bGravityOn)
-		{
-			this->addExtF(XMVectorSet(0.f, point_mass * GravityConst * gravMulti, 0.f, 0.f));
-		}
-	}
-
-	void clearForces()
-	{
-		int_F = XMVectorSet(0.f, 0.f, 0.f, 0.f);
-		ext_F = XMVectorSet(0.f, 0.f, 0.f, 0.f);
-	}
-};
-
-float getDistance(XMVECTOR* p, XMVECTOR* q) 
+// mass points and springs, stored as structure of arrays
+MassSpringSystem g_massSpring;
+
+// fixed time step driver and the positions before the last step (for render interpolation)
+StepAccumulator   g_stepAccumulator;
+AdaptiveStepper   g_adaptiveStepper;
+std::vector<Vec3> g_prevPositions;
+std::vector<Vec3> g_renderPositions;
+
+#ifdef SIMULATION_PROFILE
+// per frame averages of the profiling zones and counters, shown in the tweak bar
+float g_fProfileFrameMs = 0.f;
+float g_fProfileFrameMoveMs = 0.f;
+float g_fProfileSimulationMs = 0.f;
+float g_fProfileRenderMs = 0.f;
+float g_fProfileTwDrawMs = 0.f;
+float g_fProfileVideoMs = 0.f;
+int   g_iProfileSprings = 0;
+int   g_iProfileContacts = 0;
+int   g_iProfileDrawCalls = 0;
+
+void updateProfileSummary()
 {
-	XMVECTOR diff = *p - *q;
-	diff = XMVector3Length(diff); // see doc: solution written in each component
-	return XMVectorGetByIndex(diff, 0);
+	ProfileSummary summary;
+	Profiler::summary(summary, 30);
+	g_fProfileFrameMs      = (float)summary.frameMilliseconds;
+	g_fProfileFrameMoveMs  = (float)summary.zoneMilliseconds("OnFrameMove");
+	g_fProfileSimulationMs = (float)summary.zoneMilliseconds("Simulation");
+	g_fProfileRenderMs     = (float)summary.zoneMilliseconds("OnD3D11FrameRender");
+	g_fProfileTwDrawMs     = (float)summary.zoneMilliseconds("TwDraw");
+	g_fProfileVideoMs      = (float)summary.zoneMilliseconds("FFmpeg AddFrame");
+	g_iProfileSprings      = (int)summary.counterPerFrame("Springs evaluated");
+	g_iProfileContacts     = (int)(summary.counterPerFrame("Point contacts") + summary.counterPerFrame("Box contacts"));
+	g_iProfileDrawCalls    = (int)summary.counterPerFrame("Draw calls");
 }
+#endif
 
-// struct for spring
-struct spring
+// Copy the tweak bar settings into the simulation parameters
+void applySimulationSettings()
 {
-	point* point1;
-	point* point2;
-	float org_length;
-	float stiffness;
-	XMVECTOR forces = XMVectorSet(0.f, 0.f, 0.f, 0.f);
-
-	// constructors
-
-	// here spring is idle, since spring original length equals the distance
-	spring(point* point1, point* point2, float stiffness) : point1(point1), point2(point2), stiffness(stiffness)
-	{
-		org_length = getDistance(&point1->coords, &point2->coords);
-	}
-
-	spring(point* point1, point* point2, float o_length, float stiffness) : point1(point1), point2(point2), org_length(o_length), stiffness(stiffness)
+	MassSpringParams& params = g_massSpring.m_params;
+	params.integrator = (Integrator)g_iIntegrator;
+	params.xpbdIterations = g_iXpbdIterations;
+	params.xpbdJacobi = g_bXpbdJacobi;
+	params.cgMultigrid = g_bCgMultigrid;
+	params.damping    = (g_iTestCase != 4) ? g_fDamping : 0.f;	// Don't apply damping for basic calculation in Demo1
+	params.gravity    = Vec3(0.f, (g_bGravityOn && g_iTestCase >= 7) ? GravityConst * gravMulti : 0.f, 0.f);
+
+	// collision only for Demo4 and the generated scenes, Demo1 - Demo3 compare against the reference values
+	params.selfCollision = g_bSelfCollision && g_iTestCase >= 7;
+	params.collisionRadius = g_fCollisionRadius;
+	params.continuousCollision = g_bContinuousCollision;
+	params.sleeping = g_bSleeping && g_iTestCase >= 7;
+	g_massSpring.m_colliderPlanes.clear();
+	g_massSpring.m_colliderBoxes.clear();
+	if (g_bFloorCollision && g_iTestCase >= 7)
 	{
+		g_massSpring.m_colliderPlanes.push_back(Plane(Vec3(0.f, 1.f, 0.f), -1.f));
 	}
-
-	void computeSpringForces()
-	{
-		float curr_length = getDistance(&point1->coords, &point2->coords);
-		float springForce = (-1 * stiffness) * (curr_length - org_length);
-		forces = XMVectorSubtract(point1->coords, point2->coords);
-		forces = XMVectorScale(forces, 1.f / curr_length);
-		forces = XMVectorScale(forces, springForce);
-
-		point1->addIntF(forces);
-		point2->addIntF(XMVectorScale(forces, -1.f));
-	}
-
-	// same only with xtmp 
-	void computeSpringForcesTMP()
+	if (g_bBoxCollision && g_iTestCase >= 7)
 	{
-		float curr_length = getDistance(&point1->xtmp, &point2->xtmp);
-		float springForce = (-1 * stiffness) * (curr_length - org_length);
-		forces = XMVectorSubtract(point1->xtmp, point2->xtmp);
-		forces = XMVectorScale(forces, 1.f / curr_length);
-		forces = XMVectorScale(forces, springForce);
-
-		point1->addIntF(forces);
-		point2->addIntF(XMVectorScale(forces, -1.f));
+		Box axisBox;
+		axisBox.halfExtents = Vec3(0.5f, 0.5f, 0.5f);
+		g_massSpring.m_colliderBoxes.push_back(axisBox);
 	}
-
-	void addDamping()
-	{
-		XMVECTOR dampPoint1 = XMVectorScale(point1->curr_v, -g_fDamping);
-		XMVECTOR dampPoint2 = XMVectorScale(point2->curr_v, -g_fDamping);
-
-		point1->addIntF(dampPoint1);
-		point2->addIntF(dampPoint2);
-	}
-
-	// same with vtmp
-	void addDampingTMP()
-	{
-		XMVECTOR dampPoint1 = XMVectorScale(point1->vtmp, -g_fDamping);
-		XMVECTOR dampPoint2 = XMVectorScale(point2->vtmp, -g_fDamping);
-
-		point1->addIntF(dampPoint1);
-		point2->addIntF(dampPoint2);
-	}
-
-};
-
-// lists with points and springs
-std::vector<point*> points;
-std::vector<spring*> springs;
-
-spring* addSpring(point* a, point* b, float stiffness) 
-{
-	spring* s = new spring(a, b, stiffness);
-	springs.push_back(s);
-
-	return s;
 }
 
-spring* addSpring(point* a, point* b, float org_length, float stiffness)
+// Copy the statistics of the last step into the tweak bar variables
+void readSimulationStats()
 {
-	spring* s = new spring(a, b, org_length, stiffness);
-	springs.push_back(s);
-
-	return s;
+	g_iForceEvaluations = g_massSpring.lastForceEvaluations();
+	const std::vector<float>& residuals = g_massSpring.xpbdSolver().residuals();
+	g_fXpbdResidual = residuals.empty() ? 0.f : residuals.back();
+	const ParticleCollisionStats& collisions = g_massSpring.collisionStats();
+	g_iCollisionContacts = (int)(collisions.numParticleContacts + collisions.numShapeContacts);
+	const SleepStats& sleep = g_massSpring.sleepStats();
+	g_iAwakePoints = (int)sleep.numAwakePoints;
+	g_iSleepingPoints = (int)sleep.numSleepingPoints;
 }
 
-point* addPoint(float x, float y, float z, bool fixed) 
+// Copy the tweak bar settings into the simulation parameters and advance by one step
+void nextStep(float timestep)
 {
-	point* p = new point(fixed, XMVectorSet(x, y, z, 0.f));
-	points.push_back(p);
-
-	return p;
+	applySimulationSettings();
+	g_massSpring.nextStep(timestep);
+	readSimulationStats();
 }
 
-void nextStep(float timestep)
+// Advance by the frame time in adaptive steps of at most h_timeStep
+void nextStepsAdaptive(float frameTime)
 {
-	for each (auto point in points)
-	{
-		point->clearForces();
-	}
-
-	if (g_bMidpoint) 
-	{
-		// (steps on slide 71 of mass-spring slides)
-		float half_timestep = timestep / 2.f;
-
-		for each (auto point in points) 
-		{
-			if (point->fixed){ continue; }
-
-			point->xtmp = XMVectorAdd(point->coords, XMVectorScale(point->curr_v, half_timestep));	// Step 2
-
-		}
-
-		for each (auto spring in springs) 
-		{
-			// Step 3
-			spring->computeSpringForces();
-
-			if (g_iTestCase != 4)	// Don't apply damping for basic calculation in Demo1
-			{
-				spring->addDamping();
-			}
-		}
-
-		for each (auto point in points)
-		{
-			if (point->fixed){ continue; }
-
-			// Step 4
-			if (g_iTestCase == 7) { point->addGravity(); }
-			XMVECTOR totalForce = XMVectorAdd(point->ext_F, point->int_F);
-			point->vtmp = point->curr_v + half_timestep * (totalForce / point_mass);
-
-			point->coords += timestep * point->vtmp;	// Step 5
-		}
-
-		for each (auto spring in springs)
-		{
-			// Step 6
-			spring->computeSpringForcesTMP();
-
-			if (g_iTestCase != 4)	// Don't apply damping for basic calculation in Demo1
-			{
-				spring->addDampingTMP();
-			}
-		}
-
-		for each(auto point in points) 
-		{
-			if (point->fixed) { continue; }
-			
-			// Step 7
-
-			if (g_iTestCase == 7) { point->addGravity(); }
-			XMVECTOR totalForce = XMVectorAdd(point->ext_F, point->int_F);
-			point->curr_v += half_timestep * (totalForce / point_mass);
-		}
-		
-	}
-	else 
-	{
-		// doing Euler here
-		for each (auto spring in springs)
-		{
-			spring->computeSpringForces();
-
-			if (g_iTestCase != 4)	// Don't apply damping for basic calculation in Demo1
-			{
-				spring->addDamping();	
-			}
-		}
-		for each (auto point in points) 
-		{
-			if (point->fixed){ continue; }
-
-			if (g_iTestCase == 7) { point->addGravity(); }
-			XMVECTOR totalForce = XMVectorAdd(point->ext_F, point->int_F);
-
-			point->coords += XMVectorScale(point->curr_v, timestep);
-			point->curr_v += XMVectorScale(totalForce, timestep / point_mass);
-		}
-
-	}
-
-	// Position correction if z < 0
-	for each(auto point in points) 
-	{
-		if (point->fixed){ continue; }
-
-		if (XMVectorGetByIndex(point->coords, 1) < 0) 
-		{
-			XMVectorSetByIndex(point->coords, 0, 1);
-		}
-	}
+	applySimulationSettings();
+	g_adaptiveStepper.m_maxTimeStep = h_timeStep;
+	g_adaptiveStepper.m_positionTolerance = g_fStepTolerance;
+	g_adaptiveStepper.m_velocityTolerance = 10.f * g_fStepTolerance;
+	g_adaptiveStepper.m_frameBudget = 1e-3 * g_fStepBudgetMs;
+	g_adaptiveStepper.advance(g_massSpring, frameTime);
+	readSimulationStats();
+	g_iStepsPerFrame = g_adaptiveStepper.lastAdvance().steps;
+	g_fNextTimeStep = g_adaptiveStepper.timeStep();
 }
 
 // Video recorder
@@ -372,13 +259,31 @@ void InitTweakBar(ID3D11Device* pd3dDevice)
     g_pTweakBar = TwNewBar("TweakBar");
 	TwDefine(" TweakBar color='0 128 128' alpha=128 ");
 
-	TwType TW_TYPE_TESTCASE = TwDefineEnumFromString("Test Scene", "BasicTest,Setup1,Setup2,Setup3,Demo1,Demo2,Demo3,Demo4");
+	TwType TW_TYPE_TESTCASE = TwDefineEnumFromString("Test Scene", "BasicTest,Setup1,Setup2,Setup3,Demo1,Demo2,Demo3,Demo4,Cloth,Ropes,Softbody");
 	TwAddVarRW(g_pTweakBar, "Test Scene", TW_TYPE_TESTCASE, &g_iTestCase, "");
+	// same order as the Integrator enum in Integrators.h
+	TwType TW_TYPE_INTEGRATOR = TwDefineEnumFromString("Integrator", "Euler,Midpoint,Velocity Verlet,Leapfrog,RK4,Implicit Euler,XPBD");
 	// HINT: For buttons you can directly pass the callback function as a lambda expression.
 	TwAddButton(g_pTweakBar, "Reset Scene", [](void *){g_iPreTestCase = -1; }, nullptr, "");
 	TwAddButton(g_pTweakBar, "Reset Camera", [](void *){g_camera.Reset(); }, nullptr, "");
 	// Run mode, step by step, control by space key
 	TwAddVarRW(g_pTweakBar, "RunStep(space)", TW_TYPE_BOOLCPP, &g_bSimulateByStep, "");
+#ifdef SIMULATION_PROFILE
+	TwAddVarRO(g_pTweakBar, "Frame ms", TW_TYPE_FLOAT, &g_fProfileFrameMs, "group=Profile");
+	TwAddVarRO(g_pTweakBar, "OnFrameMove ms", TW_TYPE_FLOAT, &g_fProfileFrameMoveMs, "group=Profile");
+	TwAddVarRO(g_pTweakBar, "Simulation ms", TW_TYPE_FLOAT, &g_fProfileSimulationMs, "group=Profile");
+	TwAddVarRO(g_pTweakBar, "Render ms", TW_TYPE_FLOAT, &g_fProfileRenderMs, "group=Profile");
+	TwAddVarRO(g_pTweakBar, "TwDraw ms", TW_TYPE_FLOAT, &g_fProfileTwDrawMs, "group=Profile");
+	TwAddVarRO(g_pTweakBar, "Video ms", TW_TYPE_FLOAT, &g_fProfileVideoMs, "group=Profile");
+	TwAddVarRO(g_pTweakBar, "Springs/frame", TW_TYPE_INT32, &g_iProfileSprings, "group=Profile");
+	TwAddVarRO(g_pTweakBar, "Contacts/frame", TW_TYPE_INT32, &g_iProfileContacts, "group=Profile");
+	TwAddVarRO(g_pTweakBar, "Draw calls/frame", TW_TYPE_INT32, &g_iProfileDrawCalls, "group=Profile");
+	TwAddButton(g_pTweakBar, "Write Trace", [](void*)
+	{
+		if (Profiler::writeChromeTrace("trace.json")) { cout << "Wrote trace.json (open in chrome://tracing)\n"; }
+		else                                          { cout << "Cannot write trace.json\n"; }
+	}, nullptr, "group=Profile");
+#endif
 	
 #ifdef TEMPLATE_DEMO
 	switch (g_iTestCase)
@@ -396,6 +301,14 @@ void InitTweakBar(ID3D11Device* pd3dDevice)
 		break;
 	case 5:
 	case 6:
+		TwAddVarRW(g_pTweakBar, "Max Substeps", TW_TYPE_INT32, &g_iMaxSubsteps, "min=1");
+		TwAddVarRW(g_pTweakBar, "Interpolate", TW_TYPE_BOOLCPP, &g_bInterpolate, "");
+		TwAddVarRW(g_pTweakBar, "Time Step", TW_TYPE_FLOAT, &h_timeStep, "min=0.0001 step=0.001 group=Stepping");
+		TwAddVarRW(g_pTweakBar, "Adaptive Step", TW_TYPE_BOOLCPP, &g_bAdaptiveStep, "group=Stepping");
+		TwAddVarRW(g_pTweakBar, "Step Tolerance", TW_TYPE_FLOAT, &g_fStepTolerance, "min=0.00001 step=0.0005 group=Stepping");
+		TwAddVarRW(g_pTweakBar, "Step Budget ms", TW_TYPE_FLOAT, &g_fStepBudgetMs, "min=1 step=1 group=Stepping");
+		TwAddVarRO(g_pTweakBar, "Steps/frame", TW_TYPE_INT32, &g_iStepsPerFrame, "group=Stepping");
+		TwAddVarRO(g_pTweakBar, "Next Step", TW_TYPE_FLOAT, &g_fNextTimeStep, "group=Stepping");
 		TwAddVarRW(g_pTweakBar, "Draw Points", TW_TYPE_BOOLCPP, &g_bDrawPoints, "");
 		TwAddVarRW(g_pTweakBar, "Draw Springs", TW_TYPE_BOOLCPP, &g_bDrawSprings, "");
 		TwAddVarRW(g_pTweakBar, "Damping", TW_TYPE_FLOAT, &g_fDamping, "min=0.00 step=0.2");
@@ -405,28 +318,80 @@ void InitTweakBar(ID3D11Device* pd3dDevice)
 		}, nullptr, "");
 		break;
 	case 7:
-		TwAddVarRW(g_pTweakBar, "Midpoint", TW_TYPE_BOOLCPP, &g_bMidpoint, "");
+	case 8:
+	case 9:
+	case 10:
+		TwAddVarRW(g_pTweakBar, "Integrator", TW_TYPE_INTEGRATOR, &g_iIntegrator, "");
+		TwAddVarRO(g_pTweakBar, "Force evals/step", TW_TYPE_INT32, &g_iForceEvaluations, "");
+		TwAddVarRW(g_pTweakBar, "XPBD Iterations", TW_TYPE_INT32, &g_iXpbdIterations, "min=1");
+		TwAddVarRW(g_pTweakBar, "XPBD Jacobi", TW_TYPE_BOOLCPP, &g_bXpbdJacobi, "");
+		TwAddVarRW(g_pTweakBar, "CG Multigrid", TW_TYPE_BOOLCPP, &g_bCgMultigrid, "");
+		TwAddVarRO(g_pTweakBar, "XPBD Residual", TW_TYPE_FLOAT, &g_fXpbdResidual, "");
+		TwAddVarRW(g_pTweakBar, "Max Substeps", TW_TYPE_INT32, &g_iMaxSubsteps, "min=1");
+		TwAddVarRW(g_pTweakBar, "Interpolate", TW_TYPE_BOOLCPP, &g_bInterpolate, "");
+		TwAddVarRW(g_pTweakBar, "Time Step", TW_TYPE_FLOAT, &h_timeStep, "min=0.0001 step=0.001 group=Stepping");
+		TwAddVarRW(g_pTweakBar, "Adaptive Step", TW_TYPE_BOOLCPP, &g_bAdaptiveStep, "group=Stepping");
+		TwAddVarRW(g_pTweakBar, "Step Tolerance", TW_TYPE_FLOAT, &g_fStepTolerance, "min=0.00001 step=0.0005 group=Stepping");
+		TwAddVarRW(g_pTweakBar, "Step Budget ms", TW_TYPE_FLOAT, &g_fStepBudgetMs, "min=1 step=1 group=Stepping");
+		TwAddVarRO(g_pTweakBar, "Steps/frame", TW_TYPE_INT32, &g_iStepsPerFrame, "group=Stepping");
+		TwAddVarRO(g_pTweakBar, "Next Step", TW_TYPE_FLOAT, &g_fNextTimeStep, "group=Stepping");
 		TwAddVarRW(g_pTweakBar, "Draw Points", TW_TYPE_BOOLCPP, &g_bDrawPoints, "");
 		TwAddVarRW(g_pTweakBar, "Draw Springs", TW_TYPE_BOOLCPP, &g_bDrawSprings, "");
 		TwAddVarRW(g_pTweakBar, "Damping", TW_TYPE_FLOAT, &g_fDamping, "min=0.00 step=0.2");
 		TwAddVarRW(g_pTweakBar, "Gravity", TW_TYPE_BOOLCPP, &g_bGravityOn, "");
+		TwAddVarRW(g_pTweakBar, "Floor Collision", TW_TYPE_BOOLCPP, &g_bFloorCollision, "");
+		TwAddVarRW(g_pTweakBar, "Box Collision", TW_TYPE_BOOLCPP, &g_bBoxCollision, "");
+		TwAddVarRW(g_pTweakBar, "Self Collision", TW_TYPE_BOOLCPP, &g_bSelfCollision, "");
+		TwAddVarRW(g_pTweakBar, "Continuous Collision", TW_TYPE_BOOLCPP, &g_bContinuousCollision, "");
+		TwAddVarRW(g_pTweakBar, "Collision Radius", TW_TYPE_FLOAT, &g_fCollisionRadius, "min=0.005 step=0.005");
+		TwAddVarRO(g_pTweakBar, "Contacts", TW_TYPE_INT32, &g_iCollisionContacts, "");
+		TwAddVarRW(g_pTweakBar, "Sleeping", TW_TYPE_BOOLCPP, &g_bSleeping, "");
+		TwAddVarRO(g_pTweakBar, "Awake points", TW_TYPE_INT32, &g_iAwakePoints, "");
+		TwAddVarRO(g_pTweakBar, "Asleep points", TW_TYPE_INT32, &g_iSleepingPoints, "");
+		if (g_iTestCase >= 8)
+		{
+			TwAddVarRW(g_pTweakBar, "Scene Size", TW_TYPE_INT32, &g_iSceneSize, "min=2");
+		}
 		TwAddButton(g_pTweakBar, "Stiffness +10", [](void*)
 		{
-			for each(auto spring in springs) {
-				spring->stiffness += 10.f;
+			for (size_t i = 0; i < g_massSpring.m_springs.size(); i++) {
+				g_massSpring.m_springs[i].stiffness += 10.f;
 			}
-			cout << "New stiffness at " << springs[0]->stiffness << "\n";
+			g_massSpring.wakeAll();
+			cout << "New stiffness at " << g_massSpring.m_springs[0].stiffness << "\n";
 		}, nullptr, "");
 		TwAddButton(g_pTweakBar, "Stiffness -10", [](void*)
 		{
-			for each(auto spring in springs) {
-				spring->stiffness -= 10.f;
+			for (size_t i = 0; i < g_massSpring.m_springs.size(); i++) {
+				g_massSpring.m_springs[i].stiffness -= 10.f;
 			}
-			cout << "New stiffness at " << springs[0]->stiffness << "\n";
+			g_massSpring.wakeAll();
+			cout << "New stiffness at " << g_massSpring.m_springs[0].stiffness << "\n";
 		}, nullptr, "");
 		TwAddButton(g_pTweakBar, "Reset Simulation", [](void*)
 		{
-			SpringHouseInitialization();
+			resetSimulation();
+		}, nullptr, "");
+		TwAddButton(g_pTweakBar, "Save Snapshot", [](void*)
+		{
+			if (!writeSnapshot("snapshot.bin", &g_massSpring, nullptr)) { cout << "Cannot write snapshot.bin\n"; }
+		}, nullptr, "");
+		TwAddButton(g_pTweakBar, "Load Snapshot", [](void*)
+		{
+			SnapshotFile snapshot;
+			if (!snapshot.open("snapshot.bin") || !snapshot.restore(g_massSpring))
+			{
+				cout << "Cannot load snapshot.bin: " << snapshot.error() << "\n";
+				return;
+			}
+			g_massSpring.wakeAll();
+			g_stepAccumulator.reset();
+			g_adaptiveStepper.reset();
+			g_prevPositions.clear();
+		}, nullptr, "");
+		TwAddButton(g_pTweakBar, "Layout Benchmark", [](void*)
+		{
+			runLayoutBenchmark();
 		}, nullptr, "");
 		break;
 	default:
@@ -442,6 +407,7 @@ void InitTweakBar(ID3D11Device* pd3dDevice)
 // (Drawn as line primitives using a DirectXTK primitive batch)
 void DrawBoundingBox(ID3D11DeviceContext* pd3dImmediateContext)
 {
+	PROFILE_COUNT("Draw calls", 1);
     // Setup position/color effect
     g_pEffectPositionColor->SetWorld(g_camera.GetWorldMatrix());
     
@@ -486,6 +452,7 @@ void DrawBoundingBox(ID3D11DeviceContext* pd3dImmediateContext)
 // (Drawn as multiple quads, i.e. triangle strips, using a DirectXTK primitive batch)
 void DrawFloor(ID3D11DeviceContext* pd3dImmediateContext)
 {
+	PROFILE_COUNT("Draw calls", 1);
     // Setup position/normal/color effect
     g_pEffectPositionNormalColor->SetWorld(XMMatrixIdentity());
     g_pEffectPositionNormalColor->SetEmissiveColor(Colors::Black);
@@ -599,6 +566,19 @@ void DrawTriangle(ID3D11DeviceContext* pd3dImmediateContext)
 
 //#ifdef MASS_SPRING_SYSTEM
 
+// Positions to draw: between the last two simulation steps, by the fraction
+// of a step that has passed since the last one (adaptive steps end at the
+// frame time, so there is nothing to interpolate)
+const std::vector<Vec3>& renderPositions()
+{
+	if (!g_bInterpolate || g_bAdaptiveStep)
+	{
+		return g_massSpring.m_positions;
+	}
+	interpolatePositions(g_prevPositions, g_massSpring.m_positions, g_stepAccumulator.alpha(), g_renderPositions);
+	return g_renderPositions;
+}
+
 void drawPoints(ID3D11DeviceContext* pd3dImmediateContext) 
 {
 	g_pEffectPositionNormal->SetEmissiveColor(Colors::Black);
@@ -609,11 +589,13 @@ void drawPoints(ID3D11DeviceContext* pd3dImmediateContext)
 	std::uniform_real_distribution<float> randCol(0.0f, 1.0f);
 	std::uniform_real_distribution<float> randPos(-0.5f, 0.5f);
 
-	for (int i = 0; i < points.size(); i++) 
+	const std::vector<Vec3>& positions = renderPositions();
+	PROFILE_COUNT("Draw calls", positions.size());
+	for (size_t i = 0; i < positions.size(); i++) 
 	{
 		g_pEffectPositionNormal->SetDiffuseColor(0.6f * XMColorHSVToRGB(XMVectorSet(0, 0, 1, 0)));
 		XMMATRIX scale = XMMatrixScaling(0.11f, 0.11f, 0.11f);
-		XMMATRIX trans = XMMatrixTranslation(XMVectorGetByIndex(points[i]->coords, 0), XMVectorGetByIndex(points[i]->coords, 1), XMVectorGetByIndex(points[i]->coords, 2));
+		XMMATRIX trans = XMMatrixTranslation(positions[i].x, positions[i].y, positions[i].z);
 		g_pEffectPositionNormal->SetWorld(scale * trans * g_camera.GetWorldMatrix());
 
 		// draw
@@ -629,13 +611,18 @@ void drawSprings(ID3D11DeviceContext* pd3dImmediateContext)
 	g_pEffectPositionColor->Apply(pd3dImmediateContext);
 	pd3dImmediateContext->IASetInputLayout(g_pInputLayoutPositionColor);
 
-	// draw (similar as for the bounding box)
+	// draw (similar as for the bounding box); the batch draws in chunks of its vertex buffer
+	PROFILE_COUNT("Draw calls", 1);
 	g_pPrimitiveBatchPositionColor->Begin();
-	for (int i = 0; i < springs.size(); i++) 
+	const std::vector<Vec3>& positions = renderPositions();
+	const std::vector<Spring>& springs = g_massSpring.m_springs;
+	for (size_t i = 0; i < springs.size(); i++) 
 	{
+		const Vec3& p1 = positions[springs[i].point1];
+		const Vec3& p2 = positions[springs[i].point2];
 		g_pPrimitiveBatchPositionColor->DrawLine(
-			VertexPositionColor(springs[i]->point1->coords, Colors::Green),
-			VertexPositionColor(springs[i]->point2->coords, Colors::Green)
+			VertexPositionColor(XMVectorSet(p1.x, p1.y, p1.z, 0.f), Colors::Green),
+			VertexPositionColor(XMVectorSet(p2.x, p2.y, p2.z, 0.f), Colors::Green)
 			);
 	}
 	g_pPrimitiveBatchPositionColor->End();
@@ -643,73 +630,58 @@ void drawSprings(ID3D11DeviceContext* pd3dImmediateContext)
 
 void massSpringInitialization() 
 {
-	// delete old points/springs
-	for each(auto point in points) { delete point;	}
-	for each(auto spring in springs) { delete spring; }
-	points.clear();
-	springs.clear();
-
-	point* p0 = addPoint(0.f, 0.f, 0.f, false);
-	point* p1 = addPoint(0.f, 2.f, 0.f, false);
-
-	p0->curr_v = XMVectorSet(-1.f, 0.f, 0.f, 0.f);
-	p1->curr_v = XMVectorSet(1.f, 0.f, 0.f, 0.f);
-
-
-	spring* s0 = addSpring(p0, p1, 1, 40);
-
 	point_mass = 10.f;
-
+	buildTwoPointScene(g_massSpring, point_mass);
+	g_stepAccumulator.reset();
+	g_adaptiveStepper.reset();
+	g_prevPositions.clear();
 }
 
 void SpringHouseInitialization()
 {
-	// delete old points/springs
-	for each(auto point in points) { delete point; }
-	for each(auto spring in springs) { delete spring; }
-	points.clear();
-	springs.clear();
-
-	point* p0 = addPoint(0.f, 0.f, 0.f, false);
-	point* p1 = addPoint(0.f, 0.f, 2.f, false);
-	point* p2 = addPoint(2.f, 0.f, 2.f, false);
-	point* p3 = addPoint(2.f, 0.f, 0.f, false);
-
-	point* p4 = addPoint(0.f, 2.f, 0.f, false);
-	point* p5 = addPoint(0.f, 2.f, 2.f, false);
-	point* p6 = addPoint(2.f, 2.f, 2.f, false);
-	point* p7 = addPoint(2.f, 2.f, 0.f, false);
-
-	point* p8 = addPoint(0.f, 3.f, 1.f, true);
-	point* p9 = addPoint(2.f, 3.f, 1.f, false);
-
-	// some velocities
-	p1->curr_v = XMVectorSet(0.3f, 0.2f, 0.1f, 0.0f);
-	p6->curr_v = XMVectorSet(3.f, 0.f, 0.f, 0.f);
-
-	spring* s0 = addSpring(p0, p1, 40.f);
-	spring* s1 = addSpring(p1, p2, 40.f);
-	spring* s2 = addSpring(p2, p3, 40.f);
-	spring* s3 = addSpring(p3, p0, 40.f);
-
-	spring* s4 = addSpring(p1, p5, 2.f, 40.f);
-	spring* s5 = addSpring(p2, p6, 1.5f, 40.f);
-	spring* s6 = addSpring(p3, p7, 2.2f, 40.f);
-	spring* s7 = addSpring(p0, p4, 1.5f, 40.f);
-
-	spring* s8 = addSpring(p4, p5, 40.f);
-	spring* s9 = addSpring(p5, p6, 40.f);
-	spring* s10 = addSpring(p6, p7, 40.f);
-	spring* s11 = addSpring(p7, p4, 40.f);
-
-	spring* s12 = addSpring(p4, p8, 40.f);
-	spring* s13 = addSpring(p5, p8, 40.f);
-	spring* s14 = addSpring(p6, p9, 40.f);
-	spring* s15 = addSpring(p7, p9, 40.f);
-	
-	spring* s16 = addSpring(p8, p9, 40.f);
-
 	point_mass = 10.f;
+	buildSpringHouseScene(g_massSpring, point_mass);
+	g_massSpring.markScene();
+	g_stepAccumulator.reset();
+	g_adaptiveStepper.reset();
+	g_prevPositions.clear();
+}
+
+// Cloth, Ropes or Softbody (test case 8 - 10) of size g_iSceneSize
+void GeneratedSceneInitialization()
+{
+	const float spacing = 0.2f;
+	const float stiffness = 200.f;
+	const float mass = 0.1f;
+	switch (g_iTestCase)
+	{
+	case 8:  buildClothScene(g_massSpring, g_iSceneSize, g_iSceneSize, spacing, stiffness, mass); break;
+	case 9:  buildRopeScene(g_massSpring, g_iSceneSize / 2, g_iSceneSize, spacing / 2, stiffness, mass); break;
+	case 10: buildSoftBodyScene(g_massSpring, g_iSceneSize / 2, g_iSceneSize / 2, g_iSceneSize / 2, spacing, stiffness, mass); break;
+	default: break;
+	}
+	g_massSpring.markScene();
+	g_iBuiltSceneSize = g_iSceneSize;
+	g_stepAccumulator.reset();
+	g_adaptiveStepper.reset();
+	g_prevPositions.clear();
+}
+
+// Reset Demo4 or a generated scene (test case 7 - 10) by rewinding it to the
+// state it was built with, without rebuilding it (see MassSpringSystem::markScene).
+// Builds it again if the scene size was changed since.
+void resetSimulation()
+{
+	const bool sizeChanged = g_iTestCase >= 8 && g_iSceneSize != g_iBuiltSceneSize;
+	if (sizeChanged || !g_massSpring.rewindScene())
+	{
+		if (g_iTestCase == 7) { SpringHouseInitialization(); }
+		else                  { GeneratedSceneInitialization(); }
+		return;
+	}
+	g_stepAccumulator.reset();
+	g_adaptiveStepper.reset();
+	g_prevPositions.clear();
 }
 
 //void DrawMassSpringSystem(ID3D11DeviceContext* pd3dImmediateContext)
@@ -858,14 +830,7 @@ void CALLBACK OnD3D11DestroyDevice( void* pUserContext )
     SAFE_RELEASE(g_pInputLayoutPositionNormalColor);
     SAFE_DELETE (g_pEffectPositionNormalColor);
 
-	for each (auto point in points)
-	{
-		delete point;
-	}
-	for each (auto spring in springs)
-	{
-		delete spring;
-	}
+	g_massSpring.clear();
 }
 
 //--------------------------------------------------------------------------------------
@@ -1003,10 +968,14 @@ LRESULT CALLBACK MsgProc( HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam,
 //--------------------------------------------------------------------------------------
 void CALLBACK OnFrameMove(double dTime, float fElapsedTime, void* pUserContext)
 {
+	// DXUT calls OnFrameMove and then OnD3D11FrameRender: a frame ends where the next one moves
+	Profiler::endFrame();
+#ifdef SIMULATION_PROFILE
+	updateProfileSummary();
+#endif
+	PROFILE_ZONE("OnFrameMove");
 	UpdateWindowTitle(L"Demo");
 
-	static float time_counter = 0;
-
 	// Move camera
 	g_camera.FrameMove(fElapsedTime);
 
@@ -1051,35 +1020,35 @@ void CALLBACK OnFrameMove(double dTime, float fElapsedTime, void* pUserContext)
 			massSpringInitialization();
 			cout << "Points after one Euler Step\n";
 
-			g_bMidpoint = false; // use Euler method
+			g_iIntegrator = INTEGRATOR_EULER; // use Euler method
 
 			nextStep(0.1f);
 
-			cout << "Position p0: (" << XMVectorGetByIndex(points[0]->coords, 0) << ", " << XMVectorGetByIndex(points[0]->coords, 1) << ", " << XMVectorGetByIndex(points[0]->coords, 2) << ")\n";
-			cout << "Position p1: (" << XMVectorGetByIndex(points[1]->coords, 0) << ", " << XMVectorGetByIndex(points[1]->coords, 1) << ", " << XMVectorGetByIndex(points[1]->coords, 2) << ")\n";
+			cout << "Position p0: (" << g_massSpring.m_positions[0].x << ", " << g_massSpring.m_positions[0].y << ", " << g_massSpring.m_positions[0].z << ")\n";
+			cout << "Position p1: (" << g_massSpring.m_positions[1].x << ", " << g_massSpring.m_positions[1].y << ", " << g_massSpring.m_positions[1].z << ")\n";
 
-			cout << "Velocity p0: (" << XMVectorGetByIndex(points[0]->curr_v, 0) << ", " << XMVectorGetByIndex(points[0]->curr_v, 1) << ", " << XMVectorGetByIndex(points[0]->curr_v, 2) << ")\n";
-			cout << "Velocity p1: (" << XMVectorGetByIndex(points[1]->curr_v, 0) << ", " << XMVectorGetByIndex(points[1]->curr_v, 1) << ", " << XMVectorGetByIndex(points[1]->curr_v, 2) << ")\n\n";
+			cout << "Velocity p0: (" << g_massSpring.m_velocities[0].x << ", " << g_massSpring.m_velocities[0].y << ", " << g_massSpring.m_velocities[0].z << ")\n";
+			cout << "Velocity p1: (" << g_massSpring.m_velocities[1].x << ", " << g_massSpring.m_velocities[1].y << ", " << g_massSpring.m_velocities[1].z << ")\n\n";
 
 			massSpringInitialization();
-			g_bMidpoint = true; // use midpoint method
+			g_iIntegrator = INTEGRATOR_MIDPOINT; // use midpoint method
 
 			nextStep(0.1f);
 
 			cout << "\nPoints after one midpoint Step\n";
 
-			cout << "Position p0: (" << XMVectorGetByIndex(points[0]->coords, 0) << ", " << XMVectorGetByIndex(points[0]->coords, 1) << ", " << XMVectorGetByIndex(points[0]->coords, 2) << ")\n";
-			cout << "Position p1: (" << XMVectorGetByIndex(points[1]->coords, 0) << ", " << XMVectorGetByIndex(points[1]->coords, 1) << ", " << XMVectorGetByIndex(points[1]->coords, 2) << ")\n";
+			cout << "Position p0: (" << g_massSpring.m_positions[0].x << ", " << g_massSpring.m_positions[0].y << ", " << g_massSpring.m_positions[0].z << ")\n";
+			cout << "Position p1: (" << g_massSpring.m_positions[1].x << ", " << g_massSpring.m_positions[1].y << ", " << g_massSpring.m_positions[1].z << ")\n";
 
-			cout << "Velocity p0: (" << XMVectorGetByIndex(points[0]->curr_v, 0) << ", " << XMVectorGetByIndex(points[0]->curr_v, 1) << ", " << XMVectorGetByIndex(points[0]->curr_v, 2) << ")\n";
-			cout << "Velocity p1: (" << XMVectorGetByIndex(points[1]->curr_v, 0) << ", " << XMVectorGetByIndex(points[1]->curr_v, 1) << ", " << XMVectorGetByIndex(points[1]->curr_v, 2) << ")\n\n";
+			cout << "Velocity p0: (" << g_massSpring.m_velocities[0].x << ", " << g_massSpring.m_velocities[0].y << ", " << g_massSpring.m_velocities[0].z << ")\n";
+			cout << "Velocity p1: (" << g_massSpring.m_velocities[1].x << ", " << g_massSpring.m_velocities[1].y << ", " << g_massSpring.m_velocities[1].z << ")\n\n";
 
 			
 			break;
 		case 5:
 			
 			massSpringInitialization();
-			g_bMidpoint = false;
+			g_iIntegrator = INTEGRATOR_EULER;
 			h_timeStep = 0.005f;
 			
 			cout << "Demo 2\nEuler Method and timestep 0.005\n";
@@ -1087,7 +1056,7 @@ void CALLBACK OnFrameMove(double dTime, float fElapsedTime, void* pUserContext)
 		case 6:
 
 			massSpringInitialization();
-			g_bMidpoint = true;
+			g_iIntegrator = INTEGRATOR_MIDPOINT;
 			h_timeStep = 0.005f;
 
 			cout << "Demo3\nMidpoint Method and timestep 0.005\n";
@@ -1096,6 +1065,17 @@ void CALLBACK OnFrameMove(double dTime, float fElapsedTime, void* pUserContext)
 			cout << "Demo4\nSpringouse (10 points and 17 springs)\n";
 			SpringHouseInitialization();
 			break;
+		case 8:
+		case 9:
+		case 10:
+			GeneratedSceneInitialization();
+			// the generated scenes are too stiff for explicit integrators at interactive time steps
+			g_iIntegrator = INTEGRATOR_XPBD;
+			h_timeStep = 0.01f;
+			g_fDamping = 0.1f;
+			g_bGravityOn = true;
+			cout << "Generated scene: " << g_massSpring.numPoints() << " points, " << g_massSpring.numSprings() << " springs\n";
+			break;
 		default:
 			cout << "Empty Test!\n";
 			break;
@@ -1146,13 +1126,31 @@ void CALLBACK OnFrameMove(double dTime, float fElapsedTime, void* pUserContext)
 	case 5:
 	case 6:
 	case 7:
-		time_counter += fElapsedTime;
-		if (time_counter > h_timeStep) 
+	case 8:
+	case 9:
+	case 10:
+	{
+		// as many fixed steps as fit into the elapsed time, at most g_iMaxSubsteps,
+		// or adaptive steps covering it
+		PROFILE_ZONE("Simulation");
+		if (g_bAdaptiveStep)
 		{
+			nextStepsAdaptive(fElapsedTime);
+			break;
+		}
+		g_stepAccumulator.m_timeStep = h_timeStep;
+		g_stepAccumulator.m_maxSubsteps = g_iMaxSubsteps;
+		int steps = g_stepAccumulator.advance(fElapsedTime);
+		for (int step = 0; step < steps; step++)
+		{
+			if (step == steps - 1)
+			{
+				g_prevPositions = g_massSpring.m_positions;
+			}
 			nextStep(h_timeStep);
-			time_counter -= h_timeStep;
 		}
 		break;
+	}
 	default:
 		break;
 	}
@@ -1171,6 +1169,7 @@ void CALLBACK OnD3D11FrameRender( ID3D11Device* pd3dDevice, ID3D11DeviceContext*
                                   double fTime, float fElapsedTime, void* pUserContext )
 {
     HRESULT hr;
+	PROFILE_ZONE("OnD3D11FrameRender");
 
 	// Clear render target and depth stencil
 	float ClearColor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
@@ -1205,6 +1204,9 @@ void CALLBACK OnD3D11FrameRender( ID3D11Device* pd3dDevice, ID3D11DeviceContext*
 	case 5:
 	case 6:
 	case 7:
+	case 8:
+	case 9:
+	case 10:
 		// Draw Mass-Spring Setup
 		if (g_bDrawPoints) { drawPoints(pd3dImmediateContext); }
 		if (g_bDrawSprings) { drawSprings(pd3dImmediateContext); }
@@ -1219,10 +1221,14 @@ void CALLBACK OnD3D11FrameRender( ID3D11Device* pd3dDevice, ID3D11DeviceContext*
 //#endif
 
     // Draw GUI
-    TwDraw();
+    {
+        PROFILE_ZONE("TwDraw");
+        TwDraw();
+    }
 
     if (g_pFFmpegVideoRecorder) 
     {
+        PROFILE_ZONE("FFmpeg AddFrame");
         V(g_pFFmpegVideoRecorder->AddFrame(pd3dImmediateContext, DXUTGetD3D11RenderTargetView()));
     }
 }
@@ -0,0 +1,86 @@
+#include "AdaptiveStepper.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "MassSpringSystem.h"
+
+
+namespace
+{
+	const float kMaxGrowth = 2.f;
+}
+
+
+int AdaptiveStepper::advance(MassSpringSystem& ms, float frameTime)
+{
+	m_last = AdaptiveStepStats();
+	if (frameTime <= 0.f || m_maxTimeStep <= 0.f)
+	{
+		return 0;
+	}
+
+	const float minStep = std::min(m_minTimeStep, m_maxTimeStep);
+	m_timeStep = std::min(std::max(m_timeStep, minStep), m_maxTimeStep);
+	const auto start = std::chrono::steady_clock::now();
+	double remaining = frameTime;
+	while (remaining > 0.0)
+	{
+		if (m_frameBudget > 0.0 && std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() >= m_frameBudget)
+		{
+			m_last.droppedTime = remaining;
+			m_droppedTime += remaining;
+			break;
+		}
+
+		// the last step ends at the frame time; the last two share what is
+		// left evenly instead of leaving a sliver for the last one
+		float h = m_timeStep;
+		const bool last = remaining <= h;
+		if (last)
+		{
+			h = (float)remaining;
+		}
+		else if (remaining < 2.0 * h)
+		{
+			h = (float)(remaining / 2.0);
+		}
+		const bool cut = h < m_timeStep;
+		const bool forced = h <= minStep;
+
+		const float error = ms.tryStep(h, m_positionTolerance, m_velocityTolerance, forced ? INFINITY : 1.f);
+		m_last.forceEvaluations += ms.lastForceEvaluations();
+		// PI control: the error of the previous step damps the growth, so the
+		// size settles at a stiff scene's stability limit instead of
+		// overshooting it and being rejected again and again
+		float factor = error > 0.f ? 0.9f * std::pow(error, -0.35f) * std::pow(m_lastError, 0.2f) : kMaxGrowth;
+		factor = std::min(std::max(factor, 0.2f), kMaxGrowth);
+
+		if (error > 1.f && !forced)
+		{
+			m_last.rejectedSteps++;
+			m_timeStep = std::max(h * factor, minStep);
+			m_rejected = true;
+			continue;
+		}
+
+		m_lastError = std::min(std::max(error, 1e-4f), 1e4f);
+		m_last.smallestStep = m_last.steps == 0 ? h : std::min(m_last.smallestStep, h);
+		m_last.largestStep = std::max(m_last.largestStep, h);
+		m_last.steps++;
+		remaining = last ? 0.0 : remaining - h;
+
+		if (m_rejected)
+		{
+			factor = std::min(factor, 1.f);
+			m_rejected = false;
+		}
+		// a cut step says little about the full size, it only shrinks it
+		if (!cut || factor < 1.f)
+		{
+			m_timeStep = std::min(std::max(h * factor, minStep), m_maxTimeStep);
+		}
+	}
+	return m_last.steps;
+}
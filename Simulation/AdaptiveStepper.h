@@ -0,0 +1,70 @@
+#ifndef __AdaptiveStepper_h__
+#define __AdaptiveStepper_h__
+
+class MassSpringSystem;
+
+
+// Counters of the last AdaptiveStepper::advance()
+struct AdaptiveStepStats
+{
+	int    steps;             // accepted steps
+	int    rejectedSteps;     // steps tried again with a smaller size
+	int    forceEvaluations;
+	float  smallestStep;      // of the accepted steps (0 if there were none)
+	float  largestStep;
+	double droppedTime;       // frame time not simulated because the budget ran out
+
+	AdaptiveStepStats() : steps(0), rejectedSteps(0), forceEvaluations(0), smallestStep(0.f), largestStep(0.f), droppedTime(0.0) {}
+};
+
+// Advances a MassSpringSystem by the elapsed frame time in steps whose size
+// follows the embedded error estimate of MassSpringSystem::tryStep(): a step
+// whose error is above the tolerances is rejected and tried again smaller,
+// and after every step the size is scaled by 0.9 * error^-0.35 *
+// previousError^0.2 (PI control for the estimate of a first order method),
+// by a fifth to twice at most. Calm states run at m_maxTimeStep, impacts and
+// stiff springs shrink the steps down to what keeps them accurate and
+// stable, so no fixed time step has to be chosen for the worst moment of a
+// scene. Explicit steps can't get past the stability limit of the stiffest
+// springs though, resting or not; the controller settles just below it.
+// Steps of m_minTimeStep are taken whatever their error, so a state the
+// tolerances can't be met for still advances.
+//
+// The last step of a frame is cut to end exactly at the frame time (without
+// shrinking the size proposed for the next frame), so there is nothing left
+// to interpolate. If the steps of a frame take longer than m_frameBudget of
+// wall-clock time, the rest of the frame time is dropped (and counted in
+// m_droppedTime) instead of slowing down every following frame.
+class AdaptiveStepper
+{
+public:
+	explicit AdaptiveStepper(float maxTimeStep = 0.05f, float minTimeStep = 1e-5f)
+		: m_positionTolerance(1e-3f), m_velocityTolerance(1e-2f), m_minTimeStep(minTimeStep), m_maxTimeStep(maxTimeStep),
+		m_frameBudget(0.0), m_droppedTime(0.0), m_timeStep(maxTimeStep), m_lastError(1.f), m_rejected(false) {}
+
+	// Start again from m_maxTimeStep (e.g. after a scene reset)
+	void reset() { m_timeStep = m_maxTimeStep; m_lastError = 1.f; m_rejected = false; }
+
+	// Advance ms by frameTime; returns the number of accepted steps
+	int advance(MassSpringSystem& ms, float frameTime);
+
+	// Size of the next step
+	float timeStep() const { return m_timeStep; }
+
+	const AdaptiveStepStats& lastAdvance() const { return m_last; }
+
+	float  m_positionTolerance;  // allowed local error of a step in the positions (m)
+	float  m_velocityTolerance;  // and in the velocities (m/s)
+	float  m_minTimeStep;
+	float  m_maxTimeStep;
+	double m_frameBudget;        // wall-clock seconds per advance(), 0 = no limit
+	double m_droppedTime;        // total time discarded because of m_frameBudget
+
+private:
+	float m_timeStep;
+	float m_lastError;  // of the last accepted step
+	bool  m_rejected;  // the last step was rejected, don't grow the next one
+	AdaptiveStepStats m_last;
+};
+
+#endif
@@ -0,0 +1,38 @@
+#include "BlockSparseMatrix.h"
+
+#include <algorithm>
+
+
+void BlockSparseMatrix::setPattern(const std::vector<uint32_t>& rowOffsets, const std::vector<uint32_t>& columns)
+{
+	m_rowOffsets = rowOffsets;
+	m_columns = columns;
+	m_blocks.assign(m_columns.size(), Mat3());
+}
+
+
+int64_t BlockSparseMatrix::findBlock(uint32_t row, uint32_t col) const
+{
+	std::vector<uint32_t>::const_iterator first = m_columns.begin() + m_rowOffsets[row];
+	std::vector<uint32_t>::const_iterator last  = m_columns.begin() + m_rowOffsets[row + 1];
+	std::vector<uint32_t>::const_iterator it = std::lower_bound(first, last, col);
+	if (it == last || *it != col)
+	{
+		return -1;
+	}
+	return it - m_columns.begin();
+}
+
+
+void BlockSparseMatrix::multiply(const Vec3* x, Vec3* y, size_t rowBegin, size_t rowEnd) const
+{
+	for (size_t i = rowBegin; i < rowEnd; i++)
+	{
+		Vec3 sum(0.f, 0.f, 0.f);
+		for (uint32_t k = m_rowOffsets[i]; k < m_rowOffsets[i + 1]; k++)
+		{
+			sum += m_blocks[k] * x[m_columns[k]];
+		}
+		y[i] = sum;
+	}
+}
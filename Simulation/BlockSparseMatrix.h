@@ -0,0 +1,35 @@
+#ifndef __BlockSparseMatrix_h__
+#define __BlockSparseMatrix_h__
+
+#include <cstdint>
+#include <vector>
+
+#include "Mat3.h"
+#include "Vec3.h"
+
+
+// Square sparse matrix of 3x3 blocks in compressed sparse row layout.
+// The sparsity pattern is set once (per topology) and the block values are
+// overwritten in place every step, so assembling never allocates.
+class BlockSparseMatrix
+{
+public:
+	// Set the pattern: the blocks of row i have the (ascending) column indices
+	// columns[rowOffsets[i] .. rowOffsets[i + 1]). All blocks are set to zero.
+	void setPattern(const std::vector<uint32_t>& rowOffsets, const std::vector<uint32_t>& columns);
+
+	size_t numRows() const   { return m_rowOffsets.empty() ? 0 : m_rowOffsets.size() - 1; }
+	size_t numBlocks() const { return m_columns.size(); }
+
+	// Index of block (row, col) in m_blocks, or -1 if it is not part of the pattern
+	int64_t findBlock(uint32_t row, uint32_t col) const;
+
+	// y[i] = sum_j A(i, j) * x[j] for the rows [rowBegin, rowEnd)
+	void multiply(const Vec3* x, Vec3* y, size_t rowBegin, size_t rowEnd) const;
+
+	std::vector<uint32_t> m_rowOffsets;
+	std::vector<uint32_t> m_columns;
+	std::vector<Mat3>     m_blocks;
+};
+
+#endif
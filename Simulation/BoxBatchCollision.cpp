@@ -0,0 +1,394 @@
+#include "BoxBatchCollision.h"
+
+#include <cfloat>
+#include <cmath>
+
+#if defined(__AVX2__)
+	#include <immintrin.h>
+	#define BOX_BATCH_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define BOX_BATCH_SSE2
+#endif
+
+
+void BoxArrays::resize(size_t numBoxes)
+{
+	for (int k = 0; k < 3; k++)
+	{
+		center[k].resize(numBoxes);
+		halfExtents[k].resize(numBoxes);
+		for (int a = 0; a < 3; a++)
+		{
+			axes[a][k].resize(numBoxes);
+		}
+	}
+}
+
+
+void BoxArrays::setBox(size_t i, const Box& box)
+{
+	for (int k = 0; k < 3; k++)
+	{
+		center[k][i] = box.center[k];
+		halfExtents[k][i] = box.halfExtents[k];
+		for (int a = 0; a < 3; a++)
+		{
+			axes[a][k][i] = box.axes[a][k];
+		}
+	}
+}
+
+
+Box BoxArrays::getBox(size_t i) const
+{
+	Box box;
+	for (int k = 0; k < 3; k++)
+	{
+		box.center[k] = center[k][i];
+		box.halfExtents[k] = halfExtents[k][i];
+		for (int a = 0; a < 3; a++)
+		{
+			box.axes[a][k] = axes[a][k][i];
+		}
+	}
+	return box;
+}
+
+
+namespace
+{
+	// same tolerances as collideBoxes()
+	const float kParallelEpsilon = 1e-6f;
+	const float kFaceTolerance = 0.98f;
+	const float kEdgeTolerance = 0.95f;
+	const float kAbsoluteTolerance = 0.005f;
+	const float kMinEdgeAxisLengthSq = 1e-6f;
+
+
+	// Lane types the kernel is written against: Float1 (one pair, the reference),
+	// Float4 (SSE2) and Float8 (AVX2). Each provides arithmetic, a mask type
+	// from lessThan() and select(), F::gather() from an index list and store().
+
+	struct Float1
+	{
+		typedef bool Mask;
+		static const size_t kWidth = 1;
+
+		float v;
+		Float1() {}
+		Float1(float v) : v(v) {}
+
+		static Float1 gather(const float* base, const uint32_t* index) { return Float1(base[index[0]]); }
+	};
+	inline Float1 operator+(Float1 a, Float1 b) { return Float1(a.v + b.v); }
+	inline Float1 operator-(Float1 a, Float1 b) { return Float1(a.v - b.v); }
+	inline Float1 operator*(Float1 a, Float1 b) { return Float1(a.v * b.v); }
+	inline Float1 operator/(Float1 a, Float1 b) { return Float1(a.v / b.v); }
+	inline Float1 operator-(Float1 a)           { return Float1(-a.v); }
+	inline Float1 absolute(Float1 a)            { return Float1(std::fabs(a.v)); }
+	inline Float1 squareRoot(Float1 a)          { return Float1(std::sqrt(a.v)); }
+	inline bool lessThan(Float1 a, Float1 b)    { return a.v < b.v; }
+	inline bool andNot(bool a, bool b)          { return a && !b; }
+	inline Float1 select(bool m, Float1 a, Float1 b) { return m ? a : b; }
+	inline int maskBits(bool m)                 { return m ? 1 : 0; }
+	inline void store(Float1 a, float* out)     { out[0] = a.v; }
+
+#if defined(BOX_BATCH_AVX2)
+
+	struct Mask8 { __m256 v; };
+	inline Mask8 operator|(Mask8 a, Mask8 b) { Mask8 r = { _mm256_or_ps(a.v, b.v) }; return r; }
+	inline Mask8 operator&(Mask8 a, Mask8 b) { Mask8 r = { _mm256_and_ps(a.v, b.v) }; return r; }
+	inline Mask8 andNot(Mask8 a, Mask8 b)    { Mask8 r = { _mm256_andnot_ps(b.v, a.v) }; return r; }
+	inline int maskBits(Mask8 m)             { return _mm256_movemask_ps(m.v); }
+
+	struct Float8
+	{
+		typedef Mask8 Mask;
+		static const size_t kWidth = 8;
+
+		__m256 v;
+		Float8() {}
+		Float8(__m256 v) : v(v) {}
+		Float8(float s) : v(_mm256_set1_ps(s)) {}
+
+		static Float8 gather(const float* base, const uint32_t* index)
+		{
+			return _mm256_i32gather_ps(base, _mm256_loadu_si256((const __m256i*)index), 4);
+		}
+	};
+	inline Float8 operator+(Float8 a, Float8 b) { return _mm256_add_ps(a.v, b.v); }
+	inline Float8 operator-(Float8 a, Float8 b) { return _mm256_sub_ps(a.v, b.v); }
+	inline Float8 operator*(Float8 a, Float8 b) { return _mm256_mul_ps(a.v, b.v); }
+	inline Float8 operator/(Float8 a, Float8 b) { return _mm256_div_ps(a.v, b.v); }
+	inline Float8 operator-(Float8 a)           { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.f)); }
+	inline Float8 absolute(Float8 a)            { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), a.v); }
+	inline Float8 squareRoot(Float8 a)          { return _mm256_sqrt_ps(a.v); }
+	inline Mask8 lessThan(Float8 a, Float8 b)   { Mask8 r = { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; return r; }
+	inline Float8 select(Mask8 m, Float8 a, Float8 b) { return _mm256_blendv_ps(b.v, a.v, m.v); }
+	inline void store(Float8 a, float* out)     { _mm256_storeu_ps(out, a.v); }
+
+	typedef Float8 SimdFloat;
+
+#elif defined(BOX_BATCH_SSE2)
+
+	struct Mask4 { __m128 v; };
+	inline Mask4 operator|(Mask4 a, Mask4 b) { Mask4 r = { _mm_or_ps(a.v, b.v) }; return r; }
+	inline Mask4 operator&(Mask4 a, Mask4 b) { Mask4 r = { _mm_and_ps(a.v, b.v) }; return r; }
+	inline Mask4 andNot(Mask4 a, Mask4 b)    { Mask4 r = { _mm_andnot_ps(b.v, a.v) }; return r; }
+	inline int maskBits(Mask4 m)             { return _mm_movemask_ps(m.v); }
+
+	struct Float4
+	{
+		typedef Mask4 Mask;
+		static const size_t kWidth = 4;
+
+		__m128 v;
+		Float4() {}
+		Float4(__m128 v) : v(v) {}
+		Float4(float s) : v(_mm_set1_ps(s)) {}
+
+		static Float4 gather(const float* base, const uint32_t* index)
+		{
+			return _mm_setr_ps(base[index[0]], base[index[1]], base[index[2]], base[index[3]]);
+		}
+	};
+	inline Float4 operator+(Float4 a, Float4 b) { return _mm_add_ps(a.v, b.v); }
+	inline Float4 operator-(Float4 a, Float4 b) { return _mm_sub_ps(a.v, b.v); }
+	inline Float4 operator*(Float4 a, Float4 b) { return _mm_mul_ps(a.v, b.v); }
+	inline Float4 operator/(Float4 a, Float4 b) { return _mm_div_ps(a.v, b.v); }
+	inline Float4 operator-(Float4 a)           { return _mm_xor_ps(a.v, _mm_set1_ps(-0.f)); }
+	inline Float4 absolute(Float4 a)            { return _mm_andnot_ps(_mm_set1_ps(-0.f), a.v); }
+	inline Float4 squareRoot(Float4 a)          { return _mm_sqrt_ps(a.v); }
+	inline Mask4 lessThan(Float4 a, Float4 b)   { Mask4 r = { _mm_cmplt_ps(a.v, b.v) }; return r; }
+	inline Float4 select(Mask4 m, Float4 a, Float4 b) { return _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)); }
+	inline void store(Float4 a, float* out)     { _mm_storeu_ps(out, a.v); }
+
+	typedef Float4 SimdFloat;
+
+#endif
+
+
+	// SAT for pairs[0, count) as one group of F::kWidth lanes (count <= kWidth,
+	// the remaining lanes repeat the last pair). firstPair is the index of
+	// pairs[0] in the caller's list. Returns the number of contacts written.
+	template <typename F>
+	size_t collideGroup(const BoxArrays& boxes, const BoxPair* pairs, size_t firstPair, size_t count, BoxPairContact* contacts)
+	{
+		typedef typename F::Mask Mask;
+		const size_t W = F::kWidth;
+
+		uint32_t ia[W], ib[W];
+		for (size_t l = 0; l < W; l++)
+		{
+			const BoxPair& pair = pairs[l < count ? l : count - 1];
+			ia[l] = pair.a;
+			ib[l] = pair.b;
+		}
+
+		F ca[3], cb[3], ea[3], eb[3], A[3][3], B[3][3];
+		for (int k = 0; k < 3; k++)
+		{
+			ca[k] = F::gather(boxes.center[k].data(), ia);
+			cb[k] = F::gather(boxes.center[k].data(), ib);
+			ea[k] = F::gather(boxes.halfExtents[k].data(), ia);
+			eb[k] = F::gather(boxes.halfExtents[k].data(), ib);
+			for (int a = 0; a < 3; a++)
+			{
+				A[a][k] = F::gather(boxes.axes[a][k].data(), ia);
+				B[a][k] = F::gather(boxes.axes[a][k].data(), ib);
+			}
+		}
+
+		// R = A^T B: the transpose is the inverse of a rotation
+		F d[3], R[3][3], absR[3][3], ta[3], tb[3];
+		for (int k = 0; k < 3; k++)
+		{
+			d[k] = cb[k] - ca[k];
+		}
+		for (int i = 0; i < 3; i++)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				R[i][j] = A[i][0] * B[j][0] + A[i][1] * B[j][1] + A[i][2] * B[j][2];
+				absR[i][j] = absolute(R[i][j]) + F(kParallelEpsilon);
+			}
+			ta[i] = d[0] * A[i][0] + d[1] * A[i][1] + d[2] * A[i][2];
+			tb[i] = d[0] * B[i][0] + d[1] * B[i][1] + d[2] * B[i][2];
+		}
+
+		// face axes; normals point from A to B
+		const F zero(0.f);
+		Mask separated = lessThan(zero, zero);
+		F depthA(FLT_MAX), depthB(FLT_MAX), nA[3] = { zero, zero, zero }, nB[3] = { zero, zero, zero };
+		for (int i = 0; i < 3; i++)
+		{
+			F depth = ea[i] + eb[0] * absR[i][0] + eb[1] * absR[i][1] + eb[2] * absR[i][2] - absolute(ta[i]);
+			separated = separated | lessThan(depth, zero);
+			Mask better = lessThan(depth, depthA);
+			Mask negative = lessThan(ta[i], zero);
+			depthA = select(better, depth, depthA);
+			for (int k = 0; k < 3; k++)
+			{
+				nA[k] = select(better, select(negative, -A[i][k], A[i][k]), nA[k]);
+			}
+		}
+		for (int j = 0; j < 3; j++)
+		{
+			F depth = ea[0] * absR[0][j] + ea[1] * absR[1][j] + ea[2] * absR[2][j] + eb[j] - absolute(tb[j]);
+			separated = separated | lessThan(depth, zero);
+			Mask better = lessThan(depth, depthB);
+			Mask negative = lessThan(tb[j], zero);
+			depthB = select(better, depth, depthB);
+			for (int k = 0; k < 3; k++)
+			{
+				nB[k] = select(better, select(negative, -B[j][k], B[j][k]), nB[k]);
+			}
+		}
+		const int allLanes = (1 << W) - 1;
+		if (maskBits(separated) == allLanes)
+		{
+			return 0;
+		}
+
+		// edge axes A_i x B_j with |A_i x B_j|^2 = 1 - R_ij^2. The best edge is
+		// tracked as depth and squared axis length so that the comparison
+		// depth / |axis| < best needs no square root.
+		F edgeDepth(FLT_MAX), edgeLengthSq(1.f), nE[3] = { zero, zero, zero };
+		for (int i = 0; i < 3; i++)
+		{
+			const int i1 = (i + 1) % 3;
+			const int i2 = (i + 2) % 3;
+			for (int j = 0; j < 3; j++)
+			{
+				const int j1 = (j + 1) % 3;
+				const int j2 = (j + 2) % 3;
+				F ra = ea[i1] * absR[i2][j] + ea[i2] * absR[i1][j];
+				F rb = eb[j1] * absR[i][j2] + eb[j2] * absR[i][j1];
+				F depth = ra + rb - absolute(ta[i2] * R[i1][j] - ta[i1] * R[i2][j]);
+				separated = separated | lessThan(depth, zero);
+
+				F lengthSq = F(1.f) - R[i][j] * R[i][j];
+				Mask better = lessThan(F(kMinEdgeAxisLengthSq), lengthSq) & lessThan(depth * depth * edgeLengthSq, edgeDepth * edgeDepth * lengthSq);
+				edgeDepth = select(better, depth, edgeDepth);
+				edgeLengthSq = select(better, lengthSq, edgeLengthSq);
+				for (int k = 0; k < 3; k++)
+				{
+					const int k1 = (k + 1) % 3;
+					const int k2 = (k + 2) % 3;
+					nE[k] = select(better, A[i][k1] * B[j][k2] - A[i][k2] * B[j][k1], nE[k]);
+				}
+			}
+		}
+		if (maskBits(separated) == allLanes)
+		{
+			return 0;
+		}
+
+		// least penetration, preferring A's faces over B's and faces over edges
+		Mask useB = lessThan(depthB, F(kFaceTolerance) * depthA - F(kAbsoluteTolerance));
+		F depth = select(useB, depthB, depthA);
+		F n[3];
+		for (int k = 0; k < 3; k++)
+		{
+			n[k] = select(useB, nB[k], nA[k]);
+		}
+
+		F invLength = F(1.f) / squareRoot(edgeLengthSq);
+		edgeDepth = edgeDepth * invLength;
+		Mask useEdge = lessThan(edgeDepth, F(kEdgeTolerance) * depth - F(kAbsoluteTolerance));
+		F edgeSide = nE[0] * d[0] + nE[1] * d[1] + nE[2] * d[2];
+		Mask flipEdge = lessThan(edgeSide, zero);
+		depth = select(useEdge, edgeDepth, depth);
+		for (int k = 0; k < 3; k++)
+		{
+			F e = nE[k] * invLength;
+			n[k] = select(useEdge, select(flipEdge, -e, e), n[k]);
+		}
+
+		// deepest corner of the incident box: A's corner farthest along n for a
+		// face of B, otherwise B's corner farthest along -n
+		Mask fromA = andNot(useB, useEdge);
+		F sideA[3], sideB[3];
+		for (int a = 0; a < 3; a++)
+		{
+			F alongA = A[a][0] * n[0] + A[a][1] * n[1] + A[a][2] * n[2];
+			F alongB = B[a][0] * n[0] + B[a][1] * n[1] + B[a][2] * n[2];
+			sideA[a] = select(lessThan(alongA, zero), -ea[a], ea[a]);
+			sideB[a] = select(lessThan(zero, alongB), -eb[a], eb[a]);
+		}
+		F halfDepth = F(0.5f) * depth;
+		F point[3];
+		for (int k = 0; k < 3; k++)
+		{
+			F cornerA = ca[k] + sideA[0] * A[0][k] + sideA[1] * A[1][k] + sideA[2] * A[2][k] - halfDepth * n[k];
+			F cornerB = cb[k] + sideB[0] * B[0][k] + sideB[1] * B[1][k] + sideB[2] * B[2][k] + halfDepth * n[k];
+			point[k] = select(fromA, cornerA, cornerB);
+		}
+
+		float depthOut[W], normalOut[3][W], pointOut[3][W];
+		store(depth, depthOut);
+		for (int k = 0; k < 3; k++)
+		{
+			store(-n[k], normalOut[k]);
+			store(point[k], pointOut[k]);
+		}
+
+		const int overlapping = ~maskBits(separated);
+		size_t written = 0;
+		for (size_t l = 0; l < count; l++)
+		{
+			if (overlapping & (1 << l))
+			{
+				BoxPairContact& contact = contacts[written++];
+				contact.pair = (uint32_t)(firstPair + l);
+				contact.depth = depthOut[l];
+				contact.normalWorld = Vec3(normalOut[0][l], normalOut[1][l], normalOut[2][l]);
+				contact.pointWorld = Vec3(pointOut[0][l], pointOut[1][l], pointOut[2][l]);
+			}
+		}
+		return written;
+	}
+
+
+	template <typename F>
+	size_t collidePairs(const BoxArrays& boxes, const BoxPair* pairs, size_t numPairs, BoxPairContact* contacts)
+	{
+		const size_t W = F::kWidth;
+		size_t written = 0;
+		for (size_t p = 0; p < numPairs; p += W)
+		{
+			size_t count = numPairs - p < W ? numPairs - p : W;
+			written += collideGroup<F>(boxes, pairs + p, p, count, contacts + written);
+		}
+		return written;
+	}
+}
+
+
+size_t collideBoxPairsScalar(const BoxArrays& boxes, const BoxPair* pairs, size_t numPairs, BoxPairContact* contacts)
+{
+	return collidePairs<Float1>(boxes, pairs, numPairs, contacts);
+}
+
+
+size_t collideBoxPairsSimd(const BoxArrays& boxes, const BoxPair* pairs, size_t numPairs, BoxPairContact* contacts)
+{
+#if defined(BOX_BATCH_AVX2) || defined(BOX_BATCH_SSE2)
+	return collidePairs<SimdFloat>(boxes, pairs, numPairs, contacts);
+#else
+	return collidePairs<Float1>(boxes, pairs, numPairs, contacts);
+#endif
+}
+
+
+const char* collideBoxPairsSimdName()
+{
+#if defined(BOX_BATCH_AVX2)
+	return "AVX2";
+#elif defined(BOX_BATCH_SSE2)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
@@ -0,0 +1,66 @@
+#ifndef __BoxBatchCollision_h__
+#define __BoxBatchCollision_h__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "BoxCollision.h"
+
+
+// Poses and sizes of many boxes in structure of arrays layout, so that a batch
+// kernel loads one coordinate of several boxes into one register
+struct BoxArrays
+{
+	std::vector<float> center[3];      // center[k][i]: coordinate k of the centre of box i
+	std::vector<float> axes[3][3];     // axes[a][k][i]: coordinate k of unit axis a of box i
+	std::vector<float> halfExtents[3]; // halfExtents[a][i]: half edge length along axis a
+
+	size_t size() const { return center[0].size(); }
+	void resize(size_t numBoxes);
+
+	void setBox(size_t i, const Box& box);
+	Box getBox(size_t i) const;
+};
+
+// Candidate pair, indices into BoxArrays (e.g. from a broad phase)
+struct BoxPair
+{
+	uint32_t a, b;
+};
+
+// Result for an overlapping pair
+struct BoxPairContact
+{
+	uint32_t pair;      // index into the pair list
+	float    depth;     // penetration along the normal
+	Vec3     normalWorld; // unit direction of the impulse to box a (from b towards a)
+	Vec3     pointWorld;  // deepest corner of the incident box, moved halfway to the other surface
+};
+
+
+// Separating axis test (all 15 axes, as in collideBoxes()) for pairs
+// [0, numPairs). Writes one contact per overlapping pair to contacts, in pair
+// order, and returns their number; contacts must have room for numPairs
+// entries. Gives the normal and depth of the axis of least penetration and a
+// single point, the deepest corner like checkCollision(); run collideBoxes()
+// on a pair when the full manifold is needed.
+//
+// The rotation of A relative to B is formed from dot products of the axes
+// (the transpose is the inverse of a rotation, no general matrix inverse),
+// and pairs that are separated by a face axis in every lane skip the edge axes.
+
+// Reference implementation, one pair at a time
+size_t collideBoxPairsScalar(const BoxArrays& boxes, const BoxPair* pairs, size_t numPairs, BoxPairContact* contacts);
+
+// The same computation on 8 (AVX2) or 4 (SSE2) pairs per iteration. Results
+// can differ from collideBoxPairsScalar() in the last bits, which matters only
+// for pairs that are just touching. Falls back to the scalar version if
+// neither instruction set is available.
+size_t collideBoxPairsSimd(const BoxArrays& boxes, const BoxPair* pairs, size_t numPairs, BoxPairContact* contacts);
+
+// Instruction set used by collideBoxPairsSimd(): "AVX2", "SSE2" or "scalar"
+const char* collideBoxPairsSimdName();
+
+
+#endif
@@ -0,0 +1,449 @@
+#include "BoxCollision.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+
+Box Box::fromTransform(const float obj2World[4][4], float xlen, float ylen, float zlen)
+{
+	Box box;
+	for (int i = 0; i < 3; i++)
+	{
+		Vec3 axis(obj2World[i][0], obj2World[i][1], obj2World[i][2]);
+		box.axes[i] = axis * (1.f / length(axis));
+	}
+	box.center = Vec3(obj2World[3][0], obj2World[3][1], obj2World[3][2]);
+	box.halfExtents = Vec3(xlen / 2.f, ylen / 2.f, zlen / 2.f);
+	return box;
+}
+
+
+Vec3 Box::corner(int i) const
+{
+	Vec3 p = center;
+	for (int k = 0; k < 3; k++)
+	{
+		p += (((i >> k) & 1) ? halfExtents[k] : -halfExtents[k]) * axes[k];
+	}
+	return p;
+}
+
+
+namespace
+{
+	// added to |R| so that near parallel edges don't produce a bogus cross product axis
+	const float kParallelEpsilon = 1e-6f;
+
+	// Edge pairs less than ~1e-3 rad from parallel are skipped: the direction
+	// of their cross product is mostly rounding error, and for boxes resting on
+	// each other it would beat the face axes with a garbage normal
+	const float kMinEdgeAxisLengthSq = 1e-6f;
+
+	// Preference of face axes over edge axes and of A's faces over B's: a later
+	// axis only wins if its penetration is clearly smaller, relatively and by
+	// kAbsoluteTolerance. Without it the chosen feature flips between frames
+	// for resting boxes. The absolute part matters for shallow contacts, where
+	// a slight tilt changes the depths by a large fraction (an edge pair of a
+	// tilted box resting on another one would win and give a single point).
+	const float kFaceTolerance = 0.98f;
+	const float kEdgeTolerance = 0.95f;
+	const float kAbsoluteTolerance = 0.005f;
+
+	enum AxisType { AXIS_FACE_A, AXIS_FACE_B, AXIS_EDGE };
+
+
+	// Sutherland-Hodgman: keep the part of polygon in[0..n) with dot(normal, p) <= offset
+	int clipPolygon(const Vec3* in, int n, const Vec3& normal, float offset, Vec3* out)
+	{
+		int m = 0;
+		for (int k = 0; k < n; k++)
+		{
+			const Vec3& p = in[k];
+			const Vec3& q = in[(k + 1) % n];
+			float dp = dot(normal, p) - offset;
+			float dq = dot(normal, q) - offset;
+			if (dp <= 0.f)
+			{
+				out[m++] = p;
+			}
+			if ((dp < 0.f && dq > 0.f) || (dp > 0.f && dq < 0.f))
+			{
+				out[m++] = p + (dp / (dp - dq)) * (q - p);
+			}
+		}
+		return m;
+	}
+
+
+	// Keep at most 4 of the candidates: the deepest one, the one farthest from
+	// it and the two that span the largest triangles on either side of that line
+	void reduceContacts(const ContactPoint* candidates, int count, const Vec3& normal, ContactManifold& manifold)
+	{
+		if (count <= 4)
+		{
+			for (int k = 0; k < count; k++)
+			{
+				manifold.points[k] = candidates[k];
+			}
+			manifold.numPoints = count;
+			return;
+		}
+
+		int chosen[4] = { 0, -1, -1, -1 };
+		for (int k = 1; k < count; k++)
+		{
+			if (candidates[k].depth > candidates[chosen[0]].depth) { chosen[0] = k; }
+		}
+		const Vec3& p0 = candidates[chosen[0]].positionWorld;
+
+		float farthest = -1.f;
+		for (int k = 0; k < count; k++)
+		{
+			float d = lengthSq(candidates[k].positionWorld - p0);
+			if (k != chosen[0] && d > farthest) { farthest = d; chosen[1] = k; }
+		}
+		const Vec3 edge = candidates[chosen[1]].positionWorld - p0;
+
+		float maxArea = -FLT_MAX;
+		float minArea = FLT_MAX;
+		for (int k = 0; k < count; k++)
+		{
+			if (k == chosen[0] || k == chosen[1]) { continue; }
+			float area = dot(cross(edge, candidates[k].positionWorld - p0), normal);
+			if (area > maxArea) { maxArea = area; chosen[2] = k; }
+		}
+		for (int k = 0; k < count; k++)
+		{
+			if (k == chosen[0] || k == chosen[1] || k == chosen[2]) { continue; }
+			float area = dot(cross(edge, candidates[k].positionWorld - p0), normal);
+			if (area < minArea) { minArea = area; chosen[3] = k; }
+		}
+
+		manifold.numPoints = 4;
+		for (int k = 0; k < 4; k++)
+		{
+			manifold.points[k] = candidates[chosen[k]];
+		}
+	}
+
+
+	// Contacts for a face axis. refNormal is the outward normal of the reference
+	// face of ref (pointing towards inc); the incident face of inc is the one most
+	// anti-parallel to it.
+	void faceContacts(const Box& ref, int refAxis, const Vec3& refNormal, const Box& inc, ContactManifold& manifold)
+	{
+		int incAxis = 0;
+		float maxAlignment = -1.f;
+		for (int k = 0; k < 3; k++)
+		{
+			float alignment = std::fabs(dot(inc.axes[k], refNormal));
+			if (alignment > maxAlignment) { maxAlignment = alignment; incAxis = k; }
+		}
+		float side = dot(inc.axes[incAxis], refNormal) > 0.f ? -1.f : 1.f;
+		Vec3 incCenter = inc.center + (side * inc.halfExtents[incAxis]) * inc.axes[incAxis];
+		Vec3 eu = inc.halfExtents[(incAxis + 1) % 3] * inc.axes[(incAxis + 1) % 3];
+		Vec3 ev = inc.halfExtents[(incAxis + 2) % 3] * inc.axes[(incAxis + 2) % 3];
+
+		// every clip against a half space adds at most one vertex: 4 -> 8
+		Vec3 polygon[8];
+		Vec3 clipped[8];
+		polygon[0] = incCenter + eu + ev;
+		polygon[1] = incCenter - eu + ev;
+		polygon[2] = incCenter - eu - ev;
+		polygon[3] = incCenter + eu - ev;
+		int n = 4;
+
+		// side planes of the reference face
+		for (int k = 1; k < 3 && n > 0; k++)
+		{
+			const int axis = (refAxis + k) % 3;
+			const Vec3& u = ref.axes[axis];
+			const float c = dot(ref.center, u);
+			n = clipPolygon(polygon, n, u, c + ref.halfExtents[axis], clipped);
+			n = clipPolygon(clipped, n, -u, -c + ref.halfExtents[axis], polygon);
+		}
+
+		// keep the points below the reference face, moved halfway towards it
+		const float refOffset = dot(ref.center, refNormal) + ref.halfExtents[refAxis];
+		ContactPoint candidates[8];
+		int count = 0;
+		for (int k = 0; k < n; k++)
+		{
+			float depth = refOffset - dot(polygon[k], refNormal);
+			if (depth >= 0.f)
+			{
+				candidates[count].positionWorld = polygon[k] + (0.5f * depth) * refNormal;
+				candidates[count].depth = depth;
+				count++;
+			}
+		}
+		reduceContacts(candidates, count, refNormal, manifold);
+	}
+
+
+	// The edge of box parallel to axes[axis] that lies farthest in direction dir
+	void supportEdge(const Box& box, int axis, const Vec3& dir, Vec3& p, Vec3& q)
+	{
+		Vec3 c = box.center;
+		for (int k = 0; k < 3; k++)
+		{
+			if (k == axis) { continue; }
+			c += (dot(box.axes[k], dir) > 0.f ? box.halfExtents[k] : -box.halfExtents[k]) * box.axes[k];
+		}
+		p = c - box.halfExtents[axis] * box.axes[axis];
+		q = c + box.halfExtents[axis] * box.axes[axis];
+	}
+
+
+	float clamp01(float x) { return x < 0.f ? 0.f : (x > 1.f ? 1.f : x); }
+
+
+	// Closest points c1 on segment p1 q1 and c2 on p2 q2 (Ericson, Real-Time
+	// Collision Detection, 5.1.9), for segments of nonzero length
+	void closestPointsSegments(const Vec3& p1, const Vec3& q1, const Vec3& p2, const Vec3& q2, Vec3& c1, Vec3& c2)
+	{
+		const Vec3 d1 = q1 - p1;
+		const Vec3 d2 = q2 - p2;
+		const Vec3 r = p1 - p2;
+		const float a = dot(d1, d1);
+		const float e = dot(d2, d2);
+		const float f = dot(d2, r);
+		const float c = dot(d1, r);
+		const float b = dot(d1, d2);
+		const float denom = a * e - b * b;
+
+		float s = denom > 1e-12f ? clamp01((b * f - c * e) / denom) : 0.f;
+		float t = (b * s + f) / e;
+		if (t < 0.f)
+		{
+			t = 0.f;
+			s = clamp01(-c / a);
+		}
+		else if (t > 1.f)
+		{
+			t = 1.f;
+			s = clamp01((b - c) / a);
+		}
+		c1 = p1 + s * d1;
+		c2 = p2 + t * d2;
+	}
+}
+
+
+bool collideBoxes(const Box& a, const Box& b, ContactManifold& manifold)
+{
+	manifold.numPoints = 0;
+
+	const Vec3& ea = a.halfExtents;
+	const Vec3& eb = b.halfExtents;
+	const Vec3 d = b.center - a.center;
+
+	// B's axes in A's frame and the centre offset in both frames
+	float R[3][3];
+	float absR[3][3];
+	float ta[3];
+	float tb[3];
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			R[i][j] = dot(a.axes[i], b.axes[j]);
+			absR[i][j] = std::fabs(R[i][j]) + kParallelEpsilon;
+		}
+		ta[i] = dot(d, a.axes[i]);
+		tb[i] = dot(d, b.axes[i]);
+	}
+
+	// faces of A
+	float faceDepthA = FLT_MAX;
+	int faceA = 0;
+	for (int i = 0; i < 3; i++)
+	{
+		float depth = ea[i] + eb[0] * absR[i][0] + eb[1] * absR[i][1] + eb[2] * absR[i][2] - std::fabs(ta[i]);
+		if (depth < 0.f) { return false; }
+		if (depth < faceDepthA) { faceDepthA = depth; faceA = i; }
+	}
+
+	// faces of B
+	float faceDepthB = FLT_MAX;
+	int faceB = 0;
+	for (int j = 0; j < 3; j++)
+	{
+		float depth = ea[0] * absR[0][j] + ea[1] * absR[1][j] + ea[2] * absR[2][j] + eb[j] - std::fabs(tb[j]);
+		if (depth < 0.f) { return false; }
+		if (depth < faceDepthB) { faceDepthB = depth; faceB = j; }
+	}
+
+	// edge pairs A_i x B_j, projections written in A's frame
+	float edgeDepth = FLT_MAX;
+	int edgeA = -1;
+	int edgeB = -1;
+	for (int i = 0; i < 3; i++)
+	{
+		const int i1 = (i + 1) % 3;
+		const int i2 = (i + 2) % 3;
+		for (int j = 0; j < 3; j++)
+		{
+			const int j1 = (j + 1) % 3;
+			const int j2 = (j + 2) % 3;
+			float ra = ea[i1] * absR[i2][j] + ea[i2] * absR[i1][j];
+			float rb = eb[j1] * absR[i][j2] + eb[j2] * absR[i][j1];
+			float distance = std::fabs(ta[i2] * R[i1][j] - ta[i1] * R[i2][j]);
+			float depth = ra + rb - distance;
+			if (depth < 0.f) { return false; }
+
+			// |A_i x B_j|^2 = 1 - R_ij^2 for orthonormal axes. (Nearly) parallel
+			// edges are skipped, the face axes already cover that direction.
+			float axisLengthSq = 1.f - R[i][j] * R[i][j];
+			if (axisLengthSq < kMinEdgeAxisLengthSq) { continue; }
+			if (depth * depth < edgeDepth * edgeDepth * axisLengthSq)
+			{
+				edgeDepth = depth / std::sqrt(axisLengthSq);
+				edgeA = i;
+				edgeB = j;
+			}
+		}
+	}
+
+	// no separating axis: pick the feature of least penetration
+	AxisType type = AXIS_FACE_A;
+	float depth = faceDepthA;
+	if (faceDepthB < kFaceTolerance * depth - kAbsoluteTolerance)
+	{
+		type = AXIS_FACE_B;
+		depth = faceDepthB;
+	}
+	if (edgeA >= 0 && edgeDepth < kEdgeTolerance * depth - kAbsoluteTolerance)
+	{
+		type = AXIS_EDGE;
+		depth = edgeDepth;
+	}
+
+	if (type == AXIS_FACE_A)
+	{
+		// reference face on A, normal pointing from A to B
+		Vec3 n = ta[faceA] < 0.f ? -a.axes[faceA] : a.axes[faceA];
+		manifold.normalWorld = -n;
+		faceContacts(a, faceA, n, b, manifold);
+	}
+	else if (type == AXIS_FACE_B)
+	{
+		// reference face on B, normal pointing from B to A
+		Vec3 n = tb[faceB] < 0.f ? b.axes[faceB] : -b.axes[faceB];
+		manifold.normalWorld = n;
+		faceContacts(b, faceB, n, a, manifold);
+	}
+	else
+	{
+		Vec3 n = cross(a.axes[edgeA], b.axes[edgeB]);
+		n *= 1.f / length(n);
+		if (dot(n, d) < 0.f) { n = -n; }
+		manifold.normalWorld = -n;
+
+		Vec3 pa, qa, pb, qb, ca, cb;
+		supportEdge(a, edgeA, n, pa, qa);
+		supportEdge(b, edgeB, -n, pb, qb);
+		closestPointsSegments(pa, qa, pb, qb, ca, cb);
+		manifold.points[0].positionWorld = 0.5f * (ca + cb);
+		manifold.points[0].depth = depth;
+		manifold.numPoints = 1;
+	}
+	return manifold.numPoints > 0;
+}
+
+
+float boxSeparation(const Box& a, const Box& b)
+{
+	const Vec3& ea = a.halfExtents;
+	const Vec3& eb = b.halfExtents;
+	const Vec3 d = b.center - a.center;
+
+	// as in collideBoxes(); the epsilon in absR only makes the separations smaller
+	float R[3][3];
+	float absR[3][3];
+	float ta[3];
+	float tb[3];
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			R[i][j] = dot(a.axes[i], b.axes[j]);
+			absR[i][j] = std::fabs(R[i][j]) + kParallelEpsilon;
+		}
+		ta[i] = dot(d, a.axes[i]);
+		tb[i] = dot(d, b.axes[i]);
+	}
+
+	float separation = -FLT_MAX;
+	for (int i = 0; i < 3; i++)
+	{
+		separation = std::max(separation, std::fabs(ta[i]) - ea[i] - eb[0] * absR[i][0] - eb[1] * absR[i][1] - eb[2] * absR[i][2]);
+	}
+	for (int j = 0; j < 3; j++)
+	{
+		separation = std::max(separation, std::fabs(tb[j]) - ea[0] * absR[0][j] - ea[1] * absR[1][j] - ea[2] * absR[2][j] - eb[j]);
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		const int i1 = (i + 1) % 3;
+		const int i2 = (i + 2) % 3;
+		for (int j = 0; j < 3; j++)
+		{
+			const int j1 = (j + 1) % 3;
+			const int j2 = (j + 2) % 3;
+			float axisLengthSq = 1.f - R[i][j] * R[i][j];
+			if (axisLengthSq < kMinEdgeAxisLengthSq) { continue; }
+			float ra = ea[i1] * absR[i2][j] + ea[i2] * absR[i1][j];
+			float rb = eb[j1] * absR[i][j2] + eb[j2] * absR[i][j1];
+			float distance = std::fabs(ta[i2] * R[i1][j] - ta[i1] * R[i2][j]);
+			separation = std::max(separation, (distance - ra - rb) / std::sqrt(axisLengthSq));
+		}
+	}
+	return separation;
+}
+
+
+bool segmentEntersBox(const Vec3& p, const Vec3& q, const Box& box, float& t, Vec3& normal)
+{
+	// clip [0, 1] against the three slabs; the last slab entered is the entry face
+	const Vec3 dp = p - box.center;
+	const Vec3 dir = q - p;
+	float tEnter = 0.f, tExit = 1.f;
+	int enterAxis = -1;
+	float enterSign = 0.f;
+	for (int k = 0; k < 3; k++)
+	{
+		const float start = dot(dp, box.axes[k]);
+		const float speed = dot(dir, box.axes[k]);
+		const float h = box.halfExtents[k];
+		if (speed == 0.f)
+		{
+			if (std::fabs(start) > h) { return false; }
+			continue;
+		}
+		float t0 = (-h - start) / speed;
+		float t1 = (h - start) / speed;
+		float sign = -1.f;  // entering through the -h face while moving along +axis
+		if (t0 > t1)
+		{
+			std::swap(t0, t1);
+			sign = 1.f;
+		}
+		if (t0 > tEnter)
+		{
+			tEnter = t0;
+			enterAxis = k;
+			enterSign = sign;
+		}
+		tExit = std::min(tExit, t1);
+		if (tEnter > tExit) { return false; }
+	}
+	if (enterAxis < 0)
+	{
+		return false;  // starts inside
+	}
+	t = tEnter;
+	normal = enterSign * box.axes[enterAxis];
+	return true;
+}
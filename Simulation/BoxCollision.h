@@ -0,0 +1,63 @@
+#ifndef __BoxCollision_h__
+#define __BoxCollision_h__
+
+#include "Vec3.h"
+
+
+// Oriented box: centre, unit axes and half edge lengths, all in world space
+struct Box
+{
+	Vec3 center;
+	Vec3 axes[3];
+	Vec3 halfExtents;
+
+	Box() { axes[0] = Vec3(1.f, 0.f, 0.f); axes[1] = Vec3(0.f, 1.f, 0.f); axes[2] = Vec3(0.f, 0.f, 1.f); }
+
+	// Box of edge lengths xlen, ylen, zlen under a rigid object to world transform
+	// in row vector convention (DirectX: rows 0 - 2 are the transformed object
+	// axes, row 3 is the translation), the layout checkCollision() takes
+	static Box fromTransform(const float obj2World[4][4], float xlen, float ylen, float zlen);
+
+	Vec3 corner(int i) const;  // i = 0..7, bit k set: + axes[k]
+};
+
+
+struct ContactPoint
+{
+	Vec3  positionWorld; // halfway between the two surfaces
+	float depth;         // penetration along the manifold normal, >= 0
+};
+
+// Contacts between two boxes A and B. All points share one normal.
+struct ContactManifold
+{
+	Vec3 normalWorld;      // unit direction of the impulse to A (from B towards A)
+	int  numPoints;        // 0 = no collision
+	ContactPoint points[4];
+
+	ContactManifold() : numPoints(0) {}
+};
+
+
+// Separating axis test over all 15 axes (3 face normals of each box and the 9
+// edge cross products). If no axis separates the boxes, the axis of least
+// penetration gives the normal. For a face axis the incident face of the other
+// box is clipped against the side planes of the reference face (up to 8 points,
+// reduced to the deepest 4 spanning the largest area); for an edge axis the
+// closest points of the two edges give a single contact.
+// Returns true and fills manifold if the boxes overlap.
+bool collideBoxes(const Box& a, const Box& b, ContactManifold& manifold);
+
+// Largest distance between the projections of a and b onto any of the 15 axes
+// of collideBoxes(); < 0 if they overlap. Never more than the true distance of
+// the boxes, so it is safe for conservative advancement.
+float boxSeparation(const Box& a, const Box& b);
+
+// Swept test of the segment p -> q against box (slabs in box space). Returns
+// true if the segment enters the box, with the entry point p + t (q - p),
+// t in [0, 1], and the outward normal of the face it enters through. A segment
+// starting inside the box does not enter it.
+bool segmentEntersBox(const Vec3& p, const Vec3& q, const Box& box, float& t, Vec3& normal);
+
+
+#endif
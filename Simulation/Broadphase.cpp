@@ -0,0 +1,514 @@
+#include "Broadphase.h"
+
+#include <algorithm>
+#include <iterator>
+
+
+Aabb boxBounds(const Box& box)
+{
+	// half size along world axis k: sum of the projections of the half edges
+	Aabb bounds;
+	for (int k = 0; k < 3; k++)
+	{
+		float extent = std::fabs(box.axes[0][k]) * box.halfExtents[0]
+		             + std::fabs(box.axes[1][k]) * box.halfExtents[1]
+		             + std::fabs(box.axes[2][k]) * box.halfExtents[2];
+		bounds.lower[k] = box.center[k] - extent;
+		bounds.upper[k] = box.center[k] + extent;
+	}
+	return bounds;
+}
+
+
+void computeBoxBounds(const BoxArrays& boxes, std::vector<Aabb>& bounds)
+{
+	const size_t n = boxes.size();
+	bounds.resize(n);
+	for (int k = 0; k < 3; k++)
+	{
+		const float* center = boxes.center[k].data();
+		const float* a0 = boxes.axes[0][k].data();
+		const float* a1 = boxes.axes[1][k].data();
+		const float* a2 = boxes.axes[2][k].data();
+		const float* h0 = boxes.halfExtents[0].data();
+		const float* h1 = boxes.halfExtents[1].data();
+		const float* h2 = boxes.halfExtents[2].data();
+		for (size_t i = 0; i < n; i++)
+		{
+			float extent = std::fabs(a0[i]) * h0[i] + std::fabs(a1[i]) * h1[i] + std::fabs(a2[i]) * h2[i];
+			bounds[i].lower[k] = center[i] - extent;
+			bounds[i].upper[k] = center[i] + extent;
+		}
+	}
+}
+
+
+namespace
+{
+	bool pairLess(const BoxPair& p, const BoxPair& q)
+	{
+		return p.a < q.a || (p.a == q.a && p.b < q.b);
+	}
+
+	BoxPair makePair(uint32_t i, uint32_t j)
+	{
+		BoxPair pair;
+		pair.a = i < j ? i : j;
+		pair.b = i < j ? j : i;
+		return pair;
+	}
+
+	Aabb merge(const Aabb& a, const Aabb& b)
+	{
+		Aabb r;
+		r.lower = Vec3(std::min(a.lower.x, b.lower.x), std::min(a.lower.y, b.lower.y), std::min(a.lower.z, b.lower.z));
+		r.upper = Vec3(std::max(a.upper.x, b.upper.x), std::max(a.upper.y, b.upper.y), std::max(a.upper.z, b.upper.z));
+		return r;
+	}
+
+	// half the surface area, the insertion cost of the tree
+	float area(const Aabb& a)
+	{
+		Vec3 d = a.upper - a.lower;
+		return d.x * d.y + d.y * d.z + d.z * d.x;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// SweepAndPrune
+//--------------------------------------------------------------------------------------
+
+void SweepAndPrune::update(const std::vector<Aabb>& bounds)
+{
+	m_swaps = 0;
+	if (bounds.size() * 2 != m_endpoints[0].size())
+	{
+		rebuild(bounds);
+		return;
+	}
+
+	m_added.clear();
+	m_removed.clear();
+	for (int axis = 0; axis < 3; axis++)
+	{
+		sortAxis(axis, bounds);
+	}
+	if (m_added.empty() && m_removed.empty())
+	{
+		return;
+	}
+
+	// m_pairs = (m_pairs - removed) + added. A pair can be reported on more
+	// than one axis, and only pairs that are in the list can be removed.
+	std::sort(m_added.begin(), m_added.end(), pairLess);
+	m_added.erase(std::unique(m_added.begin(), m_added.end(), [](const BoxPair& p, const BoxPair& q)
+	{
+		return p.a == q.a && p.b == q.b;
+	}), m_added.end());
+	std::sort(m_removed.begin(), m_removed.end(), pairLess);
+
+	m_merged.clear();
+	std::set_difference(m_pairs.begin(), m_pairs.end(), m_removed.begin(), m_removed.end(), std::back_inserter(m_merged), pairLess);
+	m_pairs.clear();
+	std::set_union(m_merged.begin(), m_merged.end(), m_added.begin(), m_added.end(), std::back_inserter(m_pairs), pairLess);
+}
+
+
+void SweepAndPrune::rebuild(const std::vector<Aabb>& bounds)
+{
+	const uint32_t n = (uint32_t)bounds.size();
+	for (int axis = 0; axis < 3; axis++)
+	{
+		std::vector<Endpoint>& endpoints = m_endpoints[axis];
+		endpoints.resize(2 * n);
+		for (uint32_t i = 0; i < n; i++)
+		{
+			endpoints[2 * i].value = bounds[i].lower[axis];
+			endpoints[2 * i].data = i << 1;
+			endpoints[2 * i + 1].value = bounds[i].upper[axis];
+			endpoints[2 * i + 1].data = (i << 1) | 1;
+		}
+		// lower bounds first on ties, so that touching proxies overlap as in overlaps()
+		std::sort(endpoints.begin(), endpoints.end(), [](const Endpoint& e, const Endpoint& f)
+		{
+			return e.value < f.value || (e.value == f.value && !e.isUpper() && f.isUpper());
+		});
+	}
+
+	// sweep along x: every proxy against the ones starting before it ends
+	m_pairs.clear();
+	m_added.clear();
+	std::vector<uint32_t> open;
+	std::vector<uint32_t> openIndex(n);
+	const std::vector<Endpoint>& endpoints = m_endpoints[0];
+	for (size_t e = 0; e < endpoints.size(); e++)
+	{
+		const uint32_t i = endpoints[e].proxy();
+		if (endpoints[e].isUpper())
+		{
+			// swap with the last open proxy, the order doesn't matter
+			const uint32_t k = openIndex[i];
+			open[k] = open.back();
+			openIndex[open[k]] = k;
+			open.pop_back();
+			continue;
+		}
+		for (size_t k = 0; k < open.size(); k++)
+		{
+			if (overlaps(bounds[i], bounds[open[k]]))
+			{
+				m_pairs.push_back(makePair(i, open[k]));
+			}
+		}
+		openIndex[i] = (uint32_t)open.size();
+		open.push_back(i);
+	}
+	std::sort(m_pairs.begin(), m_pairs.end(), pairLess);
+}
+
+
+void SweepAndPrune::sortAxis(int axis, const std::vector<Aabb>& bounds)
+{
+	std::vector<Endpoint>& endpoints = m_endpoints[axis];
+	for (size_t e = 0; e < endpoints.size(); e++)
+	{
+		const Aabb& box = bounds[endpoints[e].proxy()];
+		endpoints[e].value = endpoints[e].isUpper() ? box.upper[axis] : box.lower[axis];
+	}
+
+	for (size_t e = 1; e < endpoints.size(); e++)
+	{
+		const Endpoint moving = endpoints[e];
+		size_t m = e;
+		while (m > 0)
+		{
+			const Endpoint& other = endpoints[m - 1];
+			bool after = other.value > moving.value || (other.value == moving.value && other.isUpper() && !moving.isUpper());
+			if (!after)
+			{
+				break;
+			}
+
+			// a lower bound passing an upper bound may start an overlap, an
+			// upper bound passing a lower bound ends one
+			if (!moving.isUpper() && other.isUpper())
+			{
+				if (overlaps(bounds[moving.proxy()], bounds[other.proxy()]))
+				{
+					m_added.push_back(makePair(moving.proxy(), other.proxy()));
+				}
+			}
+			else if (moving.isUpper() && !other.isUpper())
+			{
+				m_removed.push_back(makePair(moving.proxy(), other.proxy()));
+			}
+
+			endpoints[m] = other;
+			m--;
+		}
+		m_swaps += e - m;
+		endpoints[m] = moving;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// DynamicAabbTree
+//--------------------------------------------------------------------------------------
+
+DynamicAabbTree::DynamicAabbTree(float margin)
+	: m_margin(margin)
+	, m_root(-1)
+	, m_freeList(-1)
+{
+}
+
+
+void DynamicAabbTree::update(const std::vector<Aabb>& bounds)
+{
+	const size_t n = bounds.size();
+	const Vec3 margin(m_margin, m_margin, m_margin);
+	m_moved.clear();
+
+	// proxies that no longer exist
+	if (m_leaves.size() > n)
+	{
+		for (size_t i = n; i < m_leaves.size(); i++)
+		{
+			removeLeaf(m_leaves[i]);
+			freeNode(m_leaves[i]);
+		}
+		m_leaves.resize(n);
+		m_pairs.erase(std::remove_if(m_pairs.begin(), m_pairs.end(), [&](const BoxPair& pair)
+		{
+			return pair.b >= n;
+		}), m_pairs.end());
+	}
+
+	// reinsert the proxies that left their fat bounds
+	const size_t existing = m_leaves.size();
+	for (size_t i = 0; i < existing; i++)
+	{
+		const int32_t leaf = m_leaves[i];
+		if (!contains(m_nodes[leaf].box, bounds[i]))
+		{
+			removeLeaf(leaf);
+			m_nodes[leaf].box.lower = bounds[i].lower - margin;
+			m_nodes[leaf].box.upper = bounds[i].upper + margin;
+			insertLeaf(leaf);
+			m_moved.push_back((uint32_t)i);
+		}
+	}
+
+	// new proxies
+	for (size_t i = existing; i < n; i++)
+	{
+		const int32_t leaf = allocateNode();
+		m_nodes[leaf].box.lower = bounds[i].lower - margin;
+		m_nodes[leaf].box.upper = bounds[i].upper + margin;
+		m_nodes[leaf].height = 0;
+		m_nodes[leaf].proxy = (uint32_t)i;
+		insertLeaf(leaf);
+		m_leaves.push_back(leaf);
+		m_moved.push_back((uint32_t)i);
+	}
+
+	if (m_moved.empty())
+	{
+		return;
+	}
+
+	// pairs with a reinserted proxy are found again, all others are unchanged
+	m_isMoved.assign(n, 0);
+	for (size_t k = 0; k < m_moved.size(); k++)
+	{
+		m_isMoved[m_moved[k]] = 1;
+	}
+	m_pairs.erase(std::remove_if(m_pairs.begin(), m_pairs.end(), [&](const BoxPair& pair)
+	{
+		return m_isMoved[pair.a] || m_isMoved[pair.b];
+	}), m_pairs.end());
+
+	m_newPairs.clear();
+	for (size_t k = 0; k < m_moved.size(); k++)
+	{
+		const uint32_t i = m_moved[k];
+		query(m_nodes[m_leaves[i]].box, [&](uint32_t j)
+		{
+			// a pair of two reinserted proxies is added by the smaller one
+			if (j == i || (m_isMoved[j] && j < i))
+			{
+				return;
+			}
+			m_newPairs.push_back(makePair(i, j));
+		});
+	}
+	std::sort(m_newPairs.begin(), m_newPairs.end(), pairLess);
+
+	const size_t kept = m_pairs.size();
+	m_pairs.insert(m_pairs.end(), m_newPairs.begin(), m_newPairs.end());
+	std::inplace_merge(m_pairs.begin(), m_pairs.begin() + kept, m_pairs.end(), pairLess);
+}
+
+
+int32_t DynamicAabbTree::allocateNode()
+{
+	int32_t node = m_freeList;
+	if (node < 0)
+	{
+		node = (int32_t)m_nodes.size();
+		m_nodes.push_back(Node());
+	}
+	else
+	{
+		m_freeList = m_nodes[node].parent;
+	}
+	m_nodes[node].parent = -1;
+	m_nodes[node].child1 = -1;
+	m_nodes[node].child2 = -1;
+	m_nodes[node].height = 0;
+	m_nodes[node].proxy = 0;
+	return node;
+}
+
+
+void DynamicAabbTree::freeNode(int32_t node)
+{
+	m_nodes[node].parent = m_freeList;
+	m_nodes[node].height = -1;
+	m_freeList = node;
+}
+
+
+void DynamicAabbTree::insertLeaf(int32_t leaf)
+{
+	if (m_root < 0)
+	{
+		m_root = leaf;
+		m_nodes[leaf].parent = -1;
+		return;
+	}
+
+	// descend to the sibling with the least increase of surface area
+	const Aabb leafBox = m_nodes[leaf].box;
+	int32_t index = m_root;
+	while (m_nodes[index].child1 >= 0)
+	{
+		const Node& node = m_nodes[index];
+		const float nodeArea = area(node.box);
+		const float combinedArea = area(merge(node.box, leafBox));
+
+		// cost of a new parent for this node and the leaf, and the cost
+		// the ancestors inherit when the leaf goes further down
+		const float cost = 2.f * combinedArea;
+		const float inheritanceCost = 2.f * (combinedArea - nodeArea);
+
+		float childCost[2];
+		const int32_t children[2] = { node.child1, node.child2 };
+		for (int c = 0; c < 2; c++)
+		{
+			const Node& child = m_nodes[children[c]];
+			float merged = area(merge(child.box, leafBox));
+			childCost[c] = (child.child1 < 0 ? merged : merged - area(child.box)) + inheritanceCost;
+		}
+
+		if (cost < childCost[0] && cost < childCost[1])
+		{
+			break;
+		}
+		index = childCost[0] < childCost[1] ? children[0] : children[1];
+	}
+	const int32_t sibling = index;
+
+	const int32_t newParent = allocateNode();
+	const int32_t oldParent = m_nodes[sibling].parent;
+	m_nodes[newParent].parent = oldParent;
+	m_nodes[newParent].box = merge(leafBox, m_nodes[sibling].box);
+	m_nodes[newParent].height = m_nodes[sibling].height + 1;
+	m_nodes[newParent].child1 = sibling;
+	m_nodes[newParent].child2 = leaf;
+	m_nodes[sibling].parent = newParent;
+	m_nodes[leaf].parent = newParent;
+	if (oldParent >= 0)
+	{
+		if (m_nodes[oldParent].child1 == sibling) { m_nodes[oldParent].child1 = newParent; }
+		else                                      { m_nodes[oldParent].child2 = newParent; }
+	}
+	else
+	{
+		m_root = newParent;
+	}
+
+	// refit and rebalance the ancestors
+	index = m_nodes[leaf].parent;
+	while (index >= 0)
+	{
+		index = balance(index);
+		Node& node = m_nodes[index];
+		node.height = 1 + std::max(m_nodes[node.child1].height, m_nodes[node.child2].height);
+		node.box = merge(m_nodes[node.child1].box, m_nodes[node.child2].box);
+		index = node.parent;
+	}
+}
+
+
+void DynamicAabbTree::removeLeaf(int32_t leaf)
+{
+	if (leaf == m_root)
+	{
+		m_root = -1;
+		return;
+	}
+
+	const int32_t parent = m_nodes[leaf].parent;
+	const int32_t grandParent = m_nodes[parent].parent;
+	const int32_t sibling = m_nodes[parent].child1 == leaf ? m_nodes[parent].child2 : m_nodes[parent].child1;
+
+	if (grandParent < 0)
+	{
+		m_root = sibling;
+		m_nodes[sibling].parent = -1;
+		freeNode(parent);
+		return;
+	}
+
+	// the sibling takes the parent's place
+	if (m_nodes[grandParent].child1 == parent) { m_nodes[grandParent].child1 = sibling; }
+	else                                       { m_nodes[grandParent].child2 = sibling; }
+	m_nodes[sibling].parent = grandParent;
+	freeNode(parent);
+
+	int32_t index = grandParent;
+	while (index >= 0)
+	{
+		index = balance(index);
+		Node& node = m_nodes[index];
+		node.height = 1 + std::max(m_nodes[node.child1].height, m_nodes[node.child2].height);
+		node.box = merge(m_nodes[node.child1].box, m_nodes[node.child2].box);
+		index = node.parent;
+	}
+}
+
+
+// AVL style rotation if the subtrees of iA differ in height by more than one.
+// Returns the index of the node now at iA's position.
+int32_t DynamicAabbTree::balance(int32_t iA)
+{
+	Node& A = m_nodes[iA];
+	if (A.child1 < 0 || A.height < 2)
+	{
+		return iA;
+	}
+
+	const int32_t iB = A.child1;
+	const int32_t iC = A.child2;
+	Node& B = m_nodes[iB];
+	Node& C = m_nodes[iC];
+	const int32_t difference = C.height - B.height;
+
+	// the higher child (C or B) becomes the parent of A
+	if (difference > 1 || difference < -1)
+	{
+		const bool rotateC = difference > 1;
+		const int32_t iUp = rotateC ? iC : iB;
+		const int32_t iStay = rotateC ? iB : iC;
+		Node& up = m_nodes[iUp];
+		const int32_t iF = up.child1;
+		const int32_t iG = up.child2;
+		Node& F = m_nodes[iF];
+		Node& G = m_nodes[iG];
+
+		up.child1 = iA;
+		up.parent = A.parent;
+		A.parent = iUp;
+		if (up.parent >= 0)
+		{
+			if (m_nodes[up.parent].child1 == iA) { m_nodes[up.parent].child1 = iUp; }
+			else                                 { m_nodes[up.parent].child2 = iUp; }
+		}
+		else
+		{
+			m_root = iUp;
+		}
+
+		// the higher grandchild stays with the rotated node, the other one moves to A
+		const bool keepF = F.height > G.height;
+		const int32_t iKeep = keepF ? iF : iG;
+		const int32_t iMove = keepF ? iG : iF;
+		up.child2 = iKeep;
+		if (rotateC) { A.child2 = iMove; }
+		else         { A.child1 = iMove; }
+		m_nodes[iMove].parent = iA;
+
+		const Node& stay = m_nodes[iStay];
+		const Node& move = m_nodes[iMove];
+		const Node& keep = m_nodes[iKeep];
+		A.box = merge(stay.box, move.box);
+		A.height = 1 + std::max(stay.height, move.height);
+		up.box = merge(A.box, keep.box);
+		up.height = 1 + std::max(A.height, keep.height);
+		return iUp;
+	}
+	return iA;
+}
@@ -0,0 +1,175 @@
+#ifndef __Broadphase_h__
+#define __Broadphase_h__
+
+#include <cstdint>
+#include <vector>
+
+#include "BoxBatchCollision.h"
+
+
+// Axis aligned bounding box
+struct Aabb
+{
+	Vec3 lower, upper;
+};
+
+inline bool overlaps(const Aabb& a, const Aabb& b)
+{
+	return a.lower.x <= b.upper.x && b.lower.x <= a.upper.x
+	    && a.lower.y <= b.upper.y && b.lower.y <= a.upper.y
+	    && a.lower.z <= b.upper.z && b.lower.z <= a.upper.z;
+}
+
+inline bool contains(const Aabb& outer, const Aabb& inner)
+{
+	return outer.lower.x <= inner.lower.x && outer.lower.y <= inner.lower.y && outer.lower.z <= inner.lower.z
+	    && inner.upper.x <= outer.upper.x && inner.upper.y <= outer.upper.y && inner.upper.z <= outer.upper.z;
+}
+
+// Bounds of an oriented box
+Aabb boxBounds(const Box& box);
+
+// bounds[i] = boxBounds(box i) for all boxes
+void computeBoxBounds(const BoxArrays& boxes, std::vector<Aabb>& bounds);
+
+
+// Finds the candidate pairs among a set of proxies for the narrow phase
+// (collideBoxPairsSimd(), collideBoxes(), checkCollisionSAT()). Proxy i is
+// box i; update() is called once per frame with the current bounds and
+// exploits that they change little from one frame to the next.
+class Broadphase
+{
+public:
+	virtual ~Broadphase() {}
+
+	// Bounds of proxies 0 .. bounds.size() - 1 for this frame. Proxies are
+	// added or removed at the end when the number changes.
+	virtual void update(const std::vector<Aabb>& bounds) = 0;
+
+	// Pairs (a < b, sorted) whose bounds overlapped in the last update()
+	virtual const std::vector<BoxPair>& pairs() const = 0;
+};
+
+
+// Incremental sweep and prune (Cohen et al., I-COLLIDE): the lower and upper
+// bounds of all proxies are kept sorted along each axis between frames and
+// repaired by insertion sort, which is close to linear when the proxies move
+// little. Two proxies can only start or stop overlapping when one of their
+// endpoints passes the other's on some axis, so the pair list is updated
+// from these swaps alone. When the number of proxies changes, everything is
+// sorted and swept again from scratch.
+class SweepAndPrune : public Broadphase
+{
+public:
+	SweepAndPrune() {}
+
+	void update(const std::vector<Aabb>& bounds);
+	const std::vector<BoxPair>& pairs() const { return m_pairs; }
+
+	// Endpoint swaps done by the insertion sorts of the last update()
+	size_t swapsLastUpdate() const { return m_swaps; }
+
+private:
+	struct Endpoint
+	{
+		float value;
+		uint32_t data;  // proxy << 1 | 1 for upper bounds
+
+		uint32_t proxy() const { return data >> 1; }
+		bool isUpper() const { return (data & 1) != 0; }
+	};
+
+	void rebuild(const std::vector<Aabb>& bounds);
+	void sortAxis(int axis, const std::vector<Aabb>& bounds);
+
+	std::vector<Endpoint> m_endpoints[3];
+	std::vector<BoxPair> m_pairs;
+	std::vector<BoxPair> m_added;    // pairs found by the swaps of this update
+	std::vector<BoxPair> m_removed;
+	std::vector<BoxPair> m_merged;
+	size_t m_swaps;
+};
+
+
+// Dynamic bounding volume tree (as in Box2D's b2DynamicTree). Leaves store
+// bounds fattened by a margin, so a proxy is only reinserted when its bounds
+// leave the fat bounds. Pairs between proxies that were not reinserted can't
+// have changed, so update() only queries the tree for the reinserted ones and
+// keeps all other pairs. The pairs are those of overlapping fat bounds, a
+// superset of the exact overlaps.
+class DynamicAabbTree : public Broadphase
+{
+public:
+	explicit DynamicAabbTree(float margin = 0.1f);
+
+	void update(const std::vector<Aabb>& bounds);
+	const std::vector<BoxPair>& pairs() const { return m_pairs; }
+
+	// Call callback(proxy) for every proxy whose fat bounds overlap box
+	template <typename Callback>
+	void query(const Aabb& box, Callback callback) const;
+
+	float margin() const { return m_margin; }
+	int height() const { return m_root < 0 ? 0 : m_nodes[m_root].height; }
+	size_t reinsertedLastUpdate() const { return m_moved.size(); }
+
+private:
+	struct Node
+	{
+		Aabb    box;
+		int32_t parent;   // next free node while on the free list
+		int32_t child1;   // -1 for leaves
+		int32_t child2;
+		int32_t height;   // 0 for leaves, -1 for free nodes
+		uint32_t proxy;
+	};
+
+	int32_t allocateNode();
+	void freeNode(int32_t node);
+	void insertLeaf(int32_t leaf);
+	void removeLeaf(int32_t leaf);
+	int32_t balance(int32_t node);
+
+	float m_margin;
+	int32_t m_root;
+	int32_t m_freeList;
+	std::vector<Node> m_nodes;
+	std::vector<int32_t> m_leaves;   // leaf node of every proxy
+	std::vector<uint32_t> m_moved;   // proxies reinserted in this update
+	std::vector<uint8_t> m_isMoved;
+	std::vector<BoxPair> m_pairs;
+	std::vector<BoxPair> m_newPairs;
+	mutable std::vector<int32_t> m_stack;
+};
+
+
+template <typename Callback>
+void DynamicAabbTree::query(const Aabb& box, Callback callback) const
+{
+	if (m_root < 0)
+	{
+		return;
+	}
+	m_stack.clear();
+	m_stack.push_back(m_root);
+	while (!m_stack.empty())
+	{
+		const Node& node = m_nodes[m_stack.back()];
+		m_stack.pop_back();
+		if (!overlaps(node.box, box))
+		{
+			continue;
+		}
+		if (node.child1 < 0)
+		{
+			callback(node.proxy);
+		}
+		else
+		{
+			m_stack.push_back(node.child1);
+			m_stack.push_back(node.child2);
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef __FunctionRef_h__
+#define __FunctionRef_h__
+
+#include <type_traits>
+#include <utility>
+
+
+// Non-owning reference to a callable, for the loop bodies of ThreadPool and
+// ForceModel. A std::function copies the callable and puts it on the heap
+// once it is larger than its small buffer, which the [&] lambdas of the
+// simulation loops often are, so every loop of a step allocated. This only
+// keeps a pointer to the callable and one to a function calling it: it never
+// allocates, and is valid as long as the callable is (the duration of the
+// call it is passed to).
+template <typename Signature>
+class FunctionRef;
+
+template <typename R, typename... Args>
+class FunctionRef<R(Args...)>
+{
+public:
+	template <typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, FunctionRef>::value>::type>
+	FunctionRef(F&& f)
+		: m_callable((void*)&f), m_call(&call<typename std::remove_reference<F>::type>) {}
+
+	R operator()(Args... args) const { return m_call(m_callable, std::forward<Args>(args)...); }
+
+private:
+	template <typename F>
+	static R call(void* callable, Args... args)
+	{
+		return (*(F*)callable)(std::forward<Args>(args)...);
+	}
+
+	void* m_callable;
+	R (*m_call)(void*, Args...);
+};
+
+#endif
@@ -0,0 +1,316 @@
+#include "ImplicitSolver.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "MassSpringSystem.h"
+#include "Profiler.h"
+
+
+namespace
+{
+	// points/springs per parallel chunk; also the granularity of the partial dot products
+	const size_t kGrain = 4096;
+
+	size_t numChunks(size_t count) { return (count + kGrain - 1) / kGrain; }
+}
+
+
+double ImplicitEulerSolver::sumChunks(const std::vector<double>& partial, size_t count) const
+{
+	double sum = 0.0;
+	for (size_t c = 0; c < numChunks(count); c++)
+	{
+		sum += partial[c];
+	}
+	return sum;
+}
+
+
+void ImplicitEulerSolver::setTopology(const MassSpringSystem& ms)
+{
+	const std::vector<Spring>& springs = ms.m_springs;
+	const size_t n = ms.numPoints();
+
+	buildPointSpringAdjacency(n, springs, m_pointSpringOffsets, m_pointSprings);
+
+	// matrix pattern: the diagonal plus every point connected by a spring
+	std::vector<uint32_t> rowOffsets(n + 1, 0);
+	std::vector<uint32_t> columns;
+	columns.reserve(n + m_pointSprings.size());
+	std::vector<uint32_t> row;
+	for (size_t i = 0; i < n; i++)
+	{
+		row.clear();
+		row.push_back((uint32_t)i);
+		for (uint32_t k = m_pointSpringOffsets[i]; k < m_pointSpringOffsets[i + 1]; k++)
+		{
+			const Spring& spring = springs[m_pointSprings[k] >> 1];
+			row.push_back((m_pointSprings[k] & 1) ? spring.point1 : spring.point2);
+		}
+		std::sort(row.begin(), row.end());
+		row.erase(std::unique(row.begin(), row.end()), row.end());
+
+		columns.insert(columns.end(), row.begin(), row.end());
+		rowOffsets[i + 1] = (uint32_t)columns.size();
+	}
+	m_matrix.setPattern(rowOffsets, columns);
+
+	// block indices, so that assembling does not have to search the pattern
+	m_diagonalBlocks.resize(n);
+	m_neighbourBlocks.resize(m_pointSprings.size());
+	for (size_t i = 0; i < n; i++)
+	{
+		m_diagonalBlocks[i] = (uint32_t)m_matrix.findBlock((uint32_t)i, (uint32_t)i);
+		for (uint32_t k = m_pointSpringOffsets[i]; k < m_pointSpringOffsets[i + 1]; k++)
+		{
+			const Spring& spring = springs[m_pointSprings[k] >> 1];
+			uint32_t other = (m_pointSprings[k] & 1) ? spring.point1 : spring.point2;
+			m_neighbourBlocks[k] = (uint32_t)m_matrix.findBlock((uint32_t)i, other);
+		}
+	}
+
+	m_springForces.resize(springs.size());
+	m_springStiffness.resize(springs.size());
+	m_preconditioner.resize(n);
+	m_b.resize(n);
+	m_r.resize(n);
+	m_z.resize(n);
+	m_p.resize(n);
+	m_Ap.resize(n);
+	m_partial0.assign(numChunks(n), 0.0);
+	m_partial1.assign(numChunks(n), 0.0);
+	m_partial2.assign(numChunks(n), 0.0);
+	m_multigridValid = false;
+}
+
+
+double ImplicitEulerSolver::applyMultigrid(ThreadPool* pool)
+{
+	m_multigrid.vcycle(m_matrix, m_r.data(), m_z.data(), pool);
+	parallelFor(pool, m_r.size(), kGrain, [&](size_t begin, size_t end)
+	{
+		double rz = 0.0;
+		for (size_t i = begin; i < end; i++)
+		{
+			rz += dot(m_r[i], m_z[i]);
+		}
+		m_partial0[begin / kGrain] = rz;
+	});
+	return sumChunks(m_partial0, m_r.size());
+}
+
+
+void ImplicitEulerSolver::step(MassSpringSystem& ms, float timeStep, ThreadPool* pool)
+{
+	PROFILE_ZONE("Implicit solve");
+	const std::vector<Spring>& springs = ms.m_springs;
+	const std::vector<float>& invMasses = ms.m_invMasses;
+	const std::vector<uint8_t>& fixed = ms.m_fixed;
+	std::vector<Vec3>& x = ms.m_positions;
+	std::vector<Vec3>& v = ms.m_velocities;
+	const size_t n = ms.numPoints();
+
+	const float h = timeStep;
+	const float damping = ms.m_params.damping;
+	const Vec3 gravity = ms.m_params.gravity;
+
+	// 1. force and h^2 * stiffness matrix of every spring at the current positions
+	parallelFor(pool, springs.size(), kGrain, [&](size_t begin, size_t end)
+	{
+		for (size_t s = begin; s < end; s++)
+		{
+			const Spring& spring = springs[s];
+			Vec3 diff = x[spring.point1] - x[spring.point2];
+			float curr_length = length(diff);
+			if (curr_length <= 0.f)
+			{
+				m_springForces[s] = Vec3(0.f, 0.f, 0.f);
+				m_springStiffness[s].setZero();
+				continue;
+			}
+			float springForce = (-1 * spring.stiffness) * (curr_length - spring.org_length);
+			m_springForces[s] = diff * (springForce / curr_length);
+
+			// df(point1)/dx(point1) = -k * (d d^T + (1 - L / l) * (I - d d^T)), d = diff / l.
+			// The second term is dropped for compressed springs, it would make the
+			// matrix indefinite and CG requires a positive definite one.
+			Vec3 dir = diff * (1.f / curr_length);
+			float c = std::max(1.f - spring.org_length / curr_length, 0.f);
+			Mat3 K = Mat3::identity(c) + Mat3::outer(dir, dir) * (1.f - c);
+			m_springStiffness[s] = K * (h * h * spring.stiffness);
+		}
+	});
+
+	// 2. assemble A = M - h * df/dv - h^2 * df/dx and b = M * v + h * f row by row.
+	// Rows and columns of fixed points are replaced by the identity (v' = v).
+	std::vector<Mat3>& blocks = m_matrix.m_blocks;
+	parallelFor(pool, n, kGrain, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			for (uint32_t k = m_matrix.m_rowOffsets[i]; k < m_matrix.m_rowOffsets[i + 1]; k++)
+			{
+				blocks[k].setZero();
+			}
+			Mat3& diag = blocks[m_diagonalBlocks[i]];
+
+			if (fixed[i])
+			{
+				diag = Mat3::identity();
+				m_b[i] = v[i];
+				m_preconditioner[i] = Mat3::identity();
+				ms.m_forces[i] = Vec3(0.f, 0.f, 0.f);
+				continue;
+			}
+
+			// damping acts once per spring of the point, as in the explicit integrators
+			const float mass = 1.f / invMasses[i];
+			const uint32_t numSprings = m_pointSpringOffsets[i + 1] - m_pointSpringOffsets[i];
+			diag = Mat3::identity(mass + h * damping * numSprings);
+
+			Vec3 f = mass * gravity;
+			Vec3 b = mass * v[i];
+			for (uint32_t k = m_pointSpringOffsets[i]; k < m_pointSpringOffsets[i + 1]; k++)
+			{
+				uint32_t entry = m_pointSprings[k];
+				const Spring& spring = springs[entry >> 1];
+				const Mat3& K = m_springStiffness[entry >> 1];
+				uint32_t other = (entry & 1) ? spring.point1 : spring.point2;
+
+				if (entry & 1) { f -= m_springForces[entry >> 1]; }
+				else           { f += m_springForces[entry >> 1]; }
+
+				diag += K;
+				if (fixed[other])
+				{
+					b += K * v[other];	// known velocity moved to the right hand side
+				}
+				else
+				{
+					blocks[m_neighbourBlocks[k]] -= K;
+				}
+			}
+
+			m_b[i] = b + h * f;
+			m_preconditioner[i] = diag.inverse();
+			ms.m_forces[i] = f - (damping * numSprings) * v[i];
+		}
+	});
+
+	// the multigrid levels follow the pattern and the fixed points, their
+	// matrices the blocks of every step
+	const bool multigrid = ms.m_params.cgMultigrid;
+	if (multigrid)
+	{
+		if (!m_multigridValid || m_multigridFixed != fixed)
+		{
+			m_multigrid.setPattern(m_matrix, fixed);
+			m_multigridFixed = fixed;
+			m_multigridValid = true;
+		}
+		m_multigrid.update(m_matrix, pool);
+	}
+
+	// 3. preconditioned CG, starting from the current velocities
+	parallelFor(pool, n, kGrain, [&](size_t begin, size_t end)
+	{
+		m_matrix.multiply(v.data(), m_Ap.data(), begin, end);
+		double rz = 0.0, rr = 0.0, bb = 0.0;
+		for (size_t i = begin; i < end; i++)
+		{
+			m_r[i] = m_b[i] - m_Ap[i];
+			if (!multigrid)
+			{
+				m_z[i] = m_preconditioner[i] * m_r[i];
+				rz += dot(m_r[i], m_z[i]);
+			}
+			rr += dot(m_r[i], m_r[i]);
+			bb += dot(m_b[i], m_b[i]);
+		}
+		m_partial0[begin / kGrain] = rz;
+		m_partial1[begin / kGrain] = rr;
+		m_partial2[begin / kGrain] = bb;
+	});
+	double rz = sumChunks(m_partial0, n);
+	double rr = sumChunks(m_partial1, n);
+	const double bb = sumChunks(m_partial2, n);
+	if (multigrid)
+	{
+		rz = applyMultigrid(pool);
+	}
+	m_p = m_z;
+	const double tolerance = (double)ms.m_params.cgTolerance;
+
+	int iteration = 0;
+	for (; iteration < ms.m_params.cgMaxIterations; iteration++)
+	{
+		if (rr <= tolerance * tolerance * bb)
+		{
+			break;
+		}
+
+		parallelFor(pool, n, kGrain, [&](size_t begin, size_t end)
+		{
+			m_matrix.multiply(m_p.data(), m_Ap.data(), begin, end);
+			double pAp = 0.0;
+			for (size_t i = begin; i < end; i++)
+			{
+				pAp += dot(m_p[i], m_Ap[i]);
+			}
+			m_partial0[begin / kGrain] = pAp;
+		});
+		const double pAp = sumChunks(m_partial0, n);
+		if (pAp <= 0.0)
+		{
+			break;
+		}
+
+		const float alpha = (float)(rz / pAp);
+		parallelFor(pool, n, kGrain, [&](size_t begin, size_t end)
+		{
+			double rzChunk = 0.0, rrChunk = 0.0;
+			for (size_t i = begin; i < end; i++)
+			{
+				v[i] += alpha * m_p[i];
+				m_r[i] -= alpha * m_Ap[i];
+				if (!multigrid)
+				{
+					m_z[i] = m_preconditioner[i] * m_r[i];
+					rzChunk += dot(m_r[i], m_z[i]);
+				}
+				rrChunk += dot(m_r[i], m_r[i]);
+			}
+			m_partial0[begin / kGrain] = rzChunk;
+			m_partial1[begin / kGrain] = rrChunk;
+		});
+		rr = sumChunks(m_partial1, n);
+		// no V-cycle once converged, the loop stops anyway
+		const bool precondition = multigrid && rr > tolerance * tolerance * bb;
+		const double rzNew = precondition ? applyMultigrid(pool) : sumChunks(m_partial0, n);
+
+		const float beta = (float)(rzNew / rz);
+		rz = rzNew;
+		parallelFor(pool, n, kGrain, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				m_p[i] = m_z[i] + beta * m_p[i];
+			}
+		});
+	}
+
+	m_lastIterations = iteration;
+	PROFILE_COUNT("CG iterations", iteration);
+	m_lastResidual = bb > 0.0 ? (float)std::sqrt(rr / bb) : 0.f;
+
+	// 4. x' = x + h * v'
+	parallelFor(pool, n, kGrain, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			if (fixed[i]) { continue; }
+			x[i] += h * v[i];
+		}
+	});
+}
@@ -0,0 +1,88 @@
+#ifndef __ImplicitSolver_h__
+#define __ImplicitSolver_h__
+
+#include <cstdint>
+#include <vector>
+
+#include "BlockSparseMatrix.h"
+#include "Multigrid.h"
+
+class MassSpringSystem;
+class ThreadPool;
+
+
+// Backward Euler step for a MassSpringSystem (Baraff & Witkin, "Large Steps in
+// Cloth Simulation"). The forces are linearised around the current state and
+//   (M - h * df/dv - h^2 * df/dx) * v' = M * v + h * (f_spring + f_gravity)
+// is solved for the new velocities v' with a conjugate gradient method using a
+// block Jacobi preconditioner, followed by x' = x + h * v'.
+// The system matrix has one 3x3 block per point and per connected pair of
+// points; its pattern is built by setTopology() and reused by every step().
+// With MassSpringParams::cgMultigrid a multigrid V-cycle over the coarsened
+// spring graph (see Multigrid.h) replaces the block Jacobi preconditioner,
+// which carries the corrections across large cloths in a few iterations.
+class ImplicitEulerSolver
+{
+public:
+	ImplicitEulerSolver() : m_lastIterations(0), m_lastResidual(0.f), m_multigridValid(false) {}
+
+	// Build the matrix pattern and the per point spring lists of ms.
+	// Has to be called again whenever points or springs are added or removed.
+	void setTopology(const MassSpringSystem& ms);
+
+	// Advance ms by one backward Euler step, using ms.m_params for damping,
+	// gravity and the CG settings. pool may be null (single threaded).
+	// The result does not depend on the number of threads of the pool.
+	void step(MassSpringSystem& ms, float timeStep, ThreadPool* pool);
+
+	// CG iterations and relative residual |b - A * v'| / |b| of the last step()
+	int   m_lastIterations;
+	float m_lastResidual;
+
+	// system matrix and right hand side of the last step()
+	const BlockSparseMatrix& matrix() const { return m_matrix; }
+	const std::vector<Vec3>& rightHandSide() const { return m_b; }
+
+	// levels of the multigrid preconditioner (built by the first step() with it)
+	const MultigridHierarchy& multigrid() const { return m_multigrid; }
+
+private:
+	// Sum of partial[0 .. numChunks(count)) in chunk order
+	double sumChunks(const std::vector<double>& partial, size_t count) const;
+
+	// m_z = V-cycle applied to m_r, returns dot(m_r, m_z)
+	double applyMultigrid(ThreadPool* pool);
+
+	BlockSparseMatrix m_matrix;
+
+	// springs of every point (see buildPointSpringAdjacency()); m_neighbourBlocks[k]
+	// is the matrix block coupling the point to the other end of spring entry k
+	std::vector<uint32_t> m_pointSpringOffsets;
+	std::vector<uint32_t> m_pointSprings;
+	std::vector<uint32_t> m_neighbourBlocks;
+	std::vector<uint32_t> m_diagonalBlocks;
+
+	// per spring force on point1 and h^2 * stiffness matrix
+	std::vector<Vec3> m_springForces;
+	std::vector<Mat3> m_springStiffness;
+
+	// CG vectors: right hand side, residual, preconditioned residual, search direction, A * p
+	std::vector<Mat3> m_preconditioner;
+	std::vector<Vec3> m_b;
+	std::vector<Vec3> m_r;
+	std::vector<Vec3> m_z;
+	std::vector<Vec3> m_p;
+	std::vector<Vec3> m_Ap;
+
+	// multigrid preconditioner and the fixed points it was built for
+	MultigridHierarchy   m_multigrid;
+	std::vector<uint8_t> m_multigridFixed;
+	bool                 m_multigridValid;
+
+	// per chunk partial dot products
+	std::vector<double> m_partial0;
+	std::vector<double> m_partial1;
+	std::vector<double> m_partial2;
+};
+
+#endif
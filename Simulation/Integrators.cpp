@@ -0,0 +1,357 @@
+#include "Integrators.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+
+namespace
+{
+	const char* const kIntegratorNames[INTEGRATOR_COUNT] =
+	{
+		"euler", "midpoint", "verlet", "leapfrog", "rk4", "implicit", "xpbd"
+	};
+
+
+	// x' = x + h * v, v' = v + h * a(x, v)
+	class EulerIntegrator : public TimeIntegrator
+	{
+	public:
+		Integrator type() const { return INTEGRATOR_EULER; }
+
+		int step(ForceModel& model, std::vector<Vec3>& x, std::vector<Vec3>& v, float h)
+		{
+			m_a.resize(x.size());
+			model.computeAccelerations(x, v, m_a);
+			model.parallelFor(x.size(), [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					x[i] += h * v[i];
+					v[i] += h * m_a[i];
+				}
+			});
+			return 1;
+		}
+
+	private:
+		std::vector<Vec3> m_a;
+	};
+
+
+	// Evaluates the derivative at the half step (x + h/2 * v, v + h/2 * a)
+	// and takes the full step with it (steps on slide 71 of mass-spring slides)
+	class MidpointIntegrator : public TimeIntegrator
+	{
+	public:
+		Integrator type() const { return INTEGRATOR_MIDPOINT; }
+
+		int step(ForceModel& model, std::vector<Vec3>& x, std::vector<Vec3>& v, float h)
+		{
+			const size_t n = x.size();
+			const float half_h = h / 2.f;
+			m_a.resize(n);
+			m_xtmp.resize(n);
+			m_vtmp.resize(n);
+
+			model.computeAccelerations(x, v, m_a);
+			model.parallelFor(n, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					m_xtmp[i] = x[i] + half_h * v[i];
+					m_vtmp[i] = v[i] + half_h * m_a[i];
+				}
+			});
+
+			model.computeAccelerations(m_xtmp, m_vtmp, m_a);
+			model.parallelFor(n, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					x[i] += h * m_vtmp[i];
+					v[i] += h * m_a[i];
+				}
+			});
+			return 2;
+		}
+
+	private:
+		std::vector<Vec3> m_a;
+		std::vector<Vec3> m_xtmp;
+		std::vector<Vec3> m_vtmp;
+	};
+
+
+	// x' = x + h * v + h^2/2 * a, v' = v + h/2 * (a + a(x', v + h/2 * a)).
+	// The acceleration at the end of a step is reused at the start of the next
+	// one, so every step after the first costs a single evaluation.
+	class VelocityVerletIntegrator : public TimeIntegrator
+	{
+	public:
+		VelocityVerletIntegrator() : m_valid(false) {}
+
+		Integrator type() const { return INTEGRATOR_VELOCITY_VERLET; }
+
+		void reset() { m_valid = false; }
+
+		int step(ForceModel& model, std::vector<Vec3>& x, std::vector<Vec3>& v, float h)
+		{
+			const size_t n = x.size();
+			const float half_h = h / 2.f;
+			int evaluations = 0;
+
+			if (!m_valid || m_a.size() != n)
+			{
+				m_a.resize(n);
+				m_vhalf.resize(n);
+				model.computeAccelerations(x, v, m_a);
+				evaluations++;
+			}
+
+			model.parallelFor(n, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					m_vhalf[i] = v[i] + half_h * m_a[i];
+					x[i] += h * m_vhalf[i];
+				}
+			});
+
+			// the damping force is evaluated at the half step velocity
+			model.computeAccelerations(x, m_vhalf, m_a);
+			evaluations++;
+			model.parallelFor(n, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					v[i] = m_vhalf[i] + half_h * m_a[i];
+				}
+			});
+
+			m_valid = true;
+			return evaluations;
+		}
+
+	private:
+		bool m_valid;
+		std::vector<Vec3> m_a;
+		std::vector<Vec3> m_vhalf;
+	};
+
+
+	// Staggered leapfrog: the velocities live half a step ahead of the positions,
+	// v(t + h/2) = v(t - h/2) + h * a(x(t)), x(t + h) = x(t) + h * v(t + h/2).
+	// The first step after reset() only kicks by h/2 to set up the offset.
+	class LeapfrogIntegrator : public TimeIntegrator
+	{
+	public:
+		LeapfrogIntegrator() : m_started(false) {}
+
+		Integrator type() const { return INTEGRATOR_LEAPFROG; }
+
+		void reset() { m_started = false; }
+
+		int step(ForceModel& model, std::vector<Vec3>& x, std::vector<Vec3>& v, float h)
+		{
+			const size_t n = x.size();
+			if (m_a.size() != n)
+			{
+				m_a.resize(n);
+				m_started = false;
+			}
+
+			model.computeAccelerations(x, v, m_a);
+			const float kick = m_started ? h : h / 2.f;
+			model.parallelFor(n, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					v[i] += kick * m_a[i];
+					x[i] += h * v[i];
+				}
+			});
+
+			m_started = true;
+			return 1;
+		}
+
+	private:
+		bool m_started;
+		std::vector<Vec3> m_a;
+	};
+
+
+	// Classical 4th order Runge-Kutta
+	class RK4Integrator : public TimeIntegrator
+	{
+	public:
+		Integrator type() const { return INTEGRATOR_RK4; }
+
+		int step(ForceModel& model, std::vector<Vec3>& x, std::vector<Vec3>& v, float h)
+		{
+			const size_t n = x.size();
+			const float half_h = h / 2.f;
+			m_a.resize(n);
+			m_xs.resize(n);
+			m_vs.resize(n);
+			m_dx.resize(n);
+			m_dv.resize(n);
+
+			// k1
+			model.computeAccelerations(x, v, m_a);
+			model.parallelFor(n, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					m_dx[i] = v[i];
+					m_dv[i] = m_a[i];
+					m_xs[i] = x[i] + half_h * v[i];
+					m_vs[i] = v[i] + half_h * m_a[i];
+				}
+			});
+
+			// k2 and k3, each at the half step predicted by the previous stage
+			for (int stage = 0; stage < 2; stage++)
+			{
+				const float stage_h = stage == 0 ? half_h : h;
+				model.computeAccelerations(m_xs, m_vs, m_a);
+				model.parallelFor(n, [&](size_t begin, size_t end)
+				{
+					for (size_t i = begin; i < end; i++)
+					{
+						m_dx[i] += 2.f * m_vs[i];
+						m_dv[i] += 2.f * m_a[i];
+						m_xs[i] = x[i] + stage_h * m_vs[i];
+						m_vs[i] = v[i] + stage_h * m_a[i];
+					}
+				});
+			}
+
+			// k4 and the weighted sum
+			model.computeAccelerations(m_xs, m_vs, m_a);
+			const float sixth_h = h / 6.f;
+			model.parallelFor(n, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					x[i] += sixth_h * (m_dx[i] + m_vs[i]);
+					v[i] += sixth_h * (m_dv[i] + m_a[i]);
+				}
+			});
+			return 4;
+		}
+
+	private:
+		std::vector<Vec3> m_a;   // acceleration of the current stage
+		std::vector<Vec3> m_xs;  // state of the current stage
+		std::vector<Vec3> m_vs;
+		std::vector<Vec3> m_dx;  // weighted sums of the stage derivatives
+		std::vector<Vec3> m_dv;
+	};
+}
+
+
+const char* integratorName(Integrator integrator)
+{
+	if (integrator < 0 || integrator >= INTEGRATOR_COUNT) { return "unknown"; }
+	return kIntegratorNames[integrator];
+}
+
+
+bool parseIntegrator(const char* name, Integrator& integrator)
+{
+	for (int i = 0; i < INTEGRATOR_COUNT; i++)
+	{
+		if (strcmp(name, kIntegratorNames[i]) == 0)
+		{
+			integrator = (Integrator)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+
+std::unique_ptr<TimeIntegrator> createIntegrator(Integrator integrator)
+{
+	switch (integrator)
+	{
+	case INTEGRATOR_EULER:           return std::unique_ptr<TimeIntegrator>(new EulerIntegrator());
+	case INTEGRATOR_MIDPOINT:        return std::unique_ptr<TimeIntegrator>(new MidpointIntegrator());
+	case INTEGRATOR_VELOCITY_VERLET: return std::unique_ptr<TimeIntegrator>(new VelocityVerletIntegrator());
+	case INTEGRATOR_LEAPFROG:        return std::unique_ptr<TimeIntegrator>(new LeapfrogIntegrator());
+	case INTEGRATOR_RK4:             return std::unique_ptr<TimeIntegrator>(new RK4Integrator());
+	default:                         return std::unique_ptr<TimeIntegrator>();
+	}
+}
+
+
+float EmbeddedMidpointIntegrator::step(ForceModel& model, std::vector<Vec3>& x, std::vector<Vec3>& v, float h,
+	float positionTolerance, float velocityTolerance, float maxError)
+{
+	const size_t n = x.size();
+	const float half_h = h / 2.f;
+	m_a0.resize(n);
+	m_a.resize(n);
+	m_xtmp.resize(n);
+	m_vtmp.resize(n);
+
+	model.computeAccelerations(x, v, m_a0);
+	model.parallelFor(n, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			m_xtmp[i] = x[i] + half_h * v[i];
+			m_vtmp[i] = v[i] + half_h * m_a0[i];
+		}
+	});
+	model.computeAccelerations(m_xtmp, m_vtmp, m_a);
+
+	// the position error is h/2 times the velocity error, so one scale covers
+	// both: |a_mid - a| * h * max(1 / velocityTolerance, h/2 / positionTolerance).
+	// The maximum of non-negative floats is that of their bit patterns, an
+	// atomic max that gives the same result for any chunking. NaN bit patterns
+	// are above that of infinity, so a NaN anywhere reaches the check below.
+	const float scale = h * std::max(1.f / velocityTolerance, half_h / positionTolerance);
+	std::atomic<uint32_t> maxBits(0);
+	model.parallelFor(n, [&](size_t begin, size_t end)
+	{
+		// maximum of the bit patterns already here: a float comparison would
+		// drop NaN (std::max) or let the next value replace it
+		uint32_t bits = 0;
+		for (size_t i = begin; i < end; i++)
+		{
+			const float differenceSq = lengthSq(m_a[i] - m_a0[i]);
+			uint32_t differenceBits;
+			std::memcpy(&differenceBits, &differenceSq, sizeof(differenceBits));
+			bits = std::max(bits, differenceBits);
+		}
+		uint32_t current = maxBits.load(std::memory_order_relaxed);
+		while (bits > current && !maxBits.compare_exchange_weak(current, bits, std::memory_order_relaxed)) {}
+	});
+	const uint32_t bits = maxBits.load(std::memory_order_relaxed);
+	float maxDifferenceSq;
+	std::memcpy(&maxDifferenceSq, &bits, sizeof(bits));
+	float error = scale * std::sqrt(maxDifferenceSq);
+	if (!(error <= INFINITY))
+	{
+		error = INFINITY;  // NaN accelerations
+	}
+	if (error > maxError)
+	{
+		return error;
+	}
+
+	model.parallelFor(n, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			x[i] += h * m_vtmp[i];
+			v[i] += h * m_a[i];
+		}
+	});
+	return error;
+}
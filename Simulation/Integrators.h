@@ -0,0 +1,95 @@
+#ifndef __Integrators_h__
+#define __Integrators_h__
+
+#include <memory>
+#include <vector>
+
+#include "FunctionRef.h"
+#include "Vec3.h"
+
+
+// Time integration method used by MassSpringSystem::nextStep()
+enum Integrator
+{
+	INTEGRATOR_EULER,
+	INTEGRATOR_MIDPOINT,
+	INTEGRATOR_VELOCITY_VERLET,
+	INTEGRATOR_LEAPFROG,
+	INTEGRATOR_RK4,
+	INTEGRATOR_IMPLICIT_EULER,  // backward Euler, stable for stiff springs (see ImplicitSolver.h)
+	INTEGRATOR_XPBD,            // springs as compliant distance constraints (see XpbdSolver.h)
+	INTEGRATOR_COUNT
+};
+
+// Short name of an integrator ("euler", "midpoint", "verlet", "leapfrog", "rk4", "implicit", "xpbd")
+const char* integratorName(Integrator integrator);
+
+// Integrator with the given short name; returns false if the name is unknown
+bool parseIntegrator(const char* name, Integrator& integrator);
+
+
+// The system an explicit integrator advances: it only has to provide
+// accelerations for a given state, so the force code exists exactly once
+// no matter how many intermediate states an integrator evaluates.
+class ForceModel
+{
+public:
+	virtual ~ForceModel() {}
+
+	// a[i] = acceleration of point i at positions x and velocities v (0 for fixed points)
+	virtual void computeAccelerations(const std::vector<Vec3>& x, const std::vector<Vec3>& v, std::vector<Vec3>& a) = 0;
+
+	// Call body(begin, end) for consecutive chunks covering [0, count),
+	// possibly in parallel. Used by the integrators for their per point loops.
+	virtual void parallelFor(size_t count, FunctionRef<void(size_t, size_t)> body) = 0;
+};
+
+
+// Explicit time integrator working on a state buffer of positions and velocities.
+// Integrators keep their intermediate states in their own scratch buffers.
+class TimeIntegrator
+{
+public:
+	virtual ~TimeIntegrator() {}
+
+	virtual Integrator type() const = 0;
+
+	// Advance x and v by timeStep. Returns the number of computeAccelerations() calls.
+	virtual int step(ForceModel& model, std::vector<Vec3>& x, std::vector<Vec3>& v, float timeStep) = 0;
+
+	// Forget any state carried over from the previous step (call when x or v
+	// were changed from outside, e.g. a new scene was built)
+	virtual void reset() {}
+};
+
+// Create the integrator of the given type. Returns null for the solvers that
+// need more than accelerations: INTEGRATOR_IMPLICIT_EULER (ImplicitEulerSolver)
+// and INTEGRATOR_XPBD (XpbdSolver).
+std::unique_ptr<TimeIntegrator> createIntegrator(Integrator integrator);
+
+
+// Midpoint step with the Euler step of its first evaluation embedded as error
+// estimate, for adaptive step sizes (see AdaptiveStepper.h). The velocities
+// of the two differ by h * (a_mid - a), which is the local error of the Euler
+// step and bounds that of the midpoint step; the positions of the midpoint
+// step are off by about h/3 times that, h/2 times it is used. Both vanish for
+// constant accelerations, so free fall or resting under gravity cost no
+// accuracy while impacts and stiff springs do.
+class EmbeddedMidpointIntegrator
+{
+public:
+	// Evaluate a step of h and return its error relative to the tolerances:
+	// the largest |position error| / positionTolerance or |velocity error| /
+	// velocityTolerance of any point. x and v are advanced only if it is at
+	// most maxError, otherwise they are left unchanged. Two force evaluations.
+	float step(ForceModel& model, std::vector<Vec3>& x, std::vector<Vec3>& v, float h,
+		float positionTolerance, float velocityTolerance, float maxError = 1.f);
+
+private:
+	std::vector<Vec3> m_a0;  // acceleration at the start of the step
+	std::vector<Vec3> m_a;   // acceleration at the midpoint
+	std::vector<Vec3> m_xtmp;
+	std::vector<Vec3> m_vtmp;
+};
+
+#endif
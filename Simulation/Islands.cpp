@@ -0,0 +1,101 @@
+#include "Islands.h"
+
+
+const uint32_t Islands::kNoIsland;
+
+
+void UnionFind::reset(size_t n)
+{
+	m_parents.resize(n);
+	m_sizes.assign(n, 1);
+	for (size_t i = 0; i < n; i++)
+	{
+		m_parents[i] = (uint32_t)i;
+	}
+}
+
+
+void UnionFind::unite(uint32_t a, uint32_t b)
+{
+	a = find(a);
+	b = find(b);
+	if (a == b)
+	{
+		return;
+	}
+	if (m_sizes[a] < m_sizes[b])
+	{
+		uint32_t t = a;
+		a = b;
+		b = t;
+	}
+	m_parents[b] = a;
+	m_sizes[a] += m_sizes[b];
+}
+
+
+void Islands::numberNodes(const std::vector<uint8_t>& isStatic)
+{
+	const size_t n = isStatic.size();
+
+	// the first node of a set met in index order gives the set its number;
+	// the representative's slot remembers it
+	std::vector<uint32_t>& rootIsland = m_scratch;
+	rootIsland.assign(n, kNoIsland);
+	m_nodeIslands.resize(n);
+	uint32_t numIslands = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		if (isStatic[i])
+		{
+			m_nodeIslands[i] = kNoIsland;
+			continue;
+		}
+		uint32_t root = m_sets.find((uint32_t)i);
+		if (rootIsland[root] == kNoIsland)
+		{
+			rootIsland[root] = numIslands++;
+		}
+		m_nodeIslands[i] = rootIsland[root];
+	}
+
+	// counting sort of the nodes by island, ascending within each island
+	m_nodeOffsets.assign(numIslands + 1, 0);
+	for (size_t i = 0; i < n; i++)
+	{
+		if (m_nodeIslands[i] != kNoIsland) { m_nodeOffsets[m_nodeIslands[i] + 1]++; }
+	}
+	for (uint32_t k = 0; k < numIslands; k++)
+	{
+		m_nodeOffsets[k + 1] += m_nodeOffsets[k];
+	}
+	m_nodes.resize(m_nodeOffsets[numIslands]);
+	std::vector<uint32_t>& fill = m_scratch;
+	fill.assign(m_nodeOffsets.begin(), m_nodeOffsets.end() - 1);
+	for (size_t i = 0; i < n; i++)
+	{
+		if (m_nodeIslands[i] != kNoIsland) { m_nodes[fill[m_nodeIslands[i]]++] = (uint32_t)i; }
+	}
+}
+
+
+void Islands::sortEdges()
+{
+	const size_t numIslands = size();
+	m_edgeOffsets.assign(numIslands + 1, 0);
+	for (size_t e = 0; e < m_edgeIslands.size(); e++)
+	{
+		if (m_edgeIslands[e] != kNoIsland) { m_edgeOffsets[m_edgeIslands[e] + 1]++; }
+	}
+	for (size_t k = 0; k < numIslands; k++)
+	{
+		m_edgeOffsets[k + 1] += m_edgeOffsets[k];
+	}
+	m_edges.resize(m_edgeOffsets[numIslands]);
+	std::vector<uint32_t>& fill = m_scratch;
+	fill.assign(m_edgeOffsets.begin(), m_edgeOffsets.end() - 1);
+	for (size_t e = 0; e < m_edgeIslands.size(); e++)
+	{
+		if (m_edgeIslands[e] != kNoIsland) { m_edges[fill[m_edgeIslands[e]]++] = (uint32_t)e; }
+	}
+}
@@ -0,0 +1,113 @@
+#ifndef __Islands_h__
+#define __Islands_h__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// Disjoint sets over the indices 0 .. n - 1 (union by size, path halving)
+class UnionFind
+{
+public:
+	// n singleton sets
+	void reset(size_t n);
+
+	// Representative of the set containing i
+	uint32_t find(uint32_t i)
+	{
+		while (m_parents[i] != i)
+		{
+			m_parents[i] = m_parents[m_parents[i]];
+			i = m_parents[i];
+		}
+		return i;
+	}
+
+	// Merge the sets of a and b
+	void unite(uint32_t a, uint32_t b);
+
+private:
+	std::vector<uint32_t> m_parents;
+	std::vector<uint32_t> m_sizes;
+};
+
+
+// Connected components ("islands") of a graph whose nodes are bodies or mass
+// points and whose edges are the constraints between them (contacts, springs).
+// Islands share no moving node, so each one can be solved on its own thread
+// without changing the result. Static nodes (the ground, fixed points) are in
+// no island and do not connect the islands of their edges, otherwise
+// everything resting on the ground would be one island.
+//
+// Islands are numbered by their lowest node, nodes and edges of an island are
+// listed in ascending order: the result depends only on the graph.
+class Islands
+{
+public:
+	static const uint32_t kNoIsland = 0xffffffffu;
+
+	// Build the islands of the nodes 0 .. isStatic.size() - 1
+	// (isStatic[i] != 0: static node) and numEdges edges; ends(e, a, b)
+	// returns the nodes of edge e. Every non static node is in exactly one
+	// island, an unconnected node is an island of its own. Edges between two
+	// static nodes are in no island.
+	template <typename EdgeEnds>
+	void build(const std::vector<uint8_t>& isStatic, size_t numEdges, EdgeEnds ends)
+	{
+		m_sets.reset(isStatic.size());
+		for (size_t e = 0; e < numEdges; e++)
+		{
+			uint32_t a, b;
+			ends(e, a, b);
+			if (!isStatic[a] && !isStatic[b])
+			{
+				m_sets.unite(a, b);
+			}
+		}
+		numberNodes(isStatic);
+
+		m_edgeIslands.resize(numEdges);
+		for (size_t e = 0; e < numEdges; e++)
+		{
+			uint32_t a, b;
+			ends(e, a, b);
+			m_edgeIslands[e] = !isStatic[a] ? m_nodeIslands[a] : (!isStatic[b] ? m_nodeIslands[b] : kNoIsland);
+		}
+		sortEdges();
+	}
+
+	size_t size() const { return m_nodeOffsets.empty() ? 0 : m_nodeOffsets.size() - 1; }
+
+	// Nodes of island k: nodes()[nodeBegin(k) .. nodeEnd(k))
+	uint32_t nodeBegin(size_t k) const { return m_nodeOffsets[k]; }
+	uint32_t nodeEnd(size_t k) const   { return m_nodeOffsets[k + 1]; }
+	const std::vector<uint32_t>& nodes() const { return m_nodes; }
+
+	// Edges of island k: edges()[edgeBegin(k) .. edgeEnd(k))
+	uint32_t edgeBegin(size_t k) const { return m_edgeOffsets[k]; }
+	uint32_t edgeEnd(size_t k) const   { return m_edgeOffsets[k + 1]; }
+	const std::vector<uint32_t>& edges() const { return m_edges; }
+
+	// Island of node i (kNoIsland for static nodes)
+	uint32_t islandOfNode(size_t i) const { return m_nodeIslands[i]; }
+
+private:
+	// Island numbers from the set representatives, node lists
+	void numberNodes(const std::vector<uint8_t>& isStatic);
+
+	// Edge lists from m_edgeIslands (counting sort)
+	void sortEdges();
+
+	UnionFind m_sets;
+	std::vector<uint32_t> m_nodeIslands;
+	std::vector<uint32_t> m_edgeIslands;
+	std::vector<uint32_t> m_nodeOffsets;
+	std::vector<uint32_t> m_nodes;
+	std::vector<uint32_t> m_edgeOffsets;
+	std::vector<uint32_t> m_edges;
+	std::vector<uint32_t> m_scratch;
+};
+
+
+#endif
@@ -0,0 +1,540 @@
+#include "MassSpringSystem.h"
+
+#include <cstring>
+
+#include "Profiler.h"
+#include "SpringKernels.h"
+
+
+namespace
+{
+	const uint64_t kFnvOffset = 14695981039346656037ull;
+	const uint64_t kFnvPrime = 1099511628211ull;
+
+	// FNV-1a steps for the three coordinates of v, one hash chain per
+	// coordinate (independent multiplies instead of one long dependency chain)
+	inline void hashVec3(uint64_t* h, const Vec3& v)
+	{
+		uint32_t words[3];
+		std::memcpy(words, &v.x, sizeof(float));
+		std::memcpy(words + 1, &v.y, sizeof(float));
+		std::memcpy(words + 2, &v.z, sizeof(float));
+		for (int k = 0; k < 3; k++)
+		{
+			h[k] = (h[k] ^ words[k]) * kFnvPrime;
+		}
+	}
+}
+
+
+void MassSpringSystem::clear()
+{
+	m_positions.clear();
+	m_velocities.clear();
+	m_forces.clear();
+	m_invMasses.clear();
+	m_fixed.clear();
+	m_springs.clear();
+	m_sceneMarked = false;
+	m_topologyVersion++;
+}
+
+
+void MassSpringSystem::markScene()
+{
+	m_markPositions = m_positions;
+	m_markVelocities = m_velocities;
+	m_markInvMasses = m_invMasses;
+	m_markFixed = m_fixed;
+	m_markSprings = m_springs;
+	m_markTopologyVersion = m_topologyVersion;
+	m_sceneMarked = true;
+}
+
+
+bool MassSpringSystem::rewindScene()
+{
+	if (!m_sceneMarked)
+	{
+		return false;
+	}
+
+	// Nothing was added since the mark (the version), and the public arrays
+	// were not edited in a way that changes what the derived structures are
+	// built from: the springs still connect the same points, the fixed points
+	// and masses are the same. The arrays are compared while they are copied
+	// back, in the same pass.
+	bool sameTopology = m_topologyVersion == m_markTopologyVersion && m_positions.size() == m_markPositions.size() &&
+		m_springs.size() == m_markSprings.size();
+	if (sameTopology)
+	{
+		bool same = true;
+		for (size_t s = 0; s < m_springs.size(); s++)
+		{
+			const Spring& mark = m_markSprings[s];
+			same &= m_springs[s].point1 == mark.point1 && m_springs[s].point2 == mark.point2;
+			m_springs[s] = mark;
+		}
+		for (size_t i = 0; i < m_positions.size(); i++)
+		{
+			same &= m_fixed[i] == m_markFixed[i] && m_invMasses[i] == m_markInvMasses[i];
+			m_fixed[i] = m_markFixed[i];
+			m_invMasses[i] = m_markInvMasses[i];
+		}
+		sameTopology = same;
+	}
+	else
+	{
+		m_invMasses = m_markInvMasses;
+		m_fixed = m_markFixed;
+		m_springs = m_markSprings;
+	}
+	m_positions = m_markPositions;
+	m_velocities = m_markVelocities;
+	m_forces.assign(m_markPositions.size(), Vec3(0.f, 0.f, 0.f));
+
+	if (!sameTopology)
+	{
+		m_topologyVersion++;
+		m_markTopologyVersion = m_topologyVersion;
+	}
+	else if (m_integrator)
+	{
+		m_integrator->reset();  // its cached accelerations belong to the old state
+	}
+	m_sleep.wakeAll();
+	return true;
+}
+
+
+void MassSpringSystem::reserve(size_t numPoints, size_t numSprings)
+{
+	m_positions.reserve(numPoints);
+	m_velocities.reserve(numPoints);
+	m_forces.reserve(numPoints);
+	m_invMasses.reserve(numPoints);
+	m_fixed.reserve(numPoints);
+	m_springs.reserve(numSprings);
+}
+
+
+uint32_t MassSpringSystem::addPoint(float x, float y, float z, bool fixed, float mass)
+{
+	m_positions.push_back(Vec3(x, y, z));
+	m_velocities.push_back(Vec3(0.f, 0.f, 0.f));
+	m_forces.push_back(Vec3(0.f, 0.f, 0.f));
+	m_invMasses.push_back(fixed ? 0.f : 1.f / mass);
+	m_fixed.push_back(fixed ? 1 : 0);
+	m_topologyVersion++;
+
+	return (uint32_t)(m_positions.size() - 1);
+}
+
+
+uint32_t MassSpringSystem::addSpring(uint32_t a, uint32_t b, float stiffness)
+{
+	return addSpring(a, b, length(m_positions[a] - m_positions[b]), stiffness);
+}
+
+
+uint32_t MassSpringSystem::addSpring(uint32_t a, uint32_t b, float org_length, float stiffness)
+{
+	Spring s = { a, b, org_length, stiffness };
+	m_springs.push_back(s);
+	m_topologyVersion++;
+
+	return (uint32_t)(m_springs.size() - 1);
+}
+
+
+void MassSpringSystem::setMass(float mass)
+{
+	for (size_t i = 0; i < m_invMasses.size(); i++)
+	{
+		m_invMasses[i] = m_fixed[i] ? 0.f : 1.f / mass;
+	}
+}
+
+
+void MassSpringSystem::computeForces(const std::vector<Vec3>& x, const std::vector<Vec3>& v)
+{
+	PROFILE_ZONE("Spring forces");
+	PROFILE_COUNT("Springs evaluated", m_springs.size());
+	forEachPoint([&](size_t i)
+	{
+		m_forces[i] = Vec3(0.f, 0.f, 0.f);
+	});
+
+	if (m_threadPool)
+	{
+		addSpringForcesParallel(x, v);
+	}
+	else
+	{
+		addSpringForces(x, v);
+	}
+	addGravity();
+}
+
+
+void MassSpringSystem::addSpringForces(const std::vector<Vec3>& x, const std::vector<Vec3>& v)
+{
+	const float damping = m_params.damping;
+
+	if (m_params.simdSprings)
+	{
+		// batch kernel into m_springForces, then scatter in spring order
+		m_springForces.resize(m_springs.size());
+		springForcesSimd(m_springs.data(), 0, m_springs.size(), x.data(), x.size(), m_springForces.data());
+
+		for (size_t s = 0; s < m_springs.size(); s++)
+		{
+			const Spring& spring = m_springs[s];
+			m_forces[spring.point1] += m_springForces[s];
+			m_forces[spring.point2] -= m_springForces[s];
+
+			if (damping != 0.f)
+			{
+				m_forces[spring.point1] -= damping * v[spring.point1];
+				m_forces[spring.point2] -= damping * v[spring.point2];
+			}
+		}
+		return;
+	}
+
+	for (size_t s = 0; s < m_springs.size(); s++)
+	{
+		const Spring& spring = m_springs[s];
+		Vec3 diff = x[spring.point1] - x[spring.point2];
+		float curr_length = length(diff);
+		float springForce = (-1 * spring.stiffness) * (curr_length - spring.org_length);
+		Vec3 force = diff * (springForce / curr_length);
+
+		m_forces[spring.point1] += force;
+		m_forces[spring.point2] -= force;
+
+		if (damping != 0.f)
+		{
+			m_forces[spring.point1] -= damping * v[spring.point1];
+			m_forces[spring.point2] -= damping * v[spring.point2];
+		}
+	}
+}
+
+
+void MassSpringSystem::addSpringForcesParallel(const std::vector<Vec3>& x, const std::vector<Vec3>& v)
+{
+	if (m_adjacencyVersion != m_topologyVersion)
+	{
+		buildAdjacency();
+	}
+
+	// phase 1: one force per spring, every spring writes only its own entry
+	const bool simd = m_params.simdSprings;
+	m_threadPool->parallelFor(m_springs.size(), 4096, [&](size_t begin, size_t end)
+	{
+		if (simd) { springForcesSimd(m_springs.data(), begin, end, x.data(), x.size(), m_springForces.data()); }
+		else      { springForcesScalar(m_springs.data(), begin, end, x.data(), m_springForces.data()); }
+	});
+
+	// phase 2: every point sums up the forces of its springs in spring order
+	const float damping = m_params.damping;
+	forEachPoint([&](size_t i)
+	{
+		Vec3 F = m_forces[i];
+		for (uint32_t k = m_pointSpringOffsets[i]; k < m_pointSpringOffsets[i + 1]; k++)
+		{
+			uint32_t entry = m_pointSprings[k];
+			if (entry & 1) { F -= m_springForces[entry >> 1]; }
+			else           { F += m_springForces[entry >> 1]; }
+
+			if (damping != 0.f)
+			{
+				F -= damping * v[i];
+			}
+		}
+		m_forces[i] = F;
+	});
+}
+
+
+void buildPointSpringAdjacency(size_t numPoints, const std::vector<Spring>& springs,
+	std::vector<uint32_t>& offsets, std::vector<uint32_t>& entries)
+{
+	// counting sort of the spring ends by point; springs are visited in
+	// ascending order, so every point's list ends up sorted by spring index
+	offsets.assign(numPoints + 1, 0);
+	for (size_t s = 0; s < springs.size(); s++)
+	{
+		offsets[springs[s].point1 + 1]++;
+		offsets[springs[s].point2 + 1]++;
+	}
+	for (size_t i = 0; i < numPoints; i++)
+	{
+		offsets[i + 1] += offsets[i];
+	}
+
+	entries.resize(2 * springs.size());
+	std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t s = 0; s < springs.size(); s++)
+	{
+		entries[fill[springs[s].point1]++] = (uint32_t)(s << 1);
+		entries[fill[springs[s].point2]++] = (uint32_t)(s << 1) | 1;
+	}
+}
+
+
+void MassSpringSystem::buildAdjacency()
+{
+	buildPointSpringAdjacency(numPoints(), m_springs, m_pointSpringOffsets, m_pointSprings);
+	m_springForces.resize(m_springs.size());
+	m_adjacencyVersion = m_topologyVersion;
+}
+
+
+void MassSpringSystem::updateThreadPool()
+{
+	unsigned int numThreads = m_params.numThreads;
+	if (numThreads == 0)
+	{
+		numThreads = std::thread::hardware_concurrency();
+	}
+
+	if (numThreads <= 1)
+	{
+		m_threadPool.reset();
+	}
+	else if (!m_threadPool || m_threadPool->numThreads() != numThreads)
+	{
+		m_threadPool.reset(new ThreadPool(numThreads));
+	}
+}
+
+
+void MassSpringSystem::addGravity()
+{
+	const Vec3 g = m_params.gravity;
+	if (g.x == 0.f && g.y == 0.f && g.z == 0.f) { return; }
+
+	forEachPoint([&](size_t i)
+	{
+		if (m_fixed[i]) { return; }
+		m_forces[i] += g * (1.f / m_invMasses[i]);
+	});
+}
+
+
+void MassSpringSystem::computeAccelerations(const std::vector<Vec3>& x, const std::vector<Vec3>& v, std::vector<Vec3>& a)
+{
+	computeForces(x, v);
+
+	// fixed points have an inverse mass of 0 and thus never accelerate
+	forEachPoint([&](size_t i)
+	{
+		a[i] = m_invMasses[i] * m_forces[i];
+	});
+}
+
+
+void MassSpringSystem::parallelFor(size_t count, FunctionRef<void(size_t, size_t)> body)
+{
+	::parallelFor(m_threadPool.get(), count, 4096, body);
+}
+
+
+uint64_t MassSpringSystem::stateChecksum() const
+{
+	// one hash per chunk of points, chained in chunk order
+	const size_t n = m_positions.size();
+	const size_t grain = 4096;
+	std::vector<uint64_t> chunks((n + grain - 1) / grain);
+	::parallelFor(m_threadPool.get(), n, grain, [&](size_t begin, size_t end)
+	{
+		uint64_t h[6] = { kFnvOffset, kFnvOffset, kFnvOffset, kFnvOffset, kFnvOffset, kFnvOffset };
+		for (size_t i = begin; i < end; i++)
+		{
+			hashVec3(h, m_positions[i]);
+			hashVec3(h + 3, m_velocities[i]);
+		}
+		uint64_t chunk = kFnvOffset;
+		for (int k = 0; k < 6; k++)
+		{
+			chunk = (chunk ^ h[k]) * kFnvPrime;
+		}
+		chunks[begin / grain] = chunk;
+	});
+
+	uint64_t h = (kFnvOffset ^ n) * kFnvPrime;
+	for (size_t c = 0; c < chunks.size(); c++)
+	{
+		h = (h ^ chunks[c]) * kFnvPrime;
+	}
+	return h;
+}
+
+
+template <typename Step>
+void MassSpringSystem::stepAwake(float timestep, Step step)
+{
+	if (m_sleepVersion != m_topologyVersion || m_sleep.clusterSize() != m_params.sleepClusterSize)
+	{
+		m_sleep.setTopology(*this);
+		m_sleepVersion = m_topologyVersion;
+	}
+	m_sleep.checkChanges(*this);
+
+	bool stepped;
+	if (m_sleep.allAwake())
+	{
+		if (!m_steppedAll && m_integrator)
+		{
+			m_integrator->reset();  // not stepped by it since its last step
+		}
+		m_steppedAwake = false;
+		stepped = step(*this);
+	}
+	else if (m_sleep.allAsleep())
+	{
+		m_steppedAwake = false;
+		m_lastForceEvaluations = 0;
+		stepped = true;
+	}
+	else
+	{
+		MassSpringSystem& awake = m_sleep.awakeSystem(*this);
+		m_steppedAwake = true;
+		stepped = step(awake);
+		m_lastForceEvaluations = awake.m_lastForceEvaluations;
+		if (stepped)
+		{
+			m_sleep.copyBack(*this);
+		}
+	}
+	m_steppedAll = m_sleep.allAwake();
+	if (stepped)
+	{
+		m_sleep.update(*this, timestep);
+	}
+}
+
+
+void MassSpringSystem::nextStep(float timestep)
+{
+	if (!m_params.sleeping)
+	{
+		m_sleep.wakeAll();  // sleeping was switched off
+		m_steppedAwake = false;
+		m_steppedAll = true;
+		stepAll(timestep);
+		return;
+	}
+	stepAwake(timestep, [&](MassSpringSystem& system)
+	{
+		system.stepAll(timestep);
+		return true;
+	});
+}
+
+
+float MassSpringSystem::tryStep(float timestep, float positionTolerance, float velocityTolerance, float maxError)
+{
+	if (!m_params.sleeping)
+	{
+		m_sleep.wakeAll();  // sleeping was switched off
+		m_steppedAwake = false;
+		m_steppedAll = true;
+		return tryStepAll(timestep, positionTolerance, velocityTolerance, maxError);
+	}
+	float error = 0.f;
+	stepAwake(timestep, [&](MassSpringSystem& system)
+	{
+		error = system.tryStepAll(timestep, positionTolerance, velocityTolerance, maxError);
+		return error <= maxError;
+	});
+	return error;
+}
+
+
+void MassSpringSystem::stepAll(float timestep)
+{
+	PROFILE_ZONE("Mass spring step");
+	updateThreadPool();
+	m_collider.beginStep(*this);
+	integrate(timestep);
+	m_collider.step(*this, m_threadPool.get());
+
+	// contacts moved points and changed velocities after the integrator, the
+	// accelerations velocity Verlet carries over to the next step are from
+	// before that. (Leapfrog keeps no accelerations, a reset would only
+	// restart its half step offset at every contact.)
+	const ParticleCollisionStats& collisions = m_collider.lastStepStats();
+	if (m_integrator && m_integrator->type() == INTEGRATOR_VELOCITY_VERLET &&
+		collisions.numParticleContacts + collisions.numShapeContacts > 0)
+	{
+		m_integrator->reset();
+	}
+}
+
+
+float MassSpringSystem::tryStepAll(float timestep, float positionTolerance, float velocityTolerance, float maxError)
+{
+	PROFILE_ZONE("Mass spring step");
+	updateThreadPool();
+	m_collider.beginStep(*this);
+	const float error = m_embeddedIntegrator.step(*this, m_positions, m_velocities, timestep, positionTolerance, velocityTolerance, maxError);
+	m_lastForceEvaluations = 2;
+	if (error <= maxError)
+	{
+		m_collider.step(*this, m_threadPool.get());
+		if (m_integrator)
+		{
+			m_integrator->reset();  // the state it carries over is from before this step
+		}
+	}
+	return error;
+}
+
+
+void MassSpringSystem::integrate(float timestep)
+{
+	if (m_params.integrator == INTEGRATOR_IMPLICIT_EULER)
+	{
+		if (m_implicitVersion != m_topologyVersion)
+		{
+			m_implicitSolver.setTopology(*this);
+			m_implicitVersion = m_topologyVersion;
+		}
+		m_implicitSolver.step(*this, timestep, m_threadPool.get());
+		m_lastForceEvaluations = 1;
+		return;
+	}
+
+	if (m_params.integrator == INTEGRATOR_XPBD)
+	{
+		if (m_xpbdVersion != m_topologyVersion)
+		{
+			m_xpbdSolver.setTopology(*this);
+			m_xpbdVersion = m_topologyVersion;
+		}
+		m_xpbdSolver.step(*this, timestep, m_threadPool.get());
+		m_lastForceEvaluations = 0;	// projects constraints, no forces
+		return;
+	}
+
+	if (!m_integrator || m_integrator->type() != m_params.integrator)
+	{
+		m_integrator = createIntegrator(m_params.integrator);
+		m_integratorVersion = m_topologyVersion;
+		if (!m_integrator)
+		{
+			m_lastForceEvaluations = 0;
+			return;
+		}
+	}
+	if (m_integratorVersion != m_topologyVersion)
+	{
+		m_integrator->reset();
+		m_integratorVersion = m_topologyVersion;
+	}
+	m_lastForceEvaluations = m_integrator->step(*this, m_positions, m_velocities, timestep);
+}
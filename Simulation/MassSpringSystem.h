@@ -0,0 +1,283 @@
+#ifndef __MassSpringSystem_h__
+#define __MassSpringSystem_h__
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ImplicitSolver.h"
+#include "Integrators.h"
+#include "ParticleCollision.h"
+#include "SleepClusters.h"
+#include "ThreadPool.h"
+#include "Vec3.h"
+#include "XpbdSolver.h"
+
+// Spring between two mass points, referencing them by their index
+// in the MassSpringSystem instead of by pointer.
+struct Spring
+{
+	uint32_t point1;
+	uint32_t point2;
+	float    org_length;
+	float    stiffness;
+};
+
+// Lists of the springs of every point: the springs of point i are
+// entries[offsets[i] .. offsets[i + 1]), sorted by spring index and stored as
+// (spring index << 1) | (1 if the point is point2 of the spring)
+void buildPointSpringAdjacency(size_t numPoints, const std::vector<Spring>& springs,
+	std::vector<uint32_t>& offsets, std::vector<uint32_t>& entries);
+
+// Simulation parameters (formerly tweak bar globals of the demo)
+struct MassSpringParams
+{
+	Integrator integrator;
+	float      damping;  // velocity damping, applied per spring to both of its points
+	Vec3       gravity;  // gravitational acceleration applied to all non-fixed points
+	unsigned int numThreads;  // threads used by nextStep(), 0 = all cores
+	bool       simdSprings;  // use the SSE/AVX2 spring force kernel (see SpringKernels.h)
+	int        cgMaxIterations;  // implicit Euler: conjugate gradient iteration limit
+	float      cgTolerance;  // implicit Euler: relative residual at which CG stops
+	bool       cgMultigrid;  // implicit Euler: multigrid V-cycle instead of block Jacobi CG preconditioner
+	int        xpbdIterations;  // XPBD: constraint iterations per step
+	bool       xpbdJacobi;  // XPBD: parallel Jacobi instead of serial Gauss-Seidel iterations
+	float      xpbdRelaxation;  // XPBD: over-relaxation of the averaged Jacobi corrections
+	bool       selfCollision;  // keep the points collisionRadius * 2 apart (see ParticleCollision.h)
+	int        collisionIterations;  // self collision passes per step
+	float      collisionRadius;  // radius of the points for self and shape collision, below half the spring rest lengths
+	float      collisionFriction;  // Coulomb friction of points sliding on planes and boxes
+	bool       continuousCollision;  // sweep the points against the boxes, no tunnelling through thin boxes at large steps
+	bool       sleeping;  // let quiet clusters of points fall asleep, see SleepClusters.h
+	float      sleepVelocity;  // a cluster is quiet while its RMS speed is below this
+	float      timeToSleep;  // a cluster falls asleep once it was quiet this long
+	uint32_t   sleepClusterSize;  // points per cluster
+
+	MassSpringParams() : integrator(INTEGRATOR_MIDPOINT), damping(4.0f), gravity(0.f, 0.f, 0.f), numThreads(1), simdSprings(false),
+		cgMaxIterations(100), cgTolerance(1e-4f), cgMultigrid(false), xpbdIterations(10), xpbdJacobi(false), xpbdRelaxation(1.5f),
+		selfCollision(false), collisionIterations(2), collisionRadius(0.01f), collisionFriction(0.3f),
+		continuousCollision(false), sleeping(false), sleepVelocity(0.01f), timeToSleep(0.5f),
+		sleepClusterSize(256) {}
+};
+
+// Mass-spring state stored as structure of arrays.
+// Every per-point attribute lives in its own contiguous array, so the
+// simulation loops stream through memory instead of chasing one heap
+// allocation per point and per spring.
+// The explicit integrators (see Integrators.h) advance it through the
+// ForceModel interface.
+//
+// Determinism: every parallel loop writes per point or per spring outputs or
+// per chunk partial sums, with chunks that depend only on the number of
+// points or springs, and sums are always taken in the same order. So for the
+// same build and CPU the state after every step is bitwise identical for any
+// m_params.numThreads, serial or parallel, run after run. The SIMD spring
+// kernel gives the bits of the scalar one, so m_params.simdSprings does not
+// change the state either.
+// stateChecksum() compares the states of two runs without dumping them.
+class MassSpringSystem : public ForceModel
+{
+public:
+	MassSpringSystem() : m_lastForceEvaluations(0), m_steppedAwake(false), m_steppedAll(true), m_sceneMarked(false), m_markTopologyVersion(0), m_topologyVersion(1),
+		m_adjacencyVersion(0), m_implicitVersion(0), m_xpbdVersion(0), m_integratorVersion(0), m_sleepVersion(0) {}
+
+	// Remove all points and springs (keeps the allocated capacity, so building
+	// a scene of the same size again does not allocate) and the scene mark
+	void clear();
+
+	// markScene() remembers the points and springs as they are now, e.g. right
+	// after building a scene; rewindScene() copies them back into the same
+	// storage. That is the reset of a scene without allocating and without
+	// running its generator again, but still a copy of every point and spring.
+	// The mark is a second copy of them: 29 bytes per point and 16 per spring,
+	// 21 MB for a cloth of a million springs, which like the scene's own
+	// storage stays allocated after clear().
+	// If no point or spring was added since the mark and the springs still
+	// connect the same points, with the same fixed points and masses, the
+	// adjacency, solver patterns, islands and sleep clusters built for them
+	// are kept; otherwise they are rebuilt at the next step. Returns false
+	// (and changes nothing) if there is no mark.
+	void markScene();
+	bool rewindScene();
+
+	// Preallocate storage for the given number of points and springs
+	void reserve(size_t numPoints, size_t numSprings);
+
+	// Add a mass point and return its index
+	uint32_t addPoint(float x, float y, float z, bool fixed, float mass = 10.0f);
+
+	// Add a spring whose rest length is the current distance of the points
+	uint32_t addSpring(uint32_t a, uint32_t b, float stiffness);
+
+	// Add a spring with the given rest length
+	uint32_t addSpring(uint32_t a, uint32_t b, float org_length, float stiffness);
+
+	// Set the same mass for every point (fixed points keep an inverse mass of 0)
+	void setMass(float mass);
+
+	// Advance the simulation by one time step using m_params, then resolve
+	// the collisions of the points (see ParticleCollider)
+	void nextStep(float timeStep);
+
+	// One step of adaptive time stepping (see AdaptiveStepper.h): evaluates a
+	// midpoint step of timeStep with an embedded error estimate (see
+	// EmbeddedMidpointIntegrator) and, if the error relative to the tolerances
+	// is at most maxError, takes it and resolves the collisions like
+	// nextStep(). Returns the relative error; above maxError the state is left
+	// unchanged. Ignores m_params.integrator.
+	float tryStep(float timeStep, float positionTolerance, float velocityTolerance, float maxError = 1.f);
+
+	// Number of force evaluations done by the last nextStep() or tryStep()
+	int lastForceEvaluations() const { return m_lastForceEvaluations; }
+
+	// ForceModel: spring, damping and gravity forces divided by the masses.
+	// Also leaves the forces in m_forces.
+	void computeAccelerations(const std::vector<Vec3>& x, const std::vector<Vec3>& v, std::vector<Vec3>& a);
+	void parallelFor(size_t count, FunctionRef<void(size_t, size_t)> body);
+
+	// 64 bit hash of the bit patterns of all positions and velocities; two
+	// states have the same checksum if they are bitwise equal (and differ
+	// with near certainty otherwise). Same value for any number of threads.
+	uint64_t stateChecksum() const;
+
+	size_t numPoints() const  { return m_positions.size(); }
+	size_t numSprings() const { return m_springs.size(); }
+
+	// Solver of INTEGRATOR_IMPLICIT_EULER (CG statistics of the last step)
+	const ImplicitEulerSolver& implicitSolver() const { return steppedSystem().m_implicitSolver; }
+
+	// Solver of INTEGRATOR_XPBD (residuals of the last step)
+	const XpbdSolver& xpbdSolver() const { return steppedSystem().m_xpbdSolver; }
+
+	// Collision counters of the last step
+	const ParticleCollisionStats& collisionStats() const { return steppedSystem().m_collider.lastStepStats(); }
+
+	// Sleeping (m_params.sleeping): awake and sleeping counts after the last
+	// step, the sleep state of a point, and waking for changes the sleep test
+	// can't see (springs edited, points moved or pushed from outside)
+	const SleepStats& sleepStats() const { return m_sleep.stats(); }
+	bool isAsleep(uint32_t i) const { return m_params.sleeping && m_sleep.isAsleep(i); }
+	void wakeAll() { m_sleep.wakeAll(); }
+	void wakePoint(uint32_t i) { m_sleep.wakePoint(i); }
+
+	MassSpringParams m_params;
+
+	// per point arrays
+	std::vector<Vec3>    m_positions;
+	std::vector<Vec3>    m_velocities;
+	std::vector<Vec3>    m_forces;
+	std::vector<float>   m_invMasses;
+	std::vector<uint8_t> m_fixed;
+
+	std::vector<Spring>  m_springs;
+
+	// static shapes the points collide with (not removed by clear())
+	std::vector<Plane>   m_colliderPlanes;
+	std::vector<Box>     m_colliderBoxes;
+
+private:
+	// nextStep() and tryStep() of all points
+	void stepAll(float timeStep);
+	float tryStepAll(float timeStep, float positionTolerance, float velocityTolerance, float maxError);
+
+	// Step the awake part with step(system) (see SleepClusters.h), which
+	// returns whether the step was taken, then update the sleep state
+	template <typename Step>
+	void stepAwake(float timeStep, Step step);
+
+	// The system the last step ran on: this one or the awake part of it
+	const MassSpringSystem& steppedSystem() const { return m_steppedAwake ? m_sleep.awakeSystem() : *this; }
+
+	// Advance the points by one step with the integrator of m_params
+	void integrate(float timeStep);
+
+	// Set m_forces to the spring, damping and gravity forces for positions x and velocities v
+	void computeForces(const std::vector<Vec3>& x, const std::vector<Vec3>& v);
+
+	// Accumulate spring forces (evaluated at positions x) and damping
+	// (evaluated at velocities v) onto m_forces
+	void addSpringForces(const std::vector<Vec3>& x, const std::vector<Vec3>& v);
+
+	// Multithreaded variant of addSpringForces(). Computes one force per spring
+	// and then lets every point gather the forces of its springs in ascending
+	// spring order. That is the same order in which the serial loop scatters
+	// them, so the result is bitwise identical for any number of threads.
+	void addSpringForcesParallel(const std::vector<Vec3>& x, const std::vector<Vec3>& v);
+
+	// Rebuild the point -> spring adjacency used by addSpringForcesParallel()
+	void buildAdjacency();
+
+	// Create/resize m_threadPool to match m_params.numThreads
+	void updateThreadPool();
+
+	// Call body(i) for every point index, split across m_threadPool if there is one
+	template <typename Body>
+	void forEachPoint(Body body)
+	{
+		const size_t n = m_positions.size();
+		if (m_threadPool)
+		{
+			m_threadPool->parallelFor(n, 4096, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++) { body(i); }
+			});
+		}
+		else
+		{
+			for (size_t i = 0; i < n; i++) { body(i); }
+		}
+	}
+
+	// Add the gravity force to m_forces of every non-fixed point
+	void addGravity();
+
+	std::unique_ptr<ThreadPool> m_threadPool;
+
+	// force of every spring on its first point (the second point gets the negative)
+	std::vector<Vec3>     m_springForces;
+
+	// springs of every point, see buildPointSpringAdjacency()
+	std::vector<uint32_t> m_pointSpringOffsets;
+	std::vector<uint32_t> m_pointSprings;
+
+	// matrix and CG vectors of the implicit integrator
+	ImplicitEulerSolver   m_implicitSolver;
+
+	// constraint solver of the XPBD mode
+	XpbdSolver            m_xpbdSolver;
+
+	// self and shape collision after every step
+	ParticleCollider      m_collider;
+
+	// explicit integrator matching m_params.integrator (null for implicit Euler)
+	std::unique_ptr<TimeIntegrator> m_integrator;
+	int                   m_lastForceEvaluations;
+
+	// midpoint step with error estimate of tryStep()
+	EmbeddedMidpointIntegrator m_embeddedIntegrator;
+
+	// clusters and sleep state of m_params.sleeping
+	SleepClusters         m_sleep;
+	bool                  m_steppedAwake;  // the last step ran on m_sleep.awakeSystem()
+	bool                  m_steppedAll;    // the last step ran on this system
+
+	// points and springs at markScene()
+	bool                  m_sceneMarked;
+	std::vector<Vec3>     m_markPositions;
+	std::vector<Vec3>     m_markVelocities;
+	std::vector<float>    m_markInvMasses;
+	std::vector<uint8_t>  m_markFixed;
+	std::vector<Spring>   m_markSprings;
+	uint32_t              m_markTopologyVersion;
+
+	// incremented whenever points or springs are added or removed; the data
+	// derived from the topology remembers the version it was built for
+	uint32_t              m_topologyVersion;
+	uint32_t              m_adjacencyVersion;
+	uint32_t              m_implicitVersion;
+	uint32_t              m_xpbdVersion;
+	uint32_t              m_integratorVersion;
+	uint32_t              m_sleepVersion;
+};
+
+#endif
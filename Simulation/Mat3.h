@@ -0,0 +1,99 @@
+#ifndef __Mat3_h__
+#define __Mat3_h__
+
+#include "Vec3.h"
+
+
+// Minimal row major 3x3 float matrix (blocks of the implicit solver's system matrix)
+struct Mat3
+{
+	float m[3][3];
+
+	Mat3() { setZero(); }
+
+	void setZero()
+	{
+		for (int i = 0; i < 3; i++)
+			for (int j = 0; j < 3; j++)
+				m[i][j] = 0.f;
+	}
+
+	static Mat3 identity(float s = 1.f)
+	{
+		Mat3 r;
+		r.m[0][0] = r.m[1][1] = r.m[2][2] = s;
+		return r;
+	}
+
+	// a * b^T
+	static Mat3 outer(const Vec3& a, const Vec3& b)
+	{
+		Mat3 r;
+		for (int i = 0; i < 3; i++)
+			for (int j = 0; j < 3; j++)
+				r.m[i][j] = a[i] * b[j];
+		return r;
+	}
+
+	Mat3& operator+=(const Mat3& b)
+	{
+		for (int i = 0; i < 3; i++)
+			for (int j = 0; j < 3; j++)
+				m[i][j] += b.m[i][j];
+		return *this;
+	}
+
+	Mat3& operator-=(const Mat3& b)
+	{
+		for (int i = 0; i < 3; i++)
+			for (int j = 0; j < 3; j++)
+				m[i][j] -= b.m[i][j];
+		return *this;
+	}
+
+	Mat3& operator*=(float s)
+	{
+		for (int i = 0; i < 3; i++)
+			for (int j = 0; j < 3; j++)
+				m[i][j] *= s;
+		return *this;
+	}
+
+	// Inverse via the adjugate; returns the identity for (nearly) singular matrices
+	Mat3 inverse() const
+	{
+		Mat3 r;
+		r.m[0][0] = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+		r.m[0][1] = m[0][2] * m[2][1] - m[0][1] * m[2][2];
+		r.m[0][2] = m[0][1] * m[1][2] - m[0][2] * m[1][1];
+		r.m[1][0] = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+		r.m[1][1] = m[0][0] * m[2][2] - m[0][2] * m[2][0];
+		r.m[1][2] = m[0][2] * m[1][0] - m[0][0] * m[1][2];
+		r.m[2][0] = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+		r.m[2][1] = m[0][1] * m[2][0] - m[0][0] * m[2][1];
+		r.m[2][2] = m[0][0] * m[1][1] - m[0][1] * m[1][0];
+
+		float det = m[0][0] * r.m[0][0] + m[0][1] * r.m[1][0] + m[0][2] * r.m[2][0];
+		if (std::fabs(det) < 1e-20f)
+		{
+			return identity();
+		}
+		r *= 1.f / det;
+		return r;
+	}
+};
+
+inline Mat3 operator+(Mat3 a, const Mat3& b) { a += b; return a; }
+inline Mat3 operator-(Mat3 a, const Mat3& b) { a -= b; return a; }
+inline Mat3 operator*(Mat3 a, float s)       { a *= s; return a; }
+inline Mat3 operator*(float s, Mat3 a)       { a *= s; return a; }
+
+inline Vec3 operator*(const Mat3& a, const Vec3& v)
+{
+	return Vec3(a.m[0][0] * v.x + a.m[0][1] * v.y + a.m[0][2] * v.z,
+	            a.m[1][0] * v.x + a.m[1][1] * v.y + a.m[1][2] * v.z,
+	            a.m[2][0] * v.x + a.m[2][1] * v.y + a.m[2][2] * v.z);
+}
+
+
+#endif
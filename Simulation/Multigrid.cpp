@@ -0,0 +1,419 @@
+#include "Multigrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Profiler.h"
+#include "ThreadPool.h"
+
+
+namespace
+{
+	// rows per parallel chunk, as in the implicit solver
+	const size_t kGrain = 4096;
+
+	const uint32_t kNone = 0xffffffffu;
+
+	// a level has to shrink at least to this fraction of the finer one
+	const float kMinCoarsening = 0.75f;
+
+	const size_t kMaxLevels = 16;
+
+	// Jacobi sweeps on a coarsest level too large to be factored
+	const int kCoarseSweeps = 16;
+}
+
+
+void MultigridHierarchy::setPattern(const BlockSparseMatrix& matrix, const std::vector<uint8_t>& fixed)
+{
+	// reserved, so that adding a level does not move the matrices of the others
+	m_levels.clear();
+	m_levels.reserve(kMaxLevels);
+	m_levels.resize(1);
+	m_factorValid = false;
+
+	while (m_levels.size() < kMaxLevels)
+	{
+		const size_t l = m_levels.size() - 1;
+		const BlockSparseMatrix& A = l == 0 ? matrix : m_levels[l].matrix;
+		if (A.numRows() <= kDirectPoints || !coarsen(l, A, l == 0 ? &fixed : nullptr))
+		{
+			break;
+		}
+	}
+
+	// diagonal blocks and scratch vectors of every level
+	for (size_t l = 0; l < m_levels.size(); l++)
+	{
+		Level& level = m_levels[l];
+		const BlockSparseMatrix& A = l == 0 ? matrix : level.matrix;
+		const size_t n = A.numRows();
+		level.diagonalBlocks.resize(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			level.diagonalBlocks[i] = (uint32_t)A.findBlock((uint32_t)i, (uint32_t)i);
+		}
+		level.invDiagonal.resize(n);
+		level.tmp.resize(n);
+		if (l > 0)
+		{
+			level.rhs.resize(n);
+			level.z.resize(n);
+		}
+	}
+
+	const size_t coarsest = m_levels.back().invDiagonal.size();
+	if (coarsest <= kDirectPoints)
+	{
+		m_factor.resize(9 * coarsest * coarsest);
+		m_solveTmp.resize(3 * coarsest);
+	}
+}
+
+
+bool MultigridHierarchy::coarsen(size_t l, const BlockSparseMatrix& A, const std::vector<uint8_t>* fixed)
+{
+	const size_t n = A.numRows();
+	std::vector<uint32_t> aggregates(n, kNone);
+	uint32_t numAggregates = 0;
+
+	// neighbours on this level: the off-diagonal blocks, without fixed points
+	auto excluded = [&](uint32_t i) { return fixed && (*fixed)[i] != 0; };
+
+	// 1. a free point whose neighbours are all free becomes an aggregate with them
+	for (uint32_t i = 0; i < n; i++)
+	{
+		if (excluded(i) || aggregates[i] != kNone) { continue; }
+		bool allFree = true;
+		for (uint32_t k = A.m_rowOffsets[i]; k < A.m_rowOffsets[i + 1] && allFree; k++)
+		{
+			const uint32_t j = A.m_columns[k];
+			allFree = excluded(j) || aggregates[j] == kNone;
+		}
+		if (!allFree) { continue; }
+		for (uint32_t k = A.m_rowOffsets[i]; k < A.m_rowOffsets[i + 1]; k++)
+		{
+			const uint32_t j = A.m_columns[k];
+			if (!excluded(j)) { aggregates[j] = numAggregates; }
+		}
+		aggregates[i] = numAggregates++;
+	}
+
+	// 2. the points left join the aggregate of a neighbour from step 1
+	std::vector<uint32_t> joined(aggregates);
+	for (uint32_t i = 0; i < n; i++)
+	{
+		if (excluded(i) || aggregates[i] != kNone) { continue; }
+		for (uint32_t k = A.m_rowOffsets[i]; k < A.m_rowOffsets[i + 1]; k++)
+		{
+			if (aggregates[A.m_columns[k]] != kNone)
+			{
+				joined[i] = aggregates[A.m_columns[k]];
+				break;
+			}
+		}
+	}
+	aggregates.swap(joined);
+
+	// 3. points without such a neighbour form aggregates with their free neighbours
+	for (uint32_t i = 0; i < n; i++)
+	{
+		if (excluded(i) || aggregates[i] != kNone) { continue; }
+		for (uint32_t k = A.m_rowOffsets[i]; k < A.m_rowOffsets[i + 1]; k++)
+		{
+			const uint32_t j = A.m_columns[k];
+			if (!excluded(j) && aggregates[j] == kNone) { aggregates[j] = numAggregates; }
+		}
+		aggregates[i] = numAggregates++;
+	}
+
+	if (numAggregates == 0 || numAggregates > kMinCoarsening * n)
+	{
+		return false;
+	}
+
+	// points of every aggregate, in ascending order
+	Level& level = m_levels[l];
+	level.memberOffsets.assign(numAggregates + 1, 0);
+	for (size_t i = 0; i < n; i++)
+	{
+		if (aggregates[i] != kNone) { level.memberOffsets[aggregates[i] + 1]++; }
+	}
+	for (uint32_t a = 0; a < numAggregates; a++)
+	{
+		level.memberOffsets[a + 1] += level.memberOffsets[a];
+	}
+	level.members.resize(level.memberOffsets[numAggregates]);
+	std::vector<uint32_t> fill(level.memberOffsets.begin(), level.memberOffsets.end() - 1);
+	for (uint32_t i = 0; i < n; i++)
+	{
+		if (aggregates[i] != kNone) { level.members[fill[aggregates[i]]++] = i; }
+	}
+
+	// coarse pattern: aggregates connected by a block of this level
+	std::vector<uint32_t> rowOffsets(numAggregates + 1, 0);
+	std::vector<uint32_t> columns;
+	std::vector<uint32_t> row;
+	for (uint32_t a = 0; a < numAggregates; a++)
+	{
+		row.clear();
+		for (uint32_t m = level.memberOffsets[a]; m < level.memberOffsets[a + 1]; m++)
+		{
+			const uint32_t i = level.members[m];
+			for (uint32_t k = A.m_rowOffsets[i]; k < A.m_rowOffsets[i + 1]; k++)
+			{
+				const uint32_t target = aggregates[A.m_columns[k]];
+				if (target != kNone) { row.push_back(target); }
+			}
+		}
+		std::sort(row.begin(), row.end());
+		row.erase(std::unique(row.begin(), row.end()), row.end());
+		columns.insert(columns.end(), row.begin(), row.end());
+		rowOffsets[a + 1] = (uint32_t)columns.size();
+	}
+
+	m_levels.push_back(Level());
+	Level& coarse = m_levels.back();
+	coarse.matrix.setPattern(rowOffsets, columns);
+
+	level.blockTargets.assign(A.numBlocks(), kNone);
+	for (uint32_t i = 0; i < n; i++)
+	{
+		if (aggregates[i] == kNone) { continue; }
+		for (uint32_t k = A.m_rowOffsets[i]; k < A.m_rowOffsets[i + 1]; k++)
+		{
+			const uint32_t target = aggregates[A.m_columns[k]];
+			if (target != kNone) { level.blockTargets[k] = (uint32_t)coarse.matrix.findBlock(aggregates[i], target); }
+		}
+	}
+	level.aggregates.swap(aggregates);
+	return true;
+}
+
+
+void MultigridHierarchy::update(const BlockSparseMatrix& matrix, ThreadPool* pool)
+{
+	PROFILE_ZONE("Multigrid update");
+	for (size_t l = 0; l < m_levels.size(); l++)
+	{
+		Level& level = m_levels[l];
+		const BlockSparseMatrix& A = l == 0 ? matrix : level.matrix;
+
+		parallelFor(pool, A.numRows(), kGrain, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				level.invDiagonal[i] = A.m_blocks[level.diagonalBlocks[i]].inverse();
+			}
+		});
+
+		if (l + 1 == m_levels.size()) { break; }
+
+		// Galerkin product by coarse rows: every coarse block sums the blocks
+		// between the points of its two aggregates, always in the same order
+		Level& coarse = m_levels[l + 1];
+		std::vector<Mat3>& coarseBlocks = coarse.matrix.m_blocks;
+		parallelFor(pool, coarse.matrix.numRows(), kGrain, [&](size_t begin, size_t end)
+		{
+			for (size_t a = begin; a < end; a++)
+			{
+				for (uint32_t k = coarse.matrix.m_rowOffsets[a]; k < coarse.matrix.m_rowOffsets[a + 1]; k++)
+				{
+					coarseBlocks[k].setZero();
+				}
+				for (uint32_t m = level.memberOffsets[a]; m < level.memberOffsets[a + 1]; m++)
+				{
+					const uint32_t i = level.members[m];
+					for (uint32_t k = A.m_rowOffsets[i]; k < A.m_rowOffsets[i + 1]; k++)
+					{
+						if (level.blockTargets[k] != kNone) { coarseBlocks[level.blockTargets[k]] += A.m_blocks[k]; }
+					}
+				}
+			}
+		});
+	}
+
+	const BlockSparseMatrix& coarsest = m_levels.size() == 1 ? matrix : m_levels.back().matrix;
+	m_factorValid = coarsest.numRows() <= kDirectPoints && factorCoarsest(coarsest);
+}
+
+
+bool MultigridHierarchy::factorCoarsest(const BlockSparseMatrix& A)
+{
+	// dense lower triangle of A, then an in place Cholesky factorisation A = L * L^T
+	const size_t N = 3 * A.numRows();
+	std::fill(m_factor.begin(), m_factor.end(), 0.0);
+	for (size_t i = 0; i < A.numRows(); i++)
+	{
+		for (uint32_t k = A.m_rowOffsets[i]; k < A.m_rowOffsets[i + 1]; k++)
+		{
+			const size_t j = A.m_columns[k];
+			if (j > i) { break; }
+			for (int r = 0; r < 3; r++)
+			{
+				for (int c = 0; c < 3; c++)
+				{
+					if (3 * j + c <= 3 * i + r) { m_factor[(3 * i + r) * N + 3 * j + c] = A.m_blocks[k].m[r][c]; }
+				}
+			}
+		}
+	}
+
+	for (size_t j = 0; j < N; j++)
+	{
+		double* rowJ = &m_factor[j * N];
+		double d = rowJ[j];
+		for (size_t k = 0; k < j; k++)
+		{
+			d -= rowJ[k] * rowJ[k];
+		}
+		if (!(d > 0.0))
+		{
+			return false;
+		}
+		rowJ[j] = std::sqrt(d);
+		const double inv = 1.0 / rowJ[j];
+		for (size_t i = j + 1; i < N; i++)
+		{
+			double* rowI = &m_factor[i * N];
+			double sum = rowI[j];
+			for (size_t k = 0; k < j; k++)
+			{
+				sum -= rowI[k] * rowJ[k];
+			}
+			rowI[j] = sum * inv;
+		}
+	}
+	return true;
+}
+
+
+void MultigridHierarchy::solveCoarsest(const Vec3* rhs, Vec3* z)
+{
+	const size_t N = m_solveTmp.size();
+	for (size_t i = 0; i < N; i++)
+	{
+		const double* row = &m_factor[i * N];
+		double sum = rhs[i / 3][i % 3];
+		for (size_t k = 0; k < i; k++)
+		{
+			sum -= row[k] * m_solveTmp[k];
+		}
+		m_solveTmp[i] = sum / row[i];
+	}
+	for (size_t i = N; i-- > 0;)
+	{
+		double sum = m_solveTmp[i];
+		for (size_t k = i + 1; k < N; k++)
+		{
+			sum -= m_factor[k * N + i] * m_solveTmp[k];
+		}
+		m_solveTmp[i] = sum / m_factor[i * N + i];
+	}
+	for (size_t i = 0; i < N; i++)
+	{
+		z[i / 3][i % 3] = (float)m_solveTmp[i];
+	}
+}
+
+
+void MultigridHierarchy::smooth(size_t l, const BlockSparseMatrix& A, const Vec3* rhs, Vec3* z, int sweeps, bool zeroStart, ThreadPool* pool)
+{
+	Level& level = m_levels[l];
+	const float w = m_smoothingWeight;
+	for (int sweep = 0; sweep < sweeps; sweep++)
+	{
+		if (zeroStart && sweep == 0)
+		{
+			parallelFor(pool, A.numRows(), kGrain, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					z[i] = w * (level.invDiagonal[i] * rhs[i]);
+				}
+			});
+			continue;
+		}
+		// A * z of all rows first, the update reads z of the neighbours
+		parallelFor(pool, A.numRows(), kGrain, [&](size_t begin, size_t end)
+		{
+			A.multiply(z, level.tmp.data(), begin, end);
+		});
+		parallelFor(pool, A.numRows(), kGrain, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				z[i] += w * (level.invDiagonal[i] * (rhs[i] - level.tmp[i]));
+			}
+		});
+	}
+}
+
+
+void MultigridHierarchy::vcycle(const BlockSparseMatrix& matrix, const Vec3* r, Vec3* z, ThreadPool* pool)
+{
+	PROFILE_ZONE("V-cycle");
+	const size_t numLevels = m_levels.size();
+	auto levelMatrix = [&](size_t l) -> const BlockSparseMatrix& { return l == 0 ? matrix : m_levels[l].matrix; };
+	auto levelRhs    = [&](size_t l) -> const Vec3* { return l == 0 ? r : m_levels[l].rhs.data(); };
+	auto levelZ      = [&](size_t l) -> Vec3*       { return l == 0 ? z : m_levels[l].z.data(); };
+
+	// down: smooth, restrict the residual to the next level
+	for (size_t l = 0; l + 1 < numLevels; l++)
+	{
+		Level& level = m_levels[l];
+		const BlockSparseMatrix& A = levelMatrix(l);
+		const Vec3* rhs = levelRhs(l);
+		Vec3* x = levelZ(l);
+		smooth(l, A, rhs, x, m_smoothingSweeps, true, pool);
+
+		parallelFor(pool, A.numRows(), kGrain, [&](size_t begin, size_t end)
+		{
+			A.multiply(x, level.tmp.data(), begin, end);
+			for (size_t i = begin; i < end; i++)
+			{
+				level.tmp[i] = rhs[i] - level.tmp[i];
+			}
+		});
+		Level& coarse = m_levels[l + 1];
+		parallelFor(pool, coarse.rhs.size(), kGrain, [&](size_t begin, size_t end)
+		{
+			for (size_t a = begin; a < end; a++)
+			{
+				Vec3 sum(0.f, 0.f, 0.f);
+				for (uint32_t m = level.memberOffsets[a]; m < level.memberOffsets[a + 1]; m++)
+				{
+					sum += level.tmp[level.members[m]];
+				}
+				coarse.rhs[a] = sum;
+			}
+		});
+	}
+
+	// coarsest level
+	const size_t last = numLevels - 1;
+	if (m_factorValid)
+	{
+		solveCoarsest(levelRhs(last), levelZ(last));
+	}
+	else
+	{
+		smooth(last, levelMatrix(last), levelRhs(last), levelZ(last), kCoarseSweeps, true, pool);
+	}
+
+	// up: add the prolongated coarse correction, smooth
+	for (size_t l = last; l-- > 0;)
+	{
+		const Level& level = m_levels[l];
+		const Vec3* coarseZ = m_levels[l + 1].z.data();
+		Vec3* x = levelZ(l);
+		parallelFor(pool, level.aggregates.size(), kGrain, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				if (level.aggregates[i] != kNone) { x[i] += coarseZ[level.aggregates[i]]; }
+			}
+		});
+		smooth(l, levelMatrix(l), levelRhs(l), x, m_smoothingSweeps, false, pool);
+	}
+}
@@ -0,0 +1,92 @@
+#ifndef __Multigrid_h__
+#define __Multigrid_h__
+
+#include <cstdint>
+#include <vector>
+
+#include "BlockSparseMatrix.h"
+
+class ThreadPool;
+
+
+// Multigrid hierarchy for the block systems of the implicit solver, whose
+// matrix pattern is the spring graph (see ImplicitEulerSolver).
+// setPattern() coarsens that graph level by level: a point whose neighbours
+// are all still free forms one coarse point with them (aggregation), the rest
+// join a neighbouring aggregate, until a level has at most kDirectPoints
+// points or stops shrinking. The coarse matrices are the Galerkin products
+// P^T * A * P of the piecewise constant prolongation P of the aggregates.
+// update() recomputes their values in place after the fine blocks changed, so
+// a step never allocates. vcycle() applies one V-cycle: damped block Jacobi
+// smoothing on the way down, the coarsest level solved directly (Cholesky),
+// the corrections prolongated and smoothed again on the way up. With the same
+// smoothing before and after it is a symmetric positive definite
+// approximation of A^-1, usable as a CG preconditioner.
+// As everywhere else the results do not depend on the number of threads.
+class MultigridHierarchy
+{
+public:
+	// levels with at most this many points are solved directly
+	static const uint32_t kDirectPoints = 64;
+
+	MultigridHierarchy() : m_smoothingSweeps(1), m_smoothingWeight(0.7f), m_factorValid(false) {}
+
+	// Build the levels for the pattern of matrix. Rows with fixed[i] != 0 are
+	// the identity and are left out of the coarse levels. Has to be called
+	// again whenever the pattern or the fixed points change.
+	void setPattern(const BlockSparseMatrix& matrix, const std::vector<uint8_t>& fixed);
+
+	// Recompute the coarse matrices for the current blocks of matrix, which
+	// has the pattern given to setPattern(). pool may be null.
+	void update(const BlockSparseMatrix& matrix, ThreadPool* pool);
+
+	// z = M^-1 * r for one V-cycle M^-1 ~ A^-1 (both of size matrix.numRows())
+	void vcycle(const BlockSparseMatrix& matrix, const Vec3* r, Vec3* z, ThreadPool* pool);
+
+	size_t numLevels() const { return m_levels.size(); }
+	size_t levelSize(size_t level) const { return m_levels[level].invDiagonal.size(); }
+
+	// block Jacobi sweeps before and after the coarse correction of every level,
+	// and their damping (below 1, the spring matrices have D^-1 * A <= 2)
+	int   m_smoothingSweeps;
+	float m_smoothingWeight;
+
+private:
+	struct Level
+	{
+		BlockSparseMatrix matrix;  // empty on level 0, which is the caller's matrix
+		std::vector<uint32_t> diagonalBlocks;
+		std::vector<Mat3> invDiagonal;
+
+		// to the next coarser level: coarse point of every point (or kNone),
+		// the points of every coarse point, and the coarse block every block adds to
+		std::vector<uint32_t> aggregates;
+		std::vector<uint32_t> memberOffsets;
+		std::vector<uint32_t> members;
+		std::vector<uint32_t> blockTargets;
+
+		// right hand side and solution (coarse levels only), and scratch
+		std::vector<Vec3> rhs;
+		std::vector<Vec3> z;
+		std::vector<Vec3> tmp;
+	};
+
+	// Add the aggregation of level l and level l + 1; false if it would not shrink enough
+	bool coarsen(size_t l, const BlockSparseMatrix& matrix, const std::vector<uint8_t>* fixed);
+
+	// sweeps damped Jacobi iterations on z for A * z = rhs; from zero if zeroStart
+	void smooth(size_t l, const BlockSparseMatrix& A, const Vec3* rhs, Vec3* z, int sweeps, bool zeroStart, ThreadPool* pool);
+
+	// Cholesky factorisation of the coarsest level, and the solve with it
+	bool factorCoarsest(const BlockSparseMatrix& A);
+	void solveCoarsest(const Vec3* rhs, Vec3* z);
+
+	std::vector<Level> m_levels;
+
+	// dense lower triangular factor of the coarsest matrix (3 rows per point)
+	std::vector<double> m_factor;
+	std::vector<double> m_solveTmp;
+	bool m_factorValid;
+};
+
+#endif
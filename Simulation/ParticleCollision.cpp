@@ -0,0 +1,257 @@
+#include "ParticleCollision.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "MassSpringSystem.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+
+
+namespace
+{
+	// points per parallel chunk; also the granularity of the partial contact counts
+	const size_t kGrain = 4096;
+
+	// Push a point of velocity v that is depth inside a surface of normal n out
+	// of it; remove the velocity into the surface and apply Coulomb friction
+	// (the tangential velocity loses up to friction times the removed normal velocity)
+	inline void resolveContact(Vec3& x, Vec3& v, const Vec3& n, float depth, float friction)
+	{
+		x += depth * n;
+		float vn = dot(v, n);
+		if (vn >= 0.f) { return; }
+
+		Vec3 vt = v - vn * n;
+		float vtLength = length(vt);
+		float scale = vtLength > 0.f ? std::max(0.f, 1.f + friction * vn / vtLength) : 0.f;
+		v = scale * vt;
+	}
+
+	// Normal and depth of a sphere of the given radius at p against box, or false if they do not touch
+	inline bool sphereBoxContact(const Vec3& p, float radius, const Box& box, Vec3& normal, float& depth)
+	{
+		Vec3 d = p - box.center;
+		Vec3 local(dot(d, box.axes[0]), dot(d, box.axes[1]), dot(d, box.axes[2]));
+		Vec3 outside;
+		bool inside = true;
+		for (int k = 0; k < 3; k++)
+		{
+			float h = box.halfExtents[k];
+			float clamped = std::min(std::max(local[k], -h), h);
+			outside[k] = local[k] - clamped;
+			inside &= outside[k] == 0.f;
+		}
+
+		if (!inside)
+		{
+			float distSq = lengthSq(outside);
+			if (distSq >= radius * radius) { return false; }
+			float dist = std::sqrt(distSq);
+			normal = (outside.x * box.axes[0] + outside.y * box.axes[1] + outside.z * box.axes[2]) * (1.f / dist);
+			depth = radius - dist;
+			return true;
+		}
+
+		// centre inside the box: leave through the nearest face
+		int axis = 0;
+		float minDepth = box.halfExtents[0] - std::fabs(local[0]);
+		for (int k = 1; k < 3; k++)
+		{
+			float faceDepth = box.halfExtents[k] - std::fabs(local[k]);
+			if (faceDepth < minDepth) { minDepth = faceDepth; axis = k; }
+		}
+		normal = local[axis] < 0.f ? -box.axes[axis] : box.axes[axis];
+		depth = minDepth + radius;
+		return true;
+	}
+}
+
+
+void ParticleCollider::beginStep(const MassSpringSystem& ms)
+{
+	m_sweep = ms.m_params.continuousCollision && !ms.m_colliderBoxes.empty();
+	if (m_sweep)
+	{
+		m_startPositions = ms.m_positions;
+	}
+}
+
+
+void ParticleCollider::step(MassSpringSystem& ms, ThreadPool* pool)
+{
+	PROFILE_ZONE("Particle collision");
+	m_stats = ParticleCollisionStats();
+	if (ms.m_params.selfCollision)
+	{
+		for (int it = 0; it < ms.m_params.collisionIterations; it++)
+		{
+			collideParticles(ms, pool);
+		}
+	}
+	if (!ms.m_colliderPlanes.empty() || !ms.m_colliderBoxes.empty())
+	{
+		collideShapes(ms, pool);
+	}
+	PROFILE_COUNT("Point contacts", m_stats.numParticleContacts + m_stats.numShapeContacts);
+}
+
+
+void ParticleCollider::collideParticles(MassSpringSystem& ms, ThreadPool* pool)
+{
+	const size_t n = ms.numPoints();
+	const float contactDistance = 2.f * ms.m_params.collisionRadius;
+	if (n == 0 || contactDistance <= 0.f) { return; }
+
+	std::vector<Vec3>& x = ms.m_positions;
+	std::vector<Vec3>& v = ms.m_velocities;
+	const std::vector<float>& invMasses = ms.m_invMasses;
+
+	m_hash.build(x, contactDistance);
+	m_stats.numHashBuckets = m_hash.numBuckets();
+	m_stats.numParticleContacts = 0;
+
+	// corrections from the current positions; the points are visited in bucket
+	// order, so neighbouring queries hit the same cells
+	m_positionCorrections.resize(n);
+	m_velocityCorrections.resize(n);
+	m_partial.assign((n + kGrain - 1) / kGrain, 0);
+	const std::vector<uint32_t>& sortedPoints = m_hash.sortedPoints();
+	const std::vector<Vec3>& sortedPositions = m_hash.sortedPositions();
+	parallelFor(pool, n, kGrain, [&](size_t begin, size_t end)
+	{
+		size_t contacts = 0;
+		for (size_t k = begin; k < end; k++)
+		{
+			const uint32_t i = sortedPoints[k];
+			const float wi = invMasses[i];
+			Vec3 dx, dv;
+			int count = 0;
+			m_hash.forEachNeighbour(sortedPositions[k], contactDistance, [&](uint32_t j, const Vec3& d)
+			{
+				if (j == i) { return; }
+				if (j > i) { contacts++; }
+
+				const float wj = invMasses[j];
+				const float distSq = lengthSq(d);
+				if (wi == 0.f || wi + wj == 0.f || distSq == 0.f) { return; }
+
+				const float dist = std::sqrt(distSq);
+				const Vec3 normal = d * (1.f / dist);
+				const float share = wi / (wi + wj);
+				dx += ((contactDistance - dist) * share) * normal;
+				float approach = dot(v[i] - v[j], normal);
+				if (approach < 0.f)
+				{
+					dv -= (approach * share) * normal;
+				}
+				count++;
+			});
+
+			if (count > 1)
+			{
+				dx *= 1.f / count;
+				dv *= 1.f / count;
+			}
+			m_positionCorrections[i] = dx;
+			m_velocityCorrections[i] = dv;
+		}
+		m_partial[begin / kGrain] = contacts;
+	});
+
+	parallelFor(pool, n, kGrain, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			x[i] += m_positionCorrections[i];
+			v[i] += m_velocityCorrections[i];
+		}
+	});
+
+	for (size_t c = 0; c < m_partial.size(); c++)
+	{
+		m_stats.numParticleContacts += m_partial[c];
+	}
+}
+
+
+void ParticleCollider::collideShapes(MassSpringSystem& ms, ThreadPool* pool)
+{
+	const size_t n = ms.numPoints();
+	std::vector<Vec3>& x = ms.m_positions;
+	std::vector<Vec3>& v = ms.m_velocities;
+	const std::vector<uint8_t>& fixed = ms.m_fixed;
+	const std::vector<Plane>& planes = ms.m_colliderPlanes;
+	const std::vector<Box>& boxes = ms.m_colliderBoxes;
+	const float radius = ms.m_params.collisionRadius;
+	const float friction = ms.m_params.collisionFriction;
+
+	const bool sweep = m_sweep && m_startPositions.size() == n;
+	const Vec3 grow(radius, radius, radius);
+
+	m_partial.assign((n + kGrain - 1) / kGrain, 0);
+	m_sweptPartial.assign(m_partial.size(), 0);
+	parallelFor(pool, n, kGrain, [&](size_t begin, size_t end)
+	{
+		size_t contacts = 0, swept = 0;
+		for (size_t i = begin; i < end; i++)
+		{
+			if (fixed[i]) { continue; }
+
+			// stop at the first box the path enters
+			if (sweep)
+			{
+				float first = 2.f;
+				Vec3 firstNormal;
+				for (size_t b = 0; b < boxes.size(); b++)
+				{
+					Box grown = boxes[b];
+					grown.halfExtents += grow;
+					float t;
+					Vec3 normal;
+					if (segmentEntersBox(m_startPositions[i], x[i], grown, t, normal) && t < first)
+					{
+						first = t;
+						firstNormal = normal;
+					}
+				}
+				if (first <= 1.f)
+				{
+					x[i] = m_startPositions[i] + first * (x[i] - m_startPositions[i]);
+					resolveContact(x[i], v[i], firstNormal, 0.f, friction);
+					swept++;
+				}
+			}
+
+			bool touching = false;
+			for (size_t p = 0; p < planes.size(); p++)
+			{
+				float depth = planes[p].offset + radius - dot(planes[p].normal, x[i]);
+				if (depth > 0.f)
+				{
+					resolveContact(x[i], v[i], planes[p].normal, depth, friction);
+					touching = true;
+				}
+			}
+			for (size_t b = 0; b < boxes.size(); b++)
+			{
+				Vec3 normal;
+				float depth;
+				if (sphereBoxContact(x[i], radius, boxes[b], normal, depth))
+				{
+					resolveContact(x[i], v[i], normal, depth, friction);
+					touching = true;
+				}
+			}
+			if (touching) { contacts++; }
+		}
+		m_partial[begin / kGrain] = contacts;
+		m_sweptPartial[begin / kGrain] = swept;
+	});
+
+	for (size_t c = 0; c < m_partial.size(); c++)
+	{
+		m_stats.numShapeContacts += m_partial[c];
+		m_stats.numSweptContacts += m_sweptPartial[c];
+	}
+}
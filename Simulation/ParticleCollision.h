@@ -0,0 +1,96 @@
+#ifndef __ParticleCollision_h__
+#define __ParticleCollision_h__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "BoxCollision.h"
+#include "SpatialHash.h"
+#include "Vec3.h"
+
+class MassSpringSystem;
+class ThreadPool;
+
+
+// Half space dot(normal, x) <= offset that mass points are kept out of
+// (normal: unit length, pointing out of the solid). The demo's floor at
+// y = -1 is Plane(Vec3(0, 1, 0), -1).
+struct Plane
+{
+	Vec3  normal;
+	float offset;
+
+	Plane() : normal(0.f, 1.f, 0.f), offset(0.f) {}
+	Plane(const Vec3& normal, float offset) : normal(normal), offset(offset) {}
+};
+
+// Counters of the last ParticleCollider::step()
+struct ParticleCollisionStats
+{
+	size_t numParticleContacts;  // point pairs closer than two radii in the last pass (each pair counted once)
+	size_t numShapeContacts;     // points touching a plane or box
+	size_t numSweptContacts;     // points stopped by the swept test
+	size_t numHashBuckets;
+
+	ParticleCollisionStats() : numParticleContacts(0), numShapeContacts(0), numSweptContacts(0), numHashBuckets(0) {}
+};
+
+
+// Collision of the mass points of a MassSpringSystem, done after each
+// integration step on positions and velocities. Every point is a sphere of
+// radius ms.m_params.collisionRadius.
+//
+// Self collision: the points are put into a SpatialHash with cells of two
+// radii, rebuilt every step, so every point only meets the points of at most 27
+// cells. Overlapping pairs are pushed apart along their centre line, split by
+// inverse mass, and lose the velocity with which they approach each other. All
+// corrections are computed from the same positions (Jacobi) and every point
+// averages the corrections of its pairs: the result does not depend on the
+// order of the points or on the number of threads, and a point squeezed from
+// several sides does not overshoot. Every one of the
+// ms.m_params.collisionIterations passes rebuilds the grid, which costs far
+// less than the queries.
+//
+// Shapes: points are projected out of the planes and oriented boxes (the
+// boxes of checkCollision(), see Box::fromTransform()) of the system, their
+// velocity into the shape is removed and Coulomb friction slows them down
+// along the surface. A point that moves further than a box is thick in one
+// step ends up on its far side, where the projection pushes it out the wrong
+// way. With ms.m_params.continuousCollision the path of every point since
+// beginStep() is swept against the boxes (grown by the radius) first, and a
+// point whose path enters one is stopped at the entry point.
+class ParticleCollider
+{
+public:
+	ParticleCollider() : m_sweep(false) {}
+
+	// Remember the positions at the start of a step for the swept test
+	// (only if ms.m_params.continuousCollision is set and there are boxes)
+	void beginStep(const MassSpringSystem& ms);
+
+	// Resolve the collisions of ms (self collision if ms.m_params.selfCollision,
+	// shapes from ms.m_colliderPlanes and ms.m_colliderBoxes). pool may be null.
+	void step(MassSpringSystem& ms, ThreadPool* pool);
+
+	const ParticleCollisionStats& lastStepStats() const { return m_stats; }
+
+	// Grid of the last self collision step
+	const SpatialHash& spatialHash() const { return m_hash; }
+
+private:
+	void collideParticles(MassSpringSystem& ms, ThreadPool* pool);
+	void collideShapes(MassSpringSystem& ms, ThreadPool* pool);
+
+	SpatialHash m_hash;
+	bool m_sweep;  // m_startPositions are valid for this step
+	std::vector<Vec3>   m_startPositions;
+	std::vector<Vec3>   m_positionCorrections;
+	std::vector<Vec3>   m_velocityCorrections;
+	std::vector<size_t> m_partial;  // contacts per chunk of points
+	std::vector<size_t> m_sweptPartial;
+	ParticleCollisionStats m_stats;
+};
+
+
+#endif
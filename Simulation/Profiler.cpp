@@ -0,0 +1,399 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+
+double ProfileSummary::zoneMilliseconds(const char* name) const
+{
+	for (size_t z = 0; z < zones.size(); z++)
+	{
+		if (strcmp(zones[z].name, name) == 0)
+		{
+			return zones[z].milliseconds;
+		}
+	}
+	return 0.0;
+}
+
+
+double ProfileSummary::counterPerFrame(const char* name) const
+{
+	for (size_t c = 0; c < counters.size(); c++)
+	{
+		if (strcmp(counters[c].name, name) == 0)
+		{
+			return counters[c].perFrame;
+		}
+	}
+	return 0.0;
+}
+
+
+uint64_t Profiler::now()
+{
+	static const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+
+#ifdef SIMULATION_PROFILE
+
+namespace
+{
+	const uint64_t kRingSize = 1 << 16;  // zones per thread
+	const uint64_t kMaxFrames = 1024;
+
+	struct ZoneEvent
+	{
+		const char* name;
+		uint64_t    start;
+		uint64_t    end;
+	};
+
+	// Written only by its thread: the zone goes in first, then numWritten
+	// is published. Readers take the zones below numWritten; the oldest of
+	// them may be overwritten while they are read.
+	struct ThreadRing
+	{
+		std::vector<ZoneEvent> zones;
+		std::atomic<uint64_t>  numWritten;
+		uint32_t    id;
+		std::string name;
+		bool        inUse;
+	};
+
+	struct Frame
+	{
+		uint64_t start;
+		uint64_t end;
+		std::vector<int64_t> counters;  // in the order of Registry::counters
+	};
+
+	struct Registry
+	{
+		std::mutex mutex;
+		std::vector<std::unique_ptr<ThreadRing>> threads;  // kept after their thread ends (and reused)
+		std::vector<ProfileCounter*> counters;
+		std::vector<Frame> frames;  // ring of kMaxFrames
+		uint64_t numFrames;
+		uint64_t frameStart;
+
+		Registry() : frames(kMaxFrames), numFrames(0), frameStart(0) {}
+	};
+
+	Registry& registry()
+	{
+		static Registry r;
+		return r;
+	}
+
+	// Ring of the calling thread, handed back when the thread ends
+	struct RingOwner
+	{
+		ThreadRing* ring;
+
+		RingOwner() : ring(nullptr) {}
+		~RingOwner()
+		{
+			if (ring)
+			{
+				std::lock_guard<std::mutex> lock(registry().mutex);
+				ring->inUse = false;
+			}
+		}
+	};
+	thread_local RingOwner t_ringOwner;
+
+	ThreadRing* threadRing()
+	{
+		if (!t_ringOwner.ring)
+		{
+			Registry& r = registry();
+			std::lock_guard<std::mutex> lock(r.mutex);
+			for (size_t t = 0; t < r.threads.size() && !t_ringOwner.ring; t++)
+			{
+				if (!r.threads[t]->inUse)
+				{
+					t_ringOwner.ring = r.threads[t].get();
+				}
+			}
+			if (!t_ringOwner.ring)
+			{
+				r.threads.push_back(std::unique_ptr<ThreadRing>(new ThreadRing()));
+				ThreadRing* ring = r.threads.back().get();
+				ring->zones.resize(kRingSize);
+				ring->numWritten = 0;
+				ring->id = (uint32_t)r.threads.size() - 1;
+				t_ringOwner.ring = ring;
+			}
+			t_ringOwner.ring->inUse = true;
+			t_ringOwner.ring->name = "Thread " + std::to_string(t_ringOwner.ring->id);
+		}
+		return t_ringOwner.ring;
+	}
+
+	// Zones of a ring that are still there, oldest first
+	void copyZones(const ThreadRing& ring, std::vector<ZoneEvent>& zones)
+	{
+		const uint64_t end = ring.numWritten.load(std::memory_order_acquire);
+		uint64_t begin = end > kRingSize ? end - kRingSize : 0;
+		zones.clear();
+		for (uint64_t k = begin; k < end; k++)
+		{
+			zones.push_back(ring.zones[k % kRingSize]);
+		}
+		// drop the ones the thread may have overwritten meanwhile
+		const uint64_t written = ring.numWritten.load(std::memory_order_acquire);
+		const uint64_t overwritten = written > kRingSize ? written - kRingSize : 0;
+		if (overwritten > begin)
+		{
+			zones.erase(zones.begin(), zones.begin() + (size_t)std::min(overwritten - begin, (uint64_t)zones.size()));
+		}
+	}
+
+	void writeJsonString(FILE* f, const char* s)
+	{
+		fputc('"', f);
+		for (; *s; s++)
+		{
+			if (*s == '"' || *s == '\\') { fputc('\\', f); }
+			if ((unsigned char)*s >= 0x20) { fputc(*s, f); }
+		}
+		fputc('"', f);
+	}
+}
+
+
+ProfileCounter::ProfileCounter(const char* name)
+	: m_name(name), m_value(0)
+{
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	r.counters.push_back(this);
+}
+
+
+bool Profiler::enabled()
+{
+	return true;
+}
+
+
+void Profiler::zone(const char* name, uint64_t start, uint64_t end)
+{
+	ThreadRing* ring = threadRing();
+	const uint64_t k = ring->numWritten.load(std::memory_order_relaxed);
+	ZoneEvent& zone = ring->zones[k % kRingSize];
+	zone.name = name;
+	zone.start = start;
+	zone.end = end;
+	ring->numWritten.store(k + 1, std::memory_order_release);
+}
+
+
+void Profiler::setThreadName(const char* name)
+{
+	ThreadRing* ring = threadRing();
+	std::lock_guard<std::mutex> lock(registry().mutex);
+	ring->name = name;
+}
+
+
+void Profiler::endFrame()
+{
+	Registry& r = registry();
+	const uint64_t end = now();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	Frame& frame = r.frames[r.numFrames % kMaxFrames];
+	frame.start = r.frameStart;
+	frame.end = end;
+	frame.counters.resize(r.counters.size());
+	for (size_t c = 0; c < r.counters.size(); c++)
+	{
+		frame.counters[c] = r.counters[c]->take();
+	}
+	r.numFrames++;
+	r.frameStart = end;
+}
+
+
+void Profiler::summary(ProfileSummary& out, int numFrames)
+{
+	out = ProfileSummary();
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+
+	// frames starting before oldest lost zones in some ring; the slack keeps
+	// clear of the zones a thread is overwriting right now
+	const uint64_t kSlack = 1024;
+	uint64_t oldest = 0;
+	for (size_t t = 0; t < r.threads.size(); t++)
+	{
+		const ThreadRing& ring = *r.threads[t];
+		const uint64_t written = ring.numWritten.load(std::memory_order_acquire);
+		if (written + kSlack > kRingSize)
+		{
+			oldest = std::max(oldest, ring.zones[(written + kSlack - kRingSize) % kRingSize].start);
+		}
+	}
+
+	const uint64_t last = r.numFrames;
+	uint64_t first = last - std::min<uint64_t>(std::min<uint64_t>(std::max(numFrames, 1), kMaxFrames), last);
+	while (first < last && r.frames[first % kMaxFrames].start < oldest)
+	{
+		first++;
+	}
+	if (first == last)
+	{
+		return;
+	}
+	const uint64_t windowStart = r.frames[first % kMaxFrames].start;
+	const uint64_t windowEnd = r.frames[(last - 1) % kMaxFrames].end;
+	out.numFrames = (int)(last - first);
+	out.frameMilliseconds = (windowEnd - windowStart) * 1e-6 / out.numFrames;
+
+	// zones that ended inside the frames, newest first (a ring is in order of the ends)
+	for (size_t t = 0; t < r.threads.size(); t++)
+	{
+		const ThreadRing& ring = *r.threads[t];
+		const uint64_t written = ring.numWritten.load(std::memory_order_acquire);
+		const uint64_t begin = written + kSlack > kRingSize ? written + kSlack - kRingSize : 0;
+		for (uint64_t k = written; k-- > begin; )
+		{
+			const ZoneEvent& zone = ring.zones[k % kRingSize];
+			if (zone.end <= windowStart)
+			{
+				break;
+			}
+			if (zone.end > windowEnd)
+			{
+				continue;
+			}
+			size_t s = 0;
+			while (s < out.zones.size() && out.zones[s].name != zone.name && strcmp(out.zones[s].name, zone.name) != 0)
+			{
+				s++;
+			}
+			if (s == out.zones.size())
+			{
+				ProfileZoneSummary summary = { zone.name, 0.0, 0.0 };
+				out.zones.push_back(summary);
+			}
+			out.zones[s].milliseconds += (zone.end - zone.start) * 1e-6;
+			out.zones[s].calls += 1.0;
+		}
+	}
+	for (size_t s = 0; s < out.zones.size(); s++)
+	{
+		out.zones[s].milliseconds /= out.numFrames;
+		out.zones[s].calls /= out.numFrames;
+	}
+	std::sort(out.zones.begin(), out.zones.end(), [](const ProfileZoneSummary& a, const ProfileZoneSummary& b)
+	{
+		return a.milliseconds > b.milliseconds;
+	});
+
+	// counters of the same name (from several places) are added up
+	for (size_t c = 0; c < r.counters.size(); c++)
+	{
+		int64_t sum = 0;
+		for (uint64_t f = first; f < last; f++)
+		{
+			const Frame& frame = r.frames[f % kMaxFrames];
+			sum += c < frame.counters.size() ? frame.counters[c] : 0;
+		}
+		size_t s = 0;
+		while (s < out.counters.size() && strcmp(out.counters[s].name, r.counters[c]->name()) != 0)
+		{
+			s++;
+		}
+		if (s == out.counters.size())
+		{
+			ProfileCounterSummary summary = { r.counters[c]->name(), 0.0 };
+			out.counters.push_back(summary);
+		}
+		out.counters[s].perFrame += (double)sum / out.numFrames;
+	}
+}
+
+
+bool Profiler::writeChromeTrace(const std::string& path)
+{
+	FILE* f = fopen(path.c_str(), "w");
+	if (!f)
+	{
+		return false;
+	}
+
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	bool firstEvent = true;
+	auto separator = [&]() { fprintf(f, firstEvent ? "" : ",\n"); firstEvent = false; };
+
+	std::vector<ZoneEvent> zones;
+	for (size_t t = 0; t < r.threads.size(); t++)
+	{
+		const ThreadRing& ring = *r.threads[t];
+		separator();
+		fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", ring.id);
+		writeJsonString(f, ring.name.c_str());
+		fprintf(f, "}}");
+
+		copyZones(ring, zones);
+		for (size_t k = 0; k < zones.size(); k++)
+		{
+			separator();
+			fprintf(f, "{\"name\":");
+			writeJsonString(f, zones[k].name);
+			fprintf(f, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", ring.id,
+				zones[k].start * 1e-3, (zones[k].end - zones[k].start) * 1e-3);
+		}
+	}
+
+	// frame boundaries and the counters of each frame, at its end
+	const uint64_t first = r.numFrames > kMaxFrames ? r.numFrames - kMaxFrames : 0;
+	for (uint64_t k = first; k < r.numFrames; k++)
+	{
+		const Frame& frame = r.frames[k % kMaxFrames];
+		separator();
+		fprintf(f, "{\"name\":\"Frame\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,\"ts\":%.3f}", frame.end * 1e-3);
+		for (size_t c = 0; c < frame.counters.size(); c++)
+		{
+			separator();
+			fprintf(f, "{\"name\":");
+			writeJsonString(f, r.counters[c]->name());
+			fprintf(f, ",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{\"value\":%lld}}", frame.end * 1e-3, (long long)frame.counters[c]);
+		}
+	}
+	fprintf(f, "\n]}\n");
+	return fclose(f) == 0;
+}
+
+#else
+
+bool Profiler::enabled()
+{
+	return false;
+}
+
+void Profiler::zone(const char*, uint64_t, uint64_t) {}
+void Profiler::setThreadName(const char*) {}
+void Profiler::endFrame() {}
+
+void Profiler::summary(ProfileSummary& out, int)
+{
+	out = ProfileSummary();
+}
+
+bool Profiler::writeChromeTrace(const std::string&)
+{
+	return false;
+}
+
+#endif
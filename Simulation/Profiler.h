@@ -0,0 +1,132 @@
+#ifndef __Profiler_h__
+#define __Profiler_h__
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// Instrumentation of the hot paths: scoped timing zones and named counters.
+//
+//   PROFILE_ZONE("Spring forces");               times the rest of the scope
+//   PROFILE_COUNT("Springs evaluated", count);    adds to a counter of the frame
+//   PROFILE_THREAD_NAME("Worker");                names the thread in the trace
+//
+// Every thread records its zones into a ring of its own (no locks, the
+// oldest zones are overwritten); Profiler::endFrame() closes a frame and
+// takes the counters. From the rings, Profiler writes a Chrome trace
+// (chrome://tracing or ui.perfetto.dev) and summarises the last frames per
+// zone. Zone and counter names must be string literals.
+//
+// Unless SIMULATION_PROFILE is defined the macros compile to nothing and do
+// not evaluate their arguments; Profiler's functions then do nothing and
+// report no data. The demo projects define it in their Debug configurations
+// only, so Release builds measure the simulation without the zones.
+
+#ifdef SIMULATION_PROFILE
+	#define PROFILE_CONCAT_(a, b) a##b
+	#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+	#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+	#define PROFILE_COUNT(name, amount) do { static ProfileCounter profileCounter(name); profileCounter.add((int64_t)(amount)); } while (0)
+	#define PROFILE_THREAD_NAME(name) Profiler::setThreadName(name)
+#else
+	#define PROFILE_ZONE(name) do {} while (0)
+	#define PROFILE_COUNT(name, amount) do {} while (0)
+	#define PROFILE_THREAD_NAME(name) do {} while (0)
+#endif
+
+
+struct ProfileZoneSummary
+{
+	const char* name;
+	double milliseconds;  // per frame, including nested zones, summed over threads
+	double calls;         // per frame
+};
+
+struct ProfileCounterSummary
+{
+	const char* name;
+	double perFrame;
+};
+
+struct ProfileSummary
+{
+	int    numFrames;          // frames averaged over
+	double frameMilliseconds;
+	std::vector<ProfileZoneSummary>    zones;     // most time first
+	std::vector<ProfileCounterSummary> counters;
+
+	ProfileSummary() : numFrames(0), frameMilliseconds(0.0) {}
+
+	// Milliseconds per frame of a zone (0 if it did not run)
+	double zoneMilliseconds(const char* name) const;
+	double counterPerFrame(const char* name) const;
+};
+
+
+class Profiler
+{
+public:
+	// Whether the zones and counters are compiled in
+	static bool enabled();
+
+	// Nanoseconds since the profiler started
+	static uint64_t now();
+
+	// Record a zone of the calling thread (what ProfileZone does)
+	static void zone(const char* name, uint64_t start, uint64_t end);
+
+	static void setThreadName(const char* name);
+
+	// End the current frame: takes the counters and starts the next one.
+	// Call from one thread, once per frame (or step).
+	static void endFrame();
+
+	// Averages over the last numFrames frames whose zones are still in the rings
+	static void summary(ProfileSummary& out, int numFrames = 60);
+
+	// Write the zones in the rings, the counters of the frames and the frame
+	// boundaries as a Chrome trace. Returns false if it cannot be written or
+	// profiling is compiled out. Zones recorded while writing may be missing.
+	static bool writeChromeTrace(const std::string& path);
+};
+
+
+#ifdef SIMULATION_PROFILE
+
+class ProfileZone
+{
+public:
+	explicit ProfileZone(const char* name) : m_name(name), m_start(Profiler::now()) {}
+	~ProfileZone() { Profiler::zone(m_name, m_start, Profiler::now()); }
+
+private:
+	ProfileZone(const ProfileZone&);
+	ProfileZone& operator=(const ProfileZone&);
+
+	const char* m_name;
+	uint64_t    m_start;
+};
+
+// A counter summed over all threads, taken and reset by Profiler::endFrame()
+class ProfileCounter
+{
+public:
+	explicit ProfileCounter(const char* name);  // registers it with the profiler
+
+	void add(int64_t amount) { m_value.fetch_add(amount, std::memory_order_relaxed); }
+	int64_t take() { return m_value.exchange(0, std::memory_order_relaxed); }
+	const char* name() const { return m_name; }
+
+private:
+	ProfileCounter(const ProfileCounter&);
+	ProfileCounter& operator=(const ProfileCounter&);
+
+	const char*          m_name;
+	std::atomic<int64_t> m_value;
+};
+
+#endif
+
+#endif
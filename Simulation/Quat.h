@@ -0,0 +1,73 @@
+#ifndef __Quat_h__
+#define __Quat_h__
+
+#include <cmath>
+
+#include "Mat3.h"
+#include "Vec3.h"
+
+
+// Minimal unit quaternion w + (x, y, z) for rigid body orientations
+struct Quat
+{
+	float w, x, y, z;
+
+	Quat() : w(1.f), x(0.f), y(0.f), z(0.f) {}
+	Quat(float w, float x, float y, float z) : w(w), x(x), y(y), z(z) {}
+
+	// Rotation by angle (radians) around the unit vector axis
+	static Quat fromAxisAngle(const Vec3& axis, float angle)
+	{
+		float s = std::sin(0.5f * angle);
+		return Quat(std::cos(0.5f * angle), axis.x * s, axis.y * s, axis.z * s);
+	}
+
+	Vec3 vec() const { return Vec3(x, y, z); }
+
+	Quat normalized() const
+	{
+		float n = std::sqrt(w * w + x * x + y * y + z * z);
+		if (n < 1e-20f)
+		{
+			return Quat();
+		}
+		float s = 1.f / n;
+		return Quat(w * s, x * s, y * s, z * s);
+	}
+
+	// Rotation matrix; column k is the rotated k-th coordinate axis, so
+	// toMat3() * v rotates v (column vector convention)
+	Mat3 toMat3() const
+	{
+		Mat3 r;
+		r.m[0][0] = 1.f - 2.f * (y * y + z * z);
+		r.m[0][1] = 2.f * (x * y - w * z);
+		r.m[0][2] = 2.f * (x * z + w * y);
+		r.m[1][0] = 2.f * (x * y + w * z);
+		r.m[1][1] = 1.f - 2.f * (x * x + z * z);
+		r.m[1][2] = 2.f * (y * z - w * x);
+		r.m[2][0] = 2.f * (x * z - w * y);
+		r.m[2][1] = 2.f * (y * z + w * x);
+		r.m[2][2] = 1.f - 2.f * (x * x + y * y);
+		return r;
+	}
+};
+
+inline Quat operator*(const Quat& a, const Quat& b)
+{
+	return Quat(a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+	            a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+	            a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+	            a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w);
+}
+
+// Rotate v by the unit quaternion q
+inline Vec3 rotate(const Quat& q, const Vec3& v)
+{
+	Vec3 u = q.vec();
+	Vec3 t = 2.f * cross(u, v);
+	return v + q.w * t + cross(u, t);
+}
+
+
+#endif
@@ -0,0 +1,1437 @@
+#include "RigidBodyWorld.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define RIGID_BODY_SSE2
+#endif
+
+#include "Profiler.h"
+
+
+namespace
+{
+	// Contact points of consecutive steps closer than this (in the body space
+	// of the first body) are taken to be the same point
+	const float kWarmStartDistanceSq = 0.05f * 0.05f;
+
+	// The boxes are grown by half of this for the narrow phase, so contacts
+	// appear before the surfaces touch (speculative contacts). A box rocking
+	// on a face keeps all of its contact points instead of losing those on
+	// the side that lifts off.
+	const float kContactSkin = 0.02f;
+
+	// A body is fast, and swept by the continuous stage, if it may move more
+	// than this fraction of its smallest half extent in one step; slower
+	// bodies cannot get past the middle of another one, so the solver pushes
+	// them back out on the side they came from
+	const float kFastFraction = 0.5f;
+
+	// Conservative advancement stops within this distance of its target
+	// separation, or after as many steps. The target of a pair without contact
+	// is half the tolerance (well within the skin, so the contact is found at
+	// the next step). A pair that already touches may penetrate by this
+	// fraction of the thinner body's smallest half extent, the contact pushes
+	// that out again; deeper, and the solver might push the body out through
+	// the wrong side of a thin body. A body whose contact misses a corner (it
+	// hit with an edge and turns over) would tunnel that way.
+	const float kTimeOfImpactTolerance = 0.25f * kContactSkin;
+	const float kMaxPenetrationFraction = 0.25f;
+	const int   kMaxAdvancementSteps = 20;
+	const int   kBisectionSteps = 10;
+
+	float minHalfExtent(const Vec3& e)
+	{
+		return std::min(e.x, std::min(e.y, e.z));
+	}
+
+	bool pairLess(const uint32_t a1, const uint32_t b1, const uint32_t a2, const uint32_t b2)
+	{
+		return a1 < a2 || (a1 == a2 && b1 < b2);
+	}
+
+#if defined(RIGID_BODY_SSE2)
+	// Four Vec3, one per lane. The operations are those of Vec3.h, in the
+	// same order, so every lane gets the bits the scalar solver gets.
+	struct Vec3x4
+	{
+		__m128 x, y, z;
+	};
+
+	Vec3x4 load(const float v[3][4])               { Vec3x4 r = { _mm_loadu_ps(v[0]), _mm_loadu_ps(v[1]), _mm_loadu_ps(v[2]) }; return r; }
+	Vec3x4 add(const Vec3x4& a, const Vec3x4& b)   { Vec3x4 r = { _mm_add_ps(a.x, b.x), _mm_add_ps(a.y, b.y), _mm_add_ps(a.z, b.z) }; return r; }
+	Vec3x4 sub(const Vec3x4& a, const Vec3x4& b)   { Vec3x4 r = { _mm_sub_ps(a.x, b.x), _mm_sub_ps(a.y, b.y), _mm_sub_ps(a.z, b.z) }; return r; }
+	Vec3x4 scale(const Vec3x4& a, __m128 s)        { Vec3x4 r = { _mm_mul_ps(a.x, s), _mm_mul_ps(a.y, s), _mm_mul_ps(a.z, s) }; return r; }
+	__m128 dot(const Vec3x4& a, const Vec3x4& b)   { return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a.x, b.x), _mm_mul_ps(a.y, b.y)), _mm_mul_ps(a.z, b.z)); }
+
+	__m128 select(__m128 mask, __m128 a, __m128 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+	Vec3x4 select(__m128 mask, const Vec3x4& a, const Vec3x4& b)
+	{
+		Vec3x4 r = { select(mask, a.x, b.x), select(mask, a.y, b.y), select(mask, a.z, b.z) };
+		return r;
+	}
+
+	// Lane l of the 3 x 4 floats at v
+	void scatter(float v[3][4], int l, const Vec3& a)
+	{
+		v[0][l] = a.x; v[1][l] = a.y; v[2][l] = a.z;
+	}
+
+	// Velocities and displacements of four solver bodies (12 floats each:
+	// v, w, d, theta), body l into lane l
+	void loadBodies(const float* const bodies[4], Vec3x4& v, Vec3x4& w, Vec3x4& d, Vec3x4& theta)
+	{
+		__m128 r0 = _mm_loadu_ps(bodies[0]), r1 = _mm_loadu_ps(bodies[1]), r2 = _mm_loadu_ps(bodies[2]), r3 = _mm_loadu_ps(bodies[3]);
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		v.x = r0; v.y = r1; v.z = r2; w.x = r3;
+		r0 = _mm_loadu_ps(bodies[0] + 4); r1 = _mm_loadu_ps(bodies[1] + 4); r2 = _mm_loadu_ps(bodies[2] + 4); r3 = _mm_loadu_ps(bodies[3] + 4);
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		w.y = r0; w.z = r1; d.x = r2; d.y = r3;
+		r0 = _mm_loadu_ps(bodies[0] + 8); r1 = _mm_loadu_ps(bodies[1] + 8); r2 = _mm_loadu_ps(bodies[2] + 8); r3 = _mm_loadu_ps(bodies[3] + 8);
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		d.z = r0; theta.x = r1; theta.y = r2; theta.z = r3;
+	}
+
+	// Velocities of the bodies whose bit is set in write back from the lanes
+	// (the first 8 floats of each, the displacements in there are unchanged)
+	void storeVelocities(float* const bodies[4], int write, const Vec3x4& v, const Vec3x4& w, const Vec3x4& d)
+	{
+		__m128 r0 = v.x, r1 = v.y, r2 = v.z, r3 = w.x;
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		__m128 s0 = w.y, s1 = w.z, s2 = d.x, s3 = d.y;
+		_MM_TRANSPOSE4_PS(s0, s1, s2, s3);
+		if (write & 1) { _mm_storeu_ps(bodies[0], r0); _mm_storeu_ps(bodies[0] + 4, s0); }
+		if (write & 2) { _mm_storeu_ps(bodies[1], r1); _mm_storeu_ps(bodies[1] + 4, s1); }
+		if (write & 4) { _mm_storeu_ps(bodies[2], r2); _mm_storeu_ps(bodies[2] + 4, s2); }
+		if (write & 8) { _mm_storeu_ps(bodies[3], r3); _mm_storeu_ps(bodies[3] + 4, s3); }
+	}
+#endif
+
+	// R * diag(d) * R^T
+	Mat3 rotateDiagonal(const Mat3& r, const Vec3& d)
+	{
+		Mat3 result;
+		for (int i = 0; i < 3; i++)
+		{
+			for (int j = i; j < 3; j++)
+			{
+				float s = r.m[i][0] * d.x * r.m[j][0] + r.m[i][1] * d.y * r.m[j][1] + r.m[i][2] * d.z * r.m[j][2];
+				result.m[i][j] = s;
+				result.m[j][i] = s;
+			}
+		}
+		return result;
+	}
+
+	// Rotate v into the body space of rotation r (multiply by r^T)
+	Vec3 toBody(const Mat3& r, const Vec3& v)
+	{
+		return Vec3(r.m[0][0] * v.x + r.m[1][0] * v.y + r.m[2][0] * v.z,
+		            r.m[0][1] * v.x + r.m[1][1] * v.y + r.m[2][1] * v.z,
+		            r.m[0][2] * v.x + r.m[1][2] * v.y + r.m[2][2] * v.z);
+	}
+
+	// World space box of the given pose
+	Box boxAtPose(const Vec3& center, const Quat& orientation, const Vec3& halfExtents)
+	{
+		Mat3 r = orientation.toMat3();
+		Box b;
+		b.center = center;
+		for (int k = 0; k < 3; k++)
+		{
+			b.axes[k] = Vec3(r.m[0][k], r.m[1][k], r.m[2][k]);
+		}
+		b.halfExtents = halfExtents;
+		return b;
+	}
+
+	// Axis and angle of the shortest rotation from q0 to q1: the orientation
+	// fromAxisAngle(axis, t * angle) * q0 turns from q0 to q1 at a constant rate
+	float rotationBetween(const Quat& q0, const Quat& q1, Vec3& axis)
+	{
+		Quat dq = q1 * Quat(q0.w, -q0.x, -q0.y, -q0.z);
+		if (dq.w < 0.f)
+		{
+			dq = Quat(-dq.w, -dq.x, -dq.y, -dq.z);
+		}
+		const float sinHalfAngle = length(dq.vec());
+		axis = sinHalfAngle > 1e-9f ? dq.vec() * (1.f / sinHalfAngle) : Vec3(1.f, 0.f, 0.f);
+		return 2.f * std::atan2(sinHalfAngle, dq.w);
+	}
+
+	Aabb unite(const Aabb& a, const Aabb& b)
+	{
+		Aabb u;
+		u.lower = Vec3(std::min(a.lower.x, b.lower.x), std::min(a.lower.y, b.lower.y), std::min(a.lower.z, b.lower.z));
+		u.upper = Vec3(std::max(a.upper.x, b.upper.x), std::max(a.upper.y, b.upper.y), std::max(a.upper.z, b.upper.z));
+		return u;
+	}
+
+	// Two unit vectors completing n to an orthonormal basis
+	void tangentBasis(const Vec3& n, Vec3& t1, Vec3& t2)
+	{
+		if (std::fabs(n.x) >= 0.57735f)
+		{
+			t1 = Vec3(n.y, -n.x, 0.f);
+		}
+		else
+		{
+			t1 = Vec3(0.f, n.z, -n.y);
+		}
+		t1 *= 1.f / length(t1);
+		t2 = cross(n, t1);
+	}
+}
+
+
+void RigidBodyWorld::clear()
+{
+	m_positions.clear();
+	m_orientations.clear();
+	m_linearMomenta.clear();
+	m_angularMomenta.clear();
+	m_invMasses.clear();
+	m_invInertiaBody.clear();
+	m_halfExtents.clear();
+	m_asleep.clear();
+	m_restTimes.clear();
+	m_contacts.clear();
+	m_oldContacts.clear();
+	m_broadphase = DynamicAabbTree(m_broadphase.margin());
+	m_stats = RigidBodyStats();
+}
+
+
+void RigidBodyWorld::reserve(size_t numBodies)
+{
+	m_positions.reserve(numBodies);
+	m_orientations.reserve(numBodies);
+	m_linearMomenta.reserve(numBodies);
+	m_angularMomenta.reserve(numBodies);
+	m_invMasses.reserve(numBodies);
+	m_invInertiaBody.reserve(numBodies);
+	m_halfExtents.reserve(numBodies);
+	m_asleep.reserve(numBodies);
+	m_restTimes.reserve(numBodies);
+}
+
+
+uint32_t RigidBodyWorld::addBox(const Vec3& center, const Vec3& size, float mass, const Quat& orientation)
+{
+	m_positions.push_back(center);
+	m_orientations.push_back(orientation.normalized());
+	m_linearMomenta.push_back(Vec3());
+	m_angularMomenta.push_back(Vec3());
+	m_halfExtents.push_back(0.5f * size);
+	m_asleep.push_back(0);
+	m_restTimes.push_back(0.f);
+
+	if (mass > 0.f)
+	{
+		// solid box: I_xx = m / 12 * (y^2 + z^2)
+		Vec3 sq(size.x * size.x, size.y * size.y, size.z * size.z);
+		m_invMasses.push_back(1.f / mass);
+		m_invInertiaBody.push_back(Vec3(12.f / (mass * (sq.y + sq.z)), 12.f / (mass * (sq.x + sq.z)), 12.f / (mass * (sq.x + sq.y))));
+	}
+	else
+	{
+		m_invMasses.push_back(0.f);
+		m_invInertiaBody.push_back(Vec3());
+	}
+	return (uint32_t)(m_positions.size() - 1);
+}
+
+
+void RigidBodyWorld::wake(uint32_t i)
+{
+	// the rest of the island follows in the next step()
+	m_asleep[i] = 0;
+	m_restTimes[i] = 0.f;
+}
+
+
+void RigidBodyWorld::bodiesReplaced(const uint8_t* asleep)
+{
+	const size_t n = m_positions.size();
+	if (asleep)
+	{
+		m_asleep.assign(asleep, asleep + n);
+	}
+	else
+	{
+		m_asleep.assign(n, 0);
+	}
+	m_restTimes.assign(n, 0.f);
+	m_contacts.clear();
+	m_oldContacts.clear();
+	m_broadphase = DynamicAabbTree(m_broadphase.margin());
+	m_stats = RigidBodyStats();
+}
+
+
+Vec3 RigidBodyWorld::angularVelocity(uint32_t i) const
+{
+	return rotateDiagonal(m_orientations[i].toMat3(), m_invInertiaBody[i]) * m_angularMomenta[i];
+}
+
+
+Box RigidBodyWorld::box(uint32_t i) const
+{
+	return boxAtPose(m_positions[i], m_orientations[i], m_halfExtents[i]);
+}
+
+
+void RigidBodyWorld::transform(uint32_t i, float obj2World[4][4]) const
+{
+	Mat3 r = m_orientations[i].toMat3();
+	for (int k = 0; k < 3; k++)
+	{
+		obj2World[k][0] = r.m[0][k];
+		obj2World[k][1] = r.m[1][k];
+		obj2World[k][2] = r.m[2][k];
+		obj2World[k][3] = 0.f;
+		obj2World[3][k] = m_positions[i][k];
+	}
+	obj2World[3][3] = 1.f;
+}
+
+
+float RigidBodyWorld::kineticEnergy() const
+{
+	float energy = 0.f;
+	for (size_t i = 0; i < m_positions.size(); i++)
+	{
+		energy += 0.5f * m_invMasses[i] * lengthSq(m_linearMomenta[i]);
+		energy += 0.5f * dot(angularVelocity((uint32_t)i), m_angularMomenta[i]);
+	}
+	return energy;
+}
+
+
+void RigidBodyWorld::step(float timeStep)
+{
+	if (m_positions.empty() || timeStep <= 0.f)
+	{
+		return;
+	}
+	PROFILE_ZONE("Rigid body step");
+	updateThreadPool();
+	prepareBodies(timeStep);
+	findContacts();
+	buildIslands();
+
+	// an island of sleeping bodies is left alone; one awake body wakes all
+	// the others (it touches them or was woken by wake())
+	m_awakeIslands.clear();
+	const std::vector<uint32_t>& bodies = m_islands.nodes();
+	for (size_t k = 0; k < m_islandOrder.size(); k++)
+	{
+		const uint32_t island = m_islandOrder[k];
+		bool awake = false;
+		for (uint32_t n = m_islands.nodeBegin(island); n < m_islands.nodeEnd(island) && !awake; n++)
+		{
+			awake = !m_asleep[bodies[n]];
+		}
+		if (!awake)
+		{
+			continue;
+		}
+		for (uint32_t n = m_islands.nodeBegin(island); n < m_islands.nodeEnd(island); n++)
+		{
+			m_asleep[bodies[n]] = 0;
+		}
+		m_awakeIslands.push_back(island);
+	}
+
+	// islands share no moving body: each is stepped on its own, on whichever
+	// thread gets to it (largest first)
+	m_islandSolveTimes.assign(m_islands.size(), 0.f);
+	PROFILE_COUNT("Box contacts", m_stats.numContacts);
+#if defined(RIGID_BODY_SSE2)
+	if (m_params.simdSolver)
+	{
+		// neighbours in m_awakeIslands have about the same number of contacts,
+		// few lanes stay empty
+		m_islandGroups.clear();
+		uint32_t numRows = 0;
+		for (uint32_t k = 0; k < m_awakeIslands.size(); k += kIslandLanes)
+		{
+			IslandGroup group;
+			group.islandBegin = k;
+			group.numIslands = std::min(kIslandLanes, (uint32_t)m_awakeIslands.size() - k);
+			group.rowBegin = numRows;
+			group.numRows = m_islands.edgeEnd(m_awakeIslands[k]) - m_islands.edgeBegin(m_awakeIslands[k]);
+			numRows += group.numRows;
+			m_islandGroups.push_back(group);
+		}
+		m_wideContacts.resize(numRows);
+		if (m_threadPool)
+		{
+			m_threadPool->runTasks(m_islandGroups.size(), [&](size_t task, unsigned int)
+			{
+				stepIslandGroup(m_islandGroups[task], timeStep);
+			});
+		}
+		else
+		{
+			for (size_t task = 0; task < m_islandGroups.size(); task++)
+			{
+				stepIslandGroup(m_islandGroups[task], timeStep);
+			}
+		}
+	}
+	else
+#endif
+	if (m_threadPool)
+	{
+		m_threadPool->runTasks(m_awakeIslands.size(), [&](size_t task, unsigned int)
+		{
+			stepIsland(m_awakeIslands[task], timeStep);
+		});
+	}
+	else
+	{
+		for (size_t task = 0; task < m_awakeIslands.size(); task++)
+		{
+			stepIsland(m_awakeIslands[task], timeStep);
+		}
+	}
+	if (m_params.continuousCollision)
+	{
+		solveContinuous();
+	}
+
+	m_stats.numIslands = m_islands.size();
+	for (size_t k = 0; k < m_islands.size(); k++)
+	{
+		const uint32_t first = m_islands.nodes()[m_islands.nodeBegin(k)];
+		const float seconds = m_islandSolveTimes[k];
+		if (m_asleep[first])
+		{
+			m_stats.numSleepingBodies += m_islands.nodeEnd(k) - m_islands.nodeBegin(k);
+			continue;
+		}
+		m_stats.numAwakeIslands++;
+		m_stats.islandSolveSeconds += seconds;
+		m_stats.maxIslandSolveSeconds = std::max(m_stats.maxIslandSolveSeconds, seconds);
+	}
+}
+
+
+void RigidBodyWorld::stepIsland(uint32_t island, float timeStep)
+{
+	const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	// the contacts found for the step are solved at every substep, with
+	// separations updated from how far the bodies moved since
+	const int substeps = std::max(m_params.substeps, 1);
+	const float h = timeStep / substeps;
+	for (int substep = 0; substep < substeps; substep++)
+	{
+		integrateVelocities(island, h);
+		warmStart(island);
+		for (int iteration = 0; iteration < m_params.velocityIterations; iteration++)
+		{
+			solveContacts(island, h, true);
+		}
+		integratePositions(island, h);
+		solveContacts(island, h, false);
+	}
+	applyRestitution(island);
+	storeMomenta(island);
+	updateSleep(island, timeStep);
+
+	m_islandSolveTimes[island] = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+
+#if defined(RIGID_BODY_SSE2)
+void RigidBodyWorld::stepIslandGroup(const IslandGroup& group, float timeStep)
+{
+	const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	const uint32_t* islands = &m_awakeIslands[group.islandBegin];
+
+	// the substeps of stepIsland(), the contacts of all islands at once
+	packWideContacts(group);
+	const int substeps = std::max(m_params.substeps, 1);
+	const float h = timeStep / substeps;
+	for (int substep = 0; substep < substeps; substep++)
+	{
+		for (uint32_t l = 0; l < group.numIslands; l++)
+		{
+			integrateVelocities(islands[l], h);
+		}
+		warmStartWide(group);
+		for (int iteration = 0; iteration < m_params.velocityIterations; iteration++)
+		{
+			solveContactsWide(group, h, true);
+		}
+		for (uint32_t l = 0; l < group.numIslands; l++)
+		{
+			integratePositions(islands[l], h);
+		}
+		solveContactsWide(group, h, false);
+	}
+	unpackWideContacts(group);
+	for (uint32_t l = 0; l < group.numIslands; l++)
+	{
+		applyRestitution(islands[l]);
+		storeMomenta(islands[l]);
+		updateSleep(islands[l], timeStep);
+	}
+
+	const float seconds = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+	for (uint32_t l = 0; l < group.numIslands; l++)
+	{
+		m_islandSolveTimes[islands[l]] = seconds / group.numIslands;
+	}
+}
+#endif
+
+
+void RigidBodyWorld::updateThreadPool()
+{
+	unsigned int numThreads = m_params.numThreads;
+	if (numThreads == 0)
+	{
+		numThreads = std::thread::hardware_concurrency();
+	}
+
+	if (numThreads <= 1)
+	{
+		m_threadPool.reset();
+	}
+	else if (!m_threadPool || m_threadPool->numThreads() != numThreads)
+	{
+		m_threadPool.reset(new ThreadPool(numThreads));
+	}
+}
+
+
+void RigidBodyWorld::prepareBodies(float timeStep)
+{
+	PROFILE_ZONE("Rigid bodies prepare");
+	const size_t n = m_positions.size();
+	m_solverBodies.resize(n);
+	m_staticBodies.resize(n);
+	m_invInertiaWorld.resize(n);
+	m_boxes.resize(n);
+	m_bounds.resize(n);
+
+	const Vec3 skin(0.5f * kContactSkin, 0.5f * kContactSkin, 0.5f * kContactSkin);
+	for (size_t i = 0; i < n; i++)
+	{
+		const Mat3 r = m_orientations[i].toMat3();
+		m_staticBodies[i] = m_invMasses[i] == 0.f;
+		m_invInertiaWorld[i] = rotateDiagonal(r, m_invInertiaBody[i]);
+		SolverBody& body = m_solverBodies[i];
+		body.linearVelocity = m_invMasses[i] * m_linearMomenta[i];
+		body.angularVelocity = m_invInertiaWorld[i] * m_angularMomenta[i];
+		body.linearDisplacement = Vec3();
+		body.angularDisplacement = Vec3();
+
+		Box& box = m_boxes[i];
+		box.center = m_positions[i];
+		box.axes[0] = Vec3(r.m[0][0], r.m[1][0], r.m[2][0]);
+		box.axes[1] = Vec3(r.m[0][1], r.m[1][1], r.m[2][1]);
+		box.axes[2] = Vec3(r.m[0][2], r.m[1][2], r.m[2][2]);
+		box.halfExtents = m_halfExtents[i] + skin;
+		m_bounds[i] = boxBounds(box);
+	}
+
+	m_fastBodies.assign(n, 0);
+	if (!m_params.continuousCollision)
+	{
+		return;
+	}
+	m_startPositions = m_positions;
+	m_startOrientations = m_orientations;
+	for (size_t i = 0; i < n; i++)
+	{
+		if (m_staticBodies[i] || m_asleep[i])
+		{
+			continue;
+		}
+		// motion of the farthest point of the box if only gravity acts
+		const SolverBody& body = m_solverBodies[i];
+		const Vec3 displacement = timeStep * (body.linearVelocity + timeStep * m_params.gravity);
+		const Vec3& e = m_halfExtents[i];
+		const float rotation = timeStep * length(body.angularVelocity) * length(e);
+		if (length(displacement) + rotation <= kFastFraction * minHalfExtent(e))
+		{
+			continue;
+		}
+		m_fastBodies[i] = 1;
+
+		// the box at both ends of the path, grown by how far its corners turn
+		Aabb moved = m_bounds[i];
+		moved.lower += displacement;
+		moved.upper += displacement;
+		Aabb& bounds = m_bounds[i];
+		bounds = unite(bounds, moved);
+		bounds.lower -= Vec3(rotation, rotation, rotation);
+		bounds.upper += Vec3(rotation, rotation, rotation);
+	}
+}
+
+
+void RigidBodyWorld::findContacts()
+{
+	PROFILE_ZONE("Rigid contacts");
+	m_oldContacts.swap(m_contacts);
+	m_contacts.clear();
+	m_stats = RigidBodyStats();
+
+	{
+		PROFILE_ZONE("Rigid broad phase");
+		m_broadphase.update(m_bounds);
+	}
+	const std::vector<BoxPair>& pairs = m_broadphase.pairs();
+	m_stats.numPairs = pairs.size();
+
+	// the pairs come in the order of m_oldContacts, so the contacts of the
+	// last step are found by walking along with them
+	ContactManifold manifold;
+	size_t oldIndex = 0;
+	for (size_t p = 0; p < pairs.size(); p++)
+	{
+		const uint32_t a = pairs[p].a, b = pairs[p].b;
+		const bool movingA = !m_staticBodies[a] && !m_asleep[a];
+		const bool movingB = !m_staticBodies[b] && !m_asleep[b];
+		if (m_staticBodies[a] && m_staticBodies[b])
+		{
+			continue;
+		}
+		while (oldIndex < m_oldContacts.size() && pairLess(m_oldContacts[oldIndex].a, m_oldContacts[oldIndex].b, a, b))
+		{
+			oldIndex++;
+		}
+		const bool persists = oldIndex < m_oldContacts.size() && m_oldContacts[oldIndex].a == a && m_oldContacts[oldIndex].b == b;
+
+		// neither body has moved since the last step (asleep or static): the
+		// contact is still the same, keep it with its impulses so the island
+		// wakes up warm started
+		if (!movingA && !movingB)
+		{
+			if (persists)
+			{
+				m_contacts.push_back(m_oldContacts[oldIndex]);
+				m_stats.numManifolds++;
+				m_stats.numContacts += m_contacts.back().numPoints;
+				m_stats.numWarmStarted += m_contacts.back().numPoints;
+			}
+			continue;
+		}
+
+		if (!overlaps(m_bounds[a], m_bounds[b]) || !collideBoxes(m_boxes[a], m_boxes[b], manifold))
+		{
+			continue;
+		}
+		m_stats.numManifolds++;
+		m_stats.numContacts += manifold.numPoints;
+		addManifold(a, b, manifold, persists && m_params.warmStarting ? &m_oldContacts[oldIndex] : nullptr);
+	}
+}
+
+
+void RigidBodyWorld::addManifold(uint32_t a, uint32_t b, const ContactManifold& manifold, const ContactConstraint* old)
+{
+	const Mat3& invInertiaA = m_invInertiaWorld[a];
+	const Mat3& invInertiaB = m_invInertiaWorld[b];
+	const Mat3 rotationA = m_orientations[a].toMat3();
+
+	m_contacts.push_back(ContactConstraint());
+	ContactConstraint& c = m_contacts.back();
+	c.a = a;
+	c.b = b;
+	c.numPoints = manifold.numPoints;
+	c.invMassA = m_invMasses[a];
+	c.invMassB = m_invMasses[b];
+	c.normal = manifold.normalWorld;
+	tangentBasis(c.normal, c.tangent[0], c.tangent[1]);
+
+	const SolverBody& bodyA = m_solverBodies[a];
+	const SolverBody& bodyB = m_solverBodies[b];
+	for (int k = 0; k < manifold.numPoints; k++)
+	{
+		const ContactPoint& point = manifold.points[k];
+		ContactPointConstraint& cp = c.points[k];
+		const Vec3 rA = point.positionWorld - m_positions[a];
+		const Vec3 rB = point.positionWorld - m_positions[b];
+		cp.localA = toBody(rotationA, rA);
+		cp.separation = kContactSkin - point.depth;
+
+		// K = 1/mA + 1/mB + (rA x d) . I_A^-1 (rA x d) + (same for B); the
+		// I^-1 (r x d) terms are kept so the solver needs no matrix products
+		cp.rnA = cross(rA, c.normal);
+		cp.rnB = cross(rB, c.normal);
+		cp.angularNormalA = invInertiaA * cp.rnA;
+		cp.angularNormalB = invInertiaB * cp.rnB;
+		float kNormal = c.invMassA + c.invMassB + dot(cp.rnA, cp.angularNormalA) + dot(cp.rnB, cp.angularNormalB);
+		cp.normalMass = kNormal > 0.f ? 1.f / kNormal : 0.f;
+
+		// the tangents are solved together, as a 2x2 block: with contact points
+		// off the principal axes the two directions are coupled
+		float kTangent[3];
+		for (int t = 0; t < 2; t++)
+		{
+			cp.rtA[t] = cross(rA, c.tangent[t]);
+			cp.rtB[t] = cross(rB, c.tangent[t]);
+			cp.angularTangentA[t] = invInertiaA * cp.rtA[t];
+			cp.angularTangentB[t] = invInertiaB * cp.rtB[t];
+			kTangent[2 * t] = c.invMassA + c.invMassB + dot(cp.rtA[t], cp.angularTangentA[t]) + dot(cp.rtB[t], cp.angularTangentB[t]);
+		}
+		kTangent[1] = dot(cp.rtA[0], cp.angularTangentA[1]) + dot(cp.rtB[0], cp.angularTangentB[1]);
+		const float det = kTangent[0] * kTangent[2] - kTangent[1] * kTangent[1];
+		const float invDet = det > 0.f ? 1.f / det : 0.f;
+		cp.tangentMass[0] = invDet * kTangent[2];
+		cp.tangentMass[1] = -invDet * kTangent[1];
+		cp.tangentMass[2] = invDet * kTangent[0];
+
+		cp.relativeVelocity = dot(bodyA.linearVelocity - bodyB.linearVelocity, c.normal) + dot(bodyA.angularVelocity, cp.rnA) - dot(bodyB.angularVelocity, cp.rnB);
+		cp.maxNormalImpulse = 0.f;
+		cp.normalImpulse = 0.f;
+		cp.tangentImpulse[0] = cp.tangentImpulse[1] = 0.f;
+		if (old)
+		{
+			// nearest point of the last step, the impulses are carried over
+			// in world space because the normal can have turned a little
+			int best = -1;
+			float bestDistanceSq = kWarmStartDistanceSq;
+			for (int j = 0; j < old->numPoints; j++)
+			{
+				float d = lengthSq(old->points[j].localA - cp.localA);
+				if (d < bestDistanceSq)
+				{
+					bestDistanceSq = d;
+					best = j;
+				}
+			}
+			if (best >= 0)
+			{
+				const ContactPointConstraint& op = old->points[best];
+				Vec3 impulse = op.normalImpulse * old->normal + op.tangentImpulse[0] * old->tangent[0] + op.tangentImpulse[1] * old->tangent[1];
+				cp.normalImpulse = std::max(dot(impulse, c.normal), 0.f);
+				cp.tangentImpulse[0] = dot(impulse, c.tangent[0]);
+				cp.tangentImpulse[1] = dot(impulse, c.tangent[1]);
+				m_stats.numWarmStarted++;
+			}
+		}
+	}
+}
+
+
+void RigidBodyWorld::buildIslands()
+{
+	PROFILE_ZONE("Rigid islands");
+	m_islands.build(m_staticBodies, m_contacts.size(), [this](size_t k, uint32_t& a, uint32_t& b)
+	{
+		a = m_contacts[k].a;
+		b = m_contacts[k].b;
+	});
+
+	// islands with more contacts first, for the work stealing of runTasks()
+	m_islandOrder.resize(m_islands.size());
+	for (uint32_t k = 0; k < m_islandOrder.size(); k++)
+	{
+		m_islandOrder[k] = k;
+	}
+	std::stable_sort(m_islandOrder.begin(), m_islandOrder.end(), [this](uint32_t x, uint32_t y)
+	{
+		return m_islands.edgeEnd(x) - m_islands.edgeBegin(x) > m_islands.edgeEnd(y) - m_islands.edgeBegin(y);
+	});
+}
+
+
+void RigidBodyWorld::integrateVelocities(uint32_t island, float h)
+{
+	const Vec3 dv = h * m_params.gravity;
+	const std::vector<uint32_t>& bodies = m_islands.nodes();
+	for (uint32_t k = m_islands.nodeBegin(island); k < m_islands.nodeEnd(island); k++)
+	{
+		m_solverBodies[bodies[k]].linearVelocity += dv;
+	}
+}
+
+
+void RigidBodyWorld::warmStart(uint32_t island)
+{
+	const std::vector<uint32_t>& contacts = m_islands.edges();
+	for (uint32_t k = m_islands.edgeBegin(island); k < m_islands.edgeEnd(island); k++)
+	{
+		const ContactConstraint& c = m_contacts[contacts[k]];
+		SolverBody& bodyA = m_solverBodies[c.a];
+		SolverBody& bodyB = m_solverBodies[c.b];
+		Vec3 vA = bodyA.linearVelocity, wA = bodyA.angularVelocity;
+		Vec3 vB = bodyB.linearVelocity, wB = bodyB.angularVelocity;
+		for (int j = 0; j < c.numPoints; j++)
+		{
+			const ContactPointConstraint& cp = c.points[j];
+			const Vec3 impulse = cp.normalImpulse * c.normal + cp.tangentImpulse[0] * c.tangent[0] + cp.tangentImpulse[1] * c.tangent[1];
+			vA += c.invMassA * impulse;
+			wA += cp.normalImpulse * cp.angularNormalA + cp.tangentImpulse[0] * cp.angularTangentA[0] + cp.tangentImpulse[1] * cp.angularTangentA[1];
+			vB -= c.invMassB * impulse;
+			wB -= cp.normalImpulse * cp.angularNormalB + cp.tangentImpulse[0] * cp.angularTangentB[0] + cp.tangentImpulse[1] * cp.angularTangentB[1];
+		}
+		// static bodies are shared by islands stepped in parallel, only write the moving ones
+		if (c.invMassA > 0.f) { bodyA.linearVelocity = vA; bodyA.angularVelocity = wA; }
+		if (c.invMassB > 0.f) { bodyB.linearVelocity = vB; bodyB.angularVelocity = wB; }
+	}
+}
+
+
+void RigidBodyWorld::solveContacts(uint32_t island, float h, bool useBias)
+{
+	const float friction = m_params.friction;
+	const float invH = 1.f / h;
+
+	// Penetration is removed by a soft constraint: a spring of contactHertz
+	// with the given damping ratio, solved implicitly (Catto, "Solver2D").
+	// The frequency is limited to a quarter of the substep rate, stiffer
+	// springs are not resolved by the substeps and start to oscillate.
+	const float hertz = std::min(m_params.contactHertz, 0.25f * invH);
+	const float omega = 2.f * 3.14159265f * hertz;
+	const float zeta = m_params.contactDampingRatio;
+	const float a1 = 2.f * zeta + h * omega;
+	const float a2 = h * omega * a1;
+	const float a3 = 1.f / (1.f + a2);
+	const float biasRate = omega / a1;
+	const float softMassScale = a2 * a3;
+	const float softImpulseScale = a3;
+	const std::vector<uint32_t>& contacts = m_islands.edges();
+	for (uint32_t k = m_islands.edgeBegin(island); k < m_islands.edgeEnd(island); k++)
+	{
+		ContactConstraint& c = m_contacts[contacts[k]];
+		const uint32_t a = c.a, b = c.b;
+
+		// the velocities of both bodies are updated in registers and stored
+		// once per manifold
+		SolverBody& bodyA = m_solverBodies[a];
+		SolverBody& bodyB = m_solverBodies[b];
+		Vec3 vA = bodyA.linearVelocity, wA = bodyA.angularVelocity;
+		Vec3 vB = bodyB.linearVelocity, wB = bodyB.angularVelocity;
+		const Vec3 dA = bodyA.linearDisplacement, thetaA = bodyA.angularDisplacement;
+		const Vec3 dB = bodyB.linearDisplacement, thetaB = bodyB.angularDisplacement;
+		for (int j = 0; j < c.numPoints; j++)
+		{
+			ContactPointConstraint& cp = c.points[j];
+
+			// separation now, from the motion of the contact point on both bodies since findContacts()
+			const float separation = cp.separation + dot(dA - dB, c.normal) + dot(thetaA, cp.rnA) - dot(thetaB, cp.rnB);
+
+			// a separated point may close its gap within this substep but not more;
+			// penetration is pushed out only in the biased solve, so the push does
+			// not stay in the velocities
+			float bias = 0.f, massScale = 1.f, impulseScale = 0.f;
+			if (separation > 0.f)
+			{
+				bias = -separation * invH;
+			}
+			else if (useBias)
+			{
+				bias = std::min(-separation * biasRate, m_params.maxPushVelocity);
+				massScale = softMassScale;
+				impulseScale = softImpulseScale;
+			}
+
+			// non-penetration: the accumulated normal impulse can only push
+			float vn = dot(vA - vB, c.normal) + dot(wA, cp.rnA) - dot(wB, cp.rnB);
+			float lambda = cp.normalMass * massScale * (bias - vn) - impulseScale * cp.normalImpulse;
+			float accumulated = std::max(cp.normalImpulse + lambda, 0.f);
+			lambda = accumulated - cp.normalImpulse;
+			cp.normalImpulse = accumulated;
+			cp.maxNormalImpulse = std::max(cp.maxNormalImpulse, accumulated);
+			vA += (c.invMassA * lambda) * c.normal;
+			wA += lambda * cp.angularNormalA;
+			vB -= (c.invMassB * lambda) * c.normal;
+			wB -= lambda * cp.angularNormalB;
+
+			// friction, limited to the disk of radius friction * normal impulse
+			const float maxFriction = friction * cp.normalImpulse;
+			const Vec3 dvt = vA - vB;
+			const float vt0 = dot(dvt, c.tangent[0]) + dot(wA, cp.rtA[0]) - dot(wB, cp.rtB[0]);
+			const float vt1 = dot(dvt, c.tangent[1]) + dot(wA, cp.rtA[1]) - dot(wB, cp.rtB[1]);
+			float accumulated0 = cp.tangentImpulse[0] - (cp.tangentMass[0] * vt0 + cp.tangentMass[1] * vt1);
+			float accumulated1 = cp.tangentImpulse[1] - (cp.tangentMass[1] * vt0 + cp.tangentMass[2] * vt1);
+			const float magnitudeSq = accumulated0 * accumulated0 + accumulated1 * accumulated1;
+			if (magnitudeSq > maxFriction * maxFriction)
+			{
+				const float s = maxFriction / std::sqrt(magnitudeSq);
+				accumulated0 *= s;
+				accumulated1 *= s;
+			}
+			const float lambda0 = accumulated0 - cp.tangentImpulse[0];
+			const float lambda1 = accumulated1 - cp.tangentImpulse[1];
+			cp.tangentImpulse[0] = accumulated0;
+			cp.tangentImpulse[1] = accumulated1;
+			const Vec3 impulse = lambda0 * c.tangent[0] + lambda1 * c.tangent[1];
+			vA += c.invMassA * impulse;
+			wA += lambda0 * cp.angularTangentA[0] + lambda1 * cp.angularTangentA[1];
+			vB -= c.invMassB * impulse;
+			wB -= lambda0 * cp.angularTangentB[0] + lambda1 * cp.angularTangentB[1];
+		}
+		if (c.invMassA > 0.f) { bodyA.linearVelocity = vA; bodyA.angularVelocity = wA; }
+		if (c.invMassB > 0.f) { bodyB.linearVelocity = vB; bodyB.angularVelocity = wB; }
+	}
+}
+
+
+#if defined(RIGID_BODY_SSE2)
+void RigidBodyWorld::packWideContacts(const IslandGroup& group)
+{
+	static_assert(sizeof(SolverBody) == 12 * sizeof(float), "loadBodies() takes a solver body as 12 floats");
+	const uint32_t* islands = &m_awakeIslands[group.islandBegin];
+	const std::vector<uint32_t>& contacts = m_islands.edges();
+	for (uint32_t j = 0; j < group.numRows; j++)
+	{
+		WideContact& w = m_wideContacts[group.rowBegin + j];
+		w.maxPoints = 0;
+		for (uint32_t l = 0; l < kIslandLanes; l++)
+		{
+			// the first island has the most contacts, row j always has lane 0
+			const uint32_t island = islands[l < group.numIslands ? l : 0];
+			if (l >= group.numIslands || j >= m_islands.edgeEnd(island) - m_islands.edgeBegin(island))
+			{
+				w.invMassA[l] = w.invMassB[l] = 0.f;
+				w.a[l] = w.a[0];
+				w.b[l] = w.b[0];
+				w.numPoints[l] = 0;
+				clearLane(w, l, 0);
+				continue;
+			}
+			const uint32_t k = contacts[m_islands.edgeBegin(island) + j];
+			const ContactConstraint& c = m_contacts[k];
+			w.contacts[l] = k;
+			w.a[l] = c.a;
+			w.b[l] = c.b;
+			w.numPoints[l] = c.numPoints;
+			w.maxPoints = std::max(w.maxPoints, (int32_t)c.numPoints);
+			w.invMassA[l] = c.invMassA;
+			w.invMassB[l] = c.invMassB;
+			scatter(w.normal, l, c.normal);
+			scatter(w.tangent[0], l, c.tangent[0]);
+			scatter(w.tangent[1], l, c.tangent[1]);
+			for (int p = 0; p < c.numPoints; p++)
+			{
+				const ContactPointConstraint& cp = c.points[p];
+				WideContactPoint& wp = w.points[p];
+				scatter(wp.rnA, l, cp.rnA);
+				scatter(wp.rnB, l, cp.rnB);
+				scatter(wp.angularNormalA, l, cp.angularNormalA);
+				scatter(wp.angularNormalB, l, cp.angularNormalB);
+				for (int t = 0; t < 2; t++)
+				{
+					scatter(wp.rtA[t], l, cp.rtA[t]);
+					scatter(wp.rtB[t], l, cp.rtB[t]);
+					scatter(wp.angularTangentA[t], l, cp.angularTangentA[t]);
+					scatter(wp.angularTangentB[t], l, cp.angularTangentB[t]);
+					wp.tangentImpulse[t][l] = cp.tangentImpulse[t];
+				}
+				wp.separation[l] = cp.separation;
+				wp.normalMass[l] = cp.normalMass;
+				wp.tangentMass[0][l] = cp.tangentMass[0];
+				wp.tangentMass[1][l] = cp.tangentMass[1];
+				wp.tangentMass[2][l] = cp.tangentMass[2];
+				wp.normalImpulse[l] = cp.normalImpulse;
+				wp.maxNormalImpulse[l] = cp.maxNormalImpulse;
+			}
+			clearLane(w, l, c.numPoints);
+		}
+	}
+}
+
+
+void RigidBodyWorld::clearLane(WideContact& w, uint32_t l, int firstPoint)
+{
+	// without mass and impulse the point's impulses stay 0
+	for (int p = firstPoint; p < 4; p++)
+	{
+		WideContactPoint& wp = w.points[p];
+		wp.normalMass[l] = 0.f;
+		wp.tangentMass[0][l] = wp.tangentMass[1][l] = wp.tangentMass[2][l] = 0.f;
+		wp.normalImpulse[l] = wp.maxNormalImpulse[l] = 0.f;
+		wp.tangentImpulse[0][l] = wp.tangentImpulse[1][l] = 0.f;
+	}
+}
+
+
+void RigidBodyWorld::unpackWideContacts(const IslandGroup& group)
+{
+	for (uint32_t j = 0; j < group.numRows; j++)
+	{
+		const WideContact& w = m_wideContacts[group.rowBegin + j];
+		for (uint32_t l = 0; l < kIslandLanes; l++)
+		{
+			if (w.numPoints[l] == 0)
+			{
+				continue;
+			}
+			ContactConstraint& c = m_contacts[w.contacts[l]];
+			for (int p = 0; p < c.numPoints; p++)
+			{
+				ContactPointConstraint& cp = c.points[p];
+				const WideContactPoint& wp = w.points[p];
+				cp.normalImpulse = wp.normalImpulse[l];
+				cp.tangentImpulse[0] = wp.tangentImpulse[0][l];
+				cp.tangentImpulse[1] = wp.tangentImpulse[1][l];
+				cp.maxNormalImpulse = wp.maxNormalImpulse[l];
+			}
+		}
+	}
+}
+
+
+// warmStart() and solveContacts() for a row of contacts at a time. Lanes of
+// points and contacts that take no part are computed along (to impulses of
+// 0), their velocity changes are masked, so that not even the sign of a zero
+// velocity differs from the scalar solver.
+void RigidBodyWorld::warmStartWide(const IslandGroup& group)
+{
+	for (uint32_t j = 0; j < group.numRows; j++)
+	{
+		const WideContact& c = m_wideContacts[group.rowBegin + j];
+		float* bodiesA[4];
+		float* bodiesB[4];
+		for (uint32_t l = 0; l < kIslandLanes; l++)
+		{
+			bodiesA[l] = &m_solverBodies[c.a[l]].linearVelocity.x;
+			bodiesB[l] = &m_solverBodies[c.b[l]].linearVelocity.x;
+		}
+		Vec3x4 vA, wA, dA, thetaA, vB, wB, dB, thetaB;
+		loadBodies(bodiesA, vA, wA, dA, thetaA);
+		loadBodies(bodiesB, vB, wB, dB, thetaB);
+		const __m128 invMassA = _mm_loadu_ps(c.invMassA), invMassB = _mm_loadu_ps(c.invMassB);
+		const Vec3x4 normal = load(c.normal), tangent0 = load(c.tangent[0]), tangent1 = load(c.tangent[1]);
+		const __m128i numPoints = _mm_loadu_si128((const __m128i*)c.numPoints);
+		for (int p = 0; p < c.maxPoints; p++)
+		{
+			const WideContactPoint& cp = c.points[p];
+			const __m128 normalImpulse = _mm_loadu_ps(cp.normalImpulse);
+			const __m128 tangentImpulse0 = _mm_loadu_ps(cp.tangentImpulse[0]), tangentImpulse1 = _mm_loadu_ps(cp.tangentImpulse[1]);
+			const Vec3x4 impulse = add(add(scale(normal, normalImpulse), scale(tangent0, tangentImpulse0)), scale(tangent1, tangentImpulse1));
+			const Vec3x4 vA1 = add(vA, scale(impulse, invMassA));
+			const Vec3x4 wA1 = add(wA, add(add(scale(load(cp.angularNormalA), normalImpulse),
+				scale(load(cp.angularTangentA[0]), tangentImpulse0)), scale(load(cp.angularTangentA[1]), tangentImpulse1)));
+			const Vec3x4 vB1 = sub(vB, scale(impulse, invMassB));
+			const Vec3x4 wB1 = sub(wB, add(add(scale(load(cp.angularNormalB), normalImpulse),
+				scale(load(cp.angularTangentB[0]), tangentImpulse0)), scale(load(cp.angularTangentB[1]), tangentImpulse1)));
+			const __m128 active = _mm_castsi128_ps(_mm_cmpgt_epi32(numPoints, _mm_set1_epi32(p)));
+			vA = select(active, vA1, vA);
+			wA = select(active, wA1, wA);
+			vB = select(active, vB1, vB);
+			wB = select(active, wB1, wB);
+		}
+		const __m128 zero = _mm_setzero_ps();
+		storeVelocities(bodiesA, _mm_movemask_ps(_mm_cmpgt_ps(invMassA, zero)), vA, wA, dA);
+		storeVelocities(bodiesB, _mm_movemask_ps(_mm_cmpgt_ps(invMassB, zero)), vB, wB, dB);
+	}
+}
+
+
+void RigidBodyWorld::solveContactsWide(const IslandGroup& group, float h, bool useBias)
+{
+	// the constants of solveContacts()
+	const float invH = 1.f / h;
+	const float hertz = std::min(m_params.contactHertz, 0.25f * invH);
+	const float omega = 2.f * 3.14159265f * hertz;
+	const float zeta = m_params.contactDampingRatio;
+	const float a1 = 2.f * zeta + h * omega;
+	const float a2 = h * omega * a1;
+	const float a3 = 1.f / (1.f + a2);
+	const __m128 friction = _mm_set1_ps(m_params.friction);
+	const __m128 invHs = _mm_set1_ps(invH);
+	const __m128 biasRate = _mm_set1_ps(omega / a1);
+	const __m128 softMassScale = _mm_set1_ps(a2 * a3);
+	const __m128 softImpulseScale = _mm_set1_ps(a3);
+	const __m128 maxPushVelocity = _mm_set1_ps(m_params.maxPushVelocity);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 signBit = _mm_set1_ps(-0.f);
+	for (uint32_t j = 0; j < group.numRows; j++)
+	{
+		WideContact& c = m_wideContacts[group.rowBegin + j];
+		float* bodiesA[4];
+		float* bodiesB[4];
+		for (uint32_t l = 0; l < kIslandLanes; l++)
+		{
+			bodiesA[l] = &m_solverBodies[c.a[l]].linearVelocity.x;
+			bodiesB[l] = &m_solverBodies[c.b[l]].linearVelocity.x;
+		}
+		Vec3x4 vA, wA, dA, thetaA, vB, wB, dB, thetaB;
+		loadBodies(bodiesA, vA, wA, dA, thetaA);
+		loadBodies(bodiesB, vB, wB, dB, thetaB);
+		const __m128 invMassA = _mm_loadu_ps(c.invMassA), invMassB = _mm_loadu_ps(c.invMassB);
+		const Vec3x4 normal = load(c.normal), tangent0 = load(c.tangent[0]), tangent1 = load(c.tangent[1]);
+		const __m128i numPoints = _mm_loadu_si128((const __m128i*)c.numPoints);
+		const __m128 normalDisplacement = dot(sub(dA, dB), normal);
+		for (int p = 0; p < c.maxPoints; p++)
+		{
+			WideContactPoint& cp = c.points[p];
+			const Vec3x4 vA0 = vA, wA0 = wA, vB0 = vB, wB0 = wB;
+			const Vec3x4 rnA = load(cp.rnA), rnB = load(cp.rnB);
+			const __m128 separation = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_loadu_ps(cp.separation), normalDisplacement),
+				dot(thetaA, rnA)), dot(thetaB, rnB));
+
+			// the branches of solveContacts() as masks
+			const __m128 separated = _mm_cmpgt_ps(separation, zero);
+			const __m128 negativeSeparation = _mm_xor_ps(separation, signBit);
+			__m128 bias, massScale, impulseScale;
+			if (useBias)
+			{
+				bias = select(separated, _mm_mul_ps(negativeSeparation, invHs), _mm_min_ps(maxPushVelocity, _mm_mul_ps(negativeSeparation, biasRate)));
+				massScale = select(separated, one, softMassScale);
+				impulseScale = select(separated, zero, softImpulseScale);
+			}
+			else
+			{
+				bias = _mm_and_ps(separated, _mm_mul_ps(negativeSeparation, invHs));
+				massScale = one;
+				impulseScale = zero;
+			}
+
+			// non-penetration
+			const __m128 normalImpulse = _mm_loadu_ps(cp.normalImpulse);
+			const __m128 vn = _mm_sub_ps(_mm_add_ps(dot(sub(vA, vB), normal), dot(wA, rnA)), dot(wB, rnB));
+			__m128 lambda = _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(cp.normalMass), massScale), _mm_sub_ps(bias, vn)),
+				_mm_mul_ps(impulseScale, normalImpulse));
+			const __m128 accumulated = _mm_max_ps(zero, _mm_add_ps(normalImpulse, lambda));
+			lambda = _mm_sub_ps(accumulated, normalImpulse);
+			_mm_storeu_ps(cp.normalImpulse, accumulated);
+			_mm_storeu_ps(cp.maxNormalImpulse, _mm_max_ps(accumulated, _mm_loadu_ps(cp.maxNormalImpulse)));
+			vA = add(vA, scale(normal, _mm_mul_ps(invMassA, lambda)));
+			wA = add(wA, scale(load(cp.angularNormalA), lambda));
+			vB = sub(vB, scale(normal, _mm_mul_ps(invMassB, lambda)));
+			wB = sub(wB, scale(load(cp.angularNormalB), lambda));
+
+			// friction
+			const __m128 maxFriction = _mm_mul_ps(friction, accumulated);
+			const Vec3x4 dvt = sub(vA, vB);
+			const __m128 vt0 = _mm_sub_ps(_mm_add_ps(dot(dvt, tangent0), dot(wA, load(cp.rtA[0]))), dot(wB, load(cp.rtB[0])));
+			const __m128 vt1 = _mm_sub_ps(_mm_add_ps(dot(dvt, tangent1), dot(wA, load(cp.rtA[1]))), dot(wB, load(cp.rtB[1])));
+			const __m128 tangentImpulse0 = _mm_loadu_ps(cp.tangentImpulse[0]), tangentImpulse1 = _mm_loadu_ps(cp.tangentImpulse[1]);
+			const __m128 tangentMass0 = _mm_loadu_ps(cp.tangentMass[0]), tangentMass1 = _mm_loadu_ps(cp.tangentMass[1]),
+				tangentMass2 = _mm_loadu_ps(cp.tangentMass[2]);
+			__m128 accumulated0 = _mm_sub_ps(tangentImpulse0, _mm_add_ps(_mm_mul_ps(tangentMass0, vt0), _mm_mul_ps(tangentMass1, vt1)));
+			__m128 accumulated1 = _mm_sub_ps(tangentImpulse1, _mm_add_ps(_mm_mul_ps(tangentMass1, vt0), _mm_mul_ps(tangentMass2, vt1)));
+			const __m128 magnitudeSq = _mm_add_ps(_mm_mul_ps(accumulated0, accumulated0), _mm_mul_ps(accumulated1, accumulated1));
+			const __m128 outside = _mm_cmpgt_ps(magnitudeSq, _mm_mul_ps(maxFriction, maxFriction));
+			if (_mm_movemask_ps(outside))
+			{
+				const __m128 s = _mm_div_ps(maxFriction, _mm_sqrt_ps(magnitudeSq));
+				accumulated0 = select(outside, _mm_mul_ps(accumulated0, s), accumulated0);
+				accumulated1 = select(outside, _mm_mul_ps(accumulated1, s), accumulated1);
+			}
+			const __m128 lambda0 = _mm_sub_ps(accumulated0, tangentImpulse0);
+			const __m128 lambda1 = _mm_sub_ps(accumulated1, tangentImpulse1);
+			_mm_storeu_ps(cp.tangentImpulse[0], accumulated0);
+			_mm_storeu_ps(cp.tangentImpulse[1], accumulated1);
+			const Vec3x4 impulse = add(scale(tangent0, lambda0), scale(tangent1, lambda1));
+			vA = add(vA, scale(impulse, invMassA));
+			wA = add(wA, add(scale(load(cp.angularTangentA[0]), lambda0), scale(load(cp.angularTangentA[1]), lambda1)));
+			vB = sub(vB, scale(impulse, invMassB));
+			wB = sub(wB, add(scale(load(cp.angularTangentB[0]), lambda0), scale(load(cp.angularTangentB[1]), lambda1)));
+
+			const __m128 active = _mm_castsi128_ps(_mm_cmpgt_epi32(numPoints, _mm_set1_epi32(p)));
+			if (_mm_movemask_ps(active) != 0xf)
+			{
+				vA = select(active, vA, vA0);
+				wA = select(active, wA, wA0);
+				vB = select(active, vB, vB0);
+				wB = select(active, wB, wB0);
+			}
+		}
+		storeVelocities(bodiesA, _mm_movemask_ps(_mm_cmpgt_ps(invMassA, zero)), vA, wA, dA);
+		storeVelocities(bodiesB, _mm_movemask_ps(_mm_cmpgt_ps(invMassB, zero)), vB, wB, dB);
+	}
+}
+#endif
+
+
+void RigidBodyWorld::integratePositions(uint32_t island, float h)
+{
+	const std::vector<uint32_t>& bodies = m_islands.nodes();
+	for (uint32_t k = m_islands.nodeBegin(island); k < m_islands.nodeEnd(island); k++)
+	{
+		const uint32_t i = bodies[k];
+		SolverBody& body = m_solverBodies[i];
+		const Vec3 v = body.linearVelocity;
+		const Vec3 w = body.angularVelocity;
+		m_positions[i] += h * v;
+		body.linearDisplacement += h * v;
+		body.angularDisplacement += h * w;
+
+		// dq/dt = 1/2 (0, w) q
+		const Quat& q = m_orientations[i];
+		Quat dq = Quat(0.f, w.x, w.y, w.z) * q;
+		const float s = 0.5f * h;
+		m_orientations[i] = Quat(q.w + s * dq.w, q.x + s * dq.x, q.y + s * dq.y, q.z + s * dq.z).normalized();
+	}
+}
+
+
+void RigidBodyWorld::applyRestitution(uint32_t island)
+{
+	if (m_params.restitution == 0.f)
+	{
+		return;
+	}
+	const std::vector<uint32_t>& contacts = m_islands.edges();
+	for (uint32_t k = m_islands.edgeBegin(island); k < m_islands.edgeEnd(island); k++)
+	{
+		ContactConstraint& c = m_contacts[contacts[k]];
+		SolverBody& bodyA = m_solverBodies[c.a];
+		SolverBody& bodyB = m_solverBodies[c.b];
+		Vec3 vA = bodyA.linearVelocity, wA = bodyA.angularVelocity;
+		Vec3 vB = bodyB.linearVelocity, wB = bodyB.angularVelocity;
+		for (int j = 0; j < c.numPoints; j++)
+		{
+			ContactPointConstraint& cp = c.points[j];
+
+			// only points that approached fast and did get pushed apart
+			if (cp.relativeVelocity > -m_params.restitutionThreshold || cp.maxNormalImpulse == 0.f)
+			{
+				continue;
+			}
+			float vn = dot(vA - vB, c.normal) + dot(wA, cp.rnA) - dot(wB, cp.rnB);
+			float lambda = -cp.normalMass * (vn + m_params.restitution * cp.relativeVelocity);
+			float accumulated = std::max(cp.normalImpulse + lambda, 0.f);
+			lambda = accumulated - cp.normalImpulse;
+			cp.normalImpulse = accumulated;
+			vA += (c.invMassA * lambda) * c.normal;
+			wA += lambda * cp.angularNormalA;
+			vB -= (c.invMassB * lambda) * c.normal;
+			wB -= lambda * cp.angularNormalB;
+		}
+		if (c.invMassA > 0.f) { bodyA.linearVelocity = vA; bodyA.angularVelocity = wA; }
+		if (c.invMassB > 0.f) { bodyB.linearVelocity = vB; bodyB.angularVelocity = wB; }
+	}
+}
+
+
+void RigidBodyWorld::storeMomenta(uint32_t island)
+{
+	const std::vector<uint32_t>& bodies = m_islands.nodes();
+	for (uint32_t k = m_islands.nodeBegin(island); k < m_islands.nodeEnd(island); k++)
+	{
+		// L = I w with the inertia the solver used
+		const uint32_t i = bodies[k];
+		m_linearMomenta[i] = (1.f / m_invMasses[i]) * m_solverBodies[i].linearVelocity;
+		m_angularMomenta[i] = m_invInertiaWorld[i].inverse() * m_solverBodies[i].angularVelocity;
+	}
+}
+
+
+void RigidBodyWorld::updateSleep(uint32_t island, float timeStep)
+{
+	if (!m_params.allowSleeping)
+	{
+		return;
+	}
+
+	// a body is at rest while no point of it moves faster than the sleep
+	// velocity; the island sleeps once all of its bodies were at rest for
+	// timeToSleep
+	const std::vector<uint32_t>& bodies = m_islands.nodes();
+	float minRestTime = timeStep * 1e6f;
+	for (uint32_t k = m_islands.nodeBegin(island); k < m_islands.nodeEnd(island); k++)
+	{
+		const uint32_t i = bodies[k];
+		const SolverBody& body = m_solverBodies[i];
+		const float speed = length(body.linearVelocity) + length(m_halfExtents[i]) * length(body.angularVelocity);
+		m_restTimes[i] = speed < m_params.sleepVelocity ? m_restTimes[i] + timeStep : 0.f;
+		minRestTime = std::min(minRestTime, m_restTimes[i]);
+	}
+	if (minRestTime < m_params.timeToSleep)
+	{
+		return;
+	}
+	for (uint32_t k = m_islands.nodeBegin(island); k < m_islands.nodeEnd(island); k++)
+	{
+		const uint32_t i = bodies[k];
+		m_asleep[i] = 1;
+		m_linearMomenta[i] = Vec3();
+		m_angularMomenta[i] = Vec3();
+	}
+}
+
+
+void RigidBodyWorld::solveContinuous()
+{
+	PROFILE_ZONE("Continuous collision");
+	const size_t n = m_positions.size();
+	m_timesOfImpact.assign(n, 1.f);
+	m_impactPartners.resize(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		m_stats.numFastBodies += m_fastBodies[i];
+	}
+	if (m_stats.numFastBodies == 0)
+	{
+		return;
+	}
+
+	// pairs of a fast body; those that touched at the start of the step have a
+	// contact (both lists are sorted by (a, b)) and only need a sweep if they
+	// end up too deep or the fast body's centre went into the other body
+	const std::vector<BoxPair>& pairs = m_broadphase.pairs();
+	size_t contact = 0;
+	for (size_t p = 0; p < pairs.size(); p++)
+	{
+		const uint32_t a = pairs[p].a, b = pairs[p].b;
+		if (!m_fastBodies[a] && !m_fastBodies[b])
+		{
+			continue;
+		}
+		while (contact < m_contacts.size() && pairLess(m_contacts[contact].a, m_contacts[contact].b, a, b))
+		{
+			contact++;
+		}
+		const bool touching = contact < m_contacts.size() && m_contacts[contact].a == a && m_contacts[contact].b == b;
+		if (!touching)
+		{
+			if (m_fastBodies[a]) { recordImpact(a, b, timeOfImpact(a, b)); }
+			if (m_fastBodies[b]) { recordImpact(b, a, timeOfImpact(b, a)); }
+			continue;
+		}
+
+		const float target = -kMaxPenetrationFraction * std::min(minHalfExtent(m_halfExtents[a]), minHalfExtent(m_halfExtents[b]));
+		const bool deep = boxSeparation(box(a), box(b)) < target;
+		for (int k = 0; k < 2; k++)
+		{
+			const uint32_t i = k == 0 ? a : b, other = k == 0 ? b : a;
+			if (!m_fastBodies[i])
+			{
+				continue;
+			}
+			const float end = deep ? 1.f : centreEntry(i, other);
+			if (end <= 1.f)
+			{
+				recordImpact(i, other, timeOfPenetration(i, other, target, end));
+			}
+		}
+	}
+
+	// back to the pose at the time of impact; the velocity into the body hit
+	// is lost (an inelastic impact of the centres, the spin is kept). Keeping
+	// it, a body that hit with a corner would be stopped at the same pose
+	// step after step while gravity speeds it up.
+	const Vec3 skin(0.5f * kContactSkin, 0.5f * kContactSkin, 0.5f * kContactSkin);
+	for (size_t i = 0; i < n; i++)
+	{
+		const float t = m_timesOfImpact[i];
+		if (t >= 1.f)
+		{
+			continue;
+		}
+		const uint32_t other = m_impactPartners[i];
+		Box moved = sweptBox((uint32_t)i, t);
+		m_positions[i] = moved.center;
+		m_orientations[i] = orientationAt((uint32_t)i, t);
+		m_stats.numTimeOfImpactHits++;
+
+		Box obstacle = box(other);
+		moved.halfExtents += skin;
+		obstacle.halfExtents += skin;
+		ContactManifold manifold;
+		if (collideBoxes(moved, obstacle, manifold))
+		{
+			const Vec3 relativeVelocity = m_invMasses[i] * m_linearMomenta[i] - m_invMasses[other] * m_linearMomenta[other];
+			const float approach = dot(relativeVelocity, manifold.normalWorld);
+			if (approach < 0.f)
+			{
+				m_linearMomenta[i] -= (approach / m_invMasses[i]) * manifold.normalWorld;
+			}
+		}
+	}
+}
+
+
+void RigidBodyWorld::recordImpact(uint32_t i, uint32_t other, float t)
+{
+	if (t < m_timesOfImpact[i])
+	{
+		m_timesOfImpact[i] = t;
+		m_impactPartners[i] = other;
+	}
+}
+
+
+Quat RigidBodyWorld::orientationAt(uint32_t i, float t) const
+{
+	Vec3 axis;
+	const float angle = rotationBetween(m_startOrientations[i], m_orientations[i], axis);
+	return (Quat::fromAxisAngle(axis, t * angle) * m_startOrientations[i]).normalized();
+}
+
+
+Box RigidBodyWorld::sweptBox(uint32_t i, float t) const
+{
+	return boxAtPose(m_startPositions[i] + t * (m_positions[i] - m_startPositions[i]), orientationAt(i, t), m_halfExtents[i]);
+}
+
+
+float RigidBodyWorld::timeOfImpact(uint32_t i, uint32_t other) const
+{
+	// no point of the box moves further than maxDistance over the step and
+	// boxSeparation() is at most the distance of the boxes, so advancing by
+	// separation / maxDistance never steps past the impact
+	const Box obstacle = box(other);
+	Vec3 axis;
+	const float angle = rotationBetween(m_startOrientations[i], m_orientations[i], axis);
+	const float maxDistance = length(m_positions[i] - m_startPositions[i]) + angle * length(m_halfExtents[i]);
+	if (maxDistance <= 0.f)
+	{
+		return 1.f;
+	}
+
+	float t = 0.f;
+	for (int k = 0; k < kMaxAdvancementSteps; k++)
+	{
+		const float separation = boxSeparation(sweptBox(i, t), obstacle);
+		if (separation < kTimeOfImpactTolerance)
+		{
+			return k == 0 ? 1.f : t;  // close at the start already: the contact is found next step
+		}
+		t += (separation - 0.5f * kTimeOfImpactTolerance) / maxDistance;
+		if (t >= 1.f)
+		{
+			return 1.f;
+		}
+	}
+	return t;
+}
+
+
+float RigidBodyWorld::centreEntry(uint32_t i, uint32_t other) const
+{
+	Box core = box(other);
+	const float grow = 0.5f * minHalfExtent(m_halfExtents[i]);
+	core.halfExtents += Vec3(grow, grow, grow);
+	float t;
+	Vec3 normal;
+	return segmentEntersBox(m_startPositions[i], m_positions[i], core, t, normal) ? t : 2.f;
+}
+
+
+float RigidBodyWorld::timeOfPenetration(uint32_t i, uint32_t other, float target, float end) const
+{
+	// the separation of overlapping boxes jumps as they turn (the deepest axis
+	// changes), too fast for conservative advancement: bisect instead
+	const Box obstacle = box(other);
+	if (boxSeparation(sweptBox(i, 0.f), obstacle) < target)
+	{
+		return 1.f;
+	}
+	float lower = 0.f, upper = end;
+	for (int k = 0; k < kBisectionSteps; k++)
+	{
+		const float t = 0.5f * (lower + upper);
+		if (boxSeparation(sweptBox(i, t), obstacle) < target) { upper = t; }
+		else                                                  { lower = t; }
+	}
+	return lower;
+}
@@ -0,0 +1,354 @@
+#ifndef __RigidBodyWorld_h__
+#define __RigidBodyWorld_h__
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "BoxCollision.h"
+#include "Broadphase.h"
+#include "Islands.h"
+#include "Mat3.h"
+#include "Quat.h"
+#include "ThreadPool.h"
+#include "Vec3.h"
+
+
+// Simulation parameters of a RigidBodyWorld
+struct RigidBodyParams
+{
+	Vec3  gravity;             // gravitational acceleration of all dynamic bodies
+	int   substeps;            // solver substeps per step (contacts are found once per step)
+	int   velocityIterations;  // sequential impulse sweeps over all contacts per substep
+	float friction;            // Coulomb friction coefficient of every contact
+	float restitution;         // bounciness of impacts faster than restitutionThreshold
+	float restitutionThreshold;
+	float contactHertz;        // stiffness of the penetration recovery, at most a quarter of the substep rate
+	float contactDampingRatio;
+	float maxPushVelocity;     // limit of the velocity that pushes penetrating bodies apart
+	bool  warmStarting;        // start each contact with last step's impulse
+	unsigned int numThreads;   // threads stepping the islands, 0 = all cores
+	bool  allowSleeping;       // let islands at rest fall asleep
+	float sleepVelocity;       // a body is at rest while no point of it moves faster
+	float timeToSleep;         // an island sleeps once all of its bodies were at rest this long
+	bool  continuousCollision; // stop fast bodies at their time of impact instead of letting them tunnel
+	bool  simdSolver;          // solve the contacts of 4 islands at once in SSE2 registers (same results)
+
+	RigidBodyParams() : gravity(0.f, -9.81f, 0.f), substeps(4), velocityIterations(1), friction(0.5f), restitution(0.f),
+		restitutionThreshold(1.f), contactHertz(60.f), contactDampingRatio(1.f), maxPushVelocity(3.f), warmStarting(true),
+		numThreads(1), allowSleeping(true), sleepVelocity(0.05f), timeToSleep(0.5f), continuousCollision(false),
+		simdSolver(true) {}
+};
+
+// Counters of the last step()
+struct RigidBodyStats
+{
+	size_t numPairs;        // broad phase pairs
+	size_t numManifolds;    // pairs that touch
+	size_t numContacts;     // contact points
+	size_t numWarmStarted;  // contact points matched with one of the last step
+	size_t numIslands;
+	size_t numAwakeIslands;
+	size_t numSleepingBodies;
+	float  islandSolveSeconds;     // sum over the awake islands (more than the step time with threads)
+	float  maxIslandSolveSeconds;  // most expensive island
+	size_t numFastBodies;   // bodies swept by the continuous stage
+	size_t numTimeOfImpactHits;  // fast bodies moved back to their time of impact
+
+	RigidBodyStats() : numPairs(0), numManifolds(0), numContacts(0), numWarmStarted(0), numIslands(0), numAwakeIslands(0),
+		numSleepingBodies(0), islandSolveSeconds(0.f), maxIslandSolveSeconds(0.f), numFastBodies(0), numTimeOfImpactHits(0) {}
+};
+
+// Rigid boxes stored as structure of arrays, like the mass points of
+// MassSpringSystem. The state of body i is its centre of mass position,
+// orientation, linear momentum and angular momentum; velocities are derived
+// from the momenta at the start of every step.
+//
+// step() finds contacts with a DynamicAabbTree and collideBoxes() (the
+// separating axis test behind checkCollisionSAT() of the demo, which gives the
+// up to 4 point manifolds resting boxes need instead of the single point of
+// CollisionInfo) and solves them with sequential impulses (Catto, "Iterative
+// Dynamics with Temporal Coherence"). Contacts that persist from one step to
+// the next start with their old impulses (warm starting).
+//
+// The solver runs m_params.substeps substeps of symplectic Euler per step
+// and reuses the contacts of the step, estimating their separation from the
+// body motion since (as in Box2D v3's soft step). Penetration is pushed out
+// by soft constraints whose velocity is removed again by an unbiased "relax"
+// sweep after the positions are updated. Substeps propagate the weight of a
+// stack far better than more iterations of one big step.
+//
+// The bodies connected by contacts form islands (see Islands.h) that are
+// stepped independently, in parallel on m_params.numThreads threads with
+// work stealing. The result does not depend on the number of threads. With
+// m_params.simdSolver (and SSE2) the awake islands are stepped in groups of
+// four, each island in one lane of the SSE2 registers: one instruction does
+// the same step of the contact solver for four contacts, with the same
+// operations in the same order as the scalar solver. An
+// island whose bodies have been at rest for a while falls asleep: its bodies
+// and contacts are kept as they are and cost no narrow phase or solver time
+// until an awake body touches one of them or wake() is called.
+//
+// Contacts are only found at the start of a step, so a body that moves
+// further than about half its thickness in one step can pass through another
+// one. With m_params.continuousCollision such fast bodies get bounds that
+// cover their motion over the step, and after the solver each one is swept
+// from its old to its new pose against the bodies the broad phase paired it
+// with (held at their new poses). Conservative advancement with
+// boxSeparation() finds the first time of impact of pairs without contact;
+// pairs with contact are only swept, by bisection, if the fast body ended up
+// too deep or its centre entered the other body. The body is moved back to
+// the time of impact, loses its velocity into the body it hit, and the
+// contact is found at the next step. The fraction of the step after the
+// impact is lost, as in Box2D's continuous collision of fast bodies.
+class RigidBodyWorld
+{
+public:
+	RigidBodyWorld() {}
+
+	// Remove all bodies and cached contacts (keeps the allocated capacity)
+	void clear();
+
+	// Preallocate storage for the given number of bodies
+	void reserve(size_t numBodies);
+
+	// Add a box of edge lengths size and return its index. mass = 0 makes a
+	// static body that is never moved by the simulation.
+	uint32_t addBox(const Vec3& center, const Vec3& size, float mass, const Quat& orientation = Quat());
+
+	// Advance the simulation by one time step using m_params
+	void step(float timeStep);
+
+	size_t numBodies() const { return m_positions.size(); }
+
+	Vec3 linearVelocity(uint32_t i) const  { return m_invMasses[i] * m_linearMomenta[i]; }
+	Vec3 angularVelocity(uint32_t i) const;
+
+	// World space box of body i (for collision queries and drawing)
+	Box box(uint32_t i) const;
+
+	// Rigid object to world transform of body i in the layout checkCollision()
+	// and XMLoadFloat4x4() take (rows 0 - 2: object axes, row 3: translation)
+	void transform(uint32_t i, float obj2World[4][4]) const;
+
+	// Kinetic energy of all bodies
+	float kineticEnergy() const;
+
+	// Sleeping bodies are not moved until their island wakes up. Call wake()
+	// after changing the state of a body from outside (position, momentum).
+	bool isAsleep(uint32_t i) const { return m_asleep[i] != 0; }
+	void wake(uint32_t i);
+
+	// Sleep state of all bodies (1 = asleep), e.g. for snapshots
+	const std::vector<uint8_t>& sleepFlags() const { return m_asleep; }
+
+	// Call after the public per body arrays were replaced from outside (a
+	// restored snapshot): sizes the internal per body state, drops the cached
+	// contacts and sets the sleep flags (null: all awake)
+	void bodiesReplaced(const uint8_t* asleep);
+
+	const RigidBodyStats& lastStepStats() const { return m_stats; }
+
+	// Seconds spent on every island in the last step (0 for sleeping
+	// islands), numbered as the islands of the contact graph. Islands solved
+	// together by the SSE2 solver share the time of their group evenly.
+	const std::vector<float>& lastIslandSolveTimes() const { return m_islandSolveTimes; }
+
+	RigidBodyParams m_params;
+
+	// per body arrays
+	std::vector<Vec3>  m_positions;         // centre of mass
+	std::vector<Quat>  m_orientations;
+	std::vector<Vec3>  m_linearMomenta;
+	std::vector<Vec3>  m_angularMomenta;
+	std::vector<float> m_invMasses;         // 0 for static bodies
+	std::vector<Vec3>  m_invInertiaBody;    // diagonal of the inverse inertia tensor in body space
+	std::vector<Vec3>  m_halfExtents;
+
+private:
+	// The state of a body the solver changes, in one place because every
+	// contact reads and writes all of it for both of its bodies
+	struct SolverBody
+	{
+		Vec3 linearVelocity;
+		Vec3 angularVelocity;
+		Vec3 linearDisplacement;   // since the contacts were found
+		Vec3 angularDisplacement;  // sum of angular velocity * substep
+	};
+
+	// A contact point as seen by the solver
+	struct ContactPointConstraint
+	{
+		// Jacobians: the relative velocity along the normal n is
+		// (vA - vB) . n + wA . (rA x n) - wB . (rB x n), r = contact point
+		// relative to the centre of mass. Keeping r x n (and r x t) instead of
+		// r spares the solver all cross products.
+		Vec3  rnA, rnB;             // rA x n, rB x n
+		Vec3  rtA[2], rtB[2];       // rA x t, rB x t for both tangents
+		Vec3  angularNormalA;       // I_A^-1 (rA x n), angular velocity change of a per unit normal impulse
+		Vec3  angularNormalB;
+		Vec3  angularTangentA[2];
+		Vec3  angularTangentB[2];
+		float separation;           // distance of the surfaces when found, < 0 if penetrating
+		float normalMass;           // 1 / effective mass along the normal
+		float tangentMass[3];       // inverse of the 2x2 effective mass of both tangents: xx, xy, yy
+		float normalImpulse;        // accumulated impulses of a substep
+		float tangentImpulse[2];
+		float maxNormalImpulse;
+		float relativeVelocity;     // normal velocity when found, for restitution
+		Vec3  localA;               // contact point in the body space of a, identifies the point in the next step
+	};
+
+	// The contact manifold of a pair of bodies; its points share the normal and
+	// the body velocities, which the solver loads only once for all of them
+	struct ContactConstraint
+	{
+		uint32_t a, b;              // bodies, the normal points from b towards a
+		int   numPoints;
+		float invMassA, invMassB;
+		Vec3  normal;
+		Vec3  tangent[2];
+		ContactPointConstraint points[4];
+	};
+
+	// islands stepped together by the SSE2 solver, one per lane
+	static const uint32_t kIslandLanes = 4;
+
+	// ContactPointConstraint of four contacts, [k][lane] for component k
+	struct WideContactPoint
+	{
+		float rnA[3][4], rnB[3][4];
+		float rtA[2][3][4], rtB[2][3][4];
+		float angularNormalA[3][4], angularNormalB[3][4];
+		float angularTangentA[2][3][4], angularTangentB[2][3][4];
+		float separation[4];
+		float normalMass[4];
+		float tangentMass[3][4];
+		float normalImpulse[4];
+		float tangentImpulse[2][4];
+		float maxNormalImpulse[4];
+	};
+
+	// Row j of an island group: contact j of every island of the group, lane l
+	// from island l. Lanes of islands with fewer contacts and points beyond
+	// the end of a smaller manifold take no part (their results are masked).
+	struct WideContact
+	{
+		float invMassA[4], invMassB[4];  // 0 in unused lanes
+		float normal[3][4];
+		float tangent[2][3][4];
+		WideContactPoint points[4];
+		uint32_t contacts[4];   // index into m_contacts
+		uint32_t a[4], b[4];    // bodies (of lane 0 in unused lanes, never written)
+		int32_t  numPoints[4];  // 0 in unused lanes
+		int32_t  maxPoints;
+	};
+
+	// Up to kIslandLanes awake islands (m_awakeIslands[islandBegin ..]) and
+	// their rows m_wideContacts[rowBegin ..], as many as the first and
+	// largest island has contacts
+	struct IslandGroup
+	{
+		uint32_t islandBegin, numIslands;
+		uint32_t rowBegin, numRows;
+	};
+
+	// Velocities, world space inverse inertia and boxes from the state; bounds
+	// of fast bodies cover their predicted motion over timeStep
+	void prepareBodies(float timeStep);
+
+	// Broad and narrow phase, builds m_contacts (warm started from m_oldContacts)
+	void findContacts();
+
+	// Append the constraint of a touching pair; old is the pair's constraint of
+	// the last step to warm start from, or null
+	void addManifold(uint32_t a, uint32_t b, const ContactManifold& manifold, const ContactConstraint* old);
+
+	// Islands of the contact graph, m_islandOrder
+	void buildIslands();
+
+	// Substeps of one awake island, then its sleep test
+	void stepIsland(uint32_t island, float timeStep);
+
+	// The same for an island group with the SSE2 solver. The group's contacts
+	// are copied into its rows before the substeps and the impulses back after.
+	void stepIslandGroup(const IslandGroup& group, float timeStep);
+	void packWideContacts(const IslandGroup& group);
+	void clearLane(WideContact& w, uint32_t l, int firstPoint);  // points from firstPoint on of lane l take no part
+	void unpackWideContacts(const IslandGroup& group);
+	void warmStartWide(const IslandGroup& group);
+	void solveContactsWide(const IslandGroup& group, float h, bool useBias);
+
+	void integrateVelocities(uint32_t island, float h);
+	void warmStart(uint32_t island);
+	void solveContacts(uint32_t island, float h, bool useBias);
+	void integratePositions(uint32_t island, float h);
+	void applyRestitution(uint32_t island);
+
+	// Momenta of the state from the velocities
+	void storeMomenta(uint32_t island);
+
+	// Rest times of the island's bodies, puts the island to sleep
+	void updateSleep(uint32_t island, float timeStep);
+
+	// Continuous stage: moves the fast bodies back to their first time of impact
+	void solveContinuous();
+
+	// Keep t as the time of impact of fast body i if it is the earliest so far
+	void recordImpact(uint32_t i, uint32_t other, float t);
+
+	// Orientation and box of fast body i at fraction t of its motion from its
+	// start to its current pose (constant velocity and rotation rate)
+	Quat orientationAt(uint32_t i, float t) const;
+	Box sweptBox(uint32_t i, float t) const;
+
+	// Fraction of the step at which fast body i first comes within the
+	// tolerance of other (at its current pose), by conservative advancement;
+	// 1 if it never does
+	float timeOfImpact(uint32_t i, uint32_t other) const;
+
+	// Fraction of the step at which the centre of fast body i enters other
+	// (grown by half of i's smallest half extent); > 1 if it does not
+	float centreEntry(uint32_t i, uint32_t other) const;
+
+	// Last fraction of [0, end] found by bisection at which fast body i is not
+	// yet deeper than -target in other; 1 if it already was at the start
+	float timeOfPenetration(uint32_t i, uint32_t other, float target, float end) const;
+
+	// Create/resize m_threadPool to match m_params.numThreads
+	void updateThreadPool();
+
+	// per body sleep state
+	std::vector<uint8_t> m_asleep;
+	std::vector<float>   m_restTimes;  // how long the body has been at rest
+
+	// per step arrays
+	std::vector<SolverBody> m_solverBodies;
+	std::vector<uint8_t>    m_staticBodies;
+	std::vector<Mat3> m_invInertiaWorld;
+	std::vector<Box>  m_boxes;
+	std::vector<Aabb> m_bounds;
+
+	// continuous stage
+	std::vector<uint8_t>  m_fastBodies;
+	std::vector<Vec3>     m_startPositions;
+	std::vector<Quat>     m_startOrientations;
+	std::vector<float>    m_timesOfImpact;
+	std::vector<uint32_t> m_impactPartners;  // body hit at the time of impact
+
+	DynamicAabbTree m_broadphase;
+	std::vector<ContactConstraint> m_contacts;     // one per touching pair, sorted by (a, b)
+	std::vector<ContactConstraint> m_oldContacts;  // contacts of the last step
+	RigidBodyStats m_stats;
+
+	Islands m_islands;                       // nodes: bodies, edges: m_contacts
+	std::vector<uint32_t> m_islandOrder;     // islands by decreasing number of contacts
+	std::vector<uint32_t> m_awakeIslands;    // the awake ones of m_islandOrder, in that order
+	std::vector<IslandGroup> m_islandGroups; // of m_awakeIslands, for the SSE2 solver
+	std::vector<WideContact> m_wideContacts;
+	std::vector<float>    m_islandSolveTimes;
+	std::unique_ptr<ThreadPool> m_threadPool;
+};
+
+
+#endif
@@ -0,0 +1,255 @@
+#include "Scenes.h"
+
+#include "MassSpringSystem.h"
+#include "RigidBodyWorld.h"
+
+
+namespace
+{
+	void buildTwoPoint(MassSpringSystem& ms, uint32_t)    { buildTwoPointScene(ms); }
+	void buildSpringHouse(MassSpringSystem& ms, uint32_t) { buildSpringHouseScene(ms); }
+	void buildCloth(MassSpringSystem& ms, uint32_t size)    { buildClothScene(ms, size, size); }
+	void buildRopes(MassSpringSystem& ms, uint32_t size)    { buildRopeScene(ms, size, 4 * size); }
+	void buildSoftBody(MassSpringSystem& ms, uint32_t size) { buildSoftBodyScene(ms, size, size, size); }
+
+	struct SceneEntry
+	{
+		const char* name;
+		void (*build)(MassSpringSystem& ms, uint32_t size);
+		uint32_t defaultSize;
+	};
+
+	const SceneEntry g_scenes[] = {
+		{ "twopoint",    buildTwoPoint,    0 },
+		{ "springhouse", buildSpringHouse, 0 },
+		{ "cloth",       buildCloth,       64 },
+		{ "rope",        buildRopes,       16 },
+		{ "softbody",    buildSoftBody,    16 },
+	};
+}
+
+
+void buildTwoPointScene(MassSpringSystem& ms, float mass)
+{
+	// remove old points/springs
+	ms.clear();
+
+	uint32_t p0 = ms.addPoint(0.f, 0.f, 0.f, false, mass);
+	uint32_t p1 = ms.addPoint(0.f, 2.f, 0.f, false, mass);
+
+	ms.m_velocities[p0] = Vec3(-1.f, 0.f, 0.f);
+	ms.m_velocities[p1] = Vec3(1.f, 0.f, 0.f);
+
+	ms.addSpring(p0, p1, 1, 40);
+}
+
+
+void buildSpringHouseScene(MassSpringSystem& ms, float mass)
+{
+	// remove old points/springs
+	ms.clear();
+
+	uint32_t p0 = ms.addPoint(0.f, 0.f, 0.f, false, mass);
+	uint32_t p1 = ms.addPoint(0.f, 0.f, 2.f, false, mass);
+	uint32_t p2 = ms.addPoint(2.f, 0.f, 2.f, false, mass);
+	uint32_t p3 = ms.addPoint(2.f, 0.f, 0.f, false, mass);
+
+	uint32_t p4 = ms.addPoint(0.f, 2.f, 0.f, false, mass);
+	uint32_t p5 = ms.addPoint(0.f, 2.f, 2.f, false, mass);
+	uint32_t p6 = ms.addPoint(2.f, 2.f, 2.f, false, mass);
+	uint32_t p7 = ms.addPoint(2.f, 2.f, 0.f, false, mass);
+
+	uint32_t p8 = ms.addPoint(0.f, 3.f, 1.f, true, mass);
+	uint32_t p9 = ms.addPoint(2.f, 3.f, 1.f, false, mass);
+
+	// some velocities
+	ms.m_velocities[p1] = Vec3(0.3f, 0.2f, 0.1f);
+	ms.m_velocities[p6] = Vec3(3.f, 0.f, 0.f);
+
+	ms.addSpring(p0, p1, 40.f);
+	ms.addSpring(p1, p2, 40.f);
+	ms.addSpring(p2, p3, 40.f);
+	ms.addSpring(p3, p0, 40.f);
+
+	ms.addSpring(p1, p5, 2.f, 40.f);
+	ms.addSpring(p2, p6, 1.5f, 40.f);
+	ms.addSpring(p3, p7, 2.2f, 40.f);
+	ms.addSpring(p0, p4, 1.5f, 40.f);
+
+	ms.addSpring(p4, p5, 40.f);
+	ms.addSpring(p5, p6, 40.f);
+	ms.addSpring(p6, p7, 40.f);
+	ms.addSpring(p7, p4, 40.f);
+
+	ms.addSpring(p4, p8, 40.f);
+	ms.addSpring(p5, p8, 40.f);
+	ms.addSpring(p6, p9, 40.f);
+	ms.addSpring(p7, p9, 40.f);
+
+	ms.addSpring(p8, p9, 40.f);
+}
+
+
+void buildClothScene(MassSpringSystem& ms, uint32_t width, uint32_t height, float spacing,
+	float stiffness, float mass, bool bendSprings)
+{
+	ms.clear();
+	if (width == 0 || height == 0) { return; }
+
+	const size_t w = width, h = height;
+	size_t numSprings = (w - 1) * h + w * (h - 1) + 2 * (w - 1) * (h - 1);
+	if (bendSprings)
+	{
+		numSprings += (w > 2 ? (w - 2) * h : 0) + (h > 2 ? w * (h - 2) : 0);
+	}
+	ms.reserve(w * h, numSprings);
+
+	const float x0 = -0.5f * spacing * (w - 1);
+	const float z0 = -0.5f * spacing * (h - 1);
+	for (uint32_t z = 0; z < height; z++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			bool fixed = z == 0 && (x == 0 || x == width - 1);
+			ms.addPoint(x0 + x * spacing, 1.f, z0 + z * spacing, fixed, mass);
+		}
+	}
+
+	for (uint32_t z = 0; z < height; z++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			uint32_t i = z * width + x;
+			// structural
+			if (x + 1 < width)  { ms.addSpring(i, i + 1, stiffness); }
+			if (z + 1 < height) { ms.addSpring(i, i + width, stiffness); }
+			// shear
+			if (x + 1 < width && z + 1 < height)
+			{
+				ms.addSpring(i, i + width + 1, stiffness);
+				ms.addSpring(i + 1, i + width, stiffness);
+			}
+			// bend
+			if (bendSprings)
+			{
+				if (x + 2 < width)  { ms.addSpring(i, i + 2, stiffness); }
+				if (z + 2 < height) { ms.addSpring(i, i + 2 * width, stiffness); }
+			}
+		}
+	}
+}
+
+
+void buildRopeScene(MassSpringSystem& ms, uint32_t numRopes, uint32_t numSegments, float spacing,
+	float stiffness, float mass)
+{
+	ms.clear();
+	if (numRopes == 0 || numSegments == 0) { return; }
+
+	const size_t pointsPerRope = numSegments + 1;
+	ms.reserve(numRopes * pointsPerRope, numRopes * (2 * (size_t)numSegments - 1));
+
+	// ropes side by side along z, each one extending along x
+	const float z0 = -0.5f * 2.f * spacing * (numRopes - 1);
+	for (uint32_t r = 0; r < numRopes; r++)
+	{
+		uint32_t first = (uint32_t)ms.numPoints();
+		for (uint32_t k = 0; k <= numSegments; k++)
+		{
+			ms.addPoint(k * spacing, 1.f, z0 + 2.f * spacing * r, k == 0, mass);
+		}
+		for (uint32_t k = 0; k < numSegments; k++)
+		{
+			ms.addSpring(first + k, first + k + 1, stiffness);
+			if (k + 2 <= numSegments) { ms.addSpring(first + k, first + k + 2, stiffness); }
+		}
+	}
+}
+
+
+void buildSoftBodyScene(MassSpringSystem& ms, uint32_t nx, uint32_t ny, uint32_t nz, float spacing,
+	float stiffness, float mass)
+{
+	ms.clear();
+	if (nx == 0 || ny == 0 || nz == 0) { return; }
+
+	// edges of the Freudenthal triangulation: from every grid point to the
+	// neighbours at the offsets (a, b, c) with a, b, c in {0, 1}, not all 0
+	const uint32_t offsets[7][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 },
+		{ 1, 1, 0 }, { 1, 0, 1 }, { 0, 1, 1 }, { 1, 1, 1 } };
+
+	size_t numSprings = 0;
+	for (int e = 0; e < 7; e++)
+	{
+		numSprings += (size_t)(nx - offsets[e][0]) * (ny - offsets[e][1]) * (nz - offsets[e][2]);
+	}
+	ms.reserve((size_t)nx * ny * nz, numSprings);
+
+	const float x0 = -0.5f * spacing * (nx - 1);
+	const float z0 = -0.5f * spacing * (nz - 1);
+	for (uint32_t y = 0; y < ny; y++)
+		for (uint32_t z = 0; z < nz; z++)
+			for (uint32_t x = 0; x < nx; x++)
+				ms.addPoint(x0 + x * spacing, y * spacing, z0 + z * spacing, y == 0, mass);
+
+	for (uint32_t y = 0; y < ny; y++)
+	{
+		for (uint32_t z = 0; z < nz; z++)
+		{
+			for (uint32_t x = 0; x < nx; x++)
+			{
+				uint32_t i = (y * nz + z) * nx + x;
+				for (int e = 0; e < 7; e++)
+				{
+					uint32_t ex = offsets[e][0], ey = offsets[e][1], ez = offsets[e][2];
+					if (x + ex >= nx || y + ey >= ny || z + ez >= nz) { continue; }
+					ms.addSpring(i, ((y + ey) * nz + (z + ez)) * nx + (x + ex), stiffness);
+				}
+			}
+		}
+	}
+}
+
+
+void buildBoxStacksScene(RigidBodyWorld& world, uint32_t columnsX, uint32_t columnsZ, uint32_t height, float gap)
+{
+	world.clear();
+	world.reserve((size_t)columnsX * columnsZ * height + 1);
+
+	const float pitch = 1.f + gap;
+	const float extentX = pitch * columnsX + 2.f, extentZ = pitch * columnsZ + 2.f;
+	world.addBox(Vec3(0.f, -0.5f, 0.f), Vec3(extentX, 1.f, extentZ), 0.f);
+
+	const float x0 = -0.5f * pitch * (columnsX - 1);
+	const float z0 = -0.5f * pitch * (columnsZ - 1);
+	for (uint32_t z = 0; z < columnsZ; z++)
+		for (uint32_t x = 0; x < columnsX; x++)
+			for (uint32_t y = 0; y < height; y++)
+				world.addBox(Vec3(x0 + x * pitch, 0.5f + y, z0 + z * pitch), Vec3(1.f, 1.f, 1.f), 1.f);
+}
+
+
+std::vector<std::string> getSceneNames()
+{
+	std::vector<std::string> names;
+	for (size_t i = 0; i < sizeof(g_scenes) / sizeof(g_scenes[0]); i++)
+	{
+		names.push_back(g_scenes[i].name);
+	}
+	return names;
+}
+
+
+bool buildScene(const std::string& name, MassSpringSystem& ms, uint32_t size)
+{
+	for (size_t i = 0; i < sizeof(g_scenes) / sizeof(g_scenes[0]); i++)
+	{
+		if (name == g_scenes[i].name)
+		{
+			g_scenes[i].build(ms, size != 0 ? size : g_scenes[i].defaultSize);
+			return true;
+		}
+	}
+	ms.clear();
+	return false;
+}
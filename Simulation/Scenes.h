@@ -0,0 +1,52 @@
+#ifndef __Scenes_h__
+#define __Scenes_h__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class MassSpringSystem;
+class RigidBodyWorld;
+
+
+// Two mass points connected by a single spring (Demo1 - Demo3)
+void buildTwoPointScene(MassSpringSystem& ms, float mass = 10.f);
+
+// The "spring house": 10 points and 17 springs, one point fixed (Demo4)
+void buildSpringHouseScene(MassSpringSystem& ms, float mass = 10.f);
+
+// The generators below reserve the exact number of points and springs up front,
+// so building even millions of springs never reallocates.
+
+// width x height cloth in the xz plane at y = 1, centred on the y axis, with
+// structural, shear and (optionally) bend springs. The two corners of the
+// first row are fixed.
+void buildClothScene(MassSpringSystem& ms, uint32_t width, uint32_t height, float spacing = 0.05f,
+	float stiffness = 500.f, float mass = 0.01f, bool bendSprings = true);
+
+// numRopes parallel ropes of numSegments segments each, starting horizontally
+// from a fixed first point, with structural and bend springs
+void buildRopeScene(MassSpringSystem& ms, uint32_t numRopes, uint32_t numSegments, float spacing = 0.05f,
+	float stiffness = 500.f, float mass = 0.01f);
+
+// Soft body block of nx x ny x nz points on a grid. Every voxel is split into
+// 6 tetrahedra around its main diagonal (Freudenthal triangulation) and every
+// tetrahedron edge is a spring. The bottom layer is fixed.
+void buildSoftBodyScene(MassSpringSystem& ms, uint32_t nx, uint32_t ny, uint32_t nz, float spacing = 0.05f,
+	float stiffness = 500.f, float mass = 0.01f);
+
+// columnsX x columnsZ stacks of height unit boxes (mass 1) standing on a
+// static ground box with its top at y = 0, gap apart from each other
+void buildBoxStacksScene(RigidBodyWorld& world, uint32_t columnsX, uint32_t columnsZ, uint32_t height, float gap = 0.2f);
+
+// Names of all scenes known to buildScene()
+std::vector<std::string> getSceneNames();
+
+// Clear ms and build the scene with the given name. size scales the generated
+// scenes (cloth: size x size points, rope: size ropes of 4 * size segments,
+// softbody: size^3 points); 0 uses the scene's default size.
+// Returns false (and leaves ms empty) if the name is unknown.
+bool buildScene(const std::string& name, MassSpringSystem& ms, uint32_t size = 0);
+
+
+#endif
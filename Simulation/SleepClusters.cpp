@@ -0,0 +1,395 @@
+#include "SleepClusters.h"
+
+#include <algorithm>
+
+#include "MassSpringSystem.h"
+#include "Profiler.h"
+
+
+namespace
+{
+	const uint32_t kNone = 0xffffffffu;
+
+	inline bool boxesOverlap(const Vec3& minA, const Vec3& maxA, const Vec3& minB, const Vec3& maxB)
+	{
+		return minA.x <= maxB.x && minB.x <= maxA.x && minA.y <= maxB.y && minB.y <= maxA.y && minA.z <= maxB.z && minB.z <= maxA.z;
+	}
+}
+
+
+SleepClusters::SleepClusters()
+	: m_clusterOffsets(1, 0), m_clusterSize(0), m_neighbourOffsets(1, 0), m_numSleeping(0), m_gravity(0.f, 0.f, 0.f), m_damping(0.f), m_numShapes(0),
+	m_awakeSystemValid(false), m_numLocalAwake(0)
+{
+}
+
+
+SleepClusters::~SleepClusters()
+{
+}
+
+
+void SleepClusters::setTopology(const MassSpringSystem& ms)
+{
+	const size_t n = ms.numPoints();
+	m_clusterSize = ms.m_params.sleepClusterSize;
+	const uint32_t clusterSize = std::max(m_clusterSize, 1u);
+	buildPointSpringAdjacency(n, ms.m_springs, m_adjacencyOffsets, m_adjacency);
+
+	// breadth first from the lowest unassigned point; a cluster that is not
+	// full when its search runs out continues from the next seed, so points
+	// without springs share clusters too
+	m_pointClusters.assign(n, kNone);
+	m_clusterOffsets.assign(1, 0);
+	m_clusterPoints.clear();
+	uint32_t numInCluster = 0;
+	for (uint32_t seed = 0; seed < n; seed++)
+	{
+		if (ms.m_fixed[seed] || m_pointClusters[seed] != kNone)
+		{
+			continue;
+		}
+		m_scratch.assign(1, seed);
+		for (size_t q = 0; q < m_scratch.size() && numInCluster < clusterSize; q++)
+		{
+			const uint32_t p = m_scratch[q];
+			if (m_pointClusters[p] != kNone)
+			{
+				continue;  // queued twice
+			}
+			m_pointClusters[p] = (uint32_t)(m_clusterOffsets.size() - 1);
+			m_clusterPoints.push_back(p);
+			numInCluster++;
+			for (uint32_t e = m_adjacencyOffsets[p]; e < m_adjacencyOffsets[p + 1]; e++)
+			{
+				const Spring& spring = ms.m_springs[m_adjacency[e] >> 1];
+				const uint32_t other = (m_adjacency[e] & 1) ? spring.point1 : spring.point2;
+				if (!ms.m_fixed[other] && m_pointClusters[other] == kNone)
+				{
+					m_scratch.push_back(other);
+				}
+			}
+		}
+		if (numInCluster == clusterSize)
+		{
+			m_clusterOffsets.push_back((uint32_t)m_clusterPoints.size());
+			numInCluster = 0;
+		}
+	}
+	if (numInCluster > 0)
+	{
+		m_clusterOffsets.push_back((uint32_t)m_clusterPoints.size());
+	}
+	const size_t numClusters = m_clusterOffsets.size() - 1;
+
+	// neighbours: the other clusters of the springs of every cluster
+	m_neighbourOffsets.assign(1, 0);
+	m_neighbours.clear();
+	for (size_t c = 0; c < numClusters; c++)
+	{
+		const size_t first = m_neighbours.size();
+		for (uint32_t k = m_clusterOffsets[c]; k < m_clusterOffsets[c + 1]; k++)
+		{
+			const uint32_t p = m_clusterPoints[k];
+			for (uint32_t e = m_adjacencyOffsets[p]; e < m_adjacencyOffsets[p + 1]; e++)
+			{
+				const Spring& spring = ms.m_springs[m_adjacency[e] >> 1];
+				const uint32_t other = m_pointClusters[(m_adjacency[e] & 1) ? spring.point1 : spring.point2];
+				if (other != kNone && other != c)
+				{
+					m_neighbours.push_back(other);
+				}
+			}
+		}
+		std::sort(m_neighbours.begin() + first, m_neighbours.end());
+		m_neighbours.erase(std::unique(m_neighbours.begin() + first, m_neighbours.end()), m_neighbours.end());
+		m_neighbourOffsets.push_back((uint32_t)m_neighbours.size());
+	}
+
+	m_asleep.assign(numClusters, 0);
+	m_quiet.assign(numClusters, 0);
+	m_moving.assign(numClusters, 0);
+	m_restTimes.assign(numClusters, 0.f);
+	m_energies.assign(numClusters, 0.f);
+	m_boxMin.assign(numClusters, Vec3(0.f, 0.f, 0.f));
+	m_boxMax.assign(numClusters, Vec3(0.f, 0.f, 0.f));
+	m_numSleeping = 0;
+	m_gravity = ms.m_params.gravity;
+	m_damping = ms.m_params.damping;
+	m_numShapes = ms.m_colliderPlanes.size() + ms.m_colliderBoxes.size();
+	m_awakeSystemValid = false;
+	m_localPoints.clear();
+	m_localIndex.assign(n, kNone);
+
+	m_stats = SleepStats();
+	m_stats.numClusters = numClusters;
+	m_stats.numAwakePoints = m_clusterPoints.size();
+}
+
+
+void SleepClusters::checkChanges(const MassSpringSystem& ms)
+{
+	const Vec3& g = ms.m_params.gravity;
+	const size_t numShapes = ms.m_colliderPlanes.size() + ms.m_colliderBoxes.size();
+	if (g.x != m_gravity.x || g.y != m_gravity.y || g.z != m_gravity.z || ms.m_params.damping != m_damping || numShapes != m_numShapes)
+	{
+		wakeAll();
+		m_gravity = g;
+		m_damping = ms.m_params.damping;
+		m_numShapes = numShapes;
+	}
+}
+
+
+MassSpringSystem& SleepClusters::awakeSystem(const MassSpringSystem& ms)
+{
+	if (!m_awakeSystem)
+	{
+		m_awakeSystem.reset(new MassSpringSystem());
+	}
+	MassSpringSystem& awake = *m_awakeSystem;
+
+	if (!m_awakeSystemValid)
+	{
+		for (size_t l = 0; l < m_localPoints.size(); l++)
+		{
+			m_localIndex[m_localPoints[l]] = kNone;
+		}
+		m_localPoints.clear();
+		awake.clear();
+
+		// the points of the awake clusters
+		for (size_t c = 0; c + 1 < m_clusterOffsets.size(); c++)
+		{
+			if (m_asleep[c])
+			{
+				continue;
+			}
+			for (uint32_t k = m_clusterOffsets[c]; k < m_clusterOffsets[c + 1]; k++)
+			{
+				const uint32_t p = m_clusterPoints[k];
+				m_localIndex[p] = (uint32_t)m_localPoints.size();
+				m_localPoints.push_back(p);
+				awake.addPoint(0.f, 0.f, 0.f, false);
+				awake.m_invMasses.back() = ms.m_invMasses[p];
+			}
+		}
+		m_numLocalAwake = m_localPoints.size();
+
+		// their springs, once each: from point1 if both ends are awake. The
+		// points at the other ends that sleep or are fixed are fixed here.
+		for (size_t l = 0; l < m_numLocalAwake; l++)
+		{
+			const uint32_t p = m_localPoints[l];
+			for (uint32_t e = m_adjacencyOffsets[p]; e < m_adjacencyOffsets[p + 1]; e++)
+			{
+				const Spring& spring = ms.m_springs[m_adjacency[e] >> 1];
+				const bool isPoint2 = (m_adjacency[e] & 1) != 0;
+				const uint32_t other = isPoint2 ? spring.point1 : spring.point2;
+				if (isPoint2 && m_localIndex[other] < m_numLocalAwake)
+				{
+					continue;
+				}
+				if (m_localIndex[other] == kNone)
+				{
+					m_localIndex[other] = (uint32_t)m_localPoints.size();
+					m_localPoints.push_back(other);
+					awake.addPoint(0.f, 0.f, 0.f, true);
+				}
+				awake.addSpring(m_localIndex[spring.point1], m_localIndex[spring.point2], spring.org_length, spring.stiffness);
+			}
+		}
+		m_awakeSystemValid = true;
+	}
+
+	for (size_t l = 0; l < m_localPoints.size(); l++)
+	{
+		awake.m_positions[l] = ms.m_positions[m_localPoints[l]];
+		awake.m_velocities[l] = ms.m_velocities[m_localPoints[l]];
+	}
+	awake.m_params = ms.m_params;
+	awake.m_params.sleeping = false;
+	awake.m_colliderPlanes = ms.m_colliderPlanes;
+	awake.m_colliderBoxes = ms.m_colliderBoxes;
+	return awake;
+}
+
+
+void SleepClusters::copyBack(MassSpringSystem& ms) const
+{
+	const MassSpringSystem& awake = *m_awakeSystem;
+	for (size_t l = 0; l < m_numLocalAwake; l++)
+	{
+		ms.m_positions[m_localPoints[l]] = awake.m_positions[l];
+		ms.m_velocities[m_localPoints[l]] = awake.m_velocities[l];
+	}
+}
+
+
+void SleepClusters::update(MassSpringSystem& ms, float timeStep)
+{
+	PROFILE_ZONE("Sleep update");
+	const size_t numClusters = m_clusterOffsets.size() - 1;
+	const float sleepVelocitySq = ms.m_params.sleepVelocity * ms.m_params.sleepVelocity;
+	const bool proximity = ms.m_params.selfCollision && m_numSleeping > 0;
+	m_stats.numFellAsleep = 0;
+	m_stats.numWoken = 0;
+
+	// kinetic energy and rest time of the awake clusters
+	float maxSpeedSq = 0.f;
+	for (size_t c = 0; c < numClusters; c++)
+	{
+		if (m_asleep[c])
+		{
+			m_moving[c] = 0;
+			continue;
+		}
+		double energy = 0.0, mass = 0.0;
+		for (uint32_t k = m_clusterOffsets[c]; k < m_clusterOffsets[c + 1]; k++)
+		{
+			const uint32_t p = m_clusterPoints[k];
+			const float speedSq = lengthSq(ms.m_velocities[p]);
+			energy += 0.5 * speedSq / ms.m_invMasses[p];
+			mass += 1.0 / ms.m_invMasses[p];
+			maxSpeedSq = std::max(maxSpeedSq, speedSq);
+		}
+		m_energies[c] = (float)energy;
+		m_quiet[c] = energy <= 0.5 * mass * sleepVelocitySq;
+		m_restTimes[c] = m_quiet[c] ? m_restTimes[c] + timeStep : 0.f;
+		m_moving[c] = !m_quiet[c];
+	}
+
+	// moving clusters wake their sleeping neighbours and, with self
+	// collision, the sleeping clusters their box (grown by how far they get
+	// in the next step) touches. Only the clusters that moved in this step
+	// wake others: a cluster woken here does not pass it on before it moved
+	// itself, otherwise one poke would wake all of a connected cloth at once.
+	const float margin = 2.f * ms.m_params.collisionRadius + std::sqrt(maxSpeedSq) * timeStep;
+	for (uint32_t c = 0; c < numClusters; c++)
+	{
+		if (!m_moving[c])
+		{
+			continue;
+		}
+		for (uint32_t k = m_neighbourOffsets[c]; k < m_neighbourOffsets[c + 1]; k++)
+		{
+			if (m_asleep[m_neighbours[k]])
+			{
+				wakeCluster(m_neighbours[k]);
+			}
+		}
+		if (proximity)
+		{
+			updateBox(ms, c, margin);
+			for (uint32_t s = 0; s < numClusters; s++)
+			{
+				if (m_asleep[s] && boxesOverlap(m_boxMin[c], m_boxMax[c], m_boxMin[s], m_boxMax[s]))
+				{
+					wakeCluster(s);
+				}
+			}
+		}
+	}
+
+	// quiet clusters fall asleep once they were quiet long enough and none
+	// of their neighbours moves
+	for (uint32_t c = 0; c < numClusters; c++)
+	{
+		if (m_asleep[c] || m_restTimes[c] < ms.m_params.timeToSleep)
+		{
+			continue;
+		}
+		bool neighboursQuiet = true;
+		for (uint32_t k = m_neighbourOffsets[c]; k < m_neighbourOffsets[c + 1] && neighboursQuiet; k++)
+		{
+			neighboursQuiet = m_asleep[m_neighbours[k]] || m_quiet[m_neighbours[k]];
+		}
+		if (neighboursQuiet)
+		{
+			sleepCluster(ms, c);
+		}
+	}
+
+	m_stats.numSleepingClusters = m_numSleeping;
+	PROFILE_COUNT("Awake points", m_stats.numAwakePoints);
+}
+
+
+void SleepClusters::wakeAll()
+{
+	if (m_numSleeping == 0)
+	{
+		return;
+	}
+	for (uint32_t c = 0; c + 1 < m_clusterOffsets.size(); c++)
+	{
+		if (m_asleep[c])
+		{
+			wakeCluster(c);
+		}
+	}
+	m_stats.numSleepingClusters = m_numSleeping;
+}
+
+
+void SleepClusters::wakePoint(uint32_t i)
+{
+	if (i < m_pointClusters.size() && m_pointClusters[i] != kNone && m_asleep[m_pointClusters[i]])
+	{
+		wakeCluster(m_pointClusters[i]);
+		m_stats.numSleepingClusters = m_numSleeping;
+	}
+}
+
+
+bool SleepClusters::isAsleep(uint32_t i) const
+{
+	return i < m_pointClusters.size() && m_pointClusters[i] != kNone && m_asleep[m_pointClusters[i]];
+}
+
+
+void SleepClusters::wakeCluster(uint32_t c)
+{
+	const size_t numPoints = m_clusterOffsets[c + 1] - m_clusterOffsets[c];
+	m_asleep[c] = 0;
+	m_quiet[c] = 0;
+	m_restTimes[c] = 0.f;
+	m_numSleeping--;
+	m_stats.numWoken++;
+	m_stats.numAwakePoints += numPoints;
+	m_stats.numSleepingPoints -= numPoints;
+	m_awakeSystemValid = false;
+}
+
+
+void SleepClusters::sleepCluster(MassSpringSystem& ms, uint32_t c)
+{
+	const size_t numPoints = m_clusterOffsets[c + 1] - m_clusterOffsets[c];
+	for (uint32_t k = m_clusterOffsets[c]; k < m_clusterOffsets[c + 1]; k++)
+	{
+		ms.m_velocities[m_clusterPoints[k]] = Vec3(0.f, 0.f, 0.f);
+	}
+	updateBox(ms, c, 0.f);
+	m_asleep[c] = 1;
+	m_numSleeping++;
+	m_stats.numFellAsleep++;
+	m_stats.numAwakePoints -= numPoints;
+	m_stats.numSleepingPoints += numPoints;
+	m_awakeSystemValid = false;
+}
+
+
+void SleepClusters::updateBox(const MassSpringSystem& ms, uint32_t c, float margin)
+{
+	Vec3 boxMin = ms.m_positions[m_clusterPoints[m_clusterOffsets[c]]];
+	Vec3 boxMax = boxMin;
+	for (uint32_t k = m_clusterOffsets[c] + 1; k < m_clusterOffsets[c + 1]; k++)
+	{
+		const Vec3& x = ms.m_positions[m_clusterPoints[k]];
+		boxMin = Vec3(std::min(boxMin.x, x.x), std::min(boxMin.y, x.y), std::min(boxMin.z, x.z));
+		boxMax = Vec3(std::max(boxMax.x, x.x), std::max(boxMax.y, x.y), std::max(boxMax.z, x.z));
+	}
+	const Vec3 grow(margin, margin, margin);
+	m_boxMin[c] = boxMin - grow;
+	m_boxMax[c] = boxMax + grow;
+}
@@ -0,0 +1,140 @@
+#ifndef __SleepClusters_h__
+#define __SleepClusters_h__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Vec3.h"
+
+class MassSpringSystem;
+
+
+// Counters of the sleep state after the last step
+struct SleepStats
+{
+	size_t numClusters;
+	size_t numSleepingClusters;
+	size_t numAwakePoints;      // not counting fixed points
+	size_t numSleepingPoints;
+	size_t numFellAsleep;       // clusters put to sleep by the last step
+	size_t numWoken;            // clusters woken by the last step
+
+	SleepStats() : numClusters(0), numSleepingClusters(0), numAwakePoints(0), numSleepingPoints(0), numFellAsleep(0), numWoken(0) {}
+};
+
+
+// Sleeping of the quiet parts of a MassSpringSystem (ms.m_params.sleeping).
+//
+// The non-fixed points are split into clusters of up to
+// ms.m_params.sleepClusterSize points, grown breadth first along the springs.
+// After every step the kinetic energy of every awake cluster is summed; a
+// cluster is quiet while its mass weighted RMS speed is below
+// ms.m_params.sleepVelocity. A cluster that was quiet for
+// ms.m_params.timeToSleep and whose neighbours (clusters it shares springs
+// with) are quiet or asleep falls asleep: its velocities are set to 0 and its
+// points stop moving. It wakes when a neighbour moves (is not quiet), when an
+// awake cluster comes near it with self collision on, when gravity, damping
+// or the collision shapes change, or through MassSpringSystem::wakeAll() / wakePoint().
+//
+// While some clusters sleep, the awake clusters are copied into a system of
+// their own together with the sleeping and fixed points their springs lead
+// to, which are fixed points there. That system is stepped in place of the
+// whole one, with the same integrator, solvers and collision, so a step costs
+// in proportion to the awake part and nothing for the sleeping one. Its
+// springs are copied when the set of awake clusters changes: changes to
+// m_springs need a wakeAll().
+class SleepClusters
+{
+public:
+	SleepClusters();
+	~SleepClusters();
+
+	// Build the clusters of ms, all awake
+	void setTopology(const MassSpringSystem& ms);
+
+	// ms.m_params.sleepClusterSize of the last setTopology()
+	uint32_t clusterSize() const { return m_clusterSize; }
+
+	// Wake everything if gravity, damping or the number of collision shapes
+	// differ from the last step
+	void checkChanges(const MassSpringSystem& ms);
+
+	bool allAwake() const  { return m_numSleeping == 0; }
+	bool allAsleep() const { return m_numSleeping == m_clusterOffsets.size() - 1; }
+
+	// The awake part of ms as a system of its own (see above) with the
+	// positions, velocities, parameters and shapes of ms copied in
+	MassSpringSystem& awakeSystem(const MassSpringSystem& ms);
+
+	// The system returned by the last awakeSystem() (not valid before)
+	const MassSpringSystem& awakeSystem() const { return *m_awakeSystem; }
+
+	// Copy the state of the awake points back into ms
+	void copyBack(MassSpringSystem& ms) const;
+
+	// Energies, rest times, falling asleep and waking after a step of ms
+	void update(MassSpringSystem& ms, float timeStep);
+
+	void wakeAll();
+
+	// Wake the cluster of point i (nothing for fixed points)
+	void wakePoint(uint32_t i);
+
+	bool isAsleep(uint32_t i) const;
+
+	// Kinetic energy of cluster c after the last step it was awake for
+	float clusterEnergy(size_t c) const { return m_energies[c]; }
+
+	const SleepStats& stats() const { return m_stats; }
+
+private:
+	void wakeCluster(uint32_t c);
+	void sleepCluster(MassSpringSystem& ms, uint32_t c);
+
+	// Box of the points of cluster c, grown by margin
+	void updateBox(const MassSpringSystem& ms, uint32_t c, float margin);
+
+	// point -> spring lists of the system, see buildPointSpringAdjacency()
+	std::vector<uint32_t> m_adjacencyOffsets;
+	std::vector<uint32_t> m_adjacency;
+
+	// points of cluster c: m_clusterPoints[m_clusterOffsets[c] .. m_clusterOffsets[c + 1])
+	std::vector<uint32_t> m_clusterOffsets;
+	std::vector<uint32_t> m_clusterPoints;
+	std::vector<uint32_t> m_pointClusters;  // cluster of every point (none for fixed points)
+	uint32_t              m_clusterSize;
+
+	// clusters sharing springs with cluster c, same layout
+	std::vector<uint32_t> m_neighbourOffsets;
+	std::vector<uint32_t> m_neighbours;
+
+	// per cluster state
+	std::vector<uint8_t>  m_asleep;
+	std::vector<uint8_t>  m_quiet;   // after the last step
+	std::vector<uint8_t>  m_moving;  // awake and not quiet after the last step, before any waking
+	std::vector<float>    m_restTimes;
+	std::vector<float>    m_energies;
+	std::vector<Vec3>     m_boxMin;  // for waking by proximity (self collision)
+	std::vector<Vec3>     m_boxMax;
+	size_t                m_numSleeping;
+
+	Vec3   m_gravity;  // of the last step
+	float  m_damping;
+	size_t m_numShapes;
+
+	// the awake system, its points in the order awake points, then the
+	// points they are connected to; m_localIndex maps back
+	std::unique_ptr<MassSpringSystem> m_awakeSystem;
+	bool                  m_awakeSystemValid;  // matches the awake clusters
+	std::vector<uint32_t> m_localPoints;
+	size_t                m_numLocalAwake;
+	std::vector<uint32_t> m_localIndex;
+
+	std::vector<uint32_t> m_scratch;
+	SleepStats            m_stats;
+};
+
+
+#endif
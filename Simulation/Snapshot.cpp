@@ -0,0 +1,611 @@
+#include "Snapshot.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+#include "MassSpringSystem.h"
+#include "RigidBodyWorld.h"
+
+
+namespace
+{
+	const char kMagic[8] = { 'S', 'I', 'M', 'S', 'N', 'A', 'P', 0 };
+	const uint64_t kAlignment = 64;
+
+	// One array of a snapshot to be written
+	struct SectionSource
+	{
+		SnapshotSection section;
+		uint32_t        elementSize;
+		uint64_t        count;
+		const void*     data;
+	};
+
+	template <typename T>
+	void addSource(std::vector<SectionSource>& sources, SnapshotSection section, const std::vector<T>& v)
+	{
+		SectionSource source = { section, (uint32_t)sizeof(T), v.size(), v.data() };
+		sources.push_back(source);
+	}
+
+	void collectSources(const MassSpringSystem* ms, const RigidBodyWorld* world, std::vector<SectionSource>& sources)
+	{
+		if (ms)
+		{
+			addSource(sources, SNAPSHOT_POINT_POSITIONS, ms->m_positions);
+			addSource(sources, SNAPSHOT_POINT_VELOCITIES, ms->m_velocities);
+			addSource(sources, SNAPSHOT_POINT_INV_MASSES, ms->m_invMasses);
+			addSource(sources, SNAPSHOT_POINT_FIXED, ms->m_fixed);
+			addSource(sources, SNAPSHOT_SPRINGS, ms->m_springs);
+		}
+		if (world)
+		{
+			addSource(sources, SNAPSHOT_BODY_POSITIONS, world->m_positions);
+			addSource(sources, SNAPSHOT_BODY_ORIENTATIONS, world->m_orientations);
+			addSource(sources, SNAPSHOT_BODY_LINEAR_MOMENTA, world->m_linearMomenta);
+			addSource(sources, SNAPSHOT_BODY_ANGULAR_MOMENTA, world->m_angularMomenta);
+			addSource(sources, SNAPSHOT_BODY_INV_MASSES, world->m_invMasses);
+			addSource(sources, SNAPSHOT_BODY_INV_INERTIA, world->m_invInertiaBody);
+			addSource(sources, SNAPSHOT_BODY_HALF_EXTENTS, world->m_halfExtents);
+			addSource(sources, SNAPSHOT_BODY_ASLEEP, world->sleepFlags());
+		}
+	}
+
+	uint64_t alignUp(uint64_t offset)
+	{
+		return (offset + kAlignment - 1) / kAlignment * kAlignment;
+	}
+
+	// Section table for the sources; returns the file size
+	uint64_t layoutSections(const std::vector<SectionSource>& sources, std::vector<SnapshotSectionEntry>& entries)
+	{
+		entries.resize(sources.size());
+		uint64_t offset = alignUp(sizeof(SnapshotHeader) + sources.size() * sizeof(SnapshotSectionEntry));
+		for (size_t s = 0; s < sources.size(); s++)
+		{
+			entries[s].id = sources[s].section;
+			entries[s].elementSize = sources[s].elementSize;
+			entries[s].count = sources[s].count;
+			entries[s].offset = offset;
+			offset = alignUp(offset + sources[s].count * sources[s].elementSize);
+		}
+		return offset;
+	}
+
+	bool seekTo(FILE* f, uint64_t offset)
+	{
+#ifdef _WIN32
+		return _fseeki64(f, (long long)offset, SEEK_SET) == 0;
+#else
+		return fseeko(f, (off_t)offset, SEEK_SET) == 0;
+#endif
+	}
+
+	bool writeAt(FILE* f, uint64_t offset, const void* data, size_t bytes)
+	{
+		return seekTo(f, offset) && (bytes == 0 || fwrite(data, 1, bytes, f) == bytes);
+	}
+
+	bool replaceFile(const std::string& from, const std::string& to)
+	{
+#ifdef _WIN32
+		return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+	}
+
+	// Write header, table and sections to a temporary file next to path and
+	// rename it over path
+	bool writeWholeFile(const std::string& path, SnapshotHeader& header, const std::vector<SectionSource>& sources,
+		std::vector<SnapshotSectionEntry>& entries)
+	{
+		header.fileSize = layoutSections(sources, entries);
+		header.numSections = (uint32_t)entries.size();
+
+		const std::string temporary = path + ".tmp";
+		FILE* f = fopen(temporary.c_str(), "wb");
+		if (!f)
+		{
+			return false;
+		}
+		static const uint8_t zeros[kAlignment] = {};
+		bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+		ok = ok && (entries.empty() || fwrite(entries.data(), sizeof(SnapshotSectionEntry), entries.size(), f) == entries.size());
+		uint64_t position = sizeof(header) + entries.size() * sizeof(SnapshotSectionEntry);
+		for (size_t s = 0; s < sources.size() && ok; s++)
+		{
+			// sequential, padding written out instead of seeking over it
+			ok = fwrite(zeros, 1, (size_t)(entries[s].offset - position), f) == entries[s].offset - position;
+			const size_t bytes = (size_t)(sources[s].count * sources[s].elementSize);
+			ok = ok && (bytes == 0 || fwrite(sources[s].data, 1, bytes, f) == bytes);
+			position = entries[s].offset + bytes;
+		}
+		ok = ok && fwrite(zeros, 1, (size_t)(header.fileSize - position), f) == header.fileSize - position;
+		ok = (fclose(f) == 0) && ok;
+		if (!ok || !replaceFile(temporary, path))
+		{
+			std::remove(temporary.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	void initHeader(SnapshotHeader& header)
+	{
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.magic, kMagic, sizeof(kMagic));
+		header.version = kSnapshotVersion;
+	}
+}
+
+
+bool writeSnapshot(const std::string& path, const MassSpringSystem* ms, const RigidBodyWorld* world, uint64_t step, double time)
+{
+	std::vector<SectionSource> sources;
+	collectSources(ms, world, sources);
+	SnapshotHeader header;
+	initHeader(header);
+	header.step = step;
+	header.time = time;
+	std::vector<SnapshotSectionEntry> entries;
+	return writeWholeFile(path, header, sources, entries);
+}
+
+
+SnapshotFile::SnapshotFile()
+	: m_data(nullptr), m_size(0), m_sequence(0)
+#ifdef _WIN32
+	, m_file(nullptr), m_mapping(nullptr)
+#endif
+{
+	for (int s = 0; s < SNAPSHOT_SECTION_COUNT; s++)
+	{
+		m_sections[s] = nullptr;
+	}
+}
+
+
+SnapshotFile::~SnapshotFile()
+{
+	close();
+}
+
+
+bool SnapshotFile::open(const std::string& path)
+{
+	close();
+	m_error.clear();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		m_error = "cannot open " + path;
+		return false;
+	}
+	LARGE_INTEGER size;
+	HANDLE mapping = nullptr;
+	const void* data = nullptr;
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+	{
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	}
+	if (!data)
+	{
+		if (mapping) { CloseHandle(mapping); }
+		CloseHandle(file);
+		m_error = "cannot map " + path;
+		return false;
+	}
+	m_file = file;
+	m_mapping = mapping;
+	m_size = (uint64_t)size.QuadPart;
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		m_error = "cannot open " + path;
+		return false;
+	}
+	struct stat info;
+	void* data = MAP_FAILED;
+	if (fstat(fd, &info) == 0 && info.st_size > 0)
+	{
+		data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	::close(fd);  // the mapping keeps the file
+	if (data == MAP_FAILED)
+	{
+		m_error = "cannot map " + path;
+		return false;
+	}
+	m_size = (uint64_t)info.st_size;
+#endif
+	m_data = (const uint8_t*)data;
+
+	// header and section table
+	const SnapshotHeader& h = header();
+	if (m_size < sizeof(SnapshotHeader) || std::memcmp(h.magic, kMagic, sizeof(kMagic)) != 0)
+	{
+		m_error = path + " is not a snapshot";
+	}
+	else if (h.version != kSnapshotVersion)
+	{
+		m_error = path + " has snapshot version " + std::to_string(h.version) + ", expected " + std::to_string(kSnapshotVersion);
+	}
+	else if (h.sequence & 1)
+	{
+		m_error = path + " is being written";
+	}
+	else if (h.fileSize > m_size || h.numSections > (m_size - sizeof(SnapshotHeader)) / sizeof(SnapshotSectionEntry))
+	{
+		m_error = path + " is truncated";
+	}
+	const SnapshotSectionEntry* entries = (const SnapshotSectionEntry*)(m_data + sizeof(SnapshotHeader));
+	for (uint32_t s = 0; m_error.empty() && s < h.numSections; s++)
+	{
+		const SnapshotSectionEntry& entry = entries[s];
+		if (entry.id >= SNAPSHOT_SECTION_COUNT)
+		{
+			continue;  // from a newer writer
+		}
+		const uint64_t maxCount = entry.elementSize > 0 ? (m_size - entry.offset) / entry.elementSize : 0;
+		if (entry.offset % kAlignment != 0 || entry.offset > m_size || entry.count > maxCount || m_sections[entry.id])
+		{
+			m_error = path + " has a broken section table";
+		}
+		m_sections[entry.id] = &entry;
+	}
+	if (!m_error.empty())
+	{
+		close();
+		return false;
+	}
+	m_sequence = h.sequence;
+	return true;
+}
+
+
+void SnapshotFile::close()
+{
+	if (m_data)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(m_data);
+		CloseHandle((HANDLE)m_mapping);
+		CloseHandle((HANDLE)m_file);
+		m_file = nullptr;
+		m_mapping = nullptr;
+#else
+		munmap((void*)m_data, (size_t)m_size);
+#endif
+	}
+	m_data = nullptr;
+	m_size = 0;
+	for (int s = 0; s < SNAPSHOT_SECTION_COUNT; s++)
+	{
+		m_sections[s] = nullptr;
+	}
+}
+
+
+uint64_t SnapshotFile::count(SnapshotSection section) const
+{
+	return m_sections[section] ? m_sections[section]->count : 0;
+}
+
+
+uint64_t SnapshotFile::currentSequence() const
+{
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return *(const volatile uint64_t*)&header().sequence;
+}
+
+
+bool SnapshotFile::restore(MassSpringSystem& ms)
+{
+	m_error.clear();
+	const Vec3* positions = array<Vec3>(SNAPSHOT_POINT_POSITIONS);
+	const Vec3* velocities = array<Vec3>(SNAPSHOT_POINT_VELOCITIES);
+	const float* invMasses = array<float>(SNAPSHOT_POINT_INV_MASSES);
+	const uint8_t* fixed = array<uint8_t>(SNAPSHOT_POINT_FIXED);
+	const Spring* springs = array<Spring>(SNAPSHOT_SPRINGS);
+	const size_t n = (size_t)count(SNAPSHOT_POINT_POSITIONS);
+	const size_t numSprings = (size_t)count(SNAPSHOT_SPRINGS);
+	if (!positions || !velocities || !invMasses || !fixed || !springs || count(SNAPSHOT_POINT_VELOCITIES) != n ||
+		count(SNAPSHOT_POINT_INV_MASSES) != n || count(SNAPSHOT_POINT_FIXED) != n)
+	{
+		m_error = "no mass-spring state in the snapshot";
+		return false;
+	}
+	for (size_t s = 0; s < numSprings; s++)
+	{
+		if (springs[s].point1 >= n || springs[s].point2 >= n)
+		{
+			m_error = "spring " + std::to_string(s) + " of the snapshot references a missing point";
+			return false;
+		}
+	}
+
+	// clear() marks the topology as changed, so the solvers rebuild their data
+	ms.clear();
+	ms.m_positions.assign(positions, positions + n);
+	ms.m_velocities.assign(velocities, velocities + n);
+	ms.m_forces.assign(n, Vec3(0.f, 0.f, 0.f));
+	ms.m_invMasses.assign(invMasses, invMasses + n);
+	ms.m_fixed.assign(fixed, fixed + n);
+	ms.m_springs.assign(springs, springs + numSprings);
+
+	if (currentSequence() != m_sequence)
+	{
+		m_error = "the snapshot was updated while it was restored";
+		return false;
+	}
+	return true;
+}
+
+
+bool SnapshotFile::restore(RigidBodyWorld& world)
+{
+	m_error.clear();
+	const Vec3* positions = array<Vec3>(SNAPSHOT_BODY_POSITIONS);
+	const Quat* orientations = array<Quat>(SNAPSHOT_BODY_ORIENTATIONS);
+	const Vec3* linearMomenta = array<Vec3>(SNAPSHOT_BODY_LINEAR_MOMENTA);
+	const Vec3* angularMomenta = array<Vec3>(SNAPSHOT_BODY_ANGULAR_MOMENTA);
+	const float* invMasses = array<float>(SNAPSHOT_BODY_INV_MASSES);
+	const Vec3* invInertia = array<Vec3>(SNAPSHOT_BODY_INV_INERTIA);
+	const Vec3* halfExtents = array<Vec3>(SNAPSHOT_BODY_HALF_EXTENTS);
+	const uint8_t* asleep = array<uint8_t>(SNAPSHOT_BODY_ASLEEP);
+	const size_t n = (size_t)count(SNAPSHOT_BODY_POSITIONS);
+	bool complete = positions && orientations && linearMomenta && angularMomenta && invMasses && invInertia && halfExtents && asleep;
+	for (int s = SNAPSHOT_BODY_POSITIONS; complete && s <= SNAPSHOT_BODY_ASLEEP; s++)
+	{
+		complete = count((SnapshotSection)s) == n;
+	}
+	if (!complete)
+	{
+		m_error = "no rigid body state in the snapshot";
+		return false;
+	}
+
+	world.clear();
+	world.m_positions.assign(positions, positions + n);
+	world.m_orientations.assign(orientations, orientations + n);
+	world.m_linearMomenta.assign(linearMomenta, linearMomenta + n);
+	world.m_angularMomenta.assign(angularMomenta, angularMomenta + n);
+	world.m_invMasses.assign(invMasses, invMasses + n);
+	world.m_invInertiaBody.assign(invInertia, invInertia + n);
+	world.m_halfExtents.assign(halfExtents, halfExtents + n);
+	world.bodiesReplaced(asleep);
+
+	if (currentSequence() != m_sequence)
+	{
+		m_error = "the snapshot was updated while it was restored";
+		return false;
+	}
+	return true;
+}
+
+
+SnapshotWriter::SnapshotWriter(const std::string& path)
+	: m_path(path), m_layoutChanged(true), m_pending(false), m_quit(false)
+{
+	initHeader(m_header);
+	for (int s = 0; s < SNAPSHOT_SECTION_COUNT; s++)
+	{
+		m_staged[s].elementSize = 0;
+		m_staged[s].count = 0;
+		m_staged[s].present = false;
+		m_staged[s].dirty = false;
+	}
+	m_thread = std::thread(&SnapshotWriter::writerLoop, this);
+}
+
+
+SnapshotWriter::~SnapshotWriter()
+{
+	wait();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_wakeWriter.notify_one();
+	m_thread.join();
+}
+
+
+bool SnapshotWriter::capture(const MassSpringSystem* ms, const RigidBodyWorld* world, uint64_t step, double time)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_pending)
+		{
+			m_stats.numSkipped++;
+			return false;
+		}
+	}
+
+	// the writer thread does not touch the staging buffers until m_pending is set
+	auto start = std::chrono::high_resolution_clock::now();
+	std::vector<SectionSource> sources;
+	collectSources(ms, world, sources);
+	bool present[SNAPSHOT_SECTION_COUNT] = {};
+	for (size_t s = 0; s < sources.size(); s++)
+	{
+		stage(sources[s].section, sources[s].data, sources[s].elementSize, (size_t)sources[s].count);
+		present[sources[s].section] = true;
+	}
+	for (int s = 0; s < SNAPSHOT_SECTION_COUNT; s++)
+	{
+		if (m_staged[s].present != present[s])
+		{
+			m_staged[s].present = present[s];
+			m_layoutChanged = true;
+		}
+	}
+	m_header.step = step;
+	m_header.time = time;
+	float seconds = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_pending = true;
+		m_stats.lastCaptureSeconds = seconds;
+	}
+	m_wakeWriter.notify_one();
+	return true;
+}
+
+
+void SnapshotWriter::stage(SnapshotSection section, const void* data, uint32_t elementSize, size_t count)
+{
+	Section& staged = m_staged[section];
+	const size_t bytes = count * elementSize;
+	if (staged.elementSize == elementSize && staged.count == count)
+	{
+		// equal arrays (springs, masses, extents) stay clean: compare, no copy
+		if (bytes > 0 && std::memcmp(staged.bytes.data(), data, bytes) != 0)
+		{
+			std::memcpy(staged.bytes.data(), data, bytes);
+			staged.dirty = true;
+		}
+		return;
+	}
+	staged.elementSize = elementSize;
+	staged.count = count;
+	staged.bytes.assign((const uint8_t*)data, (const uint8_t*)data + bytes);
+	staged.dirty = true;
+	m_layoutChanged = true;
+}
+
+
+void SnapshotWriter::wait()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_writeDone.wait(lock, [this]() { return !m_pending; });
+}
+
+
+SnapshotWriterStats SnapshotWriter::stats()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats;
+}
+
+
+void SnapshotWriter::writerLoop()
+{
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wakeWriter.wait(lock, [this]() { return m_quit || m_pending; });
+			if (!m_pending)
+			{
+				return;
+			}
+		}
+
+		auto start = std::chrono::high_resolution_clock::now();
+		uint64_t bytes = 0;
+		bool ok;
+		if (m_layoutChanged)
+		{
+			ok = writeAll(bytes);
+		}
+		else
+		{
+			ok = writeChanged(bytes);
+		}
+		// after a failure the file may be half written: next time write it all
+		m_layoutChanged = !ok;
+		for (int s = 0; s < SNAPSHOT_SECTION_COUNT; s++)
+		{
+			m_staged[s].dirty = false;
+		}
+		float seconds = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (ok)
+			{
+				m_stats.numWritten++;
+				m_stats.lastBytesWritten = bytes;
+				m_stats.lastWriteSeconds = seconds;
+			}
+			else
+			{
+				m_stats.numFailed++;
+			}
+			m_pending = false;
+		}
+		m_writeDone.notify_all();
+	}
+}
+
+
+bool SnapshotWriter::writeAll(uint64_t& bytes)
+{
+	std::vector<SectionSource> sources;
+	for (int s = 0; s < SNAPSHOT_SECTION_COUNT; s++)
+	{
+		const Section& staged = m_staged[s];
+		if (staged.present)
+		{
+			SectionSource source = { (SnapshotSection)s, staged.elementSize, staged.count, staged.bytes.data() };
+			sources.push_back(source);
+		}
+	}
+	m_header.sequence = (m_header.sequence + 2) & ~1ull;
+	if (!writeWholeFile(m_path, m_header, sources, m_entries))
+	{
+		return false;
+	}
+	bytes = m_header.fileSize;
+	return true;
+}
+
+
+bool SnapshotWriter::writeChanged(uint64_t& bytes)
+{
+	FILE* f = fopen(m_path.c_str(), "r+b");
+	if (!f)
+	{
+		return writeAll(bytes);  // removed from outside
+	}
+
+	// odd sequence while the sections are inconsistent
+	m_header.sequence++;
+	bool ok = writeAt(f, 0, &m_header, sizeof(m_header)) && fflush(f) == 0;
+	bytes = 2 * sizeof(m_header);
+	for (size_t e = 0; e < m_entries.size() && ok; e++)
+	{
+		const Section& staged = m_staged[m_entries[e].id];
+		if (staged.dirty)
+		{
+			ok = writeAt(f, m_entries[e].offset, staged.bytes.data(), staged.bytes.size());
+			bytes += staged.bytes.size();
+		}
+	}
+	ok = ok && fflush(f) == 0;
+	m_header.sequence++;
+	ok = ok && writeAt(f, 0, &m_header, sizeof(m_header));
+	ok = (fclose(f) == 0) && ok;
+	return ok;
+}
@@ -0,0 +1,216 @@
+#ifndef __Snapshot_h__
+#define __Snapshot_h__
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class MassSpringSystem;
+class RigidBodyWorld;
+
+
+// Binary snapshot of the state of a MassSpringSystem and/or a RigidBodyWorld.
+//
+// Layout (native byte order and float format, no padding inside arrays):
+//   SnapshotHeader
+//   SnapshotSectionEntry[header.numSections]
+//   the arrays of the sections, each starting at a multiple of 64 bytes
+// A section is one per point, per spring or per body array, stored exactly as
+// the std::vector of the simulation holds it, so a mapped file can be read in
+// place. Readers skip sections they do not know and reject sections whose
+// element size differs from their own type; kSnapshotVersion changes when the
+// meaning of an existing section changes.
+//
+// Derived data (forces, adjacency, solver matrices, cached contacts) is not
+// stored; it is rebuilt at the first step after a restore. Parameters
+// (m_params) are not part of the state either.
+
+const uint32_t kSnapshotVersion = 1;
+
+enum SnapshotSection
+{
+	SNAPSHOT_POINT_POSITIONS,       // Vec3
+	SNAPSHOT_POINT_VELOCITIES,      // Vec3
+	SNAPSHOT_POINT_INV_MASSES,      // float
+	SNAPSHOT_POINT_FIXED,           // uint8_t
+	SNAPSHOT_SPRINGS,               // Spring
+	SNAPSHOT_BODY_POSITIONS,        // Vec3
+	SNAPSHOT_BODY_ORIENTATIONS,     // Quat
+	SNAPSHOT_BODY_LINEAR_MOMENTA,   // Vec3
+	SNAPSHOT_BODY_ANGULAR_MOMENTA,  // Vec3
+	SNAPSHOT_BODY_INV_MASSES,       // float
+	SNAPSHOT_BODY_INV_INERTIA,      // Vec3
+	SNAPSHOT_BODY_HALF_EXTENTS,     // Vec3
+	SNAPSHOT_BODY_ASLEEP,           // uint8_t
+	SNAPSHOT_SECTION_COUNT
+};
+
+struct SnapshotHeader
+{
+	char     magic[8];     // "SIMSNAP" and a zero byte
+	uint32_t version;
+	uint32_t numSections;
+	uint64_t sequence;     // incremented before and after every update: odd while one is under way
+	uint64_t fileSize;
+	uint64_t step;         // step counter and simulated time given by the writer
+	double   time;
+};
+
+struct SnapshotSectionEntry
+{
+	uint32_t id;           // SnapshotSection
+	uint32_t elementSize;
+	uint64_t count;
+	uint64_t offset;       // from the start of the file
+};
+
+
+// Write a complete snapshot of ms and/or world (either may be null) to path,
+// replacing the file atomically. Returns false if it cannot be written.
+bool writeSnapshot(const std::string& path, const MassSpringSystem* ms, const RigidBodyWorld* world, uint64_t step = 0, double time = 0.0);
+
+
+// A snapshot file mapped into memory. The arrays are read in place: no
+// parsing and no copy until restore() puts them back into a simulation.
+class SnapshotFile
+{
+public:
+	SnapshotFile();
+	~SnapshotFile();
+
+	// Map path and check the header and the section table. Returns false,
+	// with a message in error(), if the file is not a valid snapshot of this
+	// version or is being updated right now.
+	bool open(const std::string& path);
+	void close();
+
+	bool isOpen() const { return m_data != nullptr; }
+	const std::string& error() const { return m_error; }
+
+	const SnapshotHeader& header() const { return *(const SnapshotHeader*)m_data; }
+	uint64_t step() const { return header().step; }
+	double time() const { return header().time; }
+
+	// Number of elements of a section (0 if the file does not have it)
+	uint64_t count(SnapshotSection section) const;
+
+	// The elements of a section in the mapped file, or null if the file does
+	// not have it or its elements are not of size sizeof(T)
+	template <typename T>
+	const T* array(SnapshotSection section) const
+	{
+		const SnapshotSectionEntry* entry = m_sections[section];
+		return entry && entry->elementSize == sizeof(T) ? (const T*)(m_data + entry->offset) : nullptr;
+	}
+
+	// Replace the points and springs of ms (or the bodies of world) by the
+	// snapshot. Fails if the file has no such state or was updated while it
+	// was copied.
+	bool restore(MassSpringSystem& ms);
+	bool restore(RigidBodyWorld& world);
+
+private:
+	SnapshotFile(const SnapshotFile&);
+	SnapshotFile& operator=(const SnapshotFile&);
+
+	// sequence of the header right now (the file may be updated in place)
+	uint64_t currentSequence() const;
+
+	const uint8_t* m_data;
+	uint64_t       m_size;
+	uint64_t       m_sequence;  // when opened
+	const SnapshotSectionEntry* m_sections[SNAPSHOT_SECTION_COUNT];
+	std::string    m_error;
+#ifdef _WIN32
+	void*          m_file;
+	void*          m_mapping;
+#endif
+};
+
+
+// Counters of a SnapshotWriter
+struct SnapshotWriterStats
+{
+	uint64_t numWritten;       // checkpoints written to the file
+	uint64_t numSkipped;       // captures dropped because the last write was still running
+	uint64_t numFailed;        // writes that failed
+	uint64_t lastBytesWritten; // of the last write (whole file or changed sections)
+	float    lastCaptureSeconds;  // time capture() took on the caller's thread
+	float    lastWriteSeconds;    // time of the last write on the writer thread
+
+	SnapshotWriterStats() : numWritten(0), numSkipped(0), numFailed(0), lastBytesWritten(0), lastCaptureSeconds(0.f), lastWriteSeconds(0.f) {}
+};
+
+
+// Periodic checkpoints of a running simulation without stalling its step
+// loop. capture() copies the state into a staging buffer and returns; a
+// background thread writes it to the file. If the previous checkpoint is
+// still being written, the capture is skipped instead of waiting.
+//
+// Writes are incremental: the first checkpoint (and any whose layout
+// changed, i.e. other point, spring or body counts) writes the whole file and
+// renames it into place. Later ones only rewrite the sections whose bytes
+// changed since the last checkpoint, in place: for a running simulation the
+// positions, velocities and momenta, while springs, masses and extents stay
+// as they are. The header's sequence is odd during such an update, so a
+// reader never takes a half written file for a valid one (see
+// SnapshotFile::open() and restore()).
+class SnapshotWriter
+{
+public:
+	explicit SnapshotWriter(const std::string& path);
+	~SnapshotWriter();  // finishes the pending write
+
+	// Stage the state of ms and/or world (either may be null) for writing.
+	// Returns false if the previous checkpoint is still being written.
+	bool capture(const MassSpringSystem* ms, const RigidBodyWorld* world, uint64_t step = 0, double time = 0.0);
+
+	// Block until the pending checkpoint (if any) is on disk
+	void wait();
+
+	const std::string& path() const { return m_path; }
+
+	// Counters; call wait() first for the ones of the last checkpoint
+	SnapshotWriterStats stats();
+
+private:
+	SnapshotWriter(const SnapshotWriter&);
+	SnapshotWriter& operator=(const SnapshotWriter&);
+
+	struct Section
+	{
+		uint32_t elementSize;
+		uint64_t count;
+		std::vector<uint8_t> bytes;
+		bool present;  // the system it belongs to was captured
+		bool dirty;    // changed since the last write
+	};
+
+	// Copy count elements at data into m_staged[section], marking it dirty if they differ
+	void stage(SnapshotSection section, const void* data, uint32_t elementSize, size_t count);
+
+	void writerLoop();
+
+	// Write the whole file, or only the dirty sections in place; bytes: amount written
+	bool writeAll(uint64_t& bytes);
+	bool writeChanged(uint64_t& bytes);
+
+	std::string m_path;
+	Section     m_staged[SNAPSHOT_SECTION_COUNT];
+	SnapshotHeader m_header;
+	std::vector<SnapshotSectionEntry> m_entries;  // of the file on disk
+	bool        m_layoutChanged;
+
+	std::thread             m_thread;
+	std::mutex              m_mutex;
+	std::condition_variable m_wakeWriter;
+	std::condition_variable m_writeDone;
+	bool                    m_pending;
+	bool                    m_quit;
+	SnapshotWriterStats     m_stats;
+};
+
+#endif
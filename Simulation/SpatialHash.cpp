@@ -0,0 +1,47 @@
+#include "SpatialHash.h"
+
+
+void SpatialHash::build(const std::vector<Vec3>& positions, float cellSize)
+{
+	const size_t n = positions.size();
+	m_cellSize = cellSize;
+	m_invCellSize = 1.f / cellSize;
+
+	// at least twice as many buckets as points keeps most buckets to one cell
+	uint32_t numBuckets = 1;
+	while (numBuckets < 2 * n) { numBuckets <<= 1; }
+	m_tableMask = numBuckets - 1;
+
+	m_pointBuckets.resize(n);
+	m_bucketStarts.assign(numBuckets + 1, 0);
+	for (size_t i = 0; i < n; i++)
+	{
+		const Vec3& p = positions[i];
+		uint32_t bucket = hashCell(cellCoord(p.x), cellCoord(p.y), cellCoord(p.z));
+		m_pointBuckets[i] = bucket;
+		m_bucketStarts[bucket + 1]++;
+	}
+	for (uint32_t b = 0; b < numBuckets; b++)
+	{
+		m_bucketStarts[b + 1] += m_bucketStarts[b];
+	}
+
+	// scatter in place: shifted by one, entry b + 1 holds the start of bucket
+	// b and is advanced past every point put into it, which leaves it at the
+	// end of bucket b, i.e. the start of b + 1, when done. Points are visited
+	// in ascending order and so stay sorted within each bucket.
+	m_sortedPoints.resize(n);
+	m_sortedPositions.resize(n);
+	std::vector<uint32_t>& fill = m_bucketStarts;
+	for (uint32_t b = numBuckets; b > 0; b--)
+	{
+		fill[b] = fill[b - 1];
+	}
+	fill[0] = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		uint32_t k = fill[m_pointBuckets[i] + 1]++;
+		m_sortedPoints[k] = (uint32_t)i;
+		m_sortedPositions[k] = positions[i];
+	}
+}
@@ -0,0 +1,98 @@
+#ifndef __SpatialHash_h__
+#define __SpatialHash_h__
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "Vec3.h"
+
+
+// Uniform grid over an unbounded space for neighbour queries among points
+// that move every step. Cell (ix, iy, iz) = floor(x / cellSize) is hashed into
+// a table of about twice as many buckets as there are points, so memory is
+// proportional to the number of points no matter how far they spread.
+//
+// build() counts the points per bucket, takes the prefix sum and scatters the
+// point indices (counting sort): O(n) without any allocation once the arrays
+// have grown, and points of a bucket are listed in ascending index order, so
+// queries visit neighbours in an order that depends only on the positions.
+// A query with radius <= cellSize touches at most 3 x 3 x 3 cells; with a
+// bounded number of points per cell it costs O(1) and all queries O(n).
+class SpatialHash
+{
+public:
+	SpatialHash() : m_cellSize(1.f), m_invCellSize(1.f), m_tableMask(0) {}
+
+	// Sort positions into cells of edge length cellSize
+	void build(const std::vector<Vec3>& positions, float cellSize);
+
+	// Call visit(j, d) for every point j whose distance to p is below radius,
+	// d = p - positions[j] (radius <= cellSize). Points of other cells that
+	// share a bucket are filtered by the distance test.
+	template <typename Visit>
+	void forEachNeighbour(const Vec3& p, float radius, Visit visit) const
+	{
+		const float radiusSq = radius * radius;
+		const int x0 = cellCoord(p.x - radius), x1 = cellCoord(p.x + radius);
+		const int y0 = cellCoord(p.y - radius), y1 = cellCoord(p.y + radius);
+		const int z0 = cellCoord(p.z - radius), z1 = cellCoord(p.z + radius);
+
+		// at most 27 cells; two of them may share a bucket, which must be
+		// visited once only (only non empty buckets need to be remembered)
+		uint32_t buckets[27];
+		int numBuckets = 0;
+		for (int z = z0; z <= z1 && z <= z0 + 2; z++)
+		for (int y = y0; y <= y1 && y <= y0 + 2; y++)
+		for (int x = x0; x <= x1 && x <= x0 + 2; x++)
+		{
+			const uint32_t bucket = hashCell(x, y, z);
+			const uint32_t begin = m_bucketStarts[bucket], end = m_bucketStarts[bucket + 1];
+			if (begin == end) { continue; }
+			bool seen = false;
+			for (int k = 0; k < numBuckets; k++) { seen |= buckets[k] == bucket; }
+			if (seen) { continue; }
+			buckets[numBuckets++] = bucket;
+
+			for (uint32_t k = begin; k < end; k++)
+			{
+				Vec3 d = p - m_sortedPositions[k];
+				if (lengthSq(d) < radiusSq)
+				{
+					visit(m_sortedPoints[k], d);
+				}
+			}
+		}
+	}
+
+	float cellSize() const { return m_cellSize; }
+	size_t numBuckets() const { return m_bucketStarts.empty() ? 0 : m_bucketStarts.size() - 1; }
+
+	// Point indices grouped by bucket, and their positions in the same order
+	const std::vector<uint32_t>& sortedPoints() const { return m_sortedPoints; }
+	const std::vector<Vec3>& sortedPositions() const { return m_sortedPositions; }
+
+private:
+	int cellCoord(float x) const { return (int)std::floor(x * m_invCellSize); }
+
+	uint32_t hashCell(int x, int y, int z) const
+	{
+		// the primes of Teschner et al., "Optimized Spatial Hashing for Collision
+		// Detection of Deformable Objects", but added, and x unscaled: cells
+		// next to each other along x land in consecutive buckets, so the 3 cells
+		// of a query row are mostly one contiguous run of sorted points
+		return ((uint32_t)x + (uint32_t)y * 19349663u + (uint32_t)z * 83492791u) & m_tableMask;
+	}
+
+	float    m_cellSize;
+	float    m_invCellSize;
+	uint32_t m_tableMask;   // number of buckets - 1 (a power of two)
+
+	std::vector<uint32_t> m_bucketStarts;   // points of bucket b: [m_bucketStarts[b], m_bucketStarts[b + 1])
+	std::vector<uint32_t> m_sortedPoints;
+	std::vector<Vec3>     m_sortedPositions;
+	std::vector<uint32_t> m_pointBuckets;   // bucket of every point (scratch of build())
+};
+
+
+#endif
@@ -0,0 +1,241 @@
+#include "SpringKernels.h"
+
+#include <algorithm>
+
+#if defined(__AVX2__)
+	#include <immintrin.h>
+	#define SPRING_KERNELS_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define SPRING_KERNELS_SSE2
+#endif
+
+
+void springForcesScalar(const Spring* springs, size_t begin, size_t end, const Vec3* x, Vec3* forces)
+{
+	for (size_t s = begin; s < end; s++)
+	{
+		const Spring& spring = springs[s];
+		Vec3 diff = x[spring.point1] - x[spring.point2];
+		float curr_length = length(diff);
+		float springForce = (-1 * spring.stiffness) * (curr_length - spring.org_length);
+		forces[s] = diff * (springForce / curr_length);
+	}
+}
+
+
+#if defined(SPRING_KERNELS_AVX2) || defined(SPRING_KERNELS_SSE2)
+
+namespace
+{
+	// Point p as (x, y, z, junk). The 16 byte load reads 4 bytes past the
+	// point, so the last point of the array takes the careful one.
+	template <bool careful>
+	inline __m128 loadPoint(const Vec3& p)
+	{
+		if (careful)
+		{
+			return _mm_movelh_ps(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)&p.x), _mm_load_ss(&p.z));
+		}
+		return _mm_loadu_ps(&p.x);
+	}
+
+	inline __m128 loadSpring(const Spring& s)
+	{
+		return _mm_loadu_ps((const float*)&s);
+	}
+}
+
+#endif
+
+
+#if defined(SPRING_KERNELS_AVX2)
+
+namespace
+{
+	const size_t kLanes = 8;
+
+	// -k * (|d| - org_length) / |d|, the operations of springForcesScalar()
+	// in the same order, so the results are bitwise equal
+	inline __m256 springScale(__m256 dx, __m256 dy, __m256 dz, __m256 rest, __m256 k)
+	{
+		__m256 lenSq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+		__m256 len = _mm256_sqrt_ps(lenSq);
+		__m256 minusK = _mm256_xor_ps(k, _mm256_set1_ps(-0.f));
+		return _mm256_div_ps(_mm256_mul_ps(minusK, _mm256_sub_ps(len, rest)), len);
+	}
+
+	inline __m256 pair(__m128 lo, __m128 hi)
+	{
+		return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+	}
+
+	// 4x4 transpose within each 128 bit half
+	inline void transpose(__m256& r0, __m256& r1, __m256& r2, __m256& r3)
+	{
+		__m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpacklo_ps(r2, r3);
+		__m256 t2 = _mm256_unpackhi_ps(r0, r1), t3 = _mm256_unpackhi_ps(r2, r3);
+		r0 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+		r1 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+		r2 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+		r3 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+	}
+
+	template <bool careful>
+	inline void loadDifferences(const Spring* s, const Vec3* x, __m256& d0, __m256& d1, __m256& d2, __m256& d3)
+	{
+		d0 = _mm256_sub_ps(pair(loadPoint<careful>(x[s[0].point1]), loadPoint<careful>(x[s[4].point1])), pair(loadPoint<careful>(x[s[0].point2]), loadPoint<careful>(x[s[4].point2])));
+		d1 = _mm256_sub_ps(pair(loadPoint<careful>(x[s[1].point1]), loadPoint<careful>(x[s[5].point1])), pair(loadPoint<careful>(x[s[1].point2]), loadPoint<careful>(x[s[5].point2])));
+		d2 = _mm256_sub_ps(pair(loadPoint<careful>(x[s[2].point1]), loadPoint<careful>(x[s[6].point1])), pair(loadPoint<careful>(x[s[2].point2]), loadPoint<careful>(x[s[6].point2])));
+		d3 = _mm256_sub_ps(pair(loadPoint<careful>(x[s[3].point1]), loadPoint<careful>(x[s[7].point1])), pair(loadPoint<careful>(x[s[3].point2]), loadPoint<careful>(x[s[7].point2])));
+	}
+
+	// Forces of the 8 springs s[0..7], the first 'count' of them are written to out
+	inline void springGroup(const Spring* s, const Vec3* x, uint32_t last, Vec3* out, size_t count)
+	{
+		// springs i and i + 4 share a register, one per 128 bit half: after
+		// the transposes s2, s3 hold org_length and stiffness and d0, d1, d2
+		// x, y, z of the differences of the springs 0..3 in the low and 4..7
+		// in the high half, in spring order
+		__m256 s0 = pair(loadSpring(s[0]), loadSpring(s[4]));
+		__m256 s1 = pair(loadSpring(s[1]), loadSpring(s[5]));
+		__m256 s2 = pair(loadSpring(s[2]), loadSpring(s[6]));
+		__m256 s3 = pair(loadSpring(s[3]), loadSpring(s[7]));
+		transpose(s0, s1, s2, s3);
+
+		const __m256i lastPoint = _mm256_set1_epi32((int)last);
+		const __m256i isLast = _mm256_or_si256(_mm256_cmpeq_epi32(_mm256_castps_si256(s0), lastPoint), _mm256_cmpeq_epi32(_mm256_castps_si256(s1), lastPoint));
+		__m256 d0, d1, d2, d3;
+		if (_mm256_movemask_epi8(isLast) == 0) { loadDifferences<false>(s, x, d0, d1, d2, d3); }
+		else                                   { loadDifferences<true>(s, x, d0, d1, d2, d3); }
+		transpose(d0, d1, d2, d3);
+
+		__m256 scale = springScale(d0, d1, d2, s2, s3);
+		__m256 fx = _mm256_mul_ps(d0, scale);
+		__m256 fy = _mm256_mul_ps(d1, scale);
+		__m256 fz = _mm256_mul_ps(d2, scale);
+
+		// back to x y z x | y z x y | z x y z per half, then the halves in order
+		__m256 xy01 = _mm256_unpacklo_ps(fx, fy), xy23 = _mm256_unpackhi_ps(fx, fy);
+		__m256 yz01 = _mm256_unpacklo_ps(fy, fz), yz23 = _mm256_unpackhi_ps(fy, fz);
+		__m256 zx01 = _mm256_unpacklo_ps(fz, fx), zx23 = _mm256_unpackhi_ps(fz, fx);
+		__m256 o0 = _mm256_shuffle_ps(xy01, zx01, _MM_SHUFFLE(3, 0, 1, 0));
+		__m256 o1 = _mm256_shuffle_ps(yz01, xy23, _MM_SHUFFLE(1, 0, 3, 2));
+		__m256 o2 = _mm256_shuffle_ps(zx23, yz23, _MM_SHUFFLE(3, 2, 3, 0));
+
+		alignas(32) Vec3 tail[kLanes];
+		float* f = count == kLanes ? &out[0].x : &tail[0].x;
+		_mm256_storeu_ps(f,      _mm256_permute2f128_ps(o0, o1, 0x20));
+		_mm256_storeu_ps(f + 8,  _mm256_permute2f128_ps(o2, o0, 0x30));
+		_mm256_storeu_ps(f + 16, _mm256_permute2f128_ps(o1, o2, 0x31));
+		if (count < kLanes)
+		{
+			std::copy(tail, tail + count, out);
+		}
+	}
+}
+
+#elif defined(SPRING_KERNELS_SSE2)
+
+namespace
+{
+	const size_t kLanes = 4;
+
+	// -k * (|d| - org_length) / |d|, the operations of springForcesScalar()
+	// in the same order, so the results are bitwise equal
+	inline __m128 springScale(__m128 dx, __m128 dy, __m128 dz, __m128 rest, __m128 k)
+	{
+		__m128 lenSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		__m128 len = _mm_sqrt_ps(lenSq);
+		__m128 minusK = _mm_xor_ps(k, _mm_set1_ps(-0.f));
+		return _mm_div_ps(_mm_mul_ps(minusK, _mm_sub_ps(len, rest)), len);
+	}
+
+	template <bool careful>
+	inline void loadDifferences(const Spring* s, const Vec3* x, __m128& d0, __m128& d1, __m128& d2, __m128& d3)
+	{
+		d0 = _mm_sub_ps(loadPoint<careful>(x[s[0].point1]), loadPoint<careful>(x[s[0].point2]));
+		d1 = _mm_sub_ps(loadPoint<careful>(x[s[1].point1]), loadPoint<careful>(x[s[1].point2]));
+		d2 = _mm_sub_ps(loadPoint<careful>(x[s[2].point1]), loadPoint<careful>(x[s[2].point2]));
+		d3 = _mm_sub_ps(loadPoint<careful>(x[s[3].point1]), loadPoint<careful>(x[s[3].point2]));
+	}
+
+	// Forces of the 4 springs s[0..3], the first 'count' of them are written to out
+	inline void springGroup(const Spring* s, const Vec3* x, uint32_t last, Vec3* out, size_t count)
+	{
+		// one spring per register, transposed to one register per attribute:
+		// s2, s3 hold org_length and stiffness, d0, d1, d2 x, y, z of the
+		// differences
+		__m128 s0 = loadSpring(s[0]), s1 = loadSpring(s[1]), s2 = loadSpring(s[2]), s3 = loadSpring(s[3]);
+		_MM_TRANSPOSE4_PS(s0, s1, s2, s3);
+
+		const __m128i lastPoint = _mm_set1_epi32((int)last);
+		const __m128i isLast = _mm_or_si128(_mm_cmpeq_epi32(_mm_castps_si128(s0), lastPoint), _mm_cmpeq_epi32(_mm_castps_si128(s1), lastPoint));
+		__m128 d0, d1, d2, d3;
+		if (_mm_movemask_epi8(isLast) == 0) { loadDifferences<false>(s, x, d0, d1, d2, d3); }
+		else                                { loadDifferences<true>(s, x, d0, d1, d2, d3); }
+		_MM_TRANSPOSE4_PS(d0, d1, d2, d3);
+
+		__m128 scale = springScale(d0, d1, d2, s2, s3);
+		__m128 fx = _mm_mul_ps(d0, scale);
+		__m128 fy = _mm_mul_ps(d1, scale);
+		__m128 fz = _mm_mul_ps(d2, scale);
+
+		// back to x y z x | y z x y | z x y z
+		__m128 xy01 = _mm_unpacklo_ps(fx, fy), xy23 = _mm_unpackhi_ps(fx, fy);
+		__m128 yz01 = _mm_unpacklo_ps(fy, fz), yz23 = _mm_unpackhi_ps(fy, fz);
+		__m128 zx01 = _mm_unpacklo_ps(fz, fx), zx23 = _mm_unpackhi_ps(fz, fx);
+
+		alignas(16) Vec3 tail[kLanes];
+		float* f = count == kLanes ? &out[0].x : &tail[0].x;
+		_mm_storeu_ps(f,     _mm_shuffle_ps(xy01, zx01, _MM_SHUFFLE(3, 0, 1, 0)));
+		_mm_storeu_ps(f + 4, _mm_shuffle_ps(yz01, xy23, _MM_SHUFFLE(1, 0, 3, 2)));
+		_mm_storeu_ps(f + 8, _mm_shuffle_ps(zx23, yz23, _MM_SHUFFLE(3, 2, 3, 0)));
+		if (count < kLanes)
+		{
+			std::copy(tail, tail + count, out);
+		}
+	}
+}
+
+#endif
+
+
+void springForcesSimd(const Spring* springs, size_t begin, size_t end, const Vec3* x, size_t numPoints, Vec3* forces)
+{
+#if defined(SPRING_KERNELS_AVX2) || defined(SPRING_KERNELS_SSE2)
+	static_assert(sizeof(Spring) == 16 && sizeof(Vec3) == 12, "springGroup() loads springs as 4 and points as 3 floats");
+	const uint32_t last = (uint32_t)numPoints - 1;
+	size_t s = begin;
+	for (; s + kLanes <= end; s += kLanes)
+	{
+		springGroup(springs + s, x, last, forces + s, kLanes);
+	}
+
+	// remaining springs: pad the group by repeating the last spring
+	if (s < end)
+	{
+		Spring tail[kLanes];
+		for (size_t i = 0; i < kLanes; i++)
+		{
+			tail[i] = springs[s + i < end ? s + i : end - 1];
+		}
+		springGroup(tail, x, last, forces + s, end - s);
+	}
+#else
+	(void)numPoints;
+	springForcesScalar(springs, begin, end, x, forces);
+#endif
+}
+
+
+const char* springForcesSimdName()
+{
+#if defined(SPRING_KERNELS_AVX2)
+	return "AVX2";
+#elif defined(SPRING_KERNELS_SSE2)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
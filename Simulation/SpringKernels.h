@@ -0,0 +1,29 @@
+#ifndef __SpringKernels_h__
+#define __SpringKernels_h__
+
+#include <cstddef>
+
+#include "MassSpringSystem.h"
+
+
+// Batch kernels computing, for springs [begin, end), the spring force acting
+// on point1 of each spring (point2 receives the negative):
+//   forces[s] = -stiffness * (|d| - org_length) * d / |d|,  d = x[point1] - x[point2]
+
+// Reference implementation, one spring at a time
+void springForcesScalar(const Spring* springs, size_t begin, size_t end, const Vec3* x, Vec3* forces);
+
+// Vectorised implementation processing 8 (AVX2) or 4 (SSE2) springs per
+// iteration. Every spring end is loaded as a whole point and the points are
+// transposed in registers to one register per coordinate (the springs
+// likewise), the forces are transposed back and stored as whole vectors.
+// Square root and division are the exact ones, in the order of
+// springForcesScalar(), so the results are bitwise equal to it on any CPU.
+// numPoints is the size of x: the last point is loaded without reading past it.
+// Falls back to springForcesScalar() if neither instruction set is available.
+void springForcesSimd(const Spring* springs, size_t begin, size_t end, const Vec3* x, size_t numPoints, Vec3* forces);
+
+// Instruction set used by springForcesSimd(): "AVX2", "SSE2" or "scalar"
+const char* springForcesSimdName();
+
+#endif
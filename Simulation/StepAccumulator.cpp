@@ -0,0 +1,45 @@
+#include "StepAccumulator.h"
+
+
+int StepAccumulator::advance(float frameTime)
+{
+	if (m_timeStep <= 0.f || frameTime <= 0.f)
+	{
+		return 0;
+	}
+
+	m_accumulator += frameTime;
+	int steps = (int)(m_accumulator / m_timeStep);
+	if (m_maxSubsteps > 0 && steps > m_maxSubsteps)
+	{
+		// can't keep up: run the cap and drop the rest, keeping the fraction
+		// of a step so that alpha() stays continuous
+		float excess = (steps - m_maxSubsteps) * m_timeStep;
+		m_droppedTime += excess;
+		m_accumulator -= excess;
+		steps = m_maxSubsteps;
+	}
+
+	m_accumulator -= steps * m_timeStep;
+	if (m_accumulator < 0.f)
+	{
+		m_accumulator = 0.f;
+	}
+	return steps;
+}
+
+
+void interpolatePositions(const std::vector<Vec3>& previous, const std::vector<Vec3>& current, float alpha, std::vector<Vec3>& out)
+{
+	if (previous.size() != current.size())
+	{
+		out = current;
+		return;
+	}
+
+	out.resize(current.size());
+	for (size_t i = 0; i < current.size(); i++)
+	{
+		out[i] = previous[i] + alpha * (current[i] - previous[i]);
+	}
+}
@@ -0,0 +1,41 @@
+#ifndef __StepAccumulator_h__
+#define __StepAccumulator_h__
+
+#include <vector>
+
+#include "Vec3.h"
+
+
+// Turns variable frame times into a number of fixed size simulation steps.
+// Elapsed time is accumulated and every full m_timeStep in the accumulator
+// becomes one step, so the simulation keeps up with real time even when a
+// frame takes longer than a step. At most m_maxSubsteps steps are run per
+// frame; time beyond that is dropped (and counted in m_droppedTime) instead
+// of piling up into ever longer frames.
+class StepAccumulator
+{
+public:
+	explicit StepAccumulator(float timeStep = 0.01f, int maxSubsteps = 8)
+		: m_timeStep(timeStep), m_maxSubsteps(maxSubsteps), m_accumulator(0.f), m_droppedTime(0.0) {}
+
+	// Forget the accumulated time (e.g. after a scene reset)
+	void reset() { m_accumulator = 0.f; }
+
+	// Add the elapsed frame time and return the number of steps to run now
+	int advance(float frameTime);
+
+	// Fraction [0, 1) of a step accumulated but not yet simulated. Render
+	// interpolation blends the last two states with it.
+	float alpha() const { return m_timeStep > 0.f ? m_accumulator / m_timeStep : 0.f; }
+
+	float  m_timeStep;
+	int    m_maxSubsteps;
+	float  m_accumulator;
+	double m_droppedTime;  // total time discarded because of m_maxSubsteps
+};
+
+// out[i] = lerp(previous[i], current[i], alpha). If the sizes differ (the
+// scene changed since previous was stored), out is a copy of current.
+void interpolatePositions(const std::vector<Vec3>& previous, const std::vector<Vec3>& current, float alpha, std::vector<Vec3>& out);
+
+#endif
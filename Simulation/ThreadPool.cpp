@@ -0,0 +1,261 @@
+#include "ThreadPool.h"
+
+#include "Profiler.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+	#include <xmmintrin.h>
+	#define THREAD_POOL_SSE_CONTROL
+#endif
+
+
+namespace
+{
+	// SSE rounding mode and flush-to-zero/denormals-are-zero bits of the
+	// calling thread, without the sticky exception flags
+	unsigned int floatControl()
+	{
+#if defined(THREAD_POOL_SSE_CONTROL)
+		return _mm_getcsr() & ~0x3fu;
+#else
+		return 0;
+#endif
+	}
+
+	void setFloatControl(unsigned int control)
+	{
+#if defined(THREAD_POOL_SSE_CONTROL)
+		if ((_mm_getcsr() & ~0x3fu) != control)
+		{
+			_mm_setcsr(control);
+		}
+#else
+		(void)control;
+#endif
+	}
+}
+
+
+ThreadPool::ThreadPool(unsigned int numThreads)
+	: m_quit(false), m_generation(0), m_busyWorkers(0), m_floatControl(0), m_body(nullptr), m_count(0), m_grainSize(1), m_nextChunk(0), m_taskBody(nullptr)
+{
+	if (numThreads == 0)
+	{
+		numThreads = std::thread::hardware_concurrency();
+	}
+	if (numThreads == 0)
+	{
+		numThreads = 1;
+	}
+	m_queues.reset(new TaskQueue[numThreads]);
+	for (unsigned int i = 1; i < numThreads; i++)
+	{
+		m_workers.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+	}
+}
+
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_wakeWorkers.notify_all();
+	for (size_t i = 0; i < m_workers.size(); i++)
+	{
+		m_workers[i].join();
+	}
+}
+
+
+void ThreadPool::parallelFor(size_t count, size_t grainSize, FunctionRef<void(size_t, size_t)> body)
+{
+	if (grainSize == 0) { grainSize = 1; }
+
+	// nothing to share: run inline without waking anyone
+	if (m_workers.empty() || count <= grainSize)
+	{
+		for (size_t begin = 0; begin < count; begin += grainSize)
+		{
+			body(begin, begin + grainSize < count ? begin + grainSize : count);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_body = &body;
+		m_count = count;
+		m_grainSize = grainSize;
+		m_nextChunk = 0;
+		m_busyWorkers = (unsigned int)m_workers.size();
+		m_floatControl = floatControl();
+		m_generation++;
+	}
+	m_wakeWorkers.notify_all();
+
+	runChunks();
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_jobDone.wait(lock, [this]() { return m_busyWorkers == 0; });
+	m_body = nullptr;
+}
+
+
+void ThreadPool::runChunks()
+{
+	PROFILE_ZONE("Parallel for");
+	const size_t numChunks = (m_count + m_grainSize - 1) / m_grainSize;
+	for (;;)
+	{
+		size_t chunk = m_nextChunk.fetch_add(1);
+		if (chunk >= numChunks) { break; }
+
+		size_t begin = chunk * m_grainSize;
+		size_t end = begin + m_grainSize < m_count ? begin + m_grainSize : m_count;
+		(*m_body)(begin, end);
+	}
+}
+
+
+void ThreadPool::runTasks(size_t count, FunctionRef<void(size_t, unsigned int)> body)
+{
+	const unsigned int threads = numThreads();
+	if (m_workers.empty() || count <= 1)
+	{
+		for (size_t task = 0; task < count; task++)
+		{
+			body(task, 0);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (unsigned int t = 0; t < threads; t++)
+		{
+			uint64_t numOwn = t < count ? (count - t + threads - 1) / threads : 0;
+			m_queues[t].range.store(numOwn << 32);
+		}
+		m_taskBody = &body;
+		m_busyWorkers = (unsigned int)m_workers.size();
+		m_floatControl = floatControl();
+		m_generation++;
+	}
+	m_wakeWorkers.notify_all();
+
+	runOwnAndStolenTasks(0);
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_jobDone.wait(lock, [this]() { return m_busyWorkers == 0; });
+	m_taskBody = nullptr;
+}
+
+
+bool ThreadPool::popFront(TaskQueue& q, uint32_t& position)
+{
+	uint64_t range = q.range.load();
+	for (;;)
+	{
+		uint32_t front = (uint32_t)range, back = (uint32_t)(range >> 32);
+		if (front >= back) { return false; }
+		if (q.range.compare_exchange_weak(range, range + 1))
+		{
+			position = front;
+			return true;
+		}
+	}
+}
+
+
+bool ThreadPool::popBack(TaskQueue& q, uint32_t& position)
+{
+	uint64_t range = q.range.load();
+	for (;;)
+	{
+		uint32_t front = (uint32_t)range, back = (uint32_t)(range >> 32);
+		if (front >= back) { return false; }
+		if (q.range.compare_exchange_weak(range, range - (1ull << 32)))
+		{
+			position = back - 1;
+			return true;
+		}
+	}
+}
+
+
+void ThreadPool::runOwnAndStolenTasks(unsigned int thread)
+{
+	PROFILE_ZONE("Parallel tasks");
+	const unsigned int threads = numThreads();
+	uint32_t position;
+	while (popFront(m_queues[thread], position))
+	{
+		(*m_taskBody)(thread + (size_t)position * threads, thread);
+	}
+
+	// queues only ever shrink, so once a full round finds nothing all tasks
+	// have been taken
+	bool stole = true;
+	while (stole)
+	{
+		stole = false;
+		for (unsigned int i = 1; i < threads; i++)
+		{
+			unsigned int victim = (thread + i) % threads;
+			while (popBack(m_queues[victim], position))
+			{
+				(*m_taskBody)(victim + (size_t)position * threads, thread);
+				stole = true;
+			}
+		}
+	}
+}
+
+
+void ThreadPool::workerLoop(unsigned int thread)
+{
+	PROFILE_THREAD_NAME("Worker");
+	unsigned long long seenGeneration = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wakeWorkers.wait(lock, [&]() { return m_quit || m_generation != seenGeneration; });
+			if (m_quit) { return; }
+			seenGeneration = m_generation;
+			setFloatControl(m_floatControl);
+		}
+
+		if (m_taskBody)
+		{
+			runOwnAndStolenTasks(thread);
+		}
+		else
+		{
+			runChunks();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_busyWorkers--;
+		}
+		m_jobDone.notify_one();
+	}
+}
+
+
+void parallelFor(ThreadPool* pool, size_t count, size_t grainSize, FunctionRef<void(size_t, size_t)> body)
+{
+	if (pool)
+	{
+		pool->parallelFor(count, grainSize, body);
+		return;
+	}
+
+	if (grainSize == 0) { grainSize = 1; }
+	for (size_t begin = 0; begin < count; begin += grainSize)
+	{
+		body(begin, begin + grainSize < count ? begin + grainSize : count);
+	}
+}
@@ -0,0 +1,95 @@
+#ifndef __ThreadPool_h__
+#define __ThreadPool_h__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "FunctionRef.h"
+
+
+// Fixed size pool of worker threads for data parallel loops.
+// parallelFor() splits [0, count) into chunks whose boundaries depend only on
+// count and grainSize (never on the number of threads), so loops that write
+// disjoint outputs per index give identical results for any thread count.
+// The workers take over the floating point control of the calling thread
+// (SSE rounding mode, flush-to-zero) for every loop, so a caller that
+// changed it gets the same bits from every thread.
+class ThreadPool
+{
+public:
+	// Create a pool running loops on numThreads threads (including the caller).
+	// numThreads = 0 uses std::thread::hardware_concurrency().
+	explicit ThreadPool(unsigned int numThreads = 0);
+	~ThreadPool();
+
+	// Number of threads working on a loop, including the calling thread
+	unsigned int numThreads() const { return (unsigned int)m_workers.size() + 1; }
+
+	// Call body(begin, end) for consecutive chunks of at most grainSize indices
+	// covering [0, count). Blocks until all chunks are done.
+	void parallelFor(size_t count, size_t grainSize, FunctionRef<void(size_t, size_t)> body);
+
+	// Call body(task, thread) once for every task in [0, count), for tasks of
+	// very different cost (islands). The tasks are dealt out round robin in
+	// index order, so put the expensive ones first; a thread that has run all
+	// of its own tasks steals from the back of the other threads' queues.
+	// thread is 0 for the calling thread and 1 .. numThreads() - 1 for the
+	// workers, for per thread scratch data. Blocks until all tasks are done.
+	void runTasks(size_t count, FunctionRef<void(size_t, unsigned int)> body);
+
+private:
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+
+	void workerLoop(unsigned int thread);
+	void runChunks();
+	void runOwnAndStolenTasks(unsigned int thread);
+
+	// Tasks dealt to one thread: its k-th task is thread + k * numThreads().
+	// The thread takes them from the front, thieves from the back; both ends
+	// sit in one word (front | back << 32) changed by compare and swap. They
+	// only move towards each other, so a stale value can never be mistaken
+	// for a current one. Padded to a cache line against false sharing.
+	struct TaskQueue
+	{
+		std::atomic<uint64_t> range;
+		char padding[64 - sizeof(std::atomic<uint64_t>)];
+	};
+
+	// Position of the task taken from the front (owner) or back (thief) of
+	// queue q, or false if it is empty
+	static bool popFront(TaskQueue& q, uint32_t& position);
+	static bool popBack(TaskQueue& q, uint32_t& position);
+
+	std::vector<std::thread> m_workers;
+
+	std::mutex              m_mutex;
+	std::condition_variable m_wakeWorkers;
+	std::condition_variable m_jobDone;
+	bool                    m_quit;
+	unsigned long long      m_generation;  // incremented for every new loop
+	unsigned int            m_busyWorkers;
+	unsigned int            m_floatControl;  // of the thread that started the current loop
+
+	// current loop
+	const FunctionRef<void(size_t, size_t)>* m_body;
+	size_t              m_count;
+	size_t              m_grainSize;
+	std::atomic<size_t> m_nextChunk;
+
+	// current task set, m_queues[t] belongs to thread t
+	const FunctionRef<void(size_t, unsigned int)>* m_taskBody;
+	std::unique_ptr<TaskQueue[]> m_queues;
+};
+
+// pool->parallelFor(), or the same chunks one after another on the calling
+// thread if pool is null. Chunk c covers [c * grainSize, (c + 1) * grainSize),
+// so per chunk partial results can be combined in a thread independent order.
+void parallelFor(ThreadPool* pool, size_t count, size_t grainSize, FunctionRef<void(size_t, size_t)> body);
+
+#endif
@@ -0,0 +1,588 @@
+#include "Trajectory.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+
+namespace
+{
+	const char kMagic[8] = { 'S', 'I', 'M', 'T', 'R', 'A', 'J', 0 };
+	const size_t kBlockSize = 64;
+	const float kLevels = 65535.f;
+	const uint32_t kMaxLevel = 65535;
+
+	bool seekTo(FILE* f, uint64_t offset)
+	{
+#ifdef _WIN32
+		return _fseeki64(f, (long long)offset, SEEK_SET) == 0;
+#else
+		return fseeko(f, (off_t)offset, SEEK_SET) == 0;
+#endif
+	}
+
+	uint64_t sizeOfFile(FILE* f)
+	{
+#ifdef _WIN32
+		return _fseeki64(f, 0, SEEK_END) == 0 ? (uint64_t)_ftelli64(f) : 0;
+#else
+		return fseeko(f, 0, SEEK_END) == 0 ? (uint64_t)ftello(f) : 0;
+#endif
+	}
+
+	size_t paddedSize(size_t n)
+	{
+		return (n + kBlockSize - 1) / kBlockSize * kBlockSize;
+	}
+
+	// Box of the finite coordinates (NaN or infinite ones are coded as the box minimum)
+	void boundingBox(const Vec3* p, size_t n, float boxMin[3], float boxMax[3])
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			boxMin[c] = INFINITY;
+			boxMax[c] = -INFINITY;
+		}
+		for (size_t i = 0; i < n; i++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				const float x = p[i][c];
+				if (std::isfinite(x))
+				{
+					boxMin[c] = std::min(boxMin[c], x);
+					boxMax[c] = std::max(boxMax[c], x);
+				}
+			}
+		}
+		for (int c = 0; c < 3; c++)
+		{
+			if (boxMin[c] > boxMax[c])
+			{
+				boxMin[c] = boxMax[c] = 0.f;
+			}
+		}
+	}
+
+	// Quantisation of one axis of a frame: level = (x - min) * scale, x = min + level * step
+	void axisScale(float boxMin, float boxMax, float& scale, float& step)
+	{
+		const float extent = boxMax - boxMin;
+		scale = extent > 0.f ? kLevels / extent : 0.f;
+		step = extent / kLevels;
+	}
+
+	// Branch free so that the loops over the points vectorise; NaN becomes 0
+	int32_t quantise(float x, float boxMin, float scale)
+	{
+		const float level = std::min(std::max(0.f, (x - boxMin) * scale), kLevels);
+		return (int32_t)(level + 0.5f);
+	}
+
+	// Writer and reader both predict and reconstruct with the two functions
+	// below, so that they agree to the bit on what the other one computed.
+
+	// Level of a coordinate extrapolated from the two frames before
+	int32_t predict(float prev, float prev2, float boxMin, float scale)
+	{
+		return quantise(prev + (prev - prev2), boxMin, scale);
+	}
+
+	float reconstruct(int32_t level, float boxMin, float step)
+	{
+		return boxMin + (float)level * step;
+	}
+
+	uint32_t zigzag(int32_t r)   { return ((uint32_t)r << 1) ^ (uint32_t)(r >> 31); }
+	int32_t  unzigzag(uint32_t z) { return (int32_t)(z >> 1) ^ -(int32_t)(z & 1); }
+
+	// Append the values (a multiple of kBlockSize) as blocks of a width byte
+	// and kBlockSize values of that many bits
+	void packBlocks(const uint32_t* values, size_t count, std::vector<uint8_t>& out)
+	{
+		for (size_t b = 0; b < count; b += kBlockSize)
+		{
+			uint32_t all = 0;
+			for (size_t i = 0; i < kBlockSize; i++)
+			{
+				all |= values[b + i];
+			}
+			int width = 0;
+			while (width < 32 && (all >> width) != 0)
+			{
+				width++;
+			}
+
+			const size_t start = out.size();
+			out.resize(start + 1 + kBlockSize / 8 * width);
+			uint8_t* o = &out[start];
+			*o++ = (uint8_t)width;
+			uint64_t bits = 0;
+			int numBits = 0;
+			for (size_t i = 0; i < kBlockSize && width > 0; i++)
+			{
+				bits |= (uint64_t)values[b + i] << numBits;
+				numBits += width;
+				while (numBits >= 8)
+				{
+					*o++ = (uint8_t)bits;
+					bits >>= 8;
+					numBits -= 8;
+				}
+			}
+		}
+	}
+
+	// Inverse of packBlocks(); returns the bytes read, 0 if the blocks run past end
+	size_t unpackBlocks(const uint8_t* in, const uint8_t* end, size_t count, uint32_t* values)
+	{
+		const uint8_t* start = in;
+		for (size_t b = 0; b < count; b += kBlockSize)
+		{
+			if (in >= end || *in > 32 || (size_t)(end - in) < 1 + kBlockSize / 8 * *in)
+			{
+				return 0;
+			}
+			const int width = *in++;
+			const uint32_t mask = width < 32 ? (1u << width) - 1 : 0xffffffffu;
+			uint64_t bits = 0;
+			int numBits = 0;
+			for (size_t i = 0; i < kBlockSize; i++)
+			{
+				while (numBits < width)
+				{
+					bits |= (uint64_t)*in++ << numBits;
+					numBits += 8;
+				}
+				values[b + i] = (uint32_t)bits & mask;
+				bits >>= width;
+				numBits -= width;
+			}
+		}
+		return (size_t)(in - start);
+	}
+}
+
+
+TrajectoryWriter::TrajectoryWriter()
+	: m_file(nullptr), m_fileSize(0), m_first(0), m_numQueued(0), m_failed(false), m_quit(false)
+{
+	memset(&m_header, 0, sizeof(m_header));
+}
+
+
+TrajectoryWriter::~TrajectoryWriter()
+{
+	close();
+}
+
+
+bool TrajectoryWriter::open(const std::string& path, uint32_t numPoints, uint32_t keyframeInterval, uint32_t queueLength)
+{
+	close();
+	m_file = fopen(path.c_str(), "wb");
+	if (!m_file)
+	{
+		return false;
+	}
+
+	memset(&m_header, 0, sizeof(m_header));
+	memcpy(m_header.magic, kMagic, sizeof(kMagic));
+	m_header.version = kTrajectoryVersion;
+	m_header.numPoints = numPoints;
+	m_header.keyframeInterval = std::max(keyframeInterval, 1u);
+	m_failed = fwrite(&m_header, sizeof(m_header), 1, m_file) != 1;
+	m_fileSize = sizeof(m_header);
+	m_offsets.clear();
+
+	for (int r = 0; r < 3; r++)
+	{
+		m_reconstructed[r].assign(numPoints, Vec3());
+	}
+	m_residuals.assign(3 * paddedSize(numPoints), 0);
+	m_frames.assign(std::max(queueLength, 1u), Frame());
+	m_first = 0;
+	m_numQueued = 0;
+	m_quit = false;
+	m_stats = TrajectoryWriterStats();
+	m_thread = std::thread(&TrajectoryWriter::writerLoop, this);
+	return !m_failed;
+}
+
+
+bool TrajectoryWriter::record(const std::vector<Vec3>& positions, uint64_t step, double time)
+{
+	if (!m_file || positions.size() != m_header.numPoints)
+	{
+		return false;
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	Frame* frame;
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (m_failed)
+		{
+			return false;
+		}
+		if (m_numQueued == m_frames.size())
+		{
+			m_stats.numStalls++;
+			m_frameDone.wait(lock, [this]() { return m_numQueued < m_frames.size(); });
+		}
+		frame = &m_frames[(m_first + m_numQueued) % m_frames.size()];
+	}
+
+	// the writer thread does not touch this buffer until it is queued
+	frame->positions.assign(positions.begin(), positions.end());
+	frame->step = step;
+	frame->time = time;
+	float seconds = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_numQueued++;
+		m_stats.maxRecordSeconds = std::max(m_stats.maxRecordSeconds, seconds);
+	}
+	m_wakeWriter.notify_one();
+	return true;
+}
+
+
+bool TrajectoryWriter::close()
+{
+	if (!m_file)
+	{
+		return true;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_wakeWriter.notify_one();
+	m_thread.join();
+
+	// index, then the header with the frame count and the index offset
+	m_header.numFrames = m_offsets.size();
+	m_header.indexOffset = m_fileSize;
+	bool ok = !m_failed && seekTo(m_file, m_fileSize);
+	ok = ok && (m_offsets.empty() || fwrite(m_offsets.data(), sizeof(uint64_t), m_offsets.size(), m_file) == m_offsets.size());
+	ok = ok && seekTo(m_file, 0) && fwrite(&m_header, sizeof(m_header), 1, m_file) == 1;
+	ok = (fclose(m_file) == 0) && ok;
+	m_file = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stats.bytesWritten = m_fileSize + m_offsets.size() * sizeof(uint64_t);
+	}
+	return ok;
+}
+
+
+TrajectoryWriterStats TrajectoryWriter::stats()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats;
+}
+
+
+void TrajectoryWriter::writerLoop()
+{
+	for (;;)
+	{
+		Frame* frame;
+		bool failed;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wakeWriter.wait(lock, [this]() { return m_quit || m_numQueued > 0; });
+			if (m_numQueued == 0)
+			{
+				return;
+			}
+			frame = &m_frames[m_first];
+			failed = m_failed;
+		}
+
+		// after a failure the frames are only taken off the queue
+		auto start = std::chrono::high_resolution_clock::now();
+		const bool ok = failed || writeFrame(*frame);
+		float seconds = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!failed && ok)
+			{
+				m_stats.numFrames = m_offsets.size();
+				m_stats.numKeyframes = (m_offsets.size() + m_header.keyframeInterval - 1) / m_header.keyframeInterval;
+				m_stats.bytesWritten = m_fileSize;
+				m_stats.rawBytes = m_offsets.size() * m_header.numPoints * 16ull;
+			}
+			m_failed = m_failed || !ok;
+			m_stats.encodeSeconds += seconds;
+			m_first = (m_first + 1) % m_frames.size();
+			m_numQueued--;
+		}
+		m_frameDone.notify_all();
+	}
+}
+
+
+bool TrajectoryWriter::writeFrame(const Frame& frame)
+{
+	const size_t n = m_header.numPoints;
+	const uint64_t indexInSegment = m_offsets.size() % m_header.keyframeInterval;
+	const Vec3* prev = indexInSegment >= 1 ? m_reconstructed[0].data() : nullptr;
+	const Vec3* prev2 = indexInSegment >= 2 ? m_reconstructed[1].data() : nullptr;
+	Vec3* current = m_reconstructed[2].data();
+
+	TrajectoryFrameHeader header;
+	memset(&header, 0, sizeof(header));
+	header.step = frame.step;
+	header.time = frame.time;
+	boundingBox(frame.positions.data(), n, header.boxMin, header.boxMax);
+
+	float scale[3], step[3];
+	for (int c = 0; c < 3; c++)
+	{
+		axisScale(header.boxMin[c], header.boxMax[c], scale[c], step[c]);
+	}
+
+	// one pass over the points, the residuals of x, y and z go to three planes
+	const size_t plane = m_residuals.size() / 3;
+	uint32_t* residuals = m_residuals.data();
+	if (prev)
+	{
+		for (size_t i = 0; i < n; i++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				// the frame right after a keyframe repeats it instead of extrapolating
+				const int32_t predicted = predict(prev[i][c], prev2 ? prev2[i][c] : prev[i][c], header.boxMin[c], scale[c]);
+				const int32_t level = quantise(frame.positions[i][c], header.boxMin[c], scale[c]);
+				residuals[c * plane + i] = zigzag(level - predicted);
+				current[i][c] = reconstruct(level, header.boxMin[c], step[c]);
+			}
+		}
+	}
+	else
+	{
+		// keyframe: predicted by the point before, which in the generated
+		// scenes is almost always a neighbour
+		int32_t last[3] = { 0, 0, 0 };
+		for (size_t i = 0; i < n; i++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				const int32_t level = quantise(frame.positions[i][c], header.boxMin[c], scale[c]);
+				residuals[c * plane + i] = zigzag(level - last[c]);
+				last[c] = level;
+				current[i][c] = reconstruct(level, header.boxMin[c], step[c]);
+			}
+		}
+	}
+	m_payload.clear();
+	packBlocks(residuals, m_residuals.size(), m_payload);
+	header.payloadBytes = (uint32_t)m_payload.size();
+
+	if (fwrite(&header, sizeof(header), 1, m_file) != 1 || fwrite(m_payload.data(), 1, m_payload.size(), m_file) != m_payload.size())
+	{
+		return false;
+	}
+	m_offsets.push_back(m_fileSize);
+	m_fileSize += sizeof(header) + m_payload.size();
+
+	// newest first
+	std::swap(m_reconstructed[0], m_reconstructed[2]);
+	std::swap(m_reconstructed[1], m_reconstructed[2]);
+	return true;
+}
+
+
+TrajectoryReader::TrajectoryReader()
+	: m_file(nullptr), m_fileSize(0), m_decoded(UINT64_MAX)
+{
+	memset(&m_header, 0, sizeof(m_header));
+	memset(&m_frameHeader, 0, sizeof(m_frameHeader));
+}
+
+
+TrajectoryReader::~TrajectoryReader()
+{
+	close();
+}
+
+
+bool TrajectoryReader::open(const std::string& path)
+{
+	close();
+	m_file = fopen(path.c_str(), "rb");
+	if (!m_file)
+	{
+		m_error = "cannot open " + path;
+		return false;
+	}
+	m_fileSize = sizeOfFile(m_file);
+	if (!seekTo(m_file, 0) || fread(&m_header, sizeof(m_header), 1, m_file) != 1 || memcmp(m_header.magic, kMagic, sizeof(kMagic)) != 0)
+	{
+		m_error = path + " is not a trajectory file";
+		close();
+		return false;
+	}
+	if (m_header.version != kTrajectoryVersion || m_header.keyframeInterval == 0)
+	{
+		m_error = path + " has version " + std::to_string(m_header.version) + ", expected " + std::to_string(kTrajectoryVersion);
+		close();
+		return false;
+	}
+
+	if (m_header.indexOffset != 0)
+	{
+		const bool fits = m_header.indexOffset <= m_fileSize && m_header.numFrames <= (m_fileSize - m_header.indexOffset) / sizeof(uint64_t);
+		m_offsets.resize(fits ? (size_t)m_header.numFrames : 0);
+		if (!fits || !seekTo(m_file, m_header.indexOffset) ||
+			(!m_offsets.empty() && fread(m_offsets.data(), sizeof(uint64_t), m_offsets.size(), m_file) != m_offsets.size()))
+		{
+			m_error = path + " has a broken frame index";
+			close();
+			return false;
+		}
+	}
+	else
+	{
+		// not closed: walk the frames up to the last complete one
+		uint64_t offset = sizeof(m_header);
+		TrajectoryFrameHeader header;
+		while (offset + sizeof(header) <= m_fileSize && seekTo(m_file, offset) && fread(&header, sizeof(header), 1, m_file) == 1 &&
+			header.payloadBytes <= m_fileSize - offset - sizeof(header))
+		{
+			m_offsets.push_back(offset);
+			offset += sizeof(header) + header.payloadBytes;
+		}
+	}
+
+	for (int r = 0; r < 3; r++)
+	{
+		m_reconstructed[r].assign(m_header.numPoints, Vec3());
+	}
+	m_residuals.assign(3 * paddedSize(m_header.numPoints), 0);
+	m_error.clear();
+	return true;
+}
+
+
+void TrajectoryReader::close()
+{
+	if (m_file)
+	{
+		fclose(m_file);
+		m_file = nullptr;
+	}
+	m_fileSize = 0;
+	m_offsets.clear();
+	m_decoded = UINT64_MAX;
+}
+
+
+bool TrajectoryReader::readFrame(uint64_t index, std::vector<Vec3>& positions, uint64_t* step, double* time)
+{
+	if (!m_file || index >= m_offsets.size())
+	{
+		m_error = "no frame " + std::to_string(index);
+		return false;
+	}
+
+	if (m_decoded != index)
+	{
+		uint64_t first = index - index % m_header.keyframeInterval;
+		if (m_decoded != UINT64_MAX && m_decoded >= first && m_decoded < index)
+		{
+			first = m_decoded + 1;
+		}
+		for (uint64_t f = first; f <= index; f++)
+		{
+			if (!decode(f))
+			{
+				m_decoded = UINT64_MAX;
+				return false;
+			}
+		}
+	}
+
+	positions = m_reconstructed[0];
+	if (step) { *step = m_frameHeader.step; }
+	if (time) { *time = m_frameHeader.time; }
+	return true;
+}
+
+
+bool TrajectoryReader::decode(uint64_t index)
+{
+	const size_t n = m_header.numPoints;
+	const uint64_t offset = m_offsets[(size_t)index];
+	TrajectoryFrameHeader header;
+	bool ok = offset + sizeof(header) <= m_fileSize && seekTo(m_file, offset) && fread(&header, sizeof(header), 1, m_file) == 1 &&
+		header.payloadBytes <= m_fileSize - offset - sizeof(header);
+	if (ok)
+	{
+		m_payload.resize(header.payloadBytes);
+		ok = m_payload.empty() || fread(m_payload.data(), 1, m_payload.size(), m_file) == m_payload.size();
+	}
+	if (!ok)
+	{
+		m_error = "cannot read frame " + std::to_string(index);
+		return false;
+	}
+
+	const uint64_t indexInSegment = index % m_header.keyframeInterval;
+	const Vec3* prev = indexInSegment >= 1 ? m_reconstructed[0].data() : nullptr;
+	const Vec3* prev2 = indexInSegment >= 2 ? m_reconstructed[1].data() : nullptr;
+	Vec3* current = m_reconstructed[2].data();
+	float scale[3], step[3];
+	for (int c = 0; c < 3; c++)
+	{
+		axisScale(header.boxMin[c], header.boxMax[c], scale[c], step[c]);
+	}
+	const size_t plane = m_residuals.size() / 3;
+	const uint32_t* residuals = m_residuals.data();
+	ok = unpackBlocks(m_payload.data(), m_payload.data() + m_payload.size(), m_residuals.size(), m_residuals.data()) == m_payload.size();
+
+	// levels outside [0, 65535] only come from a corrupt payload
+	if (prev)
+	{
+		for (size_t i = 0; i < n && ok; i++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				const int32_t predicted = predict(prev[i][c], prev2 ? prev2[i][c] : prev[i][c], header.boxMin[c], scale[c]);
+				const int64_t level = (int64_t)predicted + unzigzag(residuals[c * plane + i]);
+				ok = ok && level >= 0 && level <= kMaxLevel;
+				current[i][c] = reconstruct((int32_t)level, header.boxMin[c], step[c]);
+			}
+		}
+	}
+	else
+	{
+		int64_t last[3] = { 0, 0, 0 };
+		for (size_t i = 0; i < n && ok; i++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				last[c] += unzigzag(residuals[c * plane + i]);
+				ok = ok && last[c] >= 0 && last[c] <= kMaxLevel;
+				current[i][c] = reconstruct((int32_t)last[c], header.boxMin[c], step[c]);
+			}
+		}
+	}
+	if (!ok)
+	{
+		m_error = "frame " + std::to_string(index) + " is corrupt";
+		return false;
+	}
+
+	std::swap(m_reconstructed[0], m_reconstructed[2]);
+	std::swap(m_reconstructed[1], m_reconstructed[2]);
+	m_decoded = index;
+	m_frameHeader = header;
+	return true;
+}
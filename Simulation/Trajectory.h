@@ -0,0 +1,179 @@
+#ifndef __Trajectory_h__
+#define __Trajectory_h__
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Vec3.h"
+
+
+// Compressed recording of the point positions of every step.
+//
+// Layout (native byte order):
+//   TrajectoryHeader
+//   frames, each a TrajectoryFrameHeader and payloadBytes of coded positions
+//   uint64_t offset of every frame (written by close(), at header.indexOffset)
+//
+// Every frame is quantised to 16 bits per coordinate inside its own
+// bounding box, so the error of a coordinate is at most half a step of
+// 1/65535 of the box (plus its float rounding). Every keyframeInterval-th
+// frame is a keyframe, coding each point relative to the point before it;
+// the frames between code each point relative to its position extrapolated
+// from the two frames before (the reconstructed ones, so errors do not add
+// up). The residuals are zigzag coded and stored x, y, z one after the
+// other in blocks of 64 values of the smallest bit width that holds the
+// whole block: a resting or smoothly moving point costs a few bits instead
+// of 16 bytes.
+
+const uint32_t kTrajectoryVersion = 1;
+
+struct TrajectoryHeader
+{
+	char     magic[8];          // "SIMTRAJ" and a zero byte
+	uint32_t version;
+	uint32_t numPoints;
+	uint32_t keyframeInterval;
+	uint32_t reserved;
+	uint64_t numFrames;         // 0 until the writer is closed
+	uint64_t indexOffset;       // of the frame offsets, 0 until the writer is closed
+};
+
+struct TrajectoryFrameHeader
+{
+	uint64_t step;              // step counter and simulated time given to record()
+	double   time;
+	float    boxMin[3];         // quantisation box of the frame
+	float    boxMax[3];
+	uint32_t payloadBytes;
+	uint32_t reserved;
+};
+
+
+// Counters of a TrajectoryWriter
+struct TrajectoryWriterStats
+{
+	uint64_t numFrames;          // frames written to the file
+	uint64_t numKeyframes;
+	uint64_t numStalls;          // record() calls that waited for a free frame buffer
+	uint64_t bytesWritten;       // file size so far
+	uint64_t rawBytes;           // the same frames as XMVECTOR (16 bytes) per point
+	float    maxRecordSeconds;   // longest record() on the caller's thread
+	float    encodeSeconds;      // time spent coding and writing on the writer thread
+
+	TrajectoryWriterStats() : numFrames(0), numKeyframes(0), numStalls(0), bytesWritten(0), rawBytes(0), maxRecordSeconds(0.f), encodeSeconds(0.f) {}
+};
+
+
+// Writes a trajectory file on a background thread. record() only copies the
+// positions into one of queueLength frame buffers; it waits (and counts a
+// stall) only if all of them are still waiting to be written.
+class TrajectoryWriter
+{
+public:
+	TrajectoryWriter();
+	~TrajectoryWriter();  // close()
+
+	// Start a new file for numPoints points. Returns false if it cannot be created.
+	bool open(const std::string& path, uint32_t numPoints, uint32_t keyframeInterval = 100, uint32_t queueLength = 4);
+
+	// Append a frame. Returns false if no file is open, the number of points
+	// differs or an earlier write failed.
+	bool record(const std::vector<Vec3>& positions, uint64_t step, double time);
+
+	// Write the queued frames and the frame index. Returns false if any write failed.
+	bool close();
+
+	bool isOpen() const { return m_file != nullptr; }
+
+	TrajectoryWriterStats stats();
+
+private:
+	TrajectoryWriter(const TrajectoryWriter&);
+	TrajectoryWriter& operator=(const TrajectoryWriter&);
+
+	struct Frame
+	{
+		std::vector<Vec3> positions;
+		uint64_t step;
+		double   time;
+	};
+
+	void writerLoop();
+	bool writeFrame(const Frame& frame);
+
+	FILE*    m_file;
+	TrajectoryHeader m_header;
+	std::vector<uint64_t> m_offsets;
+	uint64_t m_fileSize;
+
+	// state of the writer thread: the last two frames as the reader will
+	// reconstruct them (newest first) and the one being coded
+	std::vector<Vec3>    m_reconstructed[3];
+	std::vector<uint32_t> m_residuals;  // x, y and z planes, each padded to whole blocks
+	std::vector<uint8_t> m_payload;
+
+	// ring of frame buffers, m_numQueued of them starting at m_first waiting to be written
+	std::vector<Frame>      m_frames;
+	size_t                  m_first;
+	size_t                  m_numQueued;
+	bool                    m_failed;
+	bool                    m_quit;
+	std::thread             m_thread;
+	std::mutex              m_mutex;
+	std::condition_variable m_wakeWriter;
+	std::condition_variable m_frameDone;
+	TrajectoryWriterStats   m_stats;
+};
+
+
+// Random access to the frames of a trajectory file. Reading frame i decodes
+// from the keyframe before it, or only from the frame read last if that one
+// lies between the keyframe and i: reading forwards decodes each frame once.
+// Files whose writer was not closed are read up to their last complete frame.
+class TrajectoryReader
+{
+public:
+	TrajectoryReader();
+	~TrajectoryReader();
+
+	// Open path and read its frame index. Returns false, with a message in
+	// error(), if it is not a trajectory file of this version.
+	bool open(const std::string& path);
+	void close();
+
+	const std::string& error() const { return m_error; }
+
+	uint32_t numPoints() const { return m_header.numPoints; }
+	uint64_t numFrames() const { return m_offsets.size(); }
+	uint32_t keyframeInterval() const { return m_header.keyframeInterval; }
+
+	// Positions of frame index (and its step and time). Returns false if
+	// there is no such frame or it cannot be read.
+	bool readFrame(uint64_t index, std::vector<Vec3>& positions, uint64_t* step = nullptr, double* time = nullptr);
+
+private:
+	TrajectoryReader(const TrajectoryReader&);
+	TrajectoryReader& operator=(const TrajectoryReader&);
+
+	// Decode frame index on top of the reconstruction of the frames before it
+	bool decode(uint64_t index);
+
+	FILE*    m_file;
+	uint64_t m_fileSize;
+	TrajectoryHeader m_header;
+	std::vector<uint64_t> m_offsets;
+	std::string m_error;
+
+	std::vector<Vec3>    m_reconstructed[3];  // last decoded frame, the one before and one being decoded
+	uint64_t             m_decoded;           // index of m_reconstructed[0], or UINT64_MAX if none
+	TrajectoryFrameHeader m_frameHeader;      // of m_reconstructed[0]
+	std::vector<uint32_t> m_residuals;  // x, y and z planes, each padded to whole blocks
+	std::vector<uint8_t> m_payload;
+};
+
+#endif
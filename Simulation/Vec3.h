@@ -0,0 +1,37 @@
+#ifndef __Vec3_h__
+#define __Vec3_h__
+
+#include <cmath>
+
+
+// Minimal 3 component float vector for the simulation library.
+// Layout compatible with DirectX::XMFLOAT3, but without any dependency
+// on DirectXMath so that the library also builds with GCC/Clang.
+struct Vec3
+{
+	float x, y, z;
+
+	Vec3() : x(0.f), y(0.f), z(0.f) {}
+	Vec3(float x, float y, float z) : x(x), y(y), z(z) {}
+
+	float& operator[](int i)       { return (&x)[i]; }
+	float  operator[](int i) const { return (&x)[i]; }
+
+	Vec3& operator+=(const Vec3& v) { x += v.x; y += v.y; z += v.z; return *this; }
+	Vec3& operator-=(const Vec3& v) { x -= v.x; y -= v.y; z -= v.z; return *this; }
+	Vec3& operator*=(float s)       { x *= s;   y *= s;   z *= s;   return *this; }
+};
+
+inline Vec3 operator+(const Vec3& a, const Vec3& b) { return Vec3(a.x + b.x, a.y + b.y, a.z + b.z); }
+inline Vec3 operator-(const Vec3& a, const Vec3& b) { return Vec3(a.x - b.x, a.y - b.y, a.z - b.z); }
+inline Vec3 operator-(const Vec3& a)                { return Vec3(-a.x, -a.y, -a.z); }
+inline Vec3 operator*(const Vec3& a, float s)       { return Vec3(a.x * s, a.y * s, a.z * s); }
+inline Vec3 operator*(float s, const Vec3& a)       { return Vec3(a.x * s, a.y * s, a.z * s); }
+
+inline float dot(const Vec3& a, const Vec3& b)   { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline Vec3  cross(const Vec3& a, const Vec3& b) { return Vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x); }
+inline float lengthSq(const Vec3& a)             { return dot(a, a); }
+inline float length(const Vec3& a)               { return std::sqrt(dot(a, a)); }
+
+
+#endif
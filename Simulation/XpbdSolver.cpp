@@ -0,0 +1,224 @@
+#include "XpbdSolver.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "MassSpringSystem.h"
+#include "Profiler.h"
+
+
+namespace
+{
+	// points/springs per parallel chunk; also the granularity of the partial residual sums
+	const size_t kGrain = 4096;
+}
+
+
+void XpbdSolver::setTopology(const MassSpringSystem& ms)
+{
+	buildPointSpringAdjacency(ms.numPoints(), ms.m_springs, m_pointSpringOffsets, m_pointSprings);
+
+	m_predicted.resize(ms.numPoints());
+	m_lambdas.resize(ms.numSprings());
+	m_corrections.resize(ms.numSprings());
+	m_partial.assign((ms.numSprings() + kGrain - 1) / kGrain, 0.0);
+
+	const std::vector<Spring>& springs = ms.m_springs;
+	m_islands.build(ms.m_fixed, springs.size(), [&](size_t s, uint32_t& a, uint32_t& b)
+	{
+		a = springs[s].point1;
+		b = springs[s].point2;
+	});
+	m_islandOrder.resize(m_islands.size());
+	for (uint32_t k = 0; k < m_islandOrder.size(); k++)
+	{
+		m_islandOrder[k] = k;
+	}
+	std::stable_sort(m_islandOrder.begin(), m_islandOrder.end(), [this](uint32_t x, uint32_t y)
+	{
+		return m_islands.edgeEnd(x) - m_islands.edgeBegin(x) > m_islands.edgeEnd(y) - m_islands.edgeBegin(y);
+	});
+	m_islandResiduals.assign(m_islands.size(), 0.0);
+}
+
+
+void XpbdSolver::step(MassSpringSystem& ms, float timeStep, ThreadPool* pool)
+{
+	PROFILE_ZONE("XPBD solve");
+	const std::vector<float>& invMasses = ms.m_invMasses;
+	const std::vector<uint8_t>& fixed = ms.m_fixed;
+	std::vector<Vec3>& x = ms.m_positions;
+	std::vector<Vec3>& v = ms.m_velocities;
+
+	const float h = timeStep;
+	const float damping = ms.m_params.damping;
+	const Vec3 gravity = ms.m_params.gravity;
+
+	// predict the positions from gravity and the damped velocities. Damping
+	// (once per spring of the point, as in the force based integrators) is
+	// applied implicitly, v' = v / (1 + h * d * springs / m), so it never
+	// overshoots.
+	parallelFor(pool, ms.numPoints(), kGrain, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			if (fixed[i])
+			{
+				m_predicted[i] = x[i];
+				continue;
+			}
+			const uint32_t numSprings = m_pointSpringOffsets[i + 1] - m_pointSpringOffsets[i];
+			v[i] += h * gravity;
+			v[i] *= 1.f / (1.f + h * damping * numSprings * invMasses[i]);
+			m_predicted[i] = x[i] + h * v[i];
+		}
+	});
+
+	// project the constraints
+	std::fill(m_lambdas.begin(), m_lambdas.end(), 0.f);
+	const int iterations = ms.m_params.xpbdIterations;
+	const float invTimeStepSq = 1.f / (h * h);
+	m_residuals.resize(iterations > 0 ? iterations : 0);
+	m_islandSolveTimes.assign(m_islands.size(), 0.f);
+	for (int it = 0; it < iterations; it++)
+	{
+		double residualSq = ms.m_params.xpbdJacobi ? iterateJacobi(ms, invTimeStepSq, pool) : iterateGaussSeidel(ms, invTimeStepSq, pool);
+		m_residuals[it] = ms.numSprings() > 0 ? (float)std::sqrt(residualSq / ms.numSprings()) : 0.f;
+	}
+
+	// velocities from the displacement
+	parallelFor(pool, ms.numPoints(), kGrain, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			if (fixed[i]) { continue; }
+			v[i] = (m_predicted[i] - x[i]) * (1.f / h);
+			x[i] = m_predicted[i];
+		}
+	});
+}
+
+
+double XpbdSolver::iterateGaussSeidel(const MassSpringSystem& ms, float invTimeStepSq, ThreadPool* pool)
+{
+	const std::vector<Spring>& springs = ms.m_springs;
+	const std::vector<float>& invMasses = ms.m_invMasses;
+	const std::vector<uint32_t>& islandSprings = m_islands.edges();
+	std::vector<Vec3>& p = m_predicted;
+
+	auto projectIsland = [&](size_t task, unsigned int)
+	{
+		const uint32_t island = m_islandOrder[task];
+		const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		double residualSq = 0.0;
+		for (uint32_t k = m_islands.edgeBegin(island); k < m_islands.edgeEnd(island); k++)
+		{
+			const uint32_t s = islandSprings[k];
+			const Spring& spring = springs[s];
+			const float w1 = invMasses[spring.point1];
+			const float w2 = invMasses[spring.point2];
+			Vec3 diff = p[spring.point1] - p[spring.point2];
+			float curr_length = length(diff);
+			if (w1 + w2 == 0.f || curr_length <= 0.f || spring.stiffness <= 0.f) { continue; }
+
+			// delta lambda = (-C - alpha~ * lambda) / (w1 + w2 + alpha~), alpha~ = compliance / h^2
+			float alphaTilde = invTimeStepSq / spring.stiffness;
+			float residual = -(curr_length - spring.org_length) - alphaTilde * m_lambdas[s];
+			float deltaLambda = residual / (w1 + w2 + alphaTilde);
+			m_lambdas[s] += deltaLambda;
+			residualSq += residual * residual;
+
+			// fixed points are shared between islands and must not be written
+			Vec3 correction = diff * (deltaLambda / curr_length);
+			if (w1 > 0.f) { p[spring.point1] += w1 * correction; }
+			if (w2 > 0.f) { p[spring.point2] -= w2 * correction; }
+		}
+		m_islandResiduals[island] = residualSq;
+		m_islandSolveTimes[island] += std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+	};
+	if (pool)
+	{
+		pool->runTasks(m_islandOrder.size(), projectIsland);
+	}
+	else
+	{
+		for (size_t task = 0; task < m_islandOrder.size(); task++)
+		{
+			projectIsland(task, 0);
+		}
+	}
+
+	// summed in island order for a thread independent result
+	double residualSq = 0.0;
+	for (size_t k = 0; k < m_islandResiduals.size(); k++)
+	{
+		residualSq += m_islandResiduals[k];
+	}
+	return residualSq;
+}
+
+
+double XpbdSolver::iterateJacobi(const MassSpringSystem& ms, float invTimeStepSq, ThreadPool* pool)
+{
+	const std::vector<Spring>& springs = ms.m_springs;
+	const std::vector<float>& invMasses = ms.m_invMasses;
+	const std::vector<uint8_t>& fixed = ms.m_fixed;
+	std::vector<Vec3>& p = m_predicted;
+
+	// phase 1: every spring computes its correction from the same positions
+	parallelFor(pool, springs.size(), kGrain, [&](size_t begin, size_t end)
+	{
+		double residualSq = 0.0;
+		for (size_t s = begin; s < end; s++)
+		{
+			const Spring& spring = springs[s];
+			const float w1 = invMasses[spring.point1];
+			const float w2 = invMasses[spring.point2];
+			Vec3 diff = p[spring.point1] - p[spring.point2];
+			float curr_length = length(diff);
+			if (w1 + w2 == 0.f || curr_length <= 0.f || spring.stiffness <= 0.f)
+			{
+				m_corrections[s] = Vec3(0.f, 0.f, 0.f);
+				continue;
+			}
+
+			float alphaTilde = invTimeStepSq / spring.stiffness;
+			float residual = -(curr_length - spring.org_length) - alphaTilde * m_lambdas[s];
+			float deltaLambda = residual / (w1 + w2 + alphaTilde);
+			m_lambdas[s] += deltaLambda;
+			residualSq += residual * residual;
+
+			m_corrections[s] = diff * (deltaLambda / curr_length);
+		}
+		m_partial[begin / kGrain] = residualSq;
+	});
+
+	// phase 2: every point applies the average of its springs' corrections,
+	// over-relaxed by xpbdRelaxation, summed in spring order
+	const float relaxation = ms.m_params.xpbdRelaxation;
+	parallelFor(pool, ms.numPoints(), kGrain, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			const uint32_t numSprings = m_pointSpringOffsets[i + 1] - m_pointSpringOffsets[i];
+			if (fixed[i] || numSprings == 0) { continue; }
+
+			Vec3 sum(0.f, 0.f, 0.f);
+			for (uint32_t k = m_pointSpringOffsets[i]; k < m_pointSpringOffsets[i + 1]; k++)
+			{
+				uint32_t entry = m_pointSprings[k];
+				if (entry & 1) { sum -= m_corrections[entry >> 1]; }
+				else           { sum += m_corrections[entry >> 1]; }
+			}
+			p[i] += (relaxation * invMasses[i] / numSprings) * sum;
+		}
+	});
+
+	double residualSq = 0.0;
+	for (size_t c = 0; c < (springs.size() + kGrain - 1) / kGrain; c++)
+	{
+		residualSq += m_partial[c];
+	}
+	return residualSq;
+}
@@ -0,0 +1,72 @@
+#ifndef __XpbdSolver_h__
+#define __XpbdSolver_h__
+
+#include <cstdint>
+#include <vector>
+
+#include "Islands.h"
+#include "Vec3.h"
+
+class MassSpringSystem;
+class ThreadPool;
+
+
+// Extended position based dynamics (Macklin et al., "XPBD: Position-Based
+// Simulation of Compliant Constrained Dynamics"). Every spring is a distance
+// constraint C = |x1 - x2| - org_length with compliance 1 / stiffness. A step
+// predicts the positions from the velocities, projects the constraints for a
+// fixed number of iterations and derives the velocities from the displacement,
+// which keeps it stable for any time step.
+//
+// Gauss-Seidel iterations project one spring after the other (fast
+// convergence). Springs of separate pieces of cloth or rope, connected at
+// most through fixed points, never move the same point: each such island is
+// projected on its own thread, in the same spring order as a serial sweep, so
+// the positions do not depend on the number of threads. Jacobi iterations
+// compute all corrections from the same positions and let every point average
+// the corrections of its springs, so they run in parallel on the thread pool
+// with a thread independent result.
+class XpbdSolver
+{
+public:
+	XpbdSolver() {}
+
+	// Build the per point spring lists of ms (needed by the Jacobi iteration).
+	// Has to be called again whenever points or springs are added or removed.
+	void setTopology(const MassSpringSystem& ms);
+
+	// Advance ms by one step using ms.m_params (iterations, Jacobi/Gauss-Seidel,
+	// damping, gravity). pool may be null (single threaded).
+	void step(MassSpringSystem& ms, float timeStep, ThreadPool* pool);
+
+	// RMS over all springs of the XPBD residual -C - compliance / h^2 * lambda,
+	// measured at the start of each iteration of the last step
+	const std::vector<float>& residuals() const { return m_residuals; }
+
+	// Islands of the spring graph (nodes: points, edges: springs, fixed points static)
+	const Islands& islands() const { return m_islands; }
+
+	// Seconds spent on every island by the Gauss-Seidel iterations of the last step
+	const std::vector<float>& lastIslandSolveTimes() const { return m_islandSolveTimes; }
+
+private:
+	// One iteration over all springs; returns the sum of the squared residuals
+	double iterateGaussSeidel(const MassSpringSystem& ms, float invTimeStepSq, ThreadPool* pool);
+	double iterateJacobi(const MassSpringSystem& ms, float invTimeStepSq, ThreadPool* pool);
+
+	std::vector<uint32_t> m_pointSpringOffsets;
+	std::vector<uint32_t> m_pointSprings;
+
+	std::vector<Vec3>  m_predicted;   // positions being projected
+	std::vector<float> m_lambdas;     // accumulated multiplier per spring
+	std::vector<Vec3>  m_corrections; // Jacobi: delta lambda * constraint direction per spring
+	std::vector<double> m_partial;    // Jacobi: residual per chunk of springs
+	std::vector<float> m_residuals;
+
+	Islands m_islands;
+	std::vector<uint32_t> m_islandOrder;      // islands by decreasing number of springs
+	std::vector<double>   m_islandResiduals;  // Gauss-Seidel: residual per island
+	std::vector<float>    m_islandSolveTimes;
+};
+
+#endif
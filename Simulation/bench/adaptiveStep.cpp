@@ -0,0 +1,239 @@
+//--------------------------------------------------------------------------------------
+// File: adaptiveStep.cpp
+//
+// Force evaluations of adaptive time steps (AdaptiveStepper) against fixed
+// midpoint steps on three mostly resting scenes:
+//   springhouse: Demo4 swings from its fixed point onto the floor and settles
+//   drop:        a free cloth falls onto the floor and comes to rest on it
+//   hanging:     a cloth swings from its two fixed corners and settles
+// Errors are the largest distance of a point from a reference run with fixed
+// steps of an eighth of the smallest adaptive one, compared every frame. The
+// fixed steps are frameTime * 2^-k: the largest one as accurate as the
+// adaptive steps, and the one the moment that needed the smallest steps asks
+// for, which is what a fixed step chosen by hand has to be.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "AdaptiveStepper.h"
+#include "MassSpringSystem.h"
+#include "Scenes.h"
+
+
+
+
+struct RunResult
+{
+	bool   stable;
+	long long forceEvaluations;
+	long long rejectedSteps;
+	float  smallestStep;
+	float  largestStep;
+	double wallSeconds;
+	std::vector<std::vector<Vec3>> frames;  // positions at the end of every frame
+};
+
+
+enum Scene
+{
+	SCENE_SPRINGHOUSE,
+	SCENE_DROP,
+	SCENE_HANGING
+};
+
+static const char* const kSceneNames[] = { "springhouse", "drop", "hanging" };
+
+
+static void buildScene(MassSpringSystem& ms, Scene scene, uint32_t size)
+{
+	if (scene == SCENE_SPRINGHOUSE)
+	{
+		// Demo4: swings from its fixed point, hits the floor and settles
+		buildSpringHouseScene(ms);
+		ms.m_params.damping = 4.f;
+		ms.m_params.gravity = Vec3(0.f, -9.81f * 0.2f, 0.f);
+		ms.m_colliderPlanes.push_back(Plane(Vec3(0.f, 1.f, 0.f), -1.f));
+		return;
+	}
+	buildClothScene(ms, size, size, 1.f / size);
+	ms.m_params.gravity = Vec3(0.f, -9.81f, 0.f);
+	ms.m_params.damping = 0.05f;
+	if (scene == SCENE_DROP)
+	{
+		std::fill(ms.m_fixed.begin(), ms.m_fixed.end(), (uint8_t)0);
+		ms.setMass(0.01f);
+		ms.m_colliderPlanes.push_back(Plane(Vec3(0.f, 1.f, 0.f), 0.f));
+	}
+}
+
+
+// Simulate numFrames frames with fixed steps of timeStep, or adaptive steps if timeStep is 0
+static RunResult run(Scene scene, uint32_t size, int numFrames, float frameTime, float timeStep, float tolerance)
+{
+	MassSpringSystem ms;
+	buildScene(ms, scene, size);
+	ms.m_params.integrator = INTEGRATOR_MIDPOINT;
+	AdaptiveStepper stepper(frameTime);
+	stepper.m_positionTolerance = tolerance;
+	stepper.m_velocityTolerance = 10.f * tolerance;
+	const int stepsPerFrame = timeStep > 0.f ? (int)std::lround(frameTime / timeStep) : 0;
+
+	RunResult result = { true, 0, 0, timeStep, timeStep, 0.0, std::vector<std::vector<Vec3>>() };
+	result.smallestStep = timeStep > 0.f ? timeStep : frameTime;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int frame = 0; frame < numFrames && result.stable; frame++)
+	{
+		if (timeStep > 0.f)
+		{
+			for (int step = 0; step < stepsPerFrame; step++)
+			{
+				ms.nextStep(timeStep);
+				result.forceEvaluations += ms.lastForceEvaluations();
+			}
+		}
+		else
+		{
+			stepper.advance(ms, frameTime);
+			const AdaptiveStepStats& stats = stepper.lastAdvance();
+			result.forceEvaluations += stats.forceEvaluations;
+			result.rejectedSteps += stats.rejectedSteps;
+			result.smallestStep = std::min(result.smallestStep, stats.smallestStep);
+			result.largestStep = std::max(result.largestStep, stats.largestStep);
+		}
+		for (size_t i = 0; i < ms.numPoints(); i++)
+		{
+			const Vec3& x = ms.m_positions[i];
+			result.stable = result.stable && std::isfinite(x.x) && std::isfinite(x.y) && std::isfinite(x.z) && lengthSq(x) < 100.f;
+		}
+		result.frames.push_back(ms.m_positions);
+	}
+	result.wallSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	return result;
+}
+
+
+// Largest distance of a point from the reference over all frames
+static double maxError(const RunResult& run, const RunResult& reference)
+{
+	double error = 0.0;
+	for (size_t f = 0; f < run.frames.size() && f < reference.frames.size(); f++)
+	{
+		for (size_t i = 0; i < run.frames[f].size(); i++)
+		{
+			error = std::max(error, (double)length(run.frames[f][i] - reference.frames[f][i]));
+		}
+	}
+	return error;
+}
+
+
+// Largest frameTime * 2^-k (k < 16) not above timeStep
+static float gridStep(float frameTime, float timeStep)
+{
+	float step = frameTime;
+	for (int k = 0; k < 16 && step > timeStep; k++)
+	{
+		step *= 0.5f;
+	}
+	return step;
+}
+
+
+static void printRun(const char* name, const RunResult& run, const RunResult& reference)
+{
+	printf("  %-24s %12lld %10.3f %10.2e  ", name, run.forceEvaluations, run.wallSeconds, maxError(run, reference));
+	if (run.smallestStep == run.largestStep)
+	{
+		printf("%.6f%s\n", run.smallestStep, run.stable ? "" : ", unstable");
+	}
+	else
+	{
+		printf("%.6f - %.6f, %lld rejected\n", run.smallestStep, run.largestStep, run.rejectedSteps);
+	}
+}
+
+
+static bool compare(Scene scene, uint32_t size, float seconds, float frameTime, float tolerance)
+{
+	const int numFrames = std::max(1, (int)(seconds / frameTime + 0.5f));
+	printf("\n%s", kSceneNames[scene]);
+	if (scene != SCENE_SPRINGHOUSE)
+	{
+		printf(": cloth of %u x %u points", size, size);
+	}
+	printf(", %d frames of %g s\n", numFrames, frameTime);
+
+	const RunResult adaptive = run(scene, size, numFrames, frameTime, 0.f, tolerance);
+	const RunResult reference = run(scene, size, numFrames, frameTime, gridStep(frameTime, adaptive.smallestStep / 8.f), tolerance);
+	const double adaptiveError = maxError(adaptive, reference);
+
+	// the fixed step it takes to be as accurate as the adaptive steps over the
+	// whole run, and the one of the moment that needed the smallest steps
+	float accurateStep = frameTime;
+	RunResult accurate;
+	for (int k = 0; k < 16; k++, accurateStep *= 0.5f)
+	{
+		accurate = run(scene, size, numFrames, frameTime, accurateStep, tolerance);
+		if (accurate.stable && maxError(accurate, reference) <= adaptiveError)
+		{
+			break;
+		}
+	}
+	const RunResult worstMoment = run(scene, size, numFrames, frameTime, gridStep(frameTime, adaptive.smallestStep), tolerance);
+
+	printf("  %-24s %12s %10s %10s  %s\n", "", "force evals", "wall s", "max error", "steps (s)");
+	printRun("adaptive", adaptive, reference);
+	printRun("fixed, as accurate", accurate, reference);
+	printRun("fixed, smallest needed", worstMoment, reference);
+	printf("  adaptive: %.1fx / %.1fx fewer force evaluations\n",
+		(double)accurate.forceEvaluations / std::max(adaptive.forceEvaluations, 1LL),
+		(double)worstMoment.forceEvaluations / std::max(adaptive.forceEvaluations, 1LL));
+	return adaptive.stable;
+}
+
+
+// A state with a NaN velocity has to be rejected by tryStep() and left unchanged,
+// not accepted with a zero error
+static bool checkNanRejected()
+{
+	MassSpringSystem ms;
+	buildScene(ms, SCENE_SPRINGHOUSE, 0);
+	size_t moving = 0;
+	while (ms.m_fixed[moving]) { moving++; }
+	ms.m_velocities[moving].x = NAN;
+	const uint64_t before = ms.stateChecksum();
+	const float error = ms.tryStep(0.01f, 1e-3f, 1e-2f);
+	const bool rejected = error > 1.f && ms.stateChecksum() == before;
+	printf("NaN state: error %g, %s\n", error, rejected ? "rejected" : "ACCEPTED");
+	return rejected;
+}
+
+
+int main(int argc, char* argv[])
+{
+	uint32_t size = 24;
+	float seconds = 4.f;
+	float tolerance = 1e-3f;
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--size") == 0 && hasValue)           { size = (uint32_t)atoi(argv[++i]); }
+		else if (strcmp(argv[i], "--seconds") == 0 && hasValue)   { seconds = (float)atof(argv[++i]); }
+		else if (strcmp(argv[i], "--tolerance") == 0 && hasValue) { tolerance = (float)atof(argv[++i]); }
+	}
+	printf("Position tolerance %g m, velocity tolerance %g m/s per step\n", tolerance, 10.f * tolerance);
+
+	bool ok = checkNanRejected();
+
+	// Demo4 steps by 0.1 s, the cloths are drawn at 60 Hz
+	ok = compare(SCENE_SPRINGHOUSE, size, 10.f * seconds, 0.1f, tolerance);
+	ok = compare(SCENE_DROP, size, seconds, 1.f / 60.f, tolerance) && ok;
+	ok = compare(SCENE_HANGING, size, seconds, 1.f / 60.f, tolerance) && ok;
+	return ok ? 0 : 1;
+}
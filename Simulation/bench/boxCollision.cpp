@@ -0,0 +1,321 @@
+//--------------------------------------------------------------------------------------
+// File: boxCollision.cpp
+//
+// Pairs/s of collideBoxes() and collideBoxPairsSimd() against the corner-only checkCollision() of
+// Demo/collisionDetect.h, called twice with A and B swapped as the sample code
+// does. checkCollision() needs DirectXMath, so it is ported 1:1 to plain floats
+// here (general 4x4 inverse of A's transform, B's corners in A's object space).
+// Also measures the batch kernels of BoxBatchCollision.h on the same pairs,
+// counts the overlapping pairs the corner test misses (edge-edge) and runs the
+// two examples from collisionDetect.h.
+//--------------------------------------------------------------------------------------
+
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "BoxBatchCollision.h"
+#include "BoxCollision.h"
+
+
+// Row vector 4x4 transform as used by DirectXMath (p' = p * M)
+struct Mat4
+{
+	float m[4][4];
+};
+
+static Mat4 multiply(const Mat4& a, const Mat4& b)
+{
+	Mat4 r;
+	for (int i = 0; i < 4; i++)
+		for (int j = 0; j < 4; j++)
+			r.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j] + a.m[i][3] * b.m[3][j];
+	return r;
+}
+
+// General inverse via cofactors, like XMMatrixInverse()
+static Mat4 inverse(const Mat4& a)
+{
+	const float* m = &a.m[0][0];
+	float inv[16];
+	inv[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+	inv[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+	inv[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+	inv[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+	inv[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+	inv[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+	inv[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+	inv[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+	inv[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+	inv[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+	inv[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+	inv[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+	inv[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+	inv[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+	inv[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] - m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+	inv[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] + m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+
+	float det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+	Mat4 r;
+	float* out = &r.m[0][0];
+	for (int i = 0; i < 16; i++)
+	{
+		out[i] = inv[i] / det;
+	}
+	return r;
+}
+
+static Vec3 transformPoint(const Vec3& p, const Mat4& a)
+{
+	return Vec3(p.x * a.m[0][0] + p.y * a.m[1][0] + p.z * a.m[2][0] + a.m[3][0],
+	            p.x * a.m[0][1] + p.y * a.m[1][1] + p.z * a.m[2][1] + a.m[3][1],
+	            p.x * a.m[0][2] + p.y * a.m[1][2] + p.z * a.m[2][2] + a.m[3][2]);
+}
+
+static Vec3 transformNormal(const Vec3& p, const Mat4& a)
+{
+	return Vec3(p.x * a.m[0][0] + p.y * a.m[1][0] + p.z * a.m[2][0],
+	            p.x * a.m[0][1] + p.y * a.m[1][1] + p.z * a.m[2][1],
+	            p.x * a.m[0][2] + p.y * a.m[1][2] + p.z * a.m[2][2]);
+}
+
+// The object to world matrix the demo passes to checkCollision()
+static Mat4 obj2World(const Box& box)
+{
+	Mat4 r;
+	for (int i = 0; i < 3; i++)
+	{
+		r.m[i][0] = box.axes[i].x; r.m[i][1] = box.axes[i].y; r.m[i][2] = box.axes[i].z; r.m[i][3] = 0.f;
+	}
+	r.m[3][0] = box.center.x; r.m[3][1] = box.center.y; r.m[3][2] = box.center.z; r.m[3][3] = 1.f;
+	return r;
+}
+
+
+// checkCollision() step by step: B's corners in A's object space, the first
+// one inside A gives the contact point, the closest face of A the normal
+// (impulse direction to A)
+static bool cornerCollision(const Mat4& obj2World_A, const Mat4& obj2World_B, const Vec3& halfA, const Vec3& halfB, Vec3& point, Vec3& normal)
+{
+	const Mat4 world2Obj_A = inverse(obj2World_A);
+	const Mat4 objB2objA = multiply(obj2World_B, world2Obj_A);
+	const Vec3 centerB = transformPoint(Vec3(), objB2objA);
+	Vec3 edgeB[3];
+	for (int i = 0; i < 3; i++)
+	{
+		Vec3 edge;
+		edge[i] = halfB[i];
+		edgeB[i] = transformNormal(edge, objB2objA);
+	}
+
+	for (int c = 0; c < 8; c++)
+	{
+		Vec3 corner = centerB;
+		for (int i = 0; i < 3; i++)
+		{
+			corner += ((c >> i) & 1) ? edgeB[i] : -edgeB[i];
+		}
+		if (std::fabs(corner.x) > halfA.x || std::fabs(corner.y) > halfA.y || std::fabs(corner.z) > halfA.z)
+		{
+			continue;
+		}
+
+		int normalIndex = 0;
+		float minDistance = FLT_MAX;
+		float sign = 1.f;
+		for (int j = 0; j < 3; j++)
+		{
+			float distance = halfA[j] - std::fabs(corner[j]);
+			if (distance < minDistance)
+			{
+				normalIndex = j;
+				minDistance = distance;
+				sign = corner[j] >= 0.f ? -1.f : 1.f;
+			}
+		}
+		point = transformPoint(corner, obj2World_A);
+		Vec3 faceNormal;
+		faceNormal[normalIndex] = sign;
+		normal = transformNormal(faceNormal, obj2World_A);
+		normal *= 1.f / length(normal);
+		return true;
+	}
+	return false;
+}
+
+
+// The sample's two call pattern, from the boxes' transforms as the demo stores them
+static bool cornerCollisionBothWays(const Box& a, const Box& b, Vec3& point, Vec3& normal)
+{
+	const Mat4 obj2World_A = obj2World(a);
+	const Mat4 obj2World_B = obj2World(b);
+	if (cornerCollision(obj2World_A, obj2World_B, a.halfExtents, b.halfExtents, point, normal))
+	{
+		return true;
+	}
+	if (cornerCollision(obj2World_B, obj2World_A, b.halfExtents, a.halfExtents, point, normal))
+	{
+		normal = -normal;
+		return true;
+	}
+	return false;
+}
+
+
+static Box makeBox(const Vec3& center, float angleZ, float xlen, float ylen, float zlen)
+{
+	Box box;
+	box.center = center;
+	box.axes[0] = Vec3(std::cos(angleZ), std::sin(angleZ), 0.f);
+	box.axes[1] = Vec3(-std::sin(angleZ), std::cos(angleZ), 0.f);
+	box.halfExtents = Vec3(xlen / 2.f, ylen / 2.f, zlen / 2.f);
+	return box;
+}
+
+
+static void printExample(const char* name, const Box& a, const Box& b)
+{
+	ContactManifold manifold;
+	if (!collideBoxes(a, b, manifold))
+	{
+		printf("%s: no collision\n", name);
+		return;
+	}
+	printf("%s: normal %.3f %.3f %.3f, %d point(s)\n", name,
+		manifold.normalWorld.x, manifold.normalWorld.y, manifold.normalWorld.z, manifold.numPoints);
+	for (int k = 0; k < manifold.numPoints; k++)
+	{
+		const ContactPoint& p = manifold.points[k];
+		printf("    %.3f %.3f %.3f depth %.4f\n", p.positionWorld.x, p.positionWorld.y, p.positionWorld.z, p.depth);
+	}
+}
+
+
+int main(int argc, char* argv[])
+{
+	size_t numPairs = 100000;
+	int repeats = 20;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (strcmp(argv[i], "--pairs") == 0)        { numPairs = (size_t)atoll(argv[i + 1]); }
+		else if (strcmp(argv[i], "--repeats") == 0) { repeats = atoi(argv[i + 1]); }
+	}
+
+	// the examples from collisionDetect.h (expected normals (0, 1, 0) and (-1, 0, 0))
+	const float pi = 3.141592f;
+	printExample("case 1", makeBox(Vec3(0.2f, 5.f, 1.f), 0.f, 9.f, 2.f, 3.f), makeBox(Vec3(), pi / 4.f, 5.657f, 5.657f, 2.f));
+	printExample("case 2", makeBox(Vec3(-2.f, 0.f, 1.f), pi / 4.f, 2.829f, 2.829f, 2.f), makeBox(Vec3(1.f, 0.5f, 0.f), pi / 2.f, 9.f, 2.f, 4.f));
+
+	// random pairs of unit-ish boxes with random orientation, about half of them overlapping
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<float> unit(-1.f, 1.f);
+	std::uniform_real_distribution<float> size(0.5f, 1.5f);
+	std::vector<Box> boxes(2 * numPairs);
+	for (size_t i = 0; i < boxes.size(); i++)
+	{
+		Box& box = boxes[i];
+		box.center = 0.9f * Vec3(unit(rng), unit(rng), unit(rng));
+		box.halfExtents = 0.5f * Vec3(size(rng), size(rng), size(rng));
+
+		// axes from a random unit quaternion
+		float qw = unit(rng), qx = unit(rng), qy = unit(rng), qz = unit(rng);
+		float inv = 1.f / std::sqrt(qw * qw + qx * qx + qy * qy + qz * qz);
+		qw *= inv; qx *= inv; qy *= inv; qz *= inv;
+		box.axes[0] = Vec3(1.f - 2.f * (qy * qy + qz * qz), 2.f * (qx * qy + qw * qz), 2.f * (qx * qz - qw * qy));
+		box.axes[1] = Vec3(2.f * (qx * qy - qw * qz), 1.f - 2.f * (qx * qx + qz * qz), 2.f * (qy * qz + qw * qx));
+		box.axes[2] = Vec3(2.f * (qx * qz + qw * qy), 2.f * (qy * qz - qw * qx), 1.f - 2.f * (qx * qx + qy * qy));
+	}
+
+	// hit counts and the pairs only SAT finds
+	size_t satHits = 0, cornerHits = 0, missed = 0, totalPoints = 0;
+	for (size_t p = 0; p < numPairs; p++)
+	{
+		ContactManifold manifold;
+		Vec3 point, normal;
+		bool sat = collideBoxes(boxes[2 * p], boxes[2 * p + 1], manifold);
+		bool corner = cornerCollisionBothWays(boxes[2 * p], boxes[2 * p + 1], point, normal);
+		satHits += sat ? 1 : 0;
+		cornerHits += corner ? 1 : 0;
+		missed += (sat && !corner) ? 1 : 0;
+		totalPoints += manifold.numPoints;
+	}
+	printf("%zu random pairs: SAT %zu overlapping (%.2f points each), corner test %zu, missed by corners %zu\n",
+		numPairs, satHits, satHits ? (double)totalPoints / satHits : 0.0, cornerHits, missed);
+
+	// the same pairs for the batch kernels
+	BoxArrays boxArrays;
+	boxArrays.resize(boxes.size());
+	std::vector<BoxPair> pairList(numPairs);
+	for (size_t i = 0; i < boxes.size(); i++)
+	{
+		boxArrays.setBox(i, boxes[i]);
+	}
+	for (size_t p = 0; p < numPairs; p++)
+	{
+		pairList[p].a = (uint32_t)(2 * p);
+		pairList[p].b = (uint32_t)(2 * p + 1);
+	}
+	std::vector<BoxPairContact> contacts(numPairs);
+
+	// agreement of the batch kernel with collideBoxes() on overlap and normal
+	size_t numContacts = collideBoxPairsSimd(boxArrays, pairList.data(), numPairs, contacts.data());
+	size_t sameNormal = 0;
+	for (size_t c = 0; c < numContacts; c++)
+	{
+		ContactManifold manifold;
+		collideBoxes(boxes[2 * contacts[c].pair], boxes[2 * contacts[c].pair + 1], manifold);
+		sameNormal += dot(manifold.normalWorld, contacts[c].normalWorld) > 0.999f ? 1 : 0;
+	}
+	printf("batch kernel: %zu overlapping, %zu with the same normal as collideBoxes\n", numContacts, sameNormal);
+
+	// throughput; the checksum keeps the compiler from dropping the calls
+	double checksum = 0.0;
+	auto measure = [&](const char* name, double referenceRate, const std::function<void()>& pass) -> double
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int r = 0; r < repeats; r++)
+		{
+			pass();
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		double rate = (double)numPairs * repeats / std::chrono::duration<double>(end - start).count();
+		printf("%-32s %12.3g pairs/s %8.2fx\n", name, rate, referenceRate > 0.0 ? rate / referenceRate : 1.0);
+		return rate;
+	};
+
+	double cornerRate = measure("checkCollision x2 (corners)", 0.0, [&]()
+	{
+		for (size_t p = 0; p < numPairs; p++)
+		{
+			Vec3 point, normal;
+			checksum += cornerCollisionBothWays(boxes[2 * p], boxes[2 * p + 1], point, normal) ? normal.x : 0.f;
+		}
+	});
+	measure("collideBoxes (SAT manifold)", cornerRate, [&]()
+	{
+		for (size_t p = 0; p < numPairs; p++)
+		{
+			ContactManifold manifold;
+			collideBoxes(boxes[2 * p], boxes[2 * p + 1], manifold);
+			checksum += manifold.numPoints;
+		}
+	});
+	measure("collideBoxPairsScalar", cornerRate, [&]()
+	{
+		checksum += (double)collideBoxPairsScalar(boxArrays, pairList.data(), numPairs, contacts.data());
+	});
+	std::string simdName = std::string("collideBoxPairsSimd (") + collideBoxPairsSimdName() + ")";
+	measure(simdName.c_str(), cornerRate, [&]()
+	{
+		checksum += (double)collideBoxPairsSimd(boxArrays, pairList.data(), numPairs, contacts.data());
+	});
+	printf("(checksum %g)\n", checksum);
+	return 0;
+}
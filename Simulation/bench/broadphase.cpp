@@ -0,0 +1,200 @@
+//--------------------------------------------------------------------------------------
+// File: broadphase.cpp
+//
+// Pair finding time per frame of SweepAndPrune and DynamicAabbTree for 1k to
+// 100k boxes bouncing around in a cube, against testing all pairs (only
+// up to 10k boxes). The boxes move a little every frame, so both broad phases
+// work with the temporal coherence they are built for. Also checks that the
+// sweep finds exactly the brute force pairs and that the tree pairs contain them.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "Broadphase.h"
+
+
+// Boxes of size 0.5 - 1.5 at a density giving a few neighbours each, moving
+// with up to maxSpeed per frame and bouncing off the walls of the domain
+struct MovingBoxes
+{
+	std::vector<Box> boxes;
+	std::vector<Vec3> velocities;
+	float domain;
+
+	MovingBoxes(size_t count, float maxSpeed, unsigned int seed)
+	{
+		std::mt19937 rng(seed);
+		domain = std::cbrt((float)count) * 2.f;
+		std::uniform_real_distribution<float> position(0.f, domain);
+		std::uniform_real_distribution<float> unit(-1.f, 1.f);
+		std::uniform_real_distribution<float> size(0.25f, 0.75f);
+		boxes.resize(count);
+		velocities.resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			float angle = 3.141592f * unit(rng);
+			boxes[i].center = Vec3(position(rng), position(rng), position(rng));
+			boxes[i].axes[0] = Vec3(std::cos(angle), std::sin(angle), 0.f);
+			boxes[i].axes[1] = Vec3(-std::sin(angle), std::cos(angle), 0.f);
+			boxes[i].halfExtents = Vec3(size(rng), size(rng), size(rng));
+			velocities[i] = maxSpeed * Vec3(unit(rng), unit(rng), unit(rng));
+		}
+	}
+
+	void move()
+	{
+		for (size_t i = 0; i < boxes.size(); i++)
+		{
+			Vec3& c = boxes[i].center;
+			c += velocities[i];
+			for (int k = 0; k < 3; k++)
+			{
+				if ((c[k] < 0.f && velocities[i][k] < 0.f) || (c[k] > domain && velocities[i][k] > 0.f))
+				{
+					velocities[i][k] = -velocities[i][k];
+				}
+			}
+		}
+	}
+
+	void bounds(std::vector<Aabb>& out) const
+	{
+		out.resize(boxes.size());
+		for (size_t i = 0; i < boxes.size(); i++)
+		{
+			out[i] = boxBounds(boxes[i]);
+		}
+	}
+};
+
+
+static void bruteForcePairs(const std::vector<Aabb>& bounds, std::vector<BoxPair>& pairs)
+{
+	pairs.clear();
+	for (uint32_t i = 0; i < bounds.size(); i++)
+	{
+		for (uint32_t j = i + 1; j < bounds.size(); j++)
+		{
+			if (overlaps(bounds[i], bounds[j]))
+			{
+				BoxPair pair = { i, j };
+				pairs.push_back(pair);
+			}
+		}
+	}
+}
+
+
+static bool samePairs(const std::vector<BoxPair>& a, const std::vector<BoxPair>& b)
+{
+	if (a.size() != b.size())
+	{
+		return false;
+	}
+	for (size_t i = 0; i < a.size(); i++)
+	{
+		if (a[i].a != b[i].a || a[i].b != b[i].b) { return false; }
+	}
+	return true;
+}
+
+
+// every pair of exact (sorted) is in candidates (sorted)
+static bool containsPairs(const std::vector<BoxPair>& candidates, const std::vector<BoxPair>& exact)
+{
+	size_t c = 0;
+	for (size_t e = 0; e < exact.size(); e++)
+	{
+		while (c < candidates.size() && (candidates[c].a < exact[e].a || (candidates[c].a == exact[e].a && candidates[c].b < exact[e].b)))
+		{
+			c++;
+		}
+		if (c == candidates.size() || candidates[c].a != exact[e].a || candidates[c].b != exact[e].b)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+
+int main(int argc, char* argv[])
+{
+	int numFrames = 100;
+	float maxSpeed = 0.02f;
+	float margin = 0.1f;
+	std::vector<size_t> counts = { 1000, 10000, 100000 };
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--frames") == 0 && hasValue)      { numFrames = atoi(argv[++i]); }
+		else if (strcmp(argv[i], "--speed") == 0 && hasValue)  { maxSpeed = (float)atof(argv[++i]); }
+		else if (strcmp(argv[i], "--margin") == 0 && hasValue) { margin = (float)atof(argv[++i]); }
+		else if (strcmp(argv[i], "--count") == 0 && hasValue)  { counts.assign(1, (size_t)atoll(argv[++i])); }
+	}
+
+	printf("%d frames, speed <= %g per frame, tree margin %g\n", numFrames, maxSpeed, margin);
+	printf("%8s %10s %12s %12s %12s %12s %10s %10s %s\n", "boxes", "pairs", "brute ms", "sap ms", "tree ms", "tree pairs", "reinserts", "swaps", "check");
+
+	for (size_t c = 0; c < counts.size(); c++)
+	{
+		const size_t count = counts[c];
+		MovingBoxes scene(count, maxSpeed, 7);
+		SweepAndPrune sap;
+		DynamicAabbTree tree(margin);
+		std::vector<Aabb> bounds;
+		std::vector<BoxPair> exact;
+		const bool brute = count <= 10000;
+
+		// first frame builds both structures, not timed
+		scene.bounds(bounds);
+		sap.update(bounds);
+		tree.update(bounds);
+
+		double bruteSeconds = 0.0, sapSeconds = 0.0, treeSeconds = 0.0;
+		size_t reinserts = 0, swaps = 0;
+		bool ok = true;
+		for (int frame = 0; frame < numFrames; frame++)
+		{
+			scene.move();
+			scene.bounds(bounds);
+
+			auto t0 = std::chrono::high_resolution_clock::now();
+			sap.update(bounds);
+			auto t1 = std::chrono::high_resolution_clock::now();
+			tree.update(bounds);
+			auto t2 = std::chrono::high_resolution_clock::now();
+			sapSeconds += std::chrono::duration<double>(t1 - t0).count();
+			treeSeconds += std::chrono::duration<double>(t2 - t1).count();
+			reinserts += tree.reinsertedLastUpdate();
+			swaps += sap.swapsLastUpdate();
+
+			// brute force on the first and last frame only, it dominates the run time otherwise
+			if (brute && (frame == 0 || frame == numFrames - 1))
+			{
+				auto b0 = std::chrono::high_resolution_clock::now();
+				bruteForcePairs(bounds, exact);
+				auto b1 = std::chrono::high_resolution_clock::now();
+				bruteSeconds += std::chrono::duration<double>(b1 - b0).count() / 2.0;
+				ok = ok && samePairs(sap.pairs(), exact) && containsPairs(tree.pairs(), exact);
+			}
+		}
+
+		char bruteMs[32] = "-";
+		if (brute)
+		{
+			snprintf(bruteMs, sizeof(bruteMs), "%.3f", 1e3 * bruteSeconds);
+		}
+		printf("%8zu %10zu %12s %12.3f %12.3f %12zu %10.1f %10.1f %s\n", count, sap.pairs().size(), bruteMs,
+			1e3 * sapSeconds / numFrames, 1e3 * treeSeconds / numFrames, tree.pairs().size(),
+			(double)reinserts / numFrames, (double)swaps / numFrames, brute ? (ok ? "ok" : "MISMATCH") : "-");
+	}
+	return 0;
+}
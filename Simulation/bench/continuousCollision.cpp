@@ -0,0 +1,141 @@
+//--------------------------------------------------------------------------------------
+// File: continuousCollision.cpp
+//
+// Tunnelling with and without the swept tests, at growing time steps.
+//
+// Points: a grid of free mass points (no springs) flies at a thin static
+// box at the step of Demo1 and larger ones. Counts the points that end up
+// behind or inside the box and the time of the collision stage per point.
+//
+// Boxes: small boxes are shot down at a thin static plate. Counts the boxes
+// that end up below it and the mean step time, which shows what the
+// continuous stage costs on top of the discrete contacts.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "MassSpringSystem.h"
+#include "RigidBodyWorld.h"
+
+
+// not a multiple of the distance moved per step, so that no time step lands
+// the bodies exactly in the target by chance
+static const float kStartHeight = 1.37f;
+
+
+// Points that passed the plate (behind it or stuck in it) and the mean step time
+static void shootPoints(uint32_t side, float speed, float timeStep, bool continuous, size_t& passed, double& msPerStep)
+{
+	const float thickness = 0.02f;
+	MassSpringSystem ms;
+	ms.reserve((size_t)side * side, 0);
+	for (uint32_t i = 0; i < side; i++)
+	{
+		for (uint32_t j = 0; j < side; j++)
+		{
+			uint32_t p = ms.addPoint(-0.5f + (i + 0.5f) / side, kStartHeight, -0.5f + (j + 0.5f) / side, false, 0.01f);
+			ms.m_velocities[p] = Vec3(0.f, -speed, 0.f);
+		}
+	}
+	ms.m_params.integrator = INTEGRATOR_EULER;
+	ms.m_params.damping = 0.f;
+	ms.m_params.collisionFriction = 0.f;
+	ms.m_params.continuousCollision = continuous;
+	Box plate;
+	plate.halfExtents = Vec3(1.f, 0.5f * thickness, 1.f);
+	ms.m_colliderBoxes.push_back(plate);
+
+	// long enough to reach the plate and move on by as much again
+	const int numSteps = (int)(2.f / (speed * timeStep)) + 1;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int step = 0; step < numSteps; step++)
+	{
+		ms.nextStep(timeStep);
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	msPerStep = std::chrono::duration<double, std::milli>(end - start).count() / numSteps;
+
+	passed = 0;
+	for (size_t i = 0; i < ms.numPoints(); i++)
+	{
+		passed += ms.m_positions[i].y < 0.5f * thickness;
+	}
+}
+
+
+// Boxes that passed the plate and the mean step time
+static void shootBoxes(uint32_t side, float speed, float timeStep, bool continuous, size_t& passed, double& msPerStep)
+{
+	const float size = 0.1f, thickness = 0.05f;
+	RigidBodyWorld world;
+	world.m_params.continuousCollision = continuous;
+	world.m_params.allowSleeping = false;
+	world.reserve((size_t)side * side + 1);
+	world.addBox(Vec3(0.f, -0.5f * thickness, 0.f), Vec3(2.f * side * size, thickness, 2.f * side * size), 0.f);
+	for (uint32_t i = 0; i < side; i++)
+	{
+		for (uint32_t j = 0; j < side; j++)
+		{
+			float x = (2.f * i - side + 1.f) * size, z = (2.f * j - side + 1.f) * size;
+			uint32_t b = world.addBox(Vec3(x, kStartHeight, z), Vec3(size, size, size), 1.f, Quat::fromAxisAngle(Vec3(0.6f, 0.f, 0.8f), 0.3f * (i + j)));
+			world.m_linearMomenta[b] = Vec3(0.f, -speed, 0.f);
+		}
+	}
+
+	const int numSteps = (int)(2.f / (speed * timeStep)) + 1;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int step = 0; step < numSteps; step++)
+	{
+		world.step(timeStep);
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	msPerStep = std::chrono::duration<double, std::milli>(end - start).count() / numSteps;
+
+	passed = 0;
+	for (size_t i = 1; i < world.numBodies(); i++)
+	{
+		passed += world.m_positions[i].y < 0.f;
+	}
+}
+
+
+int main(int argc, char* argv[])
+{
+	uint32_t pointSide = 300, boxSide = 20;
+	float speed = 20.f;
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--points") == 0 && hasValue)     { pointSide = atoi(argv[++i]); }
+		else if (strcmp(argv[i], "--boxes") == 0 && hasValue) { boxSide = atoi(argv[++i]); }
+		else if (strcmp(argv[i], "--speed") == 0 && hasValue) { speed = (float)atof(argv[++i]); }
+	}
+	const float timeSteps[] = { 0.005f, 1.f / 60.f, 0.05f, 0.1f };
+
+	printf("%u points at %g m/s against a box 0.02 thick\n", pointSide * pointSide, speed);
+	printf("%8s %12s %14s %12s %14s\n", "dt", "passed", "ms/step", "swept passed", "swept ms/step");
+	for (float dt : timeSteps)
+	{
+		size_t passed, sweptPassed;
+		double ms, sweptMs;
+		shootPoints(pointSide, speed, dt, false, passed, ms);
+		shootPoints(pointSide, speed, dt, true, sweptPassed, sweptMs);
+		printf("%8.4f %12zu %14.3f %12zu %14.3f\n", dt, passed, ms, sweptPassed, sweptMs);
+	}
+
+	printf("\n%u boxes of size 0.1 at %g m/s against a plate 0.05 thick\n", boxSide * boxSide, speed);
+	printf("%8s %12s %14s %12s %14s\n", "dt", "passed", "ms/step", "CCD passed", "CCD ms/step");
+	for (float dt : timeSteps)
+	{
+		size_t passed, sweptPassed;
+		double ms, sweptMs;
+		shootBoxes(boxSide, speed, dt, false, passed, ms);
+		shootBoxes(boxSide, speed, dt, true, sweptPassed, sweptMs);
+		printf("%8.4f %12zu %14.3f %12zu %14.3f\n", dt, passed, ms, sweptPassed, sweptMs);
+	}
+	return 0;
+}
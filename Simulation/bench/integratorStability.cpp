@@ -0,0 +1,133 @@
+//--------------------------------------------------------------------------------------
+// File: integratorStability.cpp
+//
+// Wall time per simulated second of a stiff hanging cloth for every integrator,
+// each at the largest time step (1/60 s halved until stable) at which it stays
+// stable, together with its force evaluations per step.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "MassSpringSystem.h"
+#include "Scenes.h"
+
+
+struct RunResult
+{
+	bool   stable;
+	double wallSeconds;
+	double forceEvaluations;  // average per step
+	double cgIterations;  // average per step (implicit only)
+};
+
+
+// Simulate the cloth for simTime seconds. Unstable if any point ends up
+// non-finite or more than 10 m away from its start.
+static RunResult run(MassSpringSystem& ms, size_t n, float stiffness, const MassSpringParams& params, float timeStep, float simTime)
+{
+	buildClothScene(ms, (uint32_t)n, (uint32_t)n, 0.01f, stiffness);
+	ms.m_params = params;
+	std::vector<Vec3> start = ms.m_positions;
+
+	const int numSteps = (int)std::ceil(simTime / timeStep);
+	RunResult result = { true, 0.0, 0.0, 0.0 };
+	long long evaluations = 0, iterations = 0;
+
+	auto t0 = std::chrono::high_resolution_clock::now();
+	for (int step = 0; step < numSteps; step++)
+	{
+		ms.nextStep(timeStep);
+		evaluations += ms.lastForceEvaluations();
+		iterations += ms.implicitSolver().m_lastIterations;
+	}
+	auto t1 = std::chrono::high_resolution_clock::now();
+	result.wallSeconds = std::chrono::duration<double>(t1 - t0).count();
+	result.forceEvaluations = numSteps > 0 ? (double)evaluations / numSteps : 0.0;
+	result.cgIterations = numSteps > 0 ? (double)iterations / numSteps : 0.0;
+
+	for (size_t i = 0; i < ms.numPoints(); i++)
+	{
+		const Vec3& x = ms.m_positions[i];
+		if (!std::isfinite(x.x) || !std::isfinite(x.y) || !std::isfinite(x.z) || lengthSq(x - start[i]) > 100.f)
+		{
+			result.stable = false;
+			break;
+		}
+	}
+	return result;
+}
+
+
+// Largest stable time step 1/60 * 2^-k (k <= 12); prints every attempt
+static bool findStableStep(MassSpringSystem& ms, size_t n, float stiffness, const MassSpringParams& params,
+	float simTime, float& timeStep, RunResult& result)
+{
+	const char* name = integratorName(params.integrator);
+	timeStep = 1.f / 60.f;
+	for (int k = 0; k <= 12; k++, timeStep *= 0.5f)
+	{
+		result = run(ms, n, stiffness, params, timeStep, simTime);
+		printf("  %-9s h = %-10.6f %s\n", name, timeStep, result.stable ? "stable" : "unstable");
+		if (result.stable)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+
+int main(int argc, char* argv[])
+{
+	size_t n = 32;
+	float stiffness = 5000.f;
+	float simTime = 1.f;
+	unsigned int threads = 1;
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--size") == 0 && hasValue)           { n = (size_t)atoi(argv[++i]); }
+		else if (strcmp(argv[i], "--stiffness") == 0 && hasValue) { stiffness = (float)atof(argv[++i]); }
+		else if (strcmp(argv[i], "--time") == 0 && hasValue)      { simTime = (float)atof(argv[++i]); }
+		else if (strcmp(argv[i], "--threads") == 0 && hasValue)   { threads = (unsigned int)atoi(argv[++i]); }
+	}
+
+	MassSpringSystem ms;
+	buildClothScene(ms, (uint32_t)n, (uint32_t)n, 0.01f, stiffness);
+	printf("%zux%zu cloth: %zu points, %zu springs, stiffness %g, %g s simulated, %u thread(s)\n",
+		n, n, ms.numPoints(), ms.numSprings(), stiffness, simTime, threads);
+
+	MassSpringParams params;
+	params.gravity = Vec3(0.f, -9.81f, 0.f);
+	params.damping = 0.01f;
+	params.numThreads = threads;
+
+	float steps[INTEGRATOR_COUNT];
+	RunResult results[INTEGRATOR_COUNT];
+	bool found[INTEGRATOR_COUNT];
+	for (int m = 0; m < INTEGRATOR_COUNT; m++)
+	{
+		params.integrator = (Integrator)m;
+		found[m] = findStableStep(ms, n, stiffness, params, simTime, steps[m], results[m]);
+	}
+
+	printf("\n%-10s %12s %8s %12s %16s %12s %14s\n", "method", "stable h", "steps/s", "evals/step", "wall s / sim s", "vs midpoint", "CG its/step");
+	for (int m = 0; m < INTEGRATOR_COUNT; m++)
+	{
+		const char* name = integratorName((Integrator)m);
+		if (!found[m])
+		{
+			printf("%-10s %12s\n", name, "none");
+			continue;
+		}
+		double speedup = found[INTEGRATOR_MIDPOINT] ? results[INTEGRATOR_MIDPOINT].wallSeconds / results[m].wallSeconds : 0.0;
+		printf("%-10s %12.6f %8.0f %12.2f %16.4f %11.2fx %14.1f\n", name, steps[m], 1.f / steps[m],
+			results[m].forceEvaluations, results[m].wallSeconds / simTime, speedup,
+			m == INTEGRATOR_IMPLICIT_EULER ? results[m].cgIterations : 0.0);
+	}
+	return 0;
+}
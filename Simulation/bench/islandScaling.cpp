@@ -0,0 +1,134 @@
+//--------------------------------------------------------------------------------------
+// File: islandScaling.cpp
+//
+// Scaling of the island parallel solvers from 1 to N threads: XPBD Gauss-Seidel
+// on many separate ropes (every rope is an island) and RigidBodyWorld on the box
+// stacks scene with sleeping off (every stack is an island). Reports the
+// number of islands, the solve time of the most expensive one against the
+// mean, and checks that every thread count produces bitwise the same state.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "MassSpringSystem.h"
+#include "RigidBodyWorld.h"
+#include "Scenes.h"
+
+
+static void printRow(unsigned int threads, double msPerStep, double baseMs, size_t numIslands, const std::vector<float>& islandSeconds, const char* state)
+{
+	double sum = 0.0, max = 0.0;
+	for (size_t k = 0; k < islandSeconds.size(); k++)
+	{
+		sum += islandSeconds[k];
+		max = std::max(max, (double)islandSeconds[k]);
+	}
+	const double mean = islandSeconds.empty() ? 0.0 : sum / islandSeconds.size();
+	printf("%8u %12.3f %8.2fx %10zu %14.4f %14.4f %s\n", threads, msPerStep, baseMs / msPerStep, numIslands, 1e3 * max, 1e3 * mean, state);
+}
+
+
+int main(int argc, char* argv[])
+{
+	uint32_t numRopes = 2000, numSegments = 100;
+	uint32_t columnsX = 25, columnsZ = 20, height = 10;
+	int numSteps = 50;
+	unsigned int maxThreads = std::thread::hardware_concurrency();
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--ropes") == 0 && i + 2 < argc)       { numRopes = atoi(argv[++i]); numSegments = atoi(argv[++i]); }
+		else if (strcmp(argv[i], "--columns") == 0 && i + 2 < argc) { columnsX = atoi(argv[++i]); columnsZ = atoi(argv[++i]); }
+		else if (strcmp(argv[i], "--height") == 0 && hasValue)      { height = atoi(argv[++i]); }
+		else if (strcmp(argv[i], "--steps") == 0 && hasValue)       { numSteps = atoi(argv[++i]); }
+		else if (strcmp(argv[i], "--threads") == 0 && hasValue)     { maxThreads = (unsigned int)atoi(argv[++i]); }
+	}
+	if (maxThreads == 0) { maxThreads = 1; }
+
+	// 1, 2, 4, ... and maxThreads
+	std::vector<unsigned int> threadCounts;
+	for (unsigned int threads = 1; threads < maxThreads; threads *= 2)
+	{
+		threadCounts.push_back(threads);
+	}
+	threadCounts.push_back(maxThreads);
+
+	MassSpringSystem ms;
+	buildRopeScene(ms, numRopes, numSegments);
+	printf("XPBD Gauss-Seidel, %u ropes of %u segments: %zu points, %zu springs, %d steps, %u hardware threads\n",
+		numRopes, numSegments, ms.numPoints(), ms.numSprings(), numSteps, std::thread::hardware_concurrency());
+	printf("%8s %12s %9s %10s %14s %14s %s\n", "threads", "ms/step", "speedup", "islands", "max island ms", "mean island ms", "state");
+
+	std::vector<Vec3> reference;
+	double baseMs = 0.0;
+	for (size_t t = 0; t < threadCounts.size(); t++)
+	{
+		unsigned int threads = threadCounts[t];
+		buildRopeScene(ms, numRopes, numSegments);
+		ms.m_params.integrator = INTEGRATOR_XPBD;
+		ms.m_params.gravity = Vec3(0.f, -9.81f, 0.f);
+		ms.m_params.numThreads = threads;
+		ms.nextStep(0.005f); // warm up (creates the thread pool and the islands)
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int step = 0; step < numSteps; step++)
+		{
+			ms.nextStep(0.005f);
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		double msPerStep = std::chrono::duration<double, std::milli>(end - start).count() / numSteps;
+
+		const char* state = "reference";
+		if (threads == 1)
+		{
+			reference = ms.m_positions;
+			baseMs = msPerStep;
+		}
+		else
+		{
+			state = memcmp(reference.data(), ms.m_positions.data(), reference.size() * sizeof(Vec3)) == 0 ? "identical" : "DIFFERENT";
+		}
+		printRow(threads, msPerStep, baseMs, ms.xpbdSolver().islands().size(), ms.xpbdSolver().lastIslandSolveTimes(), state);
+	}
+
+	RigidBodyWorld world;
+	buildBoxStacksScene(world, columnsX, columnsZ, height);
+	printf("\nRigidBodyWorld, %zu boxes (%u x %u stacks of %u), sleeping off, %d steps\n", world.numBodies() - 1, columnsX, columnsZ, height, numSteps);
+	printf("%8s %12s %9s %10s %14s %14s %s\n", "threads", "ms/step", "speedup", "islands", "max island ms", "mean island ms", "state");
+
+	for (size_t t = 0; t < threadCounts.size(); t++)
+	{
+		unsigned int threads = threadCounts[t];
+		buildBoxStacksScene(world, columnsX, columnsZ, height);
+		world.m_params.allowSleeping = false;
+		world.m_params.numThreads = threads;
+		world.step(1.f / 60.f); // warm up
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int step = 0; step < numSteps; step++)
+		{
+			world.step(1.f / 60.f);
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		double msPerStep = std::chrono::duration<double, std::milli>(end - start).count() / numSteps;
+
+		const char* state = "reference";
+		if (threads == 1)
+		{
+			reference = world.m_positions;
+			baseMs = msPerStep;
+		}
+		else
+		{
+			state = memcmp(reference.data(), world.m_positions.data(), reference.size() * sizeof(Vec3)) == 0 ? "identical" : "DIFFERENT";
+		}
+		printRow(threads, msPerStep, baseMs, world.lastStepStats().numIslands, world.lastIslandSolveTimes(), state);
+	}
+	return 0;
+}
@@ -0,0 +1,308 @@
+//--------------------------------------------------------------------------------------
+// File: multigrid.cpp
+//
+// Convergence of the multigrid V-cycle (MultigridHierarchy) against flat
+// iteration on the backward Euler system of a large hanging cloth.
+// The system of one implicit step is solved from the current velocities by
+//   jacobi:    damped block Jacobi iteration, the flat counterpart of a V-cycle
+//   vcycle:    V-cycle iteration, x += V(b - A * x)
+//   cg-jacobi: CG with the block Jacobi preconditioner (the implicit solver's default)
+//   cg-vcycle: CG with one V-cycle as preconditioner (MassSpringParams::cgMultigrid)
+// and the relative residual |b - A * x| / |b| is reported per iteration and at
+// equal wall times. Then whole implicit steps are timed with both preconditioners.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "MassSpringSystem.h"
+#include "Multigrid.h"
+#include "Scenes.h"
+
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double secondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+
+struct Sample
+{
+	double seconds;
+	double residual;  // relative
+};
+
+
+static double dotAll(const std::vector<Vec3>& a, const std::vector<Vec3>& b)
+{
+	double sum = 0.0;
+	for (size_t i = 0; i < a.size(); i++)
+	{
+		sum += dot(a[i], b[i]);
+	}
+	return sum;
+}
+
+
+enum Method
+{
+	METHOD_JACOBI,
+	METHOD_VCYCLE,
+	METHOD_CG_JACOBI,
+	METHOD_CG_VCYCLE,
+	METHOD_COUNT
+};
+
+static const char* const kMethodNames[METHOD_COUNT] = { "jacobi", "vcycle", "cg-jacobi", "cg-vcycle" };
+
+
+// Solve A * x = b from x0 until the time limit or the tolerance, residual after every iteration
+static std::vector<Sample> solve(Method method, const BlockSparseMatrix& A, const std::vector<Vec3>& b, const std::vector<Vec3>& x0,
+	MultigridHierarchy& multigrid, double timeLimit, double tolerance, int maxIterations)
+{
+	const size_t n = b.size();
+	std::vector<Mat3> invDiagonal(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		invDiagonal[i] = A.m_blocks[A.findBlock((uint32_t)i, (uint32_t)i)].inverse();
+	}
+	std::vector<Vec3> x(x0), r(n), z(n), p(n), Ap(n);
+	const double bNorm = std::sqrt(dotAll(b, b));
+	std::vector<Sample> samples;
+
+	Clock::time_point start = Clock::now();
+	A.multiply(x.data(), Ap.data(), 0, n);
+	for (size_t i = 0; i < n; i++)
+	{
+		r[i] = b[i] - Ap[i];
+	}
+	double rr = dotAll(r, r);
+	samples.push_back({ secondsSince(start), std::sqrt(rr) / bNorm });
+
+	const bool cg = method == METHOD_CG_JACOBI || method == METHOD_CG_VCYCLE;
+	const bool vcycle = method == METHOD_VCYCLE || method == METHOD_CG_VCYCLE;
+	auto precondition = [&]()
+	{
+		if (vcycle)
+		{
+			multigrid.vcycle(A, r.data(), z.data(), nullptr);
+			return;
+		}
+		const float w = cg ? 1.f : multigrid.m_smoothingWeight;
+		for (size_t i = 0; i < n; i++)
+		{
+			z[i] = w * (invDiagonal[i] * r[i]);
+		}
+	};
+
+	precondition();
+	p = z;
+	double rz = dotAll(r, z);
+	for (int iteration = 0; iteration < maxIterations; iteration++)
+	{
+		if (samples.back().seconds > timeLimit || samples.back().residual <= tolerance)
+		{
+			break;
+		}
+
+		if (!cg)
+		{
+			// x += M^-1 * (b - A * x)
+			for (size_t i = 0; i < n; i++)
+			{
+				x[i] += z[i];
+			}
+			A.multiply(x.data(), Ap.data(), 0, n);
+			for (size_t i = 0; i < n; i++)
+			{
+				r[i] = b[i] - Ap[i];
+			}
+			rr = dotAll(r, r);
+			precondition();
+		}
+		else
+		{
+			A.multiply(p.data(), Ap.data(), 0, n);
+			const double pAp = dotAll(p, Ap);
+			if (pAp <= 0.0) { break; }
+			const float alpha = (float)(rz / pAp);
+			for (size_t i = 0; i < n; i++)
+			{
+				x[i] += alpha * p[i];
+				r[i] -= alpha * Ap[i];
+			}
+			rr = dotAll(r, r);
+			precondition();
+			const double rzNew = dotAll(r, z);
+			const float beta = (float)(rzNew / rz);
+			rz = rzNew;
+			for (size_t i = 0; i < n; i++)
+			{
+				p[i] = z[i] + beta * p[i];
+			}
+		}
+		samples.push_back({ secondsSince(start), std::sqrt(rr) / bNorm });
+	}
+	return samples;
+}
+
+
+// Residual reached within the given time (the last iteration that finished by then)
+static double residualAt(const std::vector<Sample>& samples, double seconds)
+{
+	double residual = samples[0].residual;
+	for (size_t i = 0; i < samples.size() && samples[i].seconds <= seconds; i++)
+	{
+		residual = samples[i].residual;
+	}
+	return residual;
+}
+
+
+// Hanging cloth after settleSteps implicit steps, the same state every time
+static void buildHangingCloth(MassSpringSystem& ms, uint32_t size, float stiffness, float timeStep, int settleSteps)
+{
+	buildClothScene(ms, size, size, 1.f / size, stiffness);
+	ms.m_params.integrator = INTEGRATOR_IMPLICIT_EULER;
+	ms.m_params.gravity = Vec3(0.f, -9.81f, 0.f);
+	ms.m_params.damping = 0.05f;
+	for (int s = 0; s < settleSteps; s++)
+	{
+		ms.nextStep(timeStep);
+	}
+}
+
+
+int main(int argc, char* argv[])
+{
+	uint32_t size = 256;
+	float timeStep = 0.02f;
+	float stiffness = 500.f;
+	int settleSteps = 20;
+	int steps = 20;
+	double timeLimitMs = 500.0;
+	MultigridHierarchy multigrid;
+	for (int i = 1; i < argc; i++)
+	{
+		const bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--size") == 0 && hasValue)            { size = (uint32_t)atoi(argv[++i]); }
+		else if (strcmp(argv[i], "--dt") == 0 && hasValue)         { timeStep = (float)atof(argv[++i]); }
+		else if (strcmp(argv[i], "--stiffness") == 0 && hasValue)  { stiffness = (float)atof(argv[++i]); }
+		else if (strcmp(argv[i], "--settle") == 0 && hasValue)     { settleSteps = atoi(argv[++i]); }
+		else if (strcmp(argv[i], "--steps") == 0 && hasValue)      { steps = atoi(argv[++i]); }
+		else if (strcmp(argv[i], "--time-limit") == 0 && hasValue) { timeLimitMs = atof(argv[++i]); }
+		else if (strcmp(argv[i], "--sweeps") == 0 && hasValue)     { multigrid.m_smoothingSweeps = atoi(argv[++i]); }
+		else if (strcmp(argv[i], "--weight") == 0 && hasValue)     { multigrid.m_smoothingWeight = (float)atof(argv[++i]); }
+		else
+		{
+			printf("Usage: multigrid [--size N] [--dt H] [--stiffness K] [--settle N] [--steps N] [--time-limit MS]\n"
+			       "                 [--sweeps N] [--weight W]\n");
+			return 1;
+		}
+	}
+
+	// let the cloth fall and stretch a little, then assemble one more step without solving it
+	MassSpringSystem probe;
+	buildHangingCloth(probe, size, stiffness, timeStep, settleSteps);
+	const std::vector<Vec3> x0 = probe.m_velocities;
+	probe.m_params.cgMaxIterations = 0;
+	probe.nextStep(timeStep);
+	const BlockSparseMatrix& A = probe.implicitSolver().matrix();
+	const std::vector<Vec3>& b = probe.implicitSolver().rightHandSide();
+
+	std::vector<uint8_t> fixed(probe.m_fixed.begin(), probe.m_fixed.end());
+	Clock::time_point start = Clock::now();
+	multigrid.setPattern(A, fixed);
+	const double setupSeconds = secondsSince(start);
+	start = Clock::now();
+	multigrid.update(A, nullptr);
+	const double updateSeconds = secondsSince(start);
+
+	printf("Cloth %ux%u: %zu points, %zu springs, dt %g, stiffness %g (h^2 k / m = %.0f)\n", size, size,
+		probe.numPoints(), probe.numSprings(), timeStep, stiffness, timeStep * timeStep * stiffness / 0.01f);
+	printf("Multigrid: %zu levels (", multigrid.numLevels());
+	for (size_t l = 0; l < multigrid.numLevels(); l++)
+	{
+		printf("%s%zu", l > 0 ? " > " : "", multigrid.levelSize(l));
+	}
+	printf(" points), built in %.1f ms, coarse matrices in %.2f ms per step\n\n", 1e3 * setupSeconds, 1e3 * updateSeconds);
+
+	std::vector<Sample> results[METHOD_COUNT];
+	for (int m = 0; m < METHOD_COUNT; m++)
+	{
+		results[m] = solve((Method)m, A, b, x0, multigrid, 1e-3 * timeLimitMs, 1e-7, 100000);
+	}
+
+	printf("Relative residual after k iterations (ms per iteration)\n");
+	printf("%-10s %10s", "method", "ms/iter");
+	const int kIterations[] = { 1, 2, 5, 10, 20, 50, 100 };
+	for (int k : kIterations) { printf(" %9s%-3d", "k=", k); }
+	printf(" %10s\n", "factor");
+	for (int m = 0; m < METHOD_COUNT; m++)
+	{
+		const std::vector<Sample>& samples = results[m];
+		const size_t numIterations = samples.size() - 1;
+		printf("%-10s %10.3f", kMethodNames[m], numIterations > 0 ? 1e3 * samples.back().seconds / numIterations : 0.0);
+		for (int k : kIterations)
+		{
+			if ((size_t)k < samples.size()) { printf(" %12.3g", samples[k].residual); }
+			else                            { printf(" %12s", "-"); }
+		}
+		// average reduction per iteration over the whole run
+		const double factor = numIterations > 0 ? std::pow(samples.back().residual / samples[0].residual, 1.0 / numIterations) : 1.0;
+		printf(" %10.3f\n", factor);
+	}
+
+	printf("\nRelative residual at equal wall time\n");
+	printf("%-10s", "method");
+	const double kMilliseconds[] = { 5, 10, 20, 50, 100, 200, 500 };
+	for (double t : kMilliseconds) { printf(" %9.0f ms", t); }
+	printf(" %14s\n", "ms to 1e-4");
+	for (int m = 0; m < METHOD_COUNT; m++)
+	{
+		const std::vector<Sample>& samples = results[m];
+		printf("%-10s", kMethodNames[m]);
+		for (double t : kMilliseconds) { printf(" %12.3g", residualAt(samples, 1e-3 * t)); }
+		size_t k = 0;
+		while (k < samples.size() && samples[k].residual > 1e-4) { k++; }
+		if (k < samples.size()) { printf(" %14.1f\n", 1e3 * samples[k].seconds); }
+		else                    { printf(" %14s\n", "-"); }
+	}
+
+	// whole implicit steps with the default CG tolerance
+	printf("\n%d implicit steps, CG to a relative residual of %g\n", steps, probe.m_params.cgTolerance);
+	MassSpringSystem runs[2];
+	for (int r = 0; r < 2; r++)
+	{
+		MassSpringSystem& run = runs[r];
+		buildHangingCloth(run, size, stiffness, timeStep, settleSteps);
+		run.m_params.cgMultigrid = r == 1;
+		run.m_params.cgMaxIterations = 1000;
+		long long iterations = 0;
+		float worst = 0.f;
+		start = Clock::now();
+		for (int s = 0; s < steps; s++)
+		{
+			run.nextStep(timeStep);
+			iterations += run.implicitSolver().m_lastIterations;
+			worst = std::max(worst, run.implicitSolver().m_lastResidual);
+		}
+		const double seconds = secondsSince(start);
+		printf("%-10s %8.2f ms/step %8.1f CG iterations/step, worst residual %.3g\n", r == 0 ? "cg-jacobi" : "cg-vcycle",
+			1e3 * seconds / steps, (double)iterations / steps, worst);
+	}
+	float maxDifference = 0.f;
+	for (size_t i = 0; i < probe.numPoints(); i++)
+	{
+		maxDifference = std::max(maxDifference, length(runs[0].m_positions[i] - runs[1].m_positions[i]));
+	}
+	printf("Largest position difference between the two: %.3g m\n", maxDifference);
+	return 0;
+}
@@ -0,0 +1,166 @@
+//--------------------------------------------------------------------------------------
+// File: sceneReset.cpp
+//
+// Latency of resetting a cloth of about a million springs, three ways:
+//   new:     a new MassSpringSystem, the scene built into it (cold storage)
+//   rebuild: the scene built again into the same system (clear() keeps the
+//            capacity), which is what the demo did for "Reset Simulation"
+//   rewind:  MassSpringSystem::rewindScene() to the mark set after building
+// The first step after a reset also pays for everything derived from the
+// topology (adjacency, solver patterns, islands), so it is reported next to
+// the reset itself and to a regular step. Heap allocations are counted by
+// replacing the global operator new.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+
+#include "MassSpringSystem.h"
+#include "Scenes.h"
+
+
+static std::atomic<long long> g_allocations(0);
+
+void* operator new(size_t size)
+{
+	g_allocations++;
+	void* p = std::malloc(size > 0 ? size : 1);
+	if (!p) { throw std::bad_alloc(); }
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	std::free(p);
+}
+
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double millisecondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+
+enum Reset
+{
+	RESET_NEW,
+	RESET_REBUILD,
+	RESET_REWIND,
+	RESET_COUNT
+};
+
+static const char* const kResetNames[RESET_COUNT] = { "new", "rebuild", "rewind" };
+
+
+struct Timing
+{
+	double    resetMs;
+	long long resetAllocations;
+	double    firstStepMs;
+	long long firstStepAllocations;
+	double    stepMs;
+};
+
+
+int main(int argc, char* argv[])
+{
+	uint32_t size = 408;  // 408 x 408 points: 994706 springs
+	int repetitions = 3;
+	float timeStep = 0.005f;
+	for (int i = 1; i < argc; i++)
+	{
+		const bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--size") == 0 && hasValue)             { size = (uint32_t)atoi(argv[++i]); }
+		else if (strcmp(argv[i], "--repetitions") == 0 && hasValue) { repetitions = atoi(argv[++i]); }
+		else
+		{
+			printf("Usage: scenereset [--size N] [--repetitions N]\n");
+			return 1;
+		}
+	}
+
+	const Integrator integrators[] = { INTEGRATOR_MIDPOINT, INTEGRATOR_IMPLICIT_EULER, INTEGRATOR_XPBD };
+	bool first = true;
+	for (Integrator integrator : integrators)
+	{
+		std::unique_ptr<MassSpringSystem> ms(new MassSpringSystem());
+		auto build = [&](MassSpringSystem& system)
+		{
+			buildClothScene(system, size, size, 1.f / size);
+			system.m_params.integrator = integrator;
+			system.m_params.gravity = Vec3(0.f, -9.81f, 0.f);
+			system.markScene();
+		};
+		build(*ms);
+		if (first)
+		{
+			printf("Cloth %ux%u: %zu points, %zu springs, best of %d\n\n", size, size, ms->numPoints(), ms->numSprings(), repetitions);
+			printf("%-10s %-8s %10s %8s %14s %8s %10s\n", "integrator", "reset", "reset ms", "allocs", "first step ms", "allocs", "step ms");
+			first = false;
+		}
+
+		for (int r = 0; r < RESET_COUNT; r++)
+		{
+			Timing best = { 1e30, 0, 1e30, 0, 1e30 };
+			for (int rep = 0; rep < repetitions; rep++)
+			{
+				// a few steps, so that there is something to reset
+				for (int s = 0; s < 3; s++)
+				{
+					ms->nextStep(timeStep);
+				}
+
+				Timing t;
+				long long allocations = g_allocations;
+				Clock::time_point start = Clock::now();
+				if (r == RESET_NEW)
+				{
+					ms.reset(new MassSpringSystem());
+					build(*ms);
+				}
+				else if (r == RESET_REBUILD)
+				{
+					build(*ms);
+				}
+				else
+				{
+					ms->rewindScene();
+				}
+				t.resetMs = millisecondsSince(start);
+				t.resetAllocations = g_allocations - allocations;
+
+				allocations = g_allocations;
+				start = Clock::now();
+				ms->nextStep(timeStep);
+				t.firstStepMs = millisecondsSince(start);
+				t.firstStepAllocations = g_allocations - allocations;
+
+				start = Clock::now();
+				ms->nextStep(timeStep);
+				t.stepMs = millisecondsSince(start);
+
+				best.resetMs = std::min(best.resetMs, t.resetMs);
+				best.firstStepMs = std::min(best.firstStepMs, t.firstStepMs);
+				best.stepMs = std::min(best.stepMs, t.stepMs);
+				best.resetAllocations = t.resetAllocations;
+				best.firstStepAllocations = t.firstStepAllocations;
+			}
+			printf("%-10s %-8s %10.2f %8lld %14.2f %8lld %10.2f\n", integratorName(integrator), kResetNames[r],
+				best.resetMs, best.resetAllocations, best.firstStepMs, best.firstStepAllocations, best.stepMs);
+		}
+	}
+	return 0;
+}
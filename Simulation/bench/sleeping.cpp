@@ -0,0 +1,121 @@
+//--------------------------------------------------------------------------------------
+// File: sleeping.cpp
+//
+// A large free cloth falls onto the floor and comes to rest, then a patch at
+// one corner is pushed up every step for a while. Two copies are simulated
+// side by side, one with m_params.sleeping: step times of both and the
+// awake/asleep split of the sleeping one, over time.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "MassSpringSystem.h"
+#include "Scenes.h"
+
+
+static void buildScene(MassSpringSystem& ms, uint32_t size, const char* integrator, bool sleeping)
+{
+	buildClothScene(ms, size, size, 2.f / size);
+	std::fill(ms.m_fixed.begin(), ms.m_fixed.end(), (uint8_t)0);
+	ms.setMass(0.01f);
+	for (size_t i = 0; i < ms.numPoints(); i++)
+	{
+		ms.m_positions[i].y = 0.2f;
+	}
+	parseIntegrator(integrator, ms.m_params.integrator);
+	ms.m_params.gravity = Vec3(0.f, -9.81f, 0.f);
+	ms.m_params.damping = 0.05f;
+	ms.m_params.sleeping = sleeping;
+	ms.m_colliderPlanes.push_back(Plane(Vec3(0.f, 1.f, 0.f), 0.f));
+}
+
+
+static double stepSeconds(MassSpringSystem& ms, float timeStep)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	ms.nextStep(timeStep);
+	return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+
+// Push the points of the patch size x size at the first corner up
+static void poke(MassSpringSystem& ms, uint32_t clothSize, uint32_t size)
+{
+	for (uint32_t row = 0; row < size; row++)
+	{
+		for (uint32_t col = 0; col < size; col++)
+		{
+			const uint32_t p = row * clothSize + col;
+			ms.m_velocities[p] = Vec3(0.f, 0.5f, 0.f);
+			ms.wakePoint(p);
+		}
+	}
+}
+
+
+int main(int argc, char* argv[])
+{
+	uint32_t size = 256;
+	float restSeconds = 3.f;
+	float pokeSeconds = 1.f;
+	float timeStep = 0.01f;
+	const char* integrator = "xpbd";
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--size") == 0 && hasValue)            { size = (uint32_t)atoi(argv[++i]); }
+		else if (strcmp(argv[i], "--rest") == 0 && hasValue)       { restSeconds = (float)atof(argv[++i]); }
+		else if (strcmp(argv[i], "--poke") == 0 && hasValue)       { pokeSeconds = (float)atof(argv[++i]); }
+		else if (strcmp(argv[i], "--dt") == 0 && hasValue)         { timeStep = (float)atof(argv[++i]); }
+		else if (strcmp(argv[i], "--integrator") == 0 && hasValue) { integrator = argv[++i]; }
+	}
+
+	MassSpringSystem plain, sleeping;
+	buildScene(plain, size, integrator, false);
+	buildScene(sleeping, size, integrator, true);
+	printf("Free cloth of %zu points, %zu springs, %s, steps of %g s, clusters of %u points\n", plain.numPoints(), plain.numSprings(),
+		integrator, timeStep, sleeping.m_params.sleepClusterSize);
+	printf("%8s %14s %14s %12s %12s\n", "time", "ms/step", "sleeping", "awake", "asleep");
+
+	const int restSteps = (int)(restSeconds / timeStep + 0.5f);
+	const int pokeSteps = (int)(pokeSeconds / timeStep + 0.5f);
+	const int reportEvery = std::max(1, (int)(0.25f / timeStep + 0.5f));
+	double plainSeconds = 0.0, sleepingSeconds = 0.0;
+	double lastPlain = 0.0, lastSleeping = 0.0;
+	for (int step = 0; step < 2 * restSteps + pokeSteps; step++)
+	{
+		const bool poking = step >= restSteps && step < restSteps + pokeSteps;
+		if (poking)
+		{
+			poke(plain, size, size / 16);
+			poke(sleeping, size, size / 16);
+		}
+		const double p = stepSeconds(plain, timeStep);
+		const double s = stepSeconds(sleeping, timeStep);
+		plainSeconds += p;
+		sleepingSeconds += s;
+		if ((step + 1) % reportEvery == 0)
+		{
+			const SleepStats& stats = sleeping.sleepStats();
+			printf("%7.2fs %14.3f %14.3f %12zu %12zu%s\n", (step + 1) * timeStep, 1e3 * (plainSeconds - lastPlain) / reportEvery,
+				1e3 * (sleepingSeconds - lastSleeping) / reportEvery, stats.numAwakePoints, stats.numSleepingPoints, poking ? "  poking" : "");
+			lastPlain = plainSeconds;
+			lastSleeping = sleepingSeconds;
+		}
+	}
+	printf("total %.3f s without sleeping, %.3f s with (%.1fx)\n", plainSeconds, sleepingSeconds, plainSeconds / std::max(sleepingSeconds, 1e-9));
+
+	// how far the sleeping copy ended up from the plain one
+	float maxDistance = 0.f;
+	for (size_t i = 0; i < plain.numPoints(); i++)
+	{
+		maxDistance = std::max(maxDistance, length(plain.m_positions[i] - sleeping.m_positions[i]));
+	}
+	printf("largest distance between the two copies %.4f m\n", maxDistance);
+	return 0;
+}
@@ -0,0 +1,181 @@
+//--------------------------------------------------------------------------------------
+// File: snapshot.cpp
+//
+// Snapshots of a million point cloth (and a few box stacks): time and size of
+// a full writeSnapshot(), of mapping the file and of restoring from it. The
+// restored state must be bitwise equal, and a restored cloth must step to
+// the same state as the original.
+//
+// Then checkpoints while stepping: the cloth is stepped with a SnapshotWriter
+// capturing every few steps, reporting how long capture() holds up the step
+// loop, how long the incremental writes of the background thread take and
+// how many bytes they write compared to the whole file.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "MassSpringSystem.h"
+#include "RigidBodyWorld.h"
+#include "Scenes.h"
+#include "Snapshot.h"
+
+
+static double secondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+template <typename T>
+static bool sameArray(const std::vector<T>& a, const std::vector<T>& b)
+{
+	return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+}
+
+static bool sameBodies(const RigidBodyWorld& a, const RigidBodyWorld& b)
+{
+	return sameArray(a.m_positions, b.m_positions) && sameArray(a.m_orientations, b.m_orientations) &&
+		sameArray(a.m_linearMomenta, b.m_linearMomenta) && sameArray(a.m_angularMomenta, b.m_angularMomenta) &&
+		sameArray(a.m_invMasses, b.m_invMasses) && sameArray(a.m_invInertiaBody, b.m_invInertiaBody) &&
+		sameArray(a.m_halfExtents, b.m_halfExtents) && sameArray(a.sleepFlags(), b.sleepFlags());
+}
+
+
+int main(int argc, char* argv[])
+{
+	uint32_t size = 1000;
+	int numSteps = 20;
+	int checkpointEvery = 2;
+	std::string path = "snapshotbench.bin";
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--size") == 0 && hasValue)        { size = (uint32_t)atoi(argv[++i]); }
+		else if (strcmp(argv[i], "--steps") == 0 && hasValue)  { numSteps = atoi(argv[++i]); }
+		else if (strcmp(argv[i], "--every") == 0 && hasValue)  { checkpointEvery = atoi(argv[++i]); }
+		else if (strcmp(argv[i], "--file") == 0 && hasValue)   { path = argv[++i]; }
+	}
+	const float timeStep = 0.001f;
+
+	MassSpringSystem ms;
+	buildClothScene(ms, size, size, 2.f / size);
+	ms.m_params.integrator = INTEGRATOR_MIDPOINT;
+	ms.m_params.gravity = Vec3(0.f, -9.81f, 0.f);
+	ms.m_params.damping = 0.01f;
+	RigidBodyWorld world;
+	buildBoxStacksScene(world, 10, 10, 10);
+	for (int step = 0; step < 5; step++)
+	{
+		ms.nextStep(timeStep);
+		world.step(timeStep);
+	}
+	printf("Cloth of %zu points and %zu springs, %zu boxes\n", ms.numPoints(), ms.numSprings(), world.numBodies());
+
+	// full snapshot
+	auto start = std::chrono::high_resolution_clock::now();
+	if (!writeSnapshot(path, &ms, &world, 5, 5 * timeStep))
+	{
+		fprintf(stderr, "Cannot write %s\n", path.c_str());
+		return 1;
+	}
+	double writeSeconds = secondsSince(start);
+
+	start = std::chrono::high_resolution_clock::now();
+	SnapshotFile file;
+	if (!file.open(path))
+	{
+		fprintf(stderr, "%s\n", file.error().c_str());
+		return 1;
+	}
+	double openSeconds = secondsSince(start);
+	const double megabytes = file.header().fileSize / 1e6;
+
+	MassSpringSystem restored;
+	restored.m_params = ms.m_params;
+	RigidBodyWorld restoredWorld;
+	start = std::chrono::high_resolution_clock::now();
+	bool ok = file.restore(restored) && file.restore(restoredWorld);
+	double restoreSeconds = secondsSince(start);
+	if (!ok)
+	{
+		fprintf(stderr, "%s\n", file.error().c_str());
+		return 1;
+	}
+	file.close();
+
+	const bool sameState = restored.stateChecksum() == ms.stateChecksum() && sameArray(restored.m_invMasses, ms.m_invMasses) &&
+		sameArray(restored.m_fixed, ms.m_fixed) && std::memcmp(restored.m_springs.data(), ms.m_springs.data(), ms.numSprings() * sizeof(Spring)) == 0;
+	const bool sameWorld = sameBodies(world, restoredWorld);
+	for (int step = 0; step < 3; step++)
+	{
+		ms.nextStep(timeStep);
+		restored.nextStep(timeStep);
+	}
+	const bool sameSteps = restored.stateChecksum() == ms.stateChecksum();
+
+	printf("\nFull snapshot: %.1f MB\n", megabytes);
+	printf("%-24s %10.2f ms (%.2f GB/s)\n", "writeSnapshot", 1e3 * writeSeconds, megabytes / 1e3 / writeSeconds);
+	printf("%-24s %10.3f ms\n", "open (map + check)", 1e3 * openSeconds);
+	printf("%-24s %10.2f ms (%.2f GB/s)\n", "restore", 1e3 * restoreSeconds, megabytes / 1e3 / restoreSeconds);
+	printf("restored state %s, bodies %s, 3 more steps %s\n", sameState ? "equal" : "DIFFERENT",
+		sameWorld ? "equal" : "DIFFERENT", sameSteps ? "equal" : "DIFFERENT");
+
+	// stepping with checkpoints
+	double plainSeconds = 0.0;
+	for (int step = 0; step < numSteps; step++)
+	{
+		start = std::chrono::high_resolution_clock::now();
+		ms.nextStep(timeStep);
+		plainSeconds += secondsSince(start);
+	}
+
+	double checkpointSeconds = 0.0, firstCaptureSeconds = 0.0, maxCaptureSeconds = 0.0, maxWriteSeconds = 0.0;
+	uint64_t incrementalBytes = 0, numIncremental = 0;
+	SnapshotWriter writer(path);
+	for (int step = 0; step < numSteps; step++)
+	{
+		start = std::chrono::high_resolution_clock::now();
+		ms.nextStep(timeStep);
+		if ((step + 1) % checkpointEvery == 0)
+		{
+			const SnapshotWriterStats before = writer.stats();
+			if (writer.capture(&ms, &world, step, step * timeStep))
+			{
+				// the first one copies everything, later ones only what changed
+				const double seconds = writer.stats().lastCaptureSeconds;
+				if (before.numWritten == 0) { firstCaptureSeconds = seconds; }
+				else                        { maxCaptureSeconds = std::max(maxCaptureSeconds, seconds); }
+			}
+			// the write finished since the last capture: collect its numbers
+			if (before.numWritten > 1)
+			{
+				incrementalBytes += before.lastBytesWritten;
+				numIncremental++;
+				maxWriteSeconds = std::max(maxWriteSeconds, (double)before.lastWriteSeconds);
+			}
+		}
+		checkpointSeconds += secondsSince(start);
+	}
+	writer.wait();
+	const SnapshotWriterStats stats = writer.stats();
+
+	printf("\n%d steps, checkpoint every %d steps\n", numSteps, checkpointEvery);
+	printf("%-24s %10.2f ms/step\n", "without checkpoints", 1e3 * plainSeconds / numSteps);
+	printf("%-24s %10.2f ms/step\n", "with checkpoints", 1e3 * checkpointSeconds / numSteps);
+	printf("%-24s %10.2f ms first, %.2f ms max after\n", "capture (step thread)", 1e3 * firstCaptureSeconds, 1e3 * maxCaptureSeconds);
+	printf("%-24s %10.2f ms max, %.1f MB of %.1f MB per write\n", "incremental write", 1e3 * maxWriteSeconds,
+		numIncremental > 0 ? incrementalBytes / 1e6 / numIncremental : 0.0, megabytes);
+	printf("checkpoints written %llu, skipped %llu (previous still writing), failed %llu\n",
+		(unsigned long long)stats.numWritten, (unsigned long long)stats.numSkipped, (unsigned long long)stats.numFailed);
+
+	ok = file.open(path) && file.restore(restored);
+	printf("last checkpoint: step %llu, restore %s\n", ok ? (unsigned long long)file.step() : 0ull, ok ? "ok" : file.error().c_str());
+	file.close();
+	std::remove(path.c_str());
+	return sameState && sameWorld && sameSteps && ok ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+//--------------------------------------------------------------------------------------
+// File: spatialHash.cpp
+//
+// Cost of the SpatialHash behind the self collision of MassSpringSystem for
+// 10k to 1M points: build (counting sort) and the neighbour queries of all
+// points, per point, which should stay flat as the count grows. Points are
+// scattered at a density of about one per cell; the pairs found are checked
+// against testing all pairs up to 10k points.
+//
+// Then a cloth falling onto the unit box of the demo and the floor at y = -1
+// with self collision, timed per step with and without collision.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "MassSpringSystem.h"
+#include "Scenes.h"
+#include "SpatialHash.h"
+
+
+static size_t bruteForcePairs(const std::vector<Vec3>& points, float radius)
+{
+	size_t pairs = 0;
+	for (size_t i = 0; i < points.size(); i++)
+	{
+		for (size_t j = i + 1; j < points.size(); j++)
+		{
+			if (lengthSq(points[i] - points[j]) < radius * radius) { pairs++; }
+		}
+	}
+	return pairs;
+}
+
+
+static double clothStepMs(uint32_t size, bool collision, int numSteps, size_t& contacts)
+{
+	MassSpringSystem ms;
+	buildClothScene(ms, size, size, 2.f / size);
+	ms.m_params.integrator = INTEGRATOR_XPBD;
+	ms.m_params.gravity = Vec3(0.f, -9.81f, 0.f);
+	ms.m_params.damping = 0.01f;
+	ms.m_params.collisionRadius = 0.4f / size;
+	ms.m_params.selfCollision = collision;
+	if (collision)
+	{
+		ms.m_colliderPlanes.push_back(Plane(Vec3(0.f, 1.f, 0.f), -1.f));
+		Box box;
+		box.halfExtents = Vec3(0.5f, 0.5f, 0.5f);
+		ms.m_colliderBoxes.push_back(box);
+	}
+	// unpin the corners, let it drop onto the box
+	for (size_t i = 0; i < ms.numPoints(); i++)
+	{
+		ms.m_fixed[i] = 0;
+	}
+	ms.setMass(0.01f);
+
+	// fall for a while, until the cloth has hit the box
+	for (int step = 0; step < 100; step++)
+	{
+		ms.nextStep(0.01f);
+	}
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int step = 0; step < numSteps; step++)
+	{
+		ms.nextStep(0.01f);
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	contacts = ms.collisionStats().numParticleContacts + ms.collisionStats().numShapeContacts;
+	return std::chrono::duration<double, std::milli>(end - start).count() / numSteps;
+}
+
+
+int main(int argc, char* argv[])
+{
+	int numQueries = 5;
+	int numSteps = 5;
+	std::vector<size_t> counts = { 10000, 100000, 1000000 };
+	std::vector<uint32_t> clothSizes = { 100, 316, 1000 };
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--repeat") == 0 && hasValue)     { numQueries = atoi(argv[++i]); }
+		else if (strcmp(argv[i], "--steps") == 0 && hasValue) { numSteps = atoi(argv[++i]); }
+		else if (strcmp(argv[i], "--count") == 0 && hasValue) { counts.assign(1, (size_t)atoll(argv[++i])); }
+		else if (strcmp(argv[i], "--cloth") == 0 && hasValue) { clothSizes.assign(1, (uint32_t)atoi(argv[++i])); }
+	}
+
+	const float radius = 1.f;  // query radius = cell size
+	printf("SpatialHash, random points at about one per cell, %d repetitions\n", numQueries);
+	printf("%8s %10s %10s %12s %10s %12s %12s %s\n", "points", "buckets", "build ms", "build ns/pt", "query ms", "query ns/pt", "pairs", "check");
+	for (size_t c = 0; c < counts.size(); c++)
+	{
+		const size_t count = counts[c];
+		std::mt19937 rng(11);
+		std::uniform_real_distribution<float> position(0.f, std::cbrt((float)count) * radius);
+		std::vector<Vec3> points(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			points[i] = Vec3(position(rng), position(rng), position(rng));
+		}
+
+		SpatialHash hash;
+		hash.build(points, radius);  // grows the arrays, not timed
+		double buildSeconds = 0.0, querySeconds = 0.0;
+		size_t pairs = 0;
+		for (int r = 0; r < numQueries; r++)
+		{
+			auto t0 = std::chrono::high_resolution_clock::now();
+			hash.build(points, radius);
+			auto t1 = std::chrono::high_resolution_clock::now();
+			// in bucket order, like the self collision
+			pairs = 0;
+			for (size_t k = 0; k < count; k++)
+			{
+				const uint32_t i = hash.sortedPoints()[k];
+				hash.forEachNeighbour(hash.sortedPositions()[k], radius, [&](uint32_t j, const Vec3&)
+				{
+					if (j > i) { pairs++; }
+				});
+			}
+			auto t2 = std::chrono::high_resolution_clock::now();
+			buildSeconds += std::chrono::duration<double>(t1 - t0).count();
+			querySeconds += std::chrono::duration<double>(t2 - t1).count();
+		}
+		buildSeconds /= numQueries;
+		querySeconds /= numQueries;
+
+		const char* check = "-";
+		if (count <= 10000)
+		{
+			check = bruteForcePairs(points, radius) == pairs ? "ok" : "MISMATCH";
+		}
+		printf("%8zu %10zu %10.3f %12.1f %10.3f %12.1f %12zu %s\n", count, hash.numBuckets(), 1e3 * buildSeconds, 1e9 * buildSeconds / count,
+			1e3 * querySeconds, 1e9 * querySeconds / count, pairs, check);
+	}
+
+	printf("\nXPBD cloth dropped on a box and the floor, self collision, %d steps\n", numSteps);
+	printf("%8s %14s %14s %12s %10s\n", "points", "plain ms/step", "coll. ms/step", "coll. ns/pt", "contacts");
+	for (size_t c = 0; c < clothSizes.size(); c++)
+	{
+		const uint32_t size = clothSizes[c];
+		const size_t points = (size_t)size * size;
+		size_t contacts = 0;
+		double plainMs = clothStepMs(size, false, numSteps, contacts);
+		double collisionMs = clothStepMs(size, true, numSteps, contacts);
+		printf("%8zu %14.2f %14.2f %12.1f %10zu\n", points, plainMs, collisionMs, 1e6 * (collisionMs - plainMs) / points, contacts);
+	}
+	return 0;
+}
@@ -0,0 +1,84 @@
+//--------------------------------------------------------------------------------------
+// File: springKernels.cpp
+//
+// Microbenchmark of the spring force kernels: springs/ns of springForcesScalar()
+// against springForcesSimd(), whose forces must match the scalar ones bit for
+// bit.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "SpringKernels.h"
+
+
+// Run kernel over all springs 'repeats' times and return springs per
+// nanosecond of the fastest run (the least disturbed by other processes)
+template <typename Kernel>
+static double measure(Kernel kernel, const std::vector<Spring>& springs, const std::vector<Vec3>& x, std::vector<Vec3>& forces, int repeats)
+{
+	kernel(springs.data(), 0, springs.size(), x.data(), forces.data()); // warm up
+
+	double bestNs = 1e30;
+	for (int r = 0; r < repeats; r++)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		kernel(springs.data(), 0, springs.size(), x.data(), forces.data());
+		auto end = std::chrono::high_resolution_clock::now();
+		bestNs = std::min(bestNs, std::chrono::duration<double, std::nano>(end - start).count());
+	}
+	return (double)springs.size() / bestNs;
+}
+
+
+int main(int argc, char* argv[])
+{
+	size_t numSprings = 1000000;
+	int repeats = 50;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (strcmp(argv[i], "--springs") == 0)      { numSprings = (size_t)atoll(argv[i + 1]); }
+		else if (strcmp(argv[i], "--repeats") == 0) { repeats = atoi(argv[i + 1]); }
+	}
+
+	// points scattered in a unit cube, springs between nearby indices (as in a cloth row)
+	std::mt19937 eng(42);
+	std::uniform_real_distribution<float> randPos(0.f, 1.f);
+	std::uniform_int_distribution<int> randOffset(1, 64);
+	std::uniform_real_distribution<float> randLength(0.5f, 1.5f);
+
+	const size_t numPoints = numSprings / 2 + 65;
+	std::vector<Vec3> x(numPoints);
+	for (size_t i = 0; i < numPoints; i++)
+	{
+		x[i] = Vec3(randPos(eng), randPos(eng), randPos(eng));
+	}
+	std::vector<Spring> springs(numSprings);
+	for (size_t s = 0; s < numSprings; s++)
+	{
+		uint32_t a = (uint32_t)(s / 2);
+		uint32_t b = a + (uint32_t)randOffset(eng);
+		Spring spring = { a, b, randLength(eng) * length(x[a] - x[b]), 40.f };
+		springs[s] = spring;
+	}
+
+	std::vector<Vec3> scalarForces(numSprings), simdForces(numSprings);
+	double scalarRate = measure(springForcesScalar, springs, x, scalarForces, repeats);
+	double simdRate = measure([numPoints](const Spring* s, size_t begin, size_t end, const Vec3* p, Vec3* f)
+	{
+		springForcesSimd(s, begin, end, p, numPoints, f);
+	}, springs, x, simdForces, repeats);
+	const bool matches = memcmp(simdForces.data(), scalarForces.data(), numSprings * sizeof(Vec3)) == 0;
+
+	printf("%zu springs, best of %d repeats\n", numSprings, repeats);
+	printf("%-8s %10.3f springs/ns\n", "scalar", scalarRate);
+	printf("%-8s %10.3f springs/ns (%.2fx, %s scalar)\n", springForcesSimdName(), simdRate, simdRate / scalarRate,
+		matches ? "bitwise equal to" : "DIFFERS from");
+	return matches ? 0 : 1;
+}
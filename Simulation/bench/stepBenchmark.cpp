@@ -0,0 +1,359 @@
+//--------------------------------------------------------------------------------------
+// File: stepBenchmark.cpp
+//
+// Benchmark suite for MassSpringSystem::nextStep(): every integrator on every
+// scene size, reporting median and p99 step time, springs/s and heap
+// allocations per step. The results can be written as JSON and compared
+// against a stored baseline written by an earlier run:
+//   stepbench --json baseline.json
+//   ... change the solver ...
+//   stepbench --baseline baseline.json --threshold 0.1
+// exits with 1 if the median springs/s of any case dropped by more than 10%.
+// Baselines are only comparable on the same machine and build type.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "MassSpringSystem.h"
+#include "Scenes.h"
+
+
+// Every heap allocation of the process goes through these, so the number of
+// allocations during the timed steps can be counted
+static std::atomic<unsigned long long> g_allocations(0);
+
+void* operator new(size_t size)
+{
+	g_allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = malloc(size == 0 ? 1 : size))
+	{
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+
+struct BenchmarkResult
+{
+	std::string name;        // scene/size/integrator
+	size_t numSprings;
+	double medianMs;
+	double p99Ms;
+	double springsPerSecond; // springs / median step time
+	double allocationsPerStep;
+	bool finite;             // false if the state blew up (timings of NaN math are meaningless)
+};
+
+
+static void printUsage()
+{
+	std::cout << "Usage: stepbench [options]\n"
+	          << "  --scene NAME         scene to benchmark (default: cloth)\n"
+	          << "  --sizes A,B,...      scene sizes (default: 16,64,128)\n"
+	          << "  --integrators A,...  integrators to run (default: all)\n"
+	          << "  --steps N            timed steps per case (default: 100)\n"
+	          << "  --warmup N           untimed steps per case (default: 5)\n"
+	          << "  --repeat N           runs per case, the fastest median is kept (default: 3)\n"
+	          << "  --dt H               time step (default: 0.0001)\n"
+	          << "  --threads T          worker threads, 0 = all cores (default: 1)\n"
+	          << "  --simd               use the SSE/AVX2 spring force kernel\n"
+	          << "  --json FILE          write the results as JSON to FILE (- for stdout)\n"
+	          << "  --baseline FILE      compare against a JSON file written by --json\n"
+	          << "  --threshold R        allowed relative springs/s regression (default: 0.1)\n";
+}
+
+
+static std::vector<std::string> splitList(const std::string& list)
+{
+	std::vector<std::string> items;
+	std::stringstream stream(list);
+	std::string item;
+	while (std::getline(stream, item, ','))
+	{
+		if (!item.empty()) { items.push_back(item); }
+	}
+	return items;
+}
+
+
+// Value at fraction q of the sorted samples (nearest rank)
+static double percentile(const std::vector<double>& sorted, double q)
+{
+	size_t rank = (size_t)std::ceil(q * sorted.size());
+	return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+}
+
+
+static BenchmarkResult runCase(const std::string& scene, uint32_t size, Integrator integrator,
+	const MassSpringParams& baseParams, float timeStep, int numSteps, int numWarmup)
+{
+	MassSpringSystem ms;
+	buildScene(scene, ms, size);
+	ms.m_params = baseParams;
+	ms.m_params.integrator = integrator;
+
+	// the warm up creates the thread pool, adjacency and solver buffers
+	for (int step = 0; step < numWarmup; step++)
+	{
+		ms.nextStep(timeStep);
+	}
+
+	std::vector<double> samples(numSteps);
+	unsigned long long allocationsBefore = g_allocations.load();
+	for (int step = 0; step < numSteps; step++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		ms.nextStep(timeStep);
+		auto end = std::chrono::steady_clock::now();
+		samples[step] = std::chrono::duration<double, std::milli>(end - start).count();
+	}
+	unsigned long long allocations = g_allocations.load() - allocationsBefore;
+	std::sort(samples.begin(), samples.end());
+
+	BenchmarkResult result;
+	result.name = scene + "/" + std::to_string(size) + "/" + integratorName(integrator);
+	result.numSprings = ms.numSprings();
+	result.medianMs = percentile(samples, 0.5);
+	result.p99Ms = percentile(samples, 0.99);
+	result.springsPerSecond = result.medianMs > 0.0 ? ms.numSprings() / (result.medianMs * 1e-3) : 0.0;
+	result.allocationsPerStep = (double)allocations / numSteps;
+	result.finite = true;
+	for (size_t i = 0; i < ms.numPoints(); i++)
+	{
+		const Vec3& x = ms.m_positions[i];
+		if (!std::isfinite(x.x) || !std::isfinite(x.y) || !std::isfinite(x.z))
+		{
+			result.finite = false;
+			break;
+		}
+	}
+	return result;
+}
+
+
+static void writeJson(std::ostream& out, const std::vector<BenchmarkResult>& results, float timeStep, int numSteps, int numRepeats, unsigned int numThreads)
+{
+	out << "{\n";
+	out << "  \"dt\": " << timeStep << ",\n";
+	out << "  \"steps\": " << numSteps << ",\n";
+	out << "  \"repeats\": " << numRepeats << ",\n";
+	out << "  \"threads\": " << numThreads << ",\n";
+	out << "  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BenchmarkResult& r = results[i];
+		out << "    {\"name\": \"" << r.name << "\""
+		    << ", \"springs\": " << r.numSprings
+		    << ", \"median_ms\": " << r.medianMs
+		    << ", \"p99_ms\": " << r.p99Ms
+		    << ", \"springs_per_sec\": " << r.springsPerSecond
+		    << ", \"allocs_per_step\": " << r.allocationsPerStep
+		    << ", \"finite\": " << (r.finite ? "true" : "false") << "}"
+		    << (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	out << "  ]\n";
+	out << "}\n";
+}
+
+
+// Read name -> springs_per_sec from a file written by writeJson(). This is not
+// a general JSON parser, it only understands the one result object per line
+// layout written above.
+static bool readBaseline(const std::string& path, std::map<std::string, double>& springsPerSecond)
+{
+	std::ifstream in(path);
+	if (!in)
+	{
+		return false;
+	}
+
+	const std::string nameKey = "\"name\": \"";
+	const std::string rateKey = "\"springs_per_sec\": ";
+	std::string line;
+	while (std::getline(in, line))
+	{
+		size_t name = line.find(nameKey);
+		size_t rate = line.find(rateKey);
+		if (name == std::string::npos || rate == std::string::npos)
+		{
+			continue;
+		}
+		name += nameKey.size();
+		size_t nameEnd = line.find('"', name);
+		if (nameEnd == std::string::npos)
+		{
+			continue;
+		}
+		springsPerSecond[line.substr(name, nameEnd - name)] = atof(line.c_str() + rate + rateKey.size());
+	}
+	return true;
+}
+
+
+int main(int argc, char* argv[])
+{
+	std::string scene = "cloth";
+	std::vector<uint32_t> sizes = { 16, 64, 128 };
+	std::vector<Integrator> integrators;
+	for (int i = 0; i < INTEGRATOR_COUNT; i++)
+	{
+		integrators.push_back((Integrator)i);
+	}
+	int numSteps = 100;
+	int numWarmup = 5;
+	int numRepeats = 3;
+	float timeStep = 0.0001f;
+	std::string jsonPath;
+	std::string baselinePath;
+	double threshold = 0.1;
+	MassSpringParams params;
+	params.numThreads = 1;
+	params.damping = 0.01f;
+	params.gravity = Vec3(0.f, -9.81f, 0.f);
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--scene" && hasValue)             { scene = argv[++i]; }
+		else if (arg == "--sizes" && hasValue)
+		{
+			sizes.clear();
+			std::vector<std::string> items = splitList(argv[++i]);
+			for (size_t s = 0; s < items.size(); s++)
+			{
+				sizes.push_back((uint32_t)atoi(items[s].c_str()));
+			}
+		}
+		else if (arg == "--integrators" && hasValue)
+		{
+			integrators.clear();
+			std::vector<std::string> items = splitList(argv[++i]);
+			for (size_t s = 0; s < items.size(); s++)
+			{
+				Integrator integrator;
+				if (!parseIntegrator(items[s].c_str(), integrator))
+				{
+					std::cerr << "Unknown integrator '" << items[s] << "'\n";
+					return 2;
+				}
+				integrators.push_back(integrator);
+			}
+		}
+		else if (arg == "--steps" && hasValue)        { numSteps = std::max(1, atoi(argv[++i])); }
+		else if (arg == "--warmup" && hasValue)       { numWarmup = std::max(0, atoi(argv[++i])); }
+		else if (arg == "--repeat" && hasValue)       { numRepeats = std::max(1, atoi(argv[++i])); }
+		else if (arg == "--dt" && hasValue)           { timeStep = (float)atof(argv[++i]); }
+		else if (arg == "--threads" && hasValue)      { params.numThreads = (unsigned int)atoi(argv[++i]); }
+		else if (arg == "--simd")                     { params.simdSprings = true; }
+		else if (arg == "--json" && hasValue)         { jsonPath = argv[++i]; }
+		else if (arg == "--baseline" && hasValue)     { baselinePath = argv[++i]; }
+		else if (arg == "--threshold" && hasValue)    { threshold = atof(argv[++i]); }
+		else
+		{
+			printUsage();
+			return arg == "--help" ? 0 : 2;
+		}
+	}
+
+	MassSpringSystem probe;
+	if (!buildScene(scene, probe, 1))
+	{
+		std::cerr << "Unknown scene '" << scene << "'\n";
+		return 2;
+	}
+
+	std::map<std::string, double> baseline;
+	if (!baselinePath.empty() && !readBaseline(baselinePath, baseline))
+	{
+		std::cerr << "Cannot read baseline '" << baselinePath << "'\n";
+		return 2;
+	}
+
+	printf("%-28s %10s %10s %10s %14s %12s\n", "case", "springs", "median ms", "p99 ms", "springs/s", "allocs/step");
+	std::vector<BenchmarkResult> results;
+	for (size_t s = 0; s < sizes.size(); s++)
+	{
+		for (size_t i = 0; i < integrators.size(); i++)
+		{
+			// the best of several runs filters out most of the noise from other processes
+			BenchmarkResult r = runCase(scene, sizes[s], integrators[i], params, timeStep, numSteps, numWarmup);
+			for (int repeat = 1; repeat < numRepeats; repeat++)
+			{
+				BenchmarkResult next = runCase(scene, sizes[s], integrators[i], params, timeStep, numSteps, numWarmup);
+				if (next.medianMs < r.medianMs) { r = next; }
+			}
+			printf("%-28s %10zu %10.4f %10.4f %14.4g %12.2f%s\n", r.name.c_str(), r.numSprings,
+				r.medianMs, r.p99Ms, r.springsPerSecond, r.allocationsPerStep, r.finite ? "" : "  (blew up)");
+			results.push_back(r);
+		}
+	}
+
+	if (!jsonPath.empty())
+	{
+		if (jsonPath == "-")
+		{
+			writeJson(std::cout, results, timeStep, numSteps, numRepeats, params.numThreads);
+		}
+		else
+		{
+			std::ofstream out(jsonPath);
+			writeJson(out, results, timeStep, numSteps, numRepeats, params.numThreads);
+			if (!out)
+			{
+				std::cerr << "Cannot write '" << jsonPath << "'\n";
+				return 2;
+			}
+		}
+	}
+
+	if (baselinePath.empty())
+	{
+		return 0;
+	}
+
+	// relative change of the median springs/s against the baseline
+	int regressions = 0;
+	printf("\nAgainst baseline %s (threshold %.0f%%):\n", baselinePath.c_str(), threshold * 100.0);
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		std::map<std::string, double>::const_iterator it = baseline.find(results[i].name);
+		if (it == baseline.end() || it->second <= 0.0)
+		{
+			printf("%-28s %s\n", results[i].name.c_str(), "not in baseline");
+			continue;
+		}
+		double change = results[i].springsPerSecond / it->second - 1.0;
+		bool regressed = change < -threshold;
+		regressions += regressed ? 1 : 0;
+		printf("%-28s %+8.1f%%%s\n", results[i].name.c_str(), change * 100.0, regressed ? "  REGRESSION" : "");
+	}
+	if (regressions > 0)
+	{
+		printf("%d case(s) regressed by more than %.0f%%\n", regressions, threshold * 100.0);
+		return 1;
+	}
+	return 0;
+}
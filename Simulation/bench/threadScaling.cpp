@@ -0,0 +1,82 @@
+//--------------------------------------------------------------------------------------
+// File: threadScaling.cpp
+//
+// Scaling of MassSpringSystem::nextStep() from 1 to N threads on a 512x512 cloth.
+// Also checks that every thread count produces bitwise the same state.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include "MassSpringSystem.h"
+#include "Scenes.h"
+
+
+int main(int argc, char* argv[])
+{
+	size_t n = 512;
+	int numSteps = 50;
+	unsigned int maxThreads = std::thread::hardware_concurrency();
+	bool simd = false;
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--size") == 0 && hasValue)         { n = (size_t)atoi(argv[++i]); }
+		else if (strcmp(argv[i], "--steps") == 0 && hasValue)   { numSteps = atoi(argv[++i]); }
+		else if (strcmp(argv[i], "--threads") == 0 && hasValue) { maxThreads = (unsigned int)atoi(argv[++i]); }
+		else if (strcmp(argv[i], "--simd") == 0)                { simd = true; }
+	}
+	if (maxThreads == 0) { maxThreads = 1; }
+
+	MassSpringSystem ms;
+	buildClothScene(ms, (uint32_t)n, (uint32_t)n, 0.01f, 100.f);
+	printf("%zux%zu cloth: %zu points, %zu springs, %d midpoint steps, %u hardware threads\n",
+		n, n, ms.numPoints(), ms.numSprings(), numSteps, std::thread::hardware_concurrency());
+	printf("%8s %12s %9s %s\n", "threads", "ms/step", "speedup", "state");
+
+	// 1, 2, 4, ... and maxThreads
+	std::vector<unsigned int> threadCounts;
+	for (unsigned int threads = 1; threads < maxThreads; threads *= 2)
+	{
+		threadCounts.push_back(threads);
+	}
+	threadCounts.push_back(maxThreads);
+
+	std::vector<Vec3> reference;
+	double baseMs = 0.0;
+	for (size_t t = 0; t < threadCounts.size(); t++)
+	{
+		unsigned int threads = threadCounts[t];
+		buildClothScene(ms, (uint32_t)n, (uint32_t)n, 0.01f, 100.f);
+		ms.m_params.integrator = INTEGRATOR_MIDPOINT;
+		ms.m_params.gravity = Vec3(0.f, -9.81f, 0.f);
+		ms.m_params.damping = 0.01f;
+		ms.m_params.numThreads = threads;
+		ms.m_params.simdSprings = simd;
+		ms.nextStep(0.001f); // warm up (creates the thread pool and adjacency)
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int step = 0; step < numSteps; step++)
+		{
+			ms.nextStep(0.001f);
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		double ms_per_step = std::chrono::duration<double, std::milli>(end - start).count() / numSteps;
+
+		const char* state = "reference";
+		if (threads == 1)
+		{
+			reference = ms.m_positions;
+			baseMs = ms_per_step;
+		}
+		else
+		{
+			state = memcmp(reference.data(), ms.m_positions.data(), reference.size() * sizeof(Vec3)) == 0 ? "identical" : "DIFFERENT";
+		}
+		printf("%8u %12.3f %8.2fx %s\n", threads, ms_per_step, baseMs / ms_per_step, state);
+	}
+	return 0;
+}
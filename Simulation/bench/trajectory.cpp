@@ -0,0 +1,186 @@
+//--------------------------------------------------------------------------------------
+// File: trajectory.cpp
+//
+// Records the positions of every step of a falling million point cloth with a
+// TrajectoryWriter: step time with and without recording, time record()
+// takes on the step thread, coding time of the writer thread and the file
+// size against raw XMVECTOR (16 bytes) and Vec3 (12 bytes) per point.
+//
+// Then reads the file back with a TrajectoryReader, forwards and at random
+// frames, and checks the error of sampled frames against the quantisation
+// step of their bounding box.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "MassSpringSystem.h"
+#include "Scenes.h"
+#include "Trajectory.h"
+
+
+static double secondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Largest error of a coordinate in quantisation steps of the frame's box;
+// withinBound is cleared if it exceeds half a step plus float rounding: that
+// of computing the level (a hundredth of a step at most) and that of the
+// coordinate itself, which matters on axes whose extent is tiny
+static double maxErrorInSteps(const std::vector<Vec3>& original, const std::vector<Vec3>& decoded, bool& withinBound)
+{
+	Vec3 boxMin = original[0], boxMax = original[0];
+	for (size_t i = 0; i < original.size(); i++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			boxMin[c] = std::min(boxMin[c], original[i][c]);
+			boxMax[c] = std::max(boxMax[c], original[i][c]);
+		}
+	}
+	double maxError = 0.0;
+	for (int c = 0; c < 3; c++)
+	{
+		const double step = (boxMax[c] - boxMin[c]) / 65535.0;
+		for (size_t i = 0; i < original.size() && step > 0.0; i++)
+		{
+			const double error = std::fabs((double)decoded[i][c] - original[i][c]);
+			const double rounding = 2.0 * FLT_EPSILON * std::max(std::fabs(original[i][c]), std::fabs(boxMin[c]));
+			withinBound = withinBound && error <= 0.51 * step + rounding;
+			maxError = std::max(maxError, error / step);
+		}
+	}
+	return maxError;
+}
+
+
+int main(int argc, char* argv[])
+{
+	uint32_t size = 1000;
+	int numFrames = 100;
+	uint32_t keyframeInterval = 50;
+	std::string path = "trajectorybench.bin";
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--size") == 0 && hasValue)          { size = (uint32_t)atoi(argv[++i]); }
+		else if (strcmp(argv[i], "--frames") == 0 && hasValue)   { numFrames = atoi(argv[++i]); }
+		else if (strcmp(argv[i], "--keyframe") == 0 && hasValue) { keyframeInterval = (uint32_t)atoi(argv[++i]); }
+		else if (strcmp(argv[i], "--file") == 0 && hasValue)     { path = argv[++i]; }
+	}
+	const float timeStep = 0.001f;
+	const int sampleEvery = 10;
+
+	MassSpringSystem ms;
+	buildClothScene(ms, size, size, 2.f / size);
+	ms.m_params.integrator = INTEGRATOR_MIDPOINT;
+	ms.m_params.gravity = Vec3(0.f, -9.81f, 0.f);
+	ms.m_params.damping = 0.01f;
+	for (int step = 0; step < 20; step++)
+	{
+		ms.nextStep(timeStep);
+	}
+	printf("Cloth of %zu points, %d frames, keyframe every %u\n", ms.numPoints(), numFrames, keyframeInterval);
+
+	double plainSeconds = 0.0;
+	for (int step = 0; step < numFrames; step++)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		ms.nextStep(timeStep);
+		plainSeconds += secondsSince(start);
+	}
+
+	TrajectoryWriter writer;
+	if (!writer.open(path, (uint32_t)ms.numPoints(), keyframeInterval))
+	{
+		fprintf(stderr, "Cannot create %s\n", path.c_str());
+		return 1;
+	}
+	std::vector<std::vector<Vec3>> samples;
+	double recordingSeconds = 0.0;
+	for (int frame = 0; frame < numFrames; frame++)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		ms.nextStep(timeStep);
+		writer.record(ms.m_positions, frame, frame * (double)timeStep);
+		recordingSeconds += secondsSince(start);
+		if (frame % sampleEvery == sampleEvery - 1)
+		{
+			samples.push_back(ms.m_positions);
+		}
+	}
+	auto closeStart = std::chrono::high_resolution_clock::now();
+	const bool closed = writer.close();
+	const double closeSeconds = secondsSince(closeStart);
+	const TrajectoryWriterStats stats = writer.stats();
+
+	printf("\n%-28s %10.2f ms/step\n", "without recording", 1e3 * plainSeconds / numFrames);
+	printf("%-28s %10.2f ms/step (record() max %.2f ms, %llu stalls)\n", "recording every step", 1e3 * recordingSeconds / numFrames,
+		1e3 * stats.maxRecordSeconds, (unsigned long long)stats.numStalls);
+	printf("%-28s %10.2f ms/frame on the writer thread, %.1f ms left at close\n", "coding and writing",
+		1e3 * stats.encodeSeconds / std::max<uint64_t>(stats.numFrames, 1), 1e3 * closeSeconds);
+	const double vec3Bytes = stats.numFrames * ms.numPoints() * 12.0;
+	printf("%-28s %10.1f MB, %.2f bytes/point/frame\n", "file", stats.bytesWritten / 1e6, stats.bytesWritten / (double)(stats.numFrames * ms.numPoints()));
+	printf("%-28s %10.1fx smaller than XMVECTOR (%.1f MB), %.1fx than Vec3\n", "compression", stats.rawBytes / (double)stats.bytesWritten,
+		stats.rawBytes / 1e6, vec3Bytes / stats.bytesWritten);
+
+	TrajectoryReader reader;
+	if (!closed || !reader.open(path))
+	{
+		fprintf(stderr, "%s\n", closed ? reader.error().c_str() : "Cannot write the trajectory");
+		return 1;
+	}
+	std::vector<Vec3> positions;
+	bool ok = reader.numFrames() == (uint64_t)numFrames;
+	auto start = std::chrono::high_resolution_clock::now();
+	double maxError = 0.0;
+	bool withinBound = true;
+	for (uint64_t frame = 0; frame < reader.numFrames() && ok; frame++)
+	{
+		uint64_t step = 0;
+		ok = reader.readFrame(frame, positions, &step) && step == frame;
+		if (ok && frame % sampleEvery == sampleEvery - 1)
+		{
+			maxError = std::max(maxError, maxErrorInSteps(samples[frame / sampleEvery], positions, withinBound));
+		}
+	}
+	const double forwardSeconds = secondsSince(start);
+
+	std::mt19937 random(1);
+	const int numRandom = 20;
+	start = std::chrono::high_resolution_clock::now();
+	for (int r = 0; r < numRandom && ok; r++)
+	{
+		const uint64_t frame = random() % reader.numFrames();
+		ok = reader.readFrame(frame, positions);
+		if (ok && frame % sampleEvery == sampleEvery - 1)
+		{
+			ok = maxErrorInSteps(samples[frame / sampleEvery], positions, withinBound) <= maxError;
+		}
+	}
+	const double randomSeconds = secondsSince(start);
+	if (!ok)
+	{
+		fprintf(stderr, "Reading failed: %s\n", reader.error().c_str());
+		return 1;
+	}
+	reader.close();
+	std::remove(path.c_str());
+
+	printf("\n%-28s %10.2f ms/frame\n", "reading forwards", 1e3 * forwardSeconds / numFrames);
+	printf("%-28s %10.2f ms/frame (decoding from the keyframe)\n", "reading random frames", 1e3 * randomSeconds / numRandom);
+	printf("%-28s %10.3f quantisation steps, %s half a step plus float rounding\n", "largest error", maxError,
+		withinBound ? "within" : "NOT within");
+
+	const bool smallEnough = stats.rawBytes >= 8 * stats.bytesWritten;
+	return smallEnough && withinBound ? 0 : 1;
+}
@@ -0,0 +1,363 @@
+//--------------------------------------------------------------------------------------
+// File: simrun.cpp
+//
+// Headless command line driver: steps a named scene N times at a fixed time step
+// and reports the step rate and the final state.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "AdaptiveStepper.h"
+#include "MassSpringSystem.h"
+#include "Profiler.h"
+#include "Scenes.h"
+#include "Snapshot.h"
+#include "Trajectory.h"
+
+
+static void printUsage()
+{
+	std::cout << "Usage: simrun [options]\n"
+	          << "  --scene NAME         scene to simulate (default: springhouse)\n"
+	          << "  --size N             size of the generated scenes, 0 = default (default: 0)\n"
+	          << "  --steps N            number of steps (default: 1000)\n"
+	          << "  --dt H               fixed time step (default: 0.1)\n"
+	          << "  --adaptive           advance every --dt in midpoint steps sized by their error\n"
+	          << "                       (see AdaptiveStepper.h), up to --dt long\n"
+	          << "  --tolerance E        adaptive: position error per step in m, 10 * E in m/s for\n"
+	          << "                       the velocities (default: 1e-3)\n"
+	          << "  --integrator NAME    euler | midpoint | verlet | leapfrog | rk4 | implicit | xpbd\n"
+	          << "                       (default: midpoint)\n"
+	          << "  --damping D          damping factor (default: 4)\n"
+	          << "  --gravity G          gravitational acceleration along y (default: 0)\n"
+	          << "  --cg-iterations N    implicit: CG iteration limit (default: 100)\n"
+	          << "  --cg-tolerance E     implicit: relative CG residual (default: 1e-4)\n"
+	          << "  --multigrid          implicit: multigrid V-cycle as CG preconditioner (see Multigrid.h)\n"
+	          << "  --xpbd-iterations N  xpbd: constraint iterations per step (default: 10)\n"
+	          << "  --xpbd-jacobi        xpbd: parallel Jacobi instead of Gauss-Seidel iterations\n"
+	          << "  --xpbd-relaxation W  xpbd: Jacobi over-relaxation (default: 1.5)\n"
+	          << "  --threads T          worker threads, 0 = all cores (default: 1)\n"
+	          << "  --simd               use the SSE/AVX2 spring force kernel\n"
+	          << "  --floor Y            collide the points with a floor plane at height Y\n"
+	          << "  --self-collision     keep the points two collision radii apart\n"
+	          << "  --collision-radius R radius of the points for collision (default: 0.01)\n"
+	          << "  --sleeping           skip clusters of points that came to rest (see SleepClusters.h)\n"
+	          << "  --checksum-every N   print the state checksum every N steps (default: 0 = only at the end)\n"
+	          << "  --restore FILE       start from the points and springs of a snapshot instead of --scene\n"
+	          << "  --checkpoint FILE    write checkpoints to FILE in the background\n"
+	          << "  --checkpoint-every N checkpoint every N steps (default: 1000)\n"
+	          << "  --record FILE        record the positions of every step to FILE (see Trajectory.h)\n"
+	          << "  --keyframe-every N   keyframe interval of the recording (default: 100)\n"
+	          << "  --profile FILE       per zone times of the last steps, Chrome trace to FILE\n"
+	          << "                       (needs a build with SIMULATION_PROFILE)\n"
+	          << "  --print-state        print position and velocity of every point\n"
+	          << "Scenes:";
+	std::vector<std::string> names = getSceneNames();
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		std::cout << " " << names[i];
+	}
+	std::cout << "\n";
+}
+
+
+int main(int argc, char* argv[])
+{
+	std::string scene = "springhouse";
+	uint32_t sceneSize = 0;
+	long long numSteps = 1000;
+	float timeStep = 0.1f;
+	bool printState = false;
+	long long checksumEvery = 0;
+	std::string restorePath;
+	std::string checkpointPath;
+	long long checkpointEvery = 1000;
+	std::string recordPath;
+	uint32_t keyframeInterval = 100;
+	std::string profilePath;
+	bool adaptive = false;
+	float tolerance = 1e-3f;
+	bool floor = false;
+	float floorHeight = 0.f;
+	MassSpringParams params;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--scene" && hasValue)           { scene = argv[++i]; }
+		else if (arg == "--size" && hasValue)       { sceneSize = (uint32_t)atoi(argv[++i]); }
+		else if (arg == "--steps" && hasValue)      { numSteps = atoll(argv[++i]); }
+		else if (arg == "--dt" && hasValue)         { timeStep = (float)atof(argv[++i]); }
+		else if (arg == "--adaptive")               { adaptive = true; }
+		else if (arg == "--tolerance" && hasValue)  { tolerance = (float)atof(argv[++i]); }
+		else if (arg == "--damping" && hasValue)    { params.damping = (float)atof(argv[++i]); }
+		else if (arg == "--gravity" && hasValue)    { params.gravity = Vec3(0.f, (float)atof(argv[++i]), 0.f); }
+		else if (arg == "--cg-iterations" && hasValue) { params.cgMaxIterations = atoi(argv[++i]); }
+		else if (arg == "--cg-tolerance" && hasValue)  { params.cgTolerance = (float)atof(argv[++i]); }
+		else if (arg == "--multigrid")                 { params.cgMultigrid = true; }
+		else if (arg == "--xpbd-iterations" && hasValue)  { params.xpbdIterations = atoi(argv[++i]); }
+		else if (arg == "--xpbd-jacobi")                   { params.xpbdJacobi = true; }
+		else if (arg == "--xpbd-relaxation" && hasValue)  { params.xpbdRelaxation = (float)atof(argv[++i]); }
+		else if (arg == "--threads" && hasValue)    { params.numThreads = (unsigned int)atoi(argv[++i]); }
+		else if (arg == "--simd")                   { params.simdSprings = true; }
+		else if (arg == "--floor" && hasValue)      { floor = true; floorHeight = (float)atof(argv[++i]); }
+		else if (arg == "--self-collision")         { params.selfCollision = true; }
+		else if (arg == "--collision-radius" && hasValue) { params.collisionRadius = (float)atof(argv[++i]); }
+		else if (arg == "--sleeping")               { params.sleeping = true; }
+		else if (arg == "--checksum-every" && hasValue) { checksumEvery = atoll(argv[++i]); }
+		else if (arg == "--restore" && hasValue)    { restorePath = argv[++i]; }
+		else if (arg == "--checkpoint" && hasValue) { checkpointPath = argv[++i]; }
+		else if (arg == "--checkpoint-every" && hasValue) { checkpointEvery = atoll(argv[++i]); }
+		else if (arg == "--record" && hasValue)     { recordPath = argv[++i]; }
+		else if (arg == "--keyframe-every" && hasValue) { keyframeInterval = (uint32_t)atoi(argv[++i]); }
+		else if (arg == "--profile" && hasValue)    { profilePath = argv[++i]; }
+		else if (arg == "--print-state")            { printState = true; }
+		else if (arg == "--integrator" && hasValue)
+		{
+			if (!parseIntegrator(argv[++i], params.integrator))
+			{
+				std::cerr << "Unknown integrator '" << argv[i] << "'\n";
+				return 1;
+			}
+		}
+		else if (arg == "--help" || arg == "-h")
+		{
+			printUsage();
+			return 0;
+		}
+		else
+		{
+			std::cerr << "Unknown or incomplete argument '" << arg << "'\n";
+			printUsage();
+			return 1;
+		}
+	}
+
+	if (numSteps < 0 || timeStep <= 0.f)
+	{
+		std::cerr << "Number of steps must be >= 0 and the time step > 0\n";
+		return 1;
+	}
+
+	MassSpringSystem ms;
+	auto buildStart = std::chrono::high_resolution_clock::now();
+	uint64_t firstStep = 0;
+	if (!restorePath.empty())
+	{
+		SnapshotFile snapshot;
+		if (!snapshot.open(restorePath) || !snapshot.restore(ms))
+		{
+			std::cerr << "Cannot restore '" << restorePath << "': " << snapshot.error() << "\n";
+			return 1;
+		}
+		scene = restorePath;
+		firstStep = snapshot.step();
+	}
+	else if (!buildScene(scene, ms, sceneSize))
+	{
+		std::cerr << "Unknown scene '" << scene << "'\n";
+		printUsage();
+		return 1;
+	}
+	ms.m_params = params;
+	if (floor)
+	{
+		ms.m_colliderPlanes.push_back(Plane(Vec3(0.f, 1.f, 0.f), floorHeight));
+	}
+
+	double buildSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - buildStart).count();
+
+	printf("Scene %s: %zu points, %zu springs, built in %.3f s\n", scene.c_str(), ms.numPoints(), ms.numSprings(), buildSeconds);
+
+	std::unique_ptr<SnapshotWriter> checkpoints;
+	if (!checkpointPath.empty() && checkpointEvery > 0)
+	{
+		checkpoints.reset(new SnapshotWriter(checkpointPath));
+	}
+
+	TrajectoryWriter recorder;
+	if (!recordPath.empty() && !recorder.open(recordPath, (uint32_t)ms.numPoints(), keyframeInterval))
+	{
+		std::cerr << "Cannot create '" << recordPath << "'\n";
+		return 1;
+	}
+
+	AdaptiveStepper stepper(timeStep);
+	stepper.m_positionTolerance = tolerance;
+	stepper.m_velocityTolerance = 10.f * tolerance;
+	AdaptiveStepStats adaptiveTotals;
+	adaptiveTotals.smallestStep = timeStep;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	double checksumSeconds = 0.0;
+	for (long long step = 0; step < numSteps; step++)
+	{
+		if (adaptive)
+		{
+			stepper.advance(ms, timeStep);
+			const AdaptiveStepStats& stats = stepper.lastAdvance();
+			adaptiveTotals.steps += stats.steps;
+			adaptiveTotals.rejectedSteps += stats.rejectedSteps;
+			adaptiveTotals.forceEvaluations += stats.forceEvaluations;
+			adaptiveTotals.smallestStep = std::min(adaptiveTotals.smallestStep, stats.smallestStep);
+			adaptiveTotals.largestStep = std::max(adaptiveTotals.largestStep, stats.largestStep);
+		}
+		else
+		{
+			ms.nextStep(timeStep);
+		}
+		if (checkpoints && (step + 1) % checkpointEvery == 0)
+		{
+			const uint64_t stepCount = firstStep + step + 1;
+			checkpoints->capture(&ms, nullptr, stepCount, stepCount * (double)timeStep);
+		}
+		if (recorder.isOpen())
+		{
+			const uint64_t stepCount = firstStep + step + 1;
+			recorder.record(ms.m_positions, stepCount, stepCount * (double)timeStep);
+		}
+		Profiler::endFrame();
+		if (checksumEvery > 0 && (step + 1) % checksumEvery == 0)
+		{
+			auto checksumStart = std::chrono::high_resolution_clock::now();
+			const unsigned long long checksum = ms.stateChecksum();
+			checksumSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - checksumStart).count();
+			printf("step %lld checksum %016llx\n", step + 1, checksum);
+		}
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	double seconds = std::chrono::duration<double>(end - start).count() - checksumSeconds;
+	if (checkpoints)
+	{
+		checkpoints->wait();
+		const SnapshotWriterStats stats = checkpoints->stats();
+		printf("Checkpoints to %s: %llu written, %llu skipped, %llu failed, capture %.3f ms, last write %.3f ms (%llu bytes)\n",
+			checkpointPath.c_str(), (unsigned long long)stats.numWritten, (unsigned long long)stats.numSkipped,
+			(unsigned long long)stats.numFailed, 1e3 * stats.lastCaptureSeconds, 1e3 * stats.lastWriteSeconds,
+			(unsigned long long)stats.lastBytesWritten);
+	}
+	if (recorder.isOpen())
+	{
+		const bool recorded = recorder.close();
+		const TrajectoryWriterStats stats = recorder.stats();
+		printf("Recorded %llu frames to %s%s: %.1f MB, %.1fx smaller than 16 bytes per point, %llu stalls\n",
+			(unsigned long long)stats.numFrames, recordPath.c_str(), recorded ? "" : " (write failed)", stats.bytesWritten / 1e6,
+			stats.bytesWritten > 0 ? stats.rawBytes / (double)stats.bytesWritten : 0.0, (unsigned long long)stats.numStalls);
+	}
+
+	printf("%lld steps of %g s in %.3f s: %.1f steps/s, %.3g springs/s\n", numSteps, timeStep, seconds,
+		seconds > 0.0 ? numSteps / seconds : 0.0,
+		seconds > 0.0 ? numSteps * (double)ms.numSprings() / seconds : 0.0);
+	if (adaptive)
+	{
+		printf("Adaptive midpoint: %d steps of %g - %g s, %d rejected, %d force evaluations (%.1f per step of %g s)\n",
+			adaptiveTotals.steps, adaptiveTotals.smallestStep, adaptiveTotals.largestStep, adaptiveTotals.rejectedSteps,
+			adaptiveTotals.forceEvaluations, numSteps > 0 ? adaptiveTotals.forceEvaluations / (double)numSteps : 0.0, timeStep);
+	}
+	else
+	{
+		printf("Integrator %s: %d force evaluations per step\n", integratorName(params.integrator), ms.lastForceEvaluations());
+	}
+
+	if (!adaptive && params.integrator == INTEGRATOR_IMPLICIT_EULER)
+	{
+		printf("Last step: %d CG iterations, relative residual %g\n",
+			ms.implicitSolver().m_lastIterations, ms.implicitSolver().m_lastResidual);
+		if (params.cgMultigrid)
+		{
+			const MultigridHierarchy& multigrid = ms.implicitSolver().multigrid();
+			printf("Multigrid levels:");
+			for (size_t l = 0; l < multigrid.numLevels(); l++)
+			{
+				printf(" %zu", multigrid.levelSize(l));
+			}
+			printf(" points\n");
+		}
+	}
+
+	if (!adaptive && params.integrator == INTEGRATOR_XPBD)
+	{
+		printf("Last step residual per iteration:");
+		const std::vector<float>& residuals = ms.xpbdSolver().residuals();
+		for (size_t i = 0; i < residuals.size(); i++)
+		{
+			printf(" %.3g", residuals[i]);
+		}
+		printf("\n");
+	}
+
+	if (floor || params.selfCollision)
+	{
+		const ParticleCollisionStats& collisions = ms.collisionStats();
+		printf("Last step: %zu point-point contacts, %zu point-shape contacts\n", collisions.numParticleContacts, collisions.numShapeContacts);
+	}
+
+	if (params.sleeping)
+	{
+		const SleepStats& sleep = ms.sleepStats();
+		printf("Sleeping: %zu of %zu clusters, %zu points awake, %zu asleep\n",
+			sleep.numSleepingClusters, sleep.numClusters, sleep.numAwakePoints, sleep.numSleepingPoints);
+	}
+
+	// summary of the final state
+	Vec3 center(0.f, 0.f, 0.f);
+	double kineticEnergy = 0.0;
+	for (size_t i = 0; i < ms.numPoints(); i++)
+	{
+		center += ms.m_positions[i];
+		if (!ms.m_fixed[i])
+		{
+			kineticEnergy += 0.5 * lengthSq(ms.m_velocities[i]) / ms.m_invMasses[i];
+		}
+	}
+	if (ms.numPoints() > 0)
+	{
+		center *= 1.f / ms.numPoints();
+	}
+	printf("Simulated time %g s, center (%g, %g, %g), kinetic energy %g\n",
+		numSteps * (double)timeStep, center.x, center.y, center.z, kineticEnergy);
+	printf("State checksum %016llx\n", (unsigned long long)ms.stateChecksum());
+
+	if (!profilePath.empty() && !Profiler::enabled())
+	{
+		std::cerr << "Built without SIMULATION_PROFILE: no profile\n";
+	}
+	else if (!profilePath.empty())
+	{
+		ProfileSummary summary;
+		Profiler::summary(summary, 1000);
+		if (!Profiler::writeChromeTrace(profilePath))
+		{
+			std::cerr << "Cannot write '" << profilePath << "'\n";
+		}
+		printf("Profile of the last %d steps (%.3f ms per step), trace in %s\n", summary.numFrames, summary.frameMilliseconds, profilePath.c_str());
+		for (size_t z = 0; z < summary.zones.size(); z++)
+		{
+			printf("  %-24s %10.3f ms %8.1f calls per step\n", summary.zones[z].name, summary.zones[z].milliseconds, summary.zones[z].calls);
+		}
+		for (size_t c = 0; c < summary.counters.size(); c++)
+		{
+			printf("  %-24s %10.0f per step\n", summary.counters[c].name, summary.counters[c].perFrame);
+		}
+	}
+
+	if (printState)
+	{
+		for (size_t i = 0; i < ms.numPoints(); i++)
+		{
+			const Vec3& x = ms.m_positions[i];
+			const Vec3& v = ms.m_velocities[i];
+			printf("p%zu x (%g, %g, %g) v (%g, %g, %g)\n", i, x.x, x.y, x.z, v.x, v.y, v.z);
+		}
+	}
+
+	return 0;
+}